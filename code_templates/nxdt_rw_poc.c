@@ -36,6 +36,37 @@
 #define WAIT_TIME_LIMIT 30
 #define OUTDIR          APP_TITLE
 
+/* Number of BLOCK_SIZE buffers shared by dump read and write threads. Can be overridden at build time. */
+#ifndef DUMP_RING_SLOT_COUNT
+#define DUMP_RING_SLOT_COUNT        4
+#endif
+
+#define DUMP_RING_MAX_SLOT_COUNT    8
+
+#if (DUMP_RING_SLOT_COUNT < 2) || (DUMP_RING_SLOT_COUNT > DUMP_RING_MAX_SLOT_COUNT)
+#error "Invalid DUMP_RING_SLOT_COUNT value."
+#endif
+
+/* Number of BLOCK_SIZE buffers shared by NCA worker threads during NSP dumps. This is the memory budget for NCAs processed ahead of the one being written. Can be overridden at build time. */
+#ifndef NSP_NCA_BUFFER_COUNT
+#define NSP_NCA_BUFFER_COUNT        6
+#endif
+
+#define NSP_MAX_NCA_WORKER_COUNT    3
+
+#if NSP_NCA_BUFFER_COUNT < 2
+#error "Invalid NSP_NCA_BUFFER_COUNT value."
+#endif
+
+#define NSP_CONTENT_STORE_SUBDIR    "Content Store"
+#define NSP_CONTENT_STORE_MANIFEST  "manifest.csv"
+
+#define NSP_DELTA_REFERENCE_PATH    DEVOPTAB_SDMC_DEVICE APP_BASE_PATH "cnmt"
+
+#define BATCH_LIST_PATH             DEVOPTAB_SDMC_DEVICE APP_BASE_PATH "batch.txt"
+#define BATCH_REPORT_PATH           DEVOPTAB_SDMC_DEVICE APP_BASE_PATH "batch_report.csv"
+#define BATCH_MAX_JOB_COUNT         512
+
 /* Type definitions. */
 
 typedef struct _Menu Menu;
@@ -90,11 +121,32 @@ typedef enum {
     MenuId_Count                = 18
 } MenuId;
 
+/// Single producer, single consumer ring of page aligned buffers used to pass data chunks from a read thread to a write thread.
+/// 'head' is only modified by the producer and 'read' / 'tail' are only modified by the consumer, so no locking takes place unless one of them needs to wait for the other.
+/// Data chunks sent to the USB host straight from the ring are released by the USB interface instead (in order), once they have been received.
+typedef struct {
+    void *slots[DUMP_RING_MAX_SLOT_COUNT];
+    size_t slot_sizes[DUMP_RING_MAX_SLOT_COUNT];
+    u32 slot_count;
+    u32 head;                       ///< Number of data chunks committed by the producer.
+    u32 read;                       ///< Number of data chunks consumed by the consumer. Chunks between 'tail' and 'read' may still be in use.
+    u32 tail;                       ///< Number of data chunks released by the consumer (or the USB interface).
+    bool aborted;
+    bool producer_waiting;
+    bool consumer_waiting;
+    Mutex mutex;
+    CondVar producer_condvar;
+    CondVar consumer_condvar;
+    u64 producer_stall_count;       ///< Number of times the producer had to wait for a free slot (or for the ring to be drained).
+    u64 producer_stall_ticks;
+    u64 consumer_stall_count;       ///< Number of times the consumer had to wait for a data chunk.
+    u64 consumer_stall_ticks;
+} DumpRing;
+
 typedef struct
 {
     FILE *fp;
-    void *data;
-    size_t data_size;
+    DumpRing ring;
     size_t data_written;
     size_t total_size;
     bool read_error;
@@ -112,6 +164,23 @@ typedef struct {
     HashFileSystemContext *hfs_ctx;
 } HfsThreadData;
 
+typedef struct {
+    char *path;
+    u64 offset;         ///< Relative to the start of the gamecard image (without key area).
+    u64 size;
+    u64 written;
+    const void *header; ///< Optional data written at the start of the output file (e.g. key area).
+    u64 header_size;
+    FILE *fp;
+    bool created;
+} GameCardTeeSink;
+
+typedef struct {
+    XciThreadData xci_thread_data;
+    GameCardTeeSink *sinks;
+    u32 sink_count;
+} GameCardTeeThreadData;
+
 typedef struct {
     void *data;
     size_t data_written;
@@ -120,6 +189,65 @@ typedef struct {
     bool transfer_cancelled;
 } NspThreadData;
 
+/// Used to keep track of a single NCA processed by a NCA worker thread during a NSP dump.
+typedef struct {
+    NcaContext *nca_ctx;
+    void *chunks[NSP_NCA_BUFFER_COUNT];                 ///< FIFO with processed data chunks from this NCA, in order.
+    u64 chunk_sizes[NSP_NCA_BUFFER_COUNT];
+    u32 chunk_head;
+    u32 chunk_tail;
+    bool done;                                          ///< Set once both hashes are available.
+    u8 clean_sha256_hash[SHA256_HASH_SIZE];
+    u8 dirty_sha256_hash[SHA256_HASH_SIZE];
+    FILE *src_fp;                                       ///< If set, NCA data is read from this file instead of the source storage.
+    bool skip;                                          ///< Set to true if this NCA is left out of the NSP dump. Never picked by worker threads.
+} NspNcaJob;
+
+/// Reads, patches and hashes NCAs from a NSP dump using multiple worker threads, while the NSP dump thread writes them in PFS entry order.
+/// The NCA currently being written always gets priority over the rest when it comes to buffer allocation, so the process can't deadlock.
+typedef struct {
+    NspNcaJob *jobs;
+    u32 job_count;
+    u32 next_job;                                       ///< Index of the next job to be picked by a worker thread.
+    u32 cur_job;                                        ///< Index of the job currently being written.
+    void *buffers[NSP_NCA_BUFFER_COUNT];
+    void *free_buffers[NSP_NCA_BUFFER_COUNT];
+    u32 free_buffer_count;
+    Thread workers[NSP_MAX_NCA_WORKER_COUNT];
+    u32 worker_count;
+    bool aborted;
+    Mutex mutex;
+    CondVar condvar;
+    u64 worker_stall_count;                             ///< Number of times a worker thread had to wait for a free buffer.
+    u64 writer_stall_count;                             ///< Number of times the NSP dump thread had to wait for a data chunk.
+} NspNcaScheduler;
+
+/// Used to keep track of NCAs from a NSP dump that can be shared with other NSP dumps through the content store.
+/// Content store files are named after the SHA-256 checksum of the NCA they hold, which means the content ID of the NCA is also part of their names.
+typedef struct {
+    bool eligible;                                      ///< Set to true if this NCA is written without modifications.
+    bool stored;                                        ///< Set to true if this NCA is already available in the content store, in which case it's read from it.
+    u8 hash[SHA256_HASH_SIZE];                          ///< Retrieved from the CNMT content record for this NCA.
+    char *path;
+    char *tmp_path;                                     ///< Used while adding a new NCA to the content store, until its checksum is verified.
+    FILE *fp;                                           ///< Opened for reading if 'stored' is true. Opened for writing otherwise.
+} NspContentStoreEntry;
+
+/// Used to keep track of NCAs left out of a delta NSP dump, because they haven't changed since the last dumped version of the same title.
+/// Unmodified CNMTs from NSP dumps are saved as reference CNMTs under NSP_DELTA_REFERENCE_PATH, using the title ID as their filename.
+typedef struct {
+    u8 *cnmt_data;                                      ///< Copy of the unmodified CNMT from the title being dumped. Saved as the new reference CNMT for this title.
+    u64 cnmt_data_size;
+    u8 *ref_data;                                       ///< Reference CNMT from the last dumped version of the same title.
+    u64 ref_data_size;
+    NcmPackagedContentInfo *ref_content_infos;          ///< Pointer to the content records within 'ref_data'.
+    u16 ref_content_count;
+    u32 base_version;                                   ///< Version from the reference CNMT.
+    bool *skip;                                         ///< One entry per NCA. NULL if this isn't a delta dump.
+    bool *rewritten;                                    ///< One entry per NCA. Set to true for NCAs available in the reference CNMT that are dumped anyway, because they're modified by the selected options.
+    u32 skip_count;
+} NspDeltaContext;
+
 typedef struct {
     TitleInfo *title_info;
     u32 content_idx;
@@ -167,6 +295,40 @@ typedef struct {
     SystemUpdateDumpContext *sys_upd_dump_ctx;
 } SystemUpdateThreadData;
 
+typedef enum {
+    BatchDumpType_Nsp    = 0,
+    BatchDumpType_Ticket = 1,
+    BatchDumpType_Count  = 2
+} BatchDumpType;
+
+typedef enum {
+    BatchDumpJobStatus_Pending   = 0,
+    BatchDumpJobStatus_Invalid   = 1,   ///< Malformed line in the batch list file.
+    BatchDumpJobStatus_NotFound  = 2,   ///< Title unavailable in the requested storage.
+    BatchDumpJobStatus_NoSpace   = 3,
+    BatchDumpJobStatus_Failed    = 4,
+    BatchDumpJobStatus_Cancelled = 5,
+    BatchDumpJobStatus_Done      = 6,
+    BatchDumpJobStatus_Count     = 7
+} BatchDumpJobStatus;
+
+/// Used to hold a single job parsed from the batch list file.
+typedef struct {
+    u32 line;                                           ///< Line number from the batch list file. Also used to keep the original job order within each storage.
+    u64 title_id;
+    u8 dump_type;                                       ///< BatchDumpType.
+    u8 storage_id;                                      ///< NcmStorageId. Set to NcmStorageId_Any if no storage was provided in the batch list file.
+    u8 status;                                          ///< BatchDumpJobStatus.
+    TitleInfo *title_info;
+    u64 size;                                           ///< Output size.
+    u64 elapsed_ns;
+} BatchDumpJob;
+
+typedef struct {
+    const char *name;                                   ///< Name used in both batch list files and reports.
+    u8 storage_id;                                      ///< NcmStorageId.
+} BatchDumpStorage;
+
 /* Function prototypes. */
 
 static void utilsScanPads(void);
@@ -221,6 +383,11 @@ static bool saveGameCardUid(void *userdata);
 static bool saveGameCardHfsPartition(void *userdata);
 static bool saveGameCardRawHfsPartition(HashFileSystemContext *hfs_ctx);
 static bool saveGameCardExtractedHfsPartition(HashFileSystemContext *hfs_ctx);
+static bool saveGameCardSinglePass(void *userdata);
+static bool gameCardTeeAddSink(GameCardTeeThreadData *tee_thread_data, char *path, u64 offset, u64 size);
+static bool gameCardTeeAddHfsPartitionSinks(GameCardTeeThreadData *tee_thread_data, u8 hfs_partition_type);
+static bool gameCardTeeOpenSink(GameCardTeeSink *sink);
+static void gameCardTeeFreeSinks(GameCardTeeThreadData *tee_thread_data, bool remove_output);
 static bool browseGameCardHfsPartition(void *userdata);
 
 static bool saveConsoleLafwBlob(void *userdata);
@@ -229,6 +396,12 @@ static bool saveNintendoSubmissionPackage(void *userdata);
 
 static bool saveTicket(void *userdata);
 
+static bool saveBatchDump(void *userdata);
+static bool batchDumpParseListFile(BatchDumpJob **out_jobs, u32 *out_job_count);
+static u32 batchDumpGetStorageIndex(u8 storage_id);
+static int batchDumpJobSortFunction(const void *a, const void *b);
+static bool batchDumpWriteReport(const BatchDumpJob *jobs, u32 job_count);
+
 static bool saveNintendoContentArchive(void *userdata);
 static bool saveNintendoContentArchiveFsSection(void *userdata);
 static bool browseNintendoContentArchiveFsSection(void *userdata);
@@ -255,6 +428,7 @@ static void xciReadThreadFunc(void *arg);
 
 static void rawHfsReadThreadFunc(void *arg);
 static void extractedHfsReadThreadFunc(void *arg);
+static void gameCardTeeWriteThreadFunc(void *arg);
 
 static void ncaReadThreadFunc(void *arg);
 
@@ -266,14 +440,50 @@ static void extractedRomFsReadThreadFunc(void *arg);
 
 static void fsBrowserFileReadThreadFunc(void *arg);
 static void fsBrowserHighlightedEntriesReadThreadFunc(void *arg);
-static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_thread_data, const char *dir_path, const FsBrowserEntry *entries, u32 entries_count, const char *base_out_path, void *buf1, void *buf2);
+static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_thread_data, const char *dir_path, const FsBrowserEntry *entries, u32 entries_count, const char *base_out_path);
 
 static void systemUpdateReadThreadFunc(void *arg);
 
 static void genericWriteThreadFunc(void *arg);
 
+static bool dumpRingInitialize(DumpRing *ring, u32 slot_count);
+static void dumpRingFree(DumpRing *ring);
+static void *dumpRingAcquire(DumpRing *ring);
+static void dumpRingCommit(DumpRing *ring, size_t size);
+static bool dumpRingDrain(DumpRing *ring);
+static bool dumpRingIsEmpty(DumpRing *ring);
+static bool dumpRingIsConsumed(DumpRing *ring);
+static bool dumpRingPeek(DumpRing *ring, void **out_data, size_t *out_size);
+static void dumpRingConsume(DumpRing *ring);
+static void dumpRingRelease(DumpRing *ring);
+static void dumpRingReleaseCallback(void *userdata);
+static void dumpRingAbort(DumpRing *ring);
+
 static bool spanDumpThreads(ThreadFunc read_func, ThreadFunc write_func, void *arg);
 
+static bool nspProcessNcaChunk(NcaContext *nca_ctx, FILE *src_fp, ContentMetaContext *cnmt_ctx, void *buf, u64 blksize, u64 offset, bool *dirty_header, Sha256Context *clean_sha256_ctx, Sha256Context *dirty_sha256_ctx);
+
+static char *generateContentStorePath(const char *filename, const char *extension);
+static NspContentStoreEntry *nspContentStoreInitialize(NcaContext *nca_ctx, u32 nca_count, ContentMetaContext *cnmt_ctx, const bool *skip);
+static bool nspContentStoreFinalizeEntry(NspContentStoreEntry *entry, TitleInfo *title_info, NcaContext *nca_ctx);
+static void nspContentStoreFree(NspContentStoreEntry *entries, u32 count);
+
+static char *generateDeltaReferencePath(u64 title_id);
+static bool nspDeltaInitialize(NspDeltaContext *out, TitleInfo *title_info, NcaContext *nca_ctx, ContentMetaContext *cnmt_ctx);
+static NcmPackagedContentInfo *nspDeltaGetReferenceContentInfo(NspDeltaContext *delta_ctx, const NcmPackagedContentInfo *packaged_content_info);
+static bool nspDeltaWriteManifest(NspDeltaContext *delta_ctx, TitleInfo *title_info, NcaContext *nca_ctx, const char *nsp_filename);
+static void nspDeltaSaveReference(NspDeltaContext *delta_ctx, u64 title_id);
+static void nspDeltaFreeContext(NspDeltaContext *delta_ctx);
+
+static bool nspNcaSchedulerStart(NspNcaScheduler *sched, NcaContext *nca_ctx, const bool *skip, NspContentStoreEntry *store_entries, u32 job_count, u32 worker_count);
+static void nspNcaSchedulerStop(NspNcaScheduler *sched);
+static void nspNcaSchedulerAbort(NspNcaScheduler *sched);
+static void *nspNcaSchedulerAcquireBuffer(NspNcaScheduler *sched, u32 job_idx);
+static bool nspNcaSchedulerPopChunk(NspNcaScheduler *sched, u32 job_idx, void **out_chunk, u64 *out_size);
+static void nspNcaSchedulerReleaseBuffer(NspNcaScheduler *sched, void *buf);
+static bool nspNcaSchedulerWaitForJob(NspNcaScheduler *sched, u32 job_idx);
+static void nspNcaWorkerThreadFunc(void *arg);
+
 static void nspThreadFunc(void *arg);
 
 static u32 getOutputStorageOption(void);
@@ -337,8 +547,59 @@ static PadState g_padState = {0};
 
 static char *g_noYesStrings[] = { "no", "yes", NULL };
 
+static char *g_nspNcaWorkerCountStrings[] = { "off", "1", "2", "3", NULL };
+
+static MenuElementOption g_nspNcaWorkerCountElementOption = {
+    .selected = 2,
+    .retrieved = false,
+    .getter_func = NULL,
+    .setter_func = NULL,
+    .options = g_nspNcaWorkerCountStrings
+};
+
+static MenuElementOption g_nspContentStoreElementOption = {
+    .selected = 0,
+    .retrieved = false,
+    .getter_func = NULL,
+    .setter_func = NULL,
+    .options = g_noYesStrings
+};
+
+static MenuElementOption g_nspDeltaElementOption = {
+    .selected = 0,
+    .retrieved = false,
+    .getter_func = NULL,
+    .setter_func = NULL,
+    .options = g_noYesStrings
+};
+
 static bool g_appletStatus = true;
 
+static char *g_batchDumpTypeNames[] = { "nsp", "tik", NULL };
+
+static const char *g_batchDumpJobStatusNames[] = {
+    [BatchDumpJobStatus_Pending]   = "pending",
+    [BatchDumpJobStatus_Invalid]   = "invalid",
+    [BatchDumpJobStatus_NotFound]  = "not_found",
+    [BatchDumpJobStatus_NoSpace]   = "no_space",
+    [BatchDumpJobStatus_Failed]    = "failed",
+    [BatchDumpJobStatus_Cancelled] = "cancelled",
+    [BatchDumpJobStatus_Done]      = "done"
+};
+
+/* Batch jobs are processed in this order. Gamecard titles go first, so the gamecard can be removed as soon as possible. */
+static const BatchDumpStorage g_batchDumpStorages[] = {
+    { "gamecard", NcmStorageId_GameCard },
+    { "emmc", NcmStorageId_BuiltInUser },
+    { "system", NcmStorageId_BuiltInSystem },
+    { "sdcard", NcmStorageId_SdCard }
+};
+
+static const u32 g_batchDumpStorageCount = MAX_ELEMENTS(g_batchDumpStorages);
+
+static bool g_batchDumpActive = false;
+static u64 g_lastDumpOutputSize = 0;    ///< Output size from the last successful saveNintendoSubmissionPackage() / saveTicket() call.
+
 static UsbHsFsDevice *g_umsDevices = NULL;
 static u32 g_umsDeviceCount = 0;
 static char **g_storageOptions = NULL;
@@ -367,6 +628,13 @@ static MenuElement *g_xciMenuElements[] = {
         .element_options = NULL,
         .userdata = NULL
     },
+    &(MenuElement){
+        .str = "start single pass dump (xci + hfs partitions + initial data + certificate)",
+        .child_menu = NULL,
+        .task_func = &saveGameCardSinglePass,
+        .element_options = NULL,
+        .userdata = NULL
+    },
     &(MenuElement){
         .str = "prepend key area",
         .child_menu = NULL,
@@ -734,6 +1002,27 @@ static MenuElement *g_nspMenuElements[] = {
         },
         .userdata = NULL
     },
+    &(MenuElement){
+        .str = "nsp: parallel nca worker threads",
+        .child_menu = NULL,
+        .task_func = NULL,
+        .element_options = &g_nspNcaWorkerCountElementOption,
+        .userdata = NULL
+    },
+    &(MenuElement){
+        .str = "nsp: share unmodified gamecard ncas through content store (ignored for usb host)",
+        .child_menu = NULL,
+        .task_func = NULL,
+        .element_options = &g_nspContentStoreElementOption,
+        .userdata = NULL
+    },
+    &(MenuElement){
+        .str = "nsp: delta dump (only new ncas since the last dumped version)",
+        .child_menu = NULL,
+        .task_func = NULL,
+        .element_options = &g_nspDeltaElementOption,
+        .userdata = NULL
+    },
     &g_storageMenuElement,
     NULL
 };
@@ -1086,6 +1375,13 @@ static MenuElement *g_rootMenuElements[] = {
         .element_options = NULL,
         .userdata = NULL
     },
+    &(MenuElement){
+        .str = "batch dump (" BATCH_LIST_PATH ")",
+        .child_menu = NULL,
+        .task_func = &saveBatchDump,
+        .element_options = NULL,
+        .userdata = NULL
+    },
     &(MenuElement){
         .str = "reset settings",
         .child_menu = NULL,
@@ -1105,7 +1401,6 @@ static Menu g_rootMenu = {
 };
 
 static Mutex g_conMutex = 0, g_fileMutex = 0;
-static CondVar g_readCondvar = 0, g_writeCondvar = 0;
 
 static char path[FS_MAX_PATH * 2] = {0};
 
@@ -3115,154 +3410,481 @@ end:
     return success;
 }
 
-static bool browseGameCardHfsPartition(void *userdata)
+static bool saveGameCardSinglePass(void *userdata)
 {
-    u32 hfs_partition_type = (userdata ? *((u32*)userdata) : HashFileSystemPartitionType_None);
-    HashFileSystemContext hfs_ctx = {0};
-    char mount_name[DEVOPTAB_MOUNT_NAME_LENGTH] = {0}, subdir[0x20] = {0}, *base_out_path = NULL;
+    NX_IGNORE_ARG(userdata);
+
+    u64 gc_size = 0, out_size = 0, free_space = 0;
+    char size_str[16] = {0};
+
+    u32 key_area_crc = 0;
+    GameCardKeyArea gc_key_area = {0};
+    GameCardSecurityInformation gc_security_information = {0};
+
+    GameCardTeeThreadData tee_thread_data = {0};
+    XciThreadData *xci_thread_data = &(tee_thread_data.xci_thread_data);
+    SharedThreadData *shared_thread_data = &(xci_thread_data->shared_thread_data);
+
+    char *filename = NULL;
+    u32 dev_idx = g_storageMenuElementOption.selected;
+
+    bool prepend_key_area = (bool)getGameCardPrependKeyAreaOption();
+    bool keep_certificate = (bool)getGameCardKeepCertificateOption();
+    bool trim_dump = (bool)getGameCardTrimDumpOption();
+    bool calculate_checksum = (bool)getGameCardCalculateChecksumOption();
 
     bool success = false;
 
-    if (hfs_partition_type < HashFileSystemPartitionType_Root || hfs_partition_type > HashFileSystemPartitionType_Secure)
+    consolePrint("gamecard single pass dump\nprepend key area: %s | keep certificate: %s | trim dump: %s | calculate checksum: %s\n\n", prepend_key_area ? "yes" : "no", keep_certificate ? "yes" : "no", trim_dump ? "yes" : "no", calculate_checksum ? "yes" : "no");
+
+    /* The USB ABI only supports a single file transfer at a time, so we can't fan out data to multiple outputs. */
+    if (dev_idx == 1)
     {
-        consolePrint("invalid hfs partition type! (%u)\n", hfs_partition_type);
+        consolePrint("single pass dumps not supported over usb\n");
         goto end;
     }
 
-    if (!gamecardGetHashFileSystemContext(hfs_partition_type, &hfs_ctx))
+    /* These don't require a storage read pass. */
+    if (!saveGameCardInitialData(NULL) || !saveGameCardCertificate(NULL)) goto end;
+
+    if ((!trim_dump && !gamecardGetTotalSize(&gc_size)) || (trim_dump && !gamecardGetTrimmedSize(&gc_size)) || !gc_size)
     {
-        consolePrint("get hfs ctx failed! this partition type may not exist within the inserted gamecard\n");
+        consolePrint("failed to get gamecard size!\n");
         goto end;
     }
 
-    /* Mount devoptab device. */
-    snprintf(mount_name, MAX_ELEMENTS(mount_name), "hfs%s", hfs_ctx.name);
+    shared_thread_data->total_size = gc_size;
 
-    if (!devoptabMountHashFileSystemDevice(&hfs_ctx, mount_name))
+    if (prepend_key_area)
     {
-        consolePrint("hfs ctx devoptab mount failed!\n");
-        goto end;
+        if (!dumpGameCardSecurityInformation(&gc_security_information)) goto end;
+
+        memcpy(&(gc_key_area.initial_data), &(gc_security_information.initial_data), sizeof(GameCardInitialData));
+
+        if (calculate_checksum)
+        {
+            key_area_crc = crc32Calculate(&gc_key_area, sizeof(GameCardKeyArea));
+            xci_thread_data->full_xci_crc = key_area_crc;
+        }
     }
 
-    /* Generate output base path. */
-    snprintf(subdir, MAX_ELEMENTS(subdir), "/%s", hfs_ctx.name);
-    base_out_path = generateOutputGameCardFileName(HFS_SUBDIR "/Extracted", subdir, true);
-    if (!base_out_path) goto end;
+    /* Add XCI sink. It must always be the first one. */
+    snprintf(path, MAX_ELEMENTS(path), " [%s][%s][%s].xci", prepend_key_area ? "KA" : "NKA", keep_certificate ? "C" : "NC", trim_dump ? "T" : "NT");
+    filename = generateOutputGameCardFileName(GAMECARD_SUBDIR, path, true);
+    if (!filename || !gameCardTeeAddSink(&tee_thread_data, filename, 0, gc_size)) goto end;
 
-    /* Display file browser. */
-    success = fsBrowser(mount_name, base_out_path);
+    filename = NULL;
 
-    /* Unmount devoptab device. */
-    devoptabUnmountDevice(mount_name);
+    if (prepend_key_area)
+    {
+        tee_thread_data.sinks[0].header = &gc_key_area;
+        tee_thread_data.sinks[0].header_size = sizeof(GameCardKeyArea);
+    }
 
-end:
-    /* Free data. */
-    if (base_out_path) free(base_out_path);
-    hfsFreeContext(&hfs_ctx);
+    /* Add raw and extracted Hash FS partition sinks. */
+    for(u8 i = HashFileSystemPartitionType_Root; i <= HashFileSystemPartitionType_Secure; i++)
+    {
+        if (!gameCardTeeAddHfsPartitionSinks(&tee_thread_data, i)) goto end;
+    }
 
-    if (!success && g_appletStatus)
+    /* Validate sinks. */
+    for(u32 i = 0; i < tee_thread_data.sink_count; i++)
     {
-        consolePrint("press any button to continue\n");
-        utilsWaitForButtonPress(0);
+        GameCardTeeSink *sink = &(tee_thread_data.sinks[i]);
+        u64 sink_size = (sink->header_size + sink->size);
+
+        if ((sink->offset + sink->size) > gc_size)
+        {
+            consolePrint("\"%s\" exceeds the gamecard image size!\n", sink->path);
+            goto end;
+        }
+
+        if (dev_idx > 1 && g_umsDevices[dev_idx - 2].fs_type < UsbHsFsDeviceFileSystemType_exFAT && sink_size > FAT32_FILESIZE_LIMIT)
+        {
+            consolePrint("split dumps not supported for FAT12/16/32 volumes in UMS devices (yet)\n");
+            goto end;
+        }
+
+        out_size += sink_size;
     }
 
-    return success;
-}
+    utilsGenerateFormattedSizeString((double)gc_size, size_str, sizeof(size_str));
+    consolePrint("gamecard size: 0x%lX (%s)\n", gc_size, size_str);
 
-static bool saveConsoleLafwBlob(void *userdata)
-{
-    NX_IGNORE_ARG(userdata);
+    utilsGenerateFormattedSizeString((double)out_size, size_str, sizeof(size_str));
+    consolePrint("total output size (%u files): 0x%lX (%s)\n", tee_thread_data.sink_count, out_size, size_str);
 
-    u64 lafw_version = 0;
-    LotusAsicFirmwareBlob lafw_blob = {0};
-    bool success = false;
-    u32 crc = 0;
-    char *filename = NULL;
-    const char *fw_type_str = NULL, *dev_type_str = NULL;
+    if (!utilsGetFileSystemStatsByPath(tee_thread_data.sinks[0].path, NULL, &free_space))
+    {
+        consolePrint("failed to retrieve free space from selected device\n");
+        goto end;
+    }
 
-    if (!gamecardGetLotusAsicFirmwareBlob(&lafw_blob, &lafw_version))
+    if (out_size >= free_space)
     {
-        consolePrint("failed to get console lafw blob\n");
+        consolePrint("dump size exceeds free space\n");
         goto end;
     }
 
-    fw_type_str = gamecardGetLafwTypeString(lafw_blob.fw_type);
-    if (!fw_type_str) fw_type_str = "Unknown";
+    /* Empty files won't ever be touched by the write thread, so we'll create them right away. */
+    for(u32 i = 0; i < tee_thread_data.sink_count; i++)
+    {
+        GameCardTeeSink *sink = &(tee_thread_data.sinks[i]);
+        if (sink->size) continue;
 
-    dev_type_str = gamecardGetLafwDeviceTypeString(lafw_blob.device_type);
-    if (!dev_type_str) dev_type_str = "Unknown";
+        if (!gameCardTeeOpenSink(sink)) goto end;
 
-    consolePrint("get console lafw blob ok\n");
+        fclose(sink->fp);
+        sink->fp = NULL;
+    }
 
-    crc = crc32Calculate(&lafw_blob, sizeof(LotusAsicFirmwareBlob));
-    snprintf(path, MAX_ELEMENTS(path), "LAFW (%s) (%s) (v%lu) (%08X).bin", fw_type_str, dev_type_str, lafw_version, crc);
+    consoleRefresh();
 
-    filename = generateOutputGameCardFileName(NULL, path, false);
-    if (!filename) goto end;
+    success = spanDumpThreads(xciReadThreadFunc, gameCardTeeWriteThreadFunc, &tee_thread_data);
 
-    if (!saveFileData(filename, &lafw_blob, sizeof(LotusAsicFirmwareBlob))) goto end;
+    if (success)
+    {
+        consolePrint("successfully saved %u files in a single pass\n", tee_thread_data.sink_count);
 
-    consolePrint("successfully saved lafw blob as \"%s\"\n", filename);
-    success = true;
+        if (calculate_checksum)
+        {
+            if (prepend_key_area) consolePrint("key area crc: %08X | ", key_area_crc);
+            consolePrint("xci crc: %08X", xci_thread_data->xci_crc);
+            if (prepend_key_area) consolePrint(" | xci crc (with key area): %08X", xci_thread_data->full_xci_crc);
+            consolePrint("\n");
+        }
+
+        consoleRefresh();
+    }
 
 end:
+    gameCardTeeFreeSinks(&tee_thread_data, !success);
+
     if (filename) free(filename);
 
     return success;
 }
 
-static bool saveNintendoSubmissionPackage(void *userdata)
+static bool gameCardTeeAddSink(GameCardTeeThreadData *tee_thread_data, char *path, u64 offset, u64 size)
 {
-    if (!userdata) return false;
+    GameCardTeeSink *tmp_sinks = realloc(tee_thread_data->sinks, (tee_thread_data->sink_count + 1) * sizeof(GameCardTeeSink));
+    if (!tmp_sinks)
+    {
+        consolePrint("failed to reallocate sink buffer!\n");
+        return false;
+    }
 
-    TitleInfo *title_info = (TitleInfo*)userdata;
-    TitleApplicationMetadata *app_metadata = title_info->app_metadata;
+    tee_thread_data->sinks = tmp_sinks;
 
-    NspThreadData nsp_thread_data = {0};
-    Thread dump_thread = {0};
+    GameCardTeeSink *sink = &(tee_thread_data->sinks[tee_thread_data->sink_count++]);
+    memset(sink, 0, sizeof(GameCardTeeSink));
 
-    time_t start = 0, btn_cancel_start_tmr = 0, btn_cancel_end_tmr = 0;
-    bool btn_cancel_cur_state = false, btn_cancel_prev_state = false, success = false;
+    /* The sink takes ownership of the provided path. */
+    sink->path = path;
+    sink->offset = offset;
+    sink->size = size;
 
-    u64 prev_size = 0;
-    u8 prev_time = 0, percent = 0;
+    return true;
+}
 
-    consolePrint("%s info:\n\n", title_info->meta_key.type == NcmContentMetaType_Application ? "base application" : \
-                                (title_info->meta_key.type == NcmContentMetaType_Patch ? "update" : \
-                                (title_info->meta_key.type == NcmContentMetaType_AddOnContent ? "dlc" : "dlc update")));
+static bool gameCardTeeAddHfsPartitionSinks(GameCardTeeThreadData *tee_thread_data, u8 hfs_partition_type)
+{
+    HashFileSystemContext hfs_ctx = {0};
+    HashFileSystemEntry *hfs_entry = NULL;
+    char *hfs_entry_name = NULL, *raw_filename = NULL, *filename = NULL, *out_path = NULL;
+    size_t filename_len = 0;
+    u32 dev_idx = g_storageMenuElementOption.selected;
+    bool success = false;
 
-    if (app_metadata)
+    /* Not all partition types are available in all gamecards. */
+    if (!gamecardGetHashFileSystemContext(hfs_partition_type, &hfs_ctx))
     {
-        consolePrint("name: %s\n", app_metadata->lang_entry.name);
-        consolePrint("publisher: %s\n", app_metadata->lang_entry.author);
+        consolePrint("%s hfs partition not available, skipping\n", hfsGetPartitionNameString(hfs_partition_type));
+        return true;
     }
 
-    consolePrint("source storage: %s\n", titleGetNcmStorageIdName(title_info->storage_id));
-    consolePrint("title id: %016lX\n", title_info->meta_key.id);
-    consolePrint("version: %u (%u.%u.%u-%u.%u)\n", title_info->version.value, title_info->version.system_version.major, title_info->version.system_version.minor, \
-                                                   title_info->version.system_version.micro, title_info->version.system_version.major_relstep, \
-                                                   title_info->version.system_version.minor_relstep);
-    consolePrint("content count: %u\n", title_info->content_count);
-    consolePrint("size: %s\n", title_info->size_str);
-    consolePrint("______________________________\n\n");
-
-    consoleRefresh();
-
-    /* Create dump thread. */
-    nsp_thread_data.data = title_info;
-    utilsCreateThread(&dump_thread, nspThreadFunc, &nsp_thread_data, 2);
+    /* Raw partition. */
+    snprintf(path, MAX_ELEMENTS(path), "/%s.hfs0", hfs_ctx.name);
+    raw_filename = generateOutputGameCardFileName(HFS_SUBDIR "/Raw", path, true);
+    if (!raw_filename || !gameCardTeeAddSink(tee_thread_data, raw_filename, hfs_ctx.offset, hfs_ctx.size)) goto end;
 
-    /* Wait until the background thread calculates the NSP size. */
-    while(!nsp_thread_data.total_size && !nsp_thread_data.error) utilsAppletLoopDelay();
+    raw_filename = NULL;
 
-    if (nsp_thread_data.error)
+    /* The extracted root partition is made out of the raw partitions we're already dumping. */
+    if (hfs_partition_type == HashFileSystemPartitionType_Root)
     {
-        utilsJoinThread(&dump_thread);
-        return false;
+        success = true;
+        goto end;
     }
 
-    /* Start dump. */
-    start = time(NULL);
+    /* Extracted partition. */
+    snprintf(path, MAX_ELEMENTS(path), "/%s", hfs_ctx.name);
+    filename = generateOutputGameCardFileName(HFS_SUBDIR "/Extracted", path, true);
+    if (!filename) goto end;
+
+    filename_len = strlen(filename);
+
+    for(u32 i = 0; i < hfsGetEntryCount(&hfs_ctx); i++)
+    {
+        u64 entry_offset = 0, entry_size = 0;
+
+        if (!(hfs_entry = hfsGetEntryByIndex(&hfs_ctx, i)) || !(hfs_entry_name = hfsGetEntryName(&hfs_ctx, hfs_entry)))
+        {
+            consolePrint("failed to retrieve %s hfs partition entry #%u!\n", hfs_ctx.name, i);
+            goto end;
+        }
+
+        /* Get the entry offset relative to the start of the gamecard image. */
+        if (!gamecardGetHashFileSystemEntryInfoByName(hfs_partition_type, hfs_entry_name, &entry_offset, &entry_size))
+        {
+            consolePrint("failed to retrieve info for \"%s\" in %s hfs partition!\n", hfs_entry_name, hfs_ctx.name);
+            goto end;
+        }
+
+        out_path = calloc(sizeof(char), FS_MAX_PATH);
+        if (!out_path)
+        {
+            consolePrint("failed to allocate memory for output path!\n");
+            goto end;
+        }
+
+        snprintf(out_path, FS_MAX_PATH, "%s/%s", filename, hfs_entry_name);
+        utilsReplaceIllegalCharacters(out_path + filename_len + 1, dev_idx == 0);
+
+        if (!gameCardTeeAddSink(tee_thread_data, out_path, entry_offset, entry_size)) goto end;
+
+        out_path = NULL;
+    }
+
+    success = true;
+
+end:
+    if (out_path) free(out_path);
+    if (filename) free(filename);
+    if (raw_filename) free(raw_filename);
+
+    hfsFreeContext(&hfs_ctx);
+
+    return success;
+}
+
+static bool gameCardTeeOpenSink(GameCardTeeSink *sink)
+{
+    u32 dev_idx = g_storageMenuElementOption.selected;
+    u64 sink_size = (sink->header_size + sink->size);
+
+    utilsCreateDirectoryTree(sink->path, false);
+
+    if (dev_idx == 0 && sink_size > FAT32_FILESIZE_LIMIT && !utilsCreateConcatenationFile(sink->path))
+    {
+        consolePrint("failed to create concatenation file for \"%s\"!\n", sink->path);
+        return false;
+    }
+
+    sink->created = true;
+
+    sink->fp = fopen(sink->path, "wb");
+    if (!sink->fp)
+    {
+        consolePrint("failed to open \"%s\" for writing!\n", sink->path);
+        return false;
+    }
+
+    setvbuf(sink->fp, NULL, _IONBF, 0);
+    ftruncate(fileno(sink->fp), (off_t)sink_size);
+
+    if (sink->header_size && fwrite(sink->header, 1, sink->header_size, sink->fp) != sink->header_size)
+    {
+        consolePrint("failed to write header data to \"%s\"!\n", sink->path);
+        return false;
+    }
+
+    return true;
+}
+
+static void gameCardTeeFreeSinks(GameCardTeeThreadData *tee_thread_data, bool remove_output)
+{
+    u32 dev_idx = g_storageMenuElementOption.selected;
+
+    if (!tee_thread_data->sinks) return;
+
+    for(u32 i = 0; i < tee_thread_data->sink_count; i++)
+    {
+        GameCardTeeSink *sink = &(tee_thread_data->sinks[i]);
+
+        if (sink->fp) fclose(sink->fp);
+
+        if (remove_output && sink->created)
+        {
+            if (dev_idx == 0)
+            {
+                utilsRemoveConcatenationFile(sink->path);
+            } else {
+                remove(sink->path);
+            }
+        }
+
+        if (sink->path) free(sink->path);
+    }
+
+    if (dev_idx == 0) utilsCommitSdCardFileSystemChanges();
+
+    free(tee_thread_data->sinks);
+    tee_thread_data->sinks = NULL;
+    tee_thread_data->sink_count = 0;
+}
+
+static bool browseGameCardHfsPartition(void *userdata)
+{
+    u32 hfs_partition_type = (userdata ? *((u32*)userdata) : HashFileSystemPartitionType_None);
+    HashFileSystemContext hfs_ctx = {0};
+    char mount_name[DEVOPTAB_MOUNT_NAME_LENGTH] = {0}, subdir[0x20] = {0}, *base_out_path = NULL;
+
+    bool success = false;
+
+    if (hfs_partition_type < HashFileSystemPartitionType_Root || hfs_partition_type > HashFileSystemPartitionType_Secure)
+    {
+        consolePrint("invalid hfs partition type! (%u)\n", hfs_partition_type);
+        goto end;
+    }
+
+    if (!gamecardGetHashFileSystemContext(hfs_partition_type, &hfs_ctx))
+    {
+        consolePrint("get hfs ctx failed! this partition type may not exist within the inserted gamecard\n");
+        goto end;
+    }
+
+    /* Mount devoptab device. */
+    snprintf(mount_name, MAX_ELEMENTS(mount_name), "hfs%s", hfs_ctx.name);
+
+    if (!devoptabMountHashFileSystemDevice(&hfs_ctx, mount_name))
+    {
+        consolePrint("hfs ctx devoptab mount failed!\n");
+        goto end;
+    }
+
+    /* Generate output base path. */
+    snprintf(subdir, MAX_ELEMENTS(subdir), "/%s", hfs_ctx.name);
+    base_out_path = generateOutputGameCardFileName(HFS_SUBDIR "/Extracted", subdir, true);
+    if (!base_out_path) goto end;
+
+    /* Display file browser. */
+    success = fsBrowser(mount_name, base_out_path);
+
+    /* Unmount devoptab device. */
+    devoptabUnmountDevice(mount_name);
+
+end:
+    /* Free data. */
+    if (base_out_path) free(base_out_path);
+    hfsFreeContext(&hfs_ctx);
+
+    if (!success && g_appletStatus)
+    {
+        consolePrint("press any button to continue\n");
+        utilsWaitForButtonPress(0);
+    }
+
+    return success;
+}
+
+static bool saveConsoleLafwBlob(void *userdata)
+{
+    NX_IGNORE_ARG(userdata);
+
+    u64 lafw_version = 0;
+    LotusAsicFirmwareBlob lafw_blob = {0};
+    bool success = false;
+    u32 crc = 0;
+    char *filename = NULL;
+    const char *fw_type_str = NULL, *dev_type_str = NULL;
+
+    if (!gamecardGetLotusAsicFirmwareBlob(&lafw_blob, &lafw_version))
+    {
+        consolePrint("failed to get console lafw blob\n");
+        goto end;
+    }
+
+    fw_type_str = gamecardGetLafwTypeString(lafw_blob.fw_type);
+    if (!fw_type_str) fw_type_str = "Unknown";
+
+    dev_type_str = gamecardGetLafwDeviceTypeString(lafw_blob.device_type);
+    if (!dev_type_str) dev_type_str = "Unknown";
+
+    consolePrint("get console lafw blob ok\n");
+
+    crc = crc32Calculate(&lafw_blob, sizeof(LotusAsicFirmwareBlob));
+    snprintf(path, MAX_ELEMENTS(path), "LAFW (%s) (%s) (v%lu) (%08X).bin", fw_type_str, dev_type_str, lafw_version, crc);
+
+    filename = generateOutputGameCardFileName(NULL, path, false);
+    if (!filename) goto end;
+
+    if (!saveFileData(filename, &lafw_blob, sizeof(LotusAsicFirmwareBlob))) goto end;
+
+    consolePrint("successfully saved lafw blob as \"%s\"\n", filename);
+    success = true;
+
+end:
+    if (filename) free(filename);
+
+    return success;
+}
+
+static bool saveNintendoSubmissionPackage(void *userdata)
+{
+    if (!userdata) return false;
+
+    TitleInfo *title_info = (TitleInfo*)userdata;
+    TitleApplicationMetadata *app_metadata = title_info->app_metadata;
+
+    NspThreadData nsp_thread_data = {0};
+    Thread dump_thread = {0};
+
+    time_t start = 0, btn_cancel_start_tmr = 0, btn_cancel_end_tmr = 0;
+    bool btn_cancel_cur_state = false, btn_cancel_prev_state = false, success = false;
+
+    u64 start_tick = 0;
+
+    u64 prev_size = 0;
+    u8 prev_time = 0, percent = 0;
+
+    consolePrint("%s info:\n\n", title_info->meta_key.type == NcmContentMetaType_Application ? "base application" : \
+                                (title_info->meta_key.type == NcmContentMetaType_Patch ? "update" : \
+                                (title_info->meta_key.type == NcmContentMetaType_AddOnContent ? "dlc" : "dlc update")));
+
+    if (app_metadata)
+    {
+        consolePrint("name: %s\n", app_metadata->lang_entry.name);
+        consolePrint("publisher: %s\n", app_metadata->lang_entry.author);
+    }
+
+    consolePrint("source storage: %s\n", titleGetNcmStorageIdName(title_info->storage_id));
+    consolePrint("title id: %016lX\n", title_info->meta_key.id);
+    consolePrint("version: %u (%u.%u.%u-%u.%u)\n", title_info->version.value, title_info->version.system_version.major, title_info->version.system_version.minor, \
+                                                   title_info->version.system_version.micro, title_info->version.system_version.major_relstep, \
+                                                   title_info->version.system_version.minor_relstep);
+    consolePrint("content count: %u\n", title_info->content_count);
+    consolePrint("size: %s\n", title_info->size_str);
+    consolePrint("______________________________\n\n");
+
+    consoleRefresh();
+
+    /* Create dump thread. */
+    start_tick = armGetSystemTick();
+    nsp_thread_data.data = title_info;
+    utilsCreateThread(&dump_thread, nspThreadFunc, &nsp_thread_data, 2);
+
+    /* Wait until the background thread calculates the NSP size. */
+    while(!nsp_thread_data.total_size && !nsp_thread_data.error) utilsAppletLoopDelay();
+
+    if (nsp_thread_data.error)
+    {
+        utilsJoinThread(&dump_thread);
+        return false;
+    }
+
+    /* Start dump. */
+    start = time(NULL);
 
     while(nsp_thread_data.data_written < nsp_thread_data.total_size)
     {
@@ -3334,6 +3956,12 @@ static bool saveNintendoSubmissionPackage(void *userdata)
     } else {
         start = (time(NULL) - start);
         consolePrint("process completed in %lu seconds\n", start);
+
+        /* Includes NCA initialization and header generation. Useful to compare different NCA worker thread counts. */
+        consolePrint("total nsp time: %lu ms (nca worker threads: %s)\n", armTicksToNs(armGetSystemTick() - start_tick) / 1000000, \
+                     g_nspNcaWorkerCountStrings[g_nspNcaWorkerCountElementOption.selected]);
+
+        g_lastDumpOutputSize = nsp_thread_data.total_size;
         success = true;
     }
 
@@ -3423,6 +4051,8 @@ static bool saveTicket(void *userdata)
     consolePrint("decrypted titlekey: %s\n\n", tik.dec_titlekey_str);
 
     consolePrint("successfully saved ticket as \"%s\"\n", filename);
+
+    g_lastDumpOutputSize = tik.size;
     success = true;
 
 end:
@@ -3433,42 +4063,337 @@ end:
     return success;
 }
 
-static bool saveNintendoContentArchive(void *userdata)
+static bool saveBatchDump(void *userdata)
 {
-    if (!userdata) return false;
-
-    NcaUserData *nca_user_data = (NcaUserData*)userdata;
-    TitleInfo *title_info = nca_user_data->title_info;
-    NcmContentInfo *content_info = &(title_info->content_infos[nca_user_data->content_idx]);
+    NX_IGNORE_ARG(userdata);
 
-    NcaThreadData nca_thread_data = {0};
-    SharedThreadData *shared_thread_data = &(nca_thread_data.shared_thread_data);
+    BatchDumpJob *jobs = NULL;
+    u32 job_count = 0, done_count = 0;
 
-    u64 free_space = 0;
-    char *filename = NULL, subdir[0x20] = {0};
     u32 dev_idx = g_storageMenuElementOption.selected;
-    char size_str[16] = {0};
+    char dev_path[0x20] = {0};
+    u64 free_space = 0, batch_start_tick = 0;
 
-    bool success = false;
+    bool cancelled = false, success = false;
 
-    /* Allocate buffer for NCA context. */
-    if (!(nca_thread_data.nca_ctx = calloc(1, sizeof(NcaContext))))
-    {
-        consolePrint("nca ctx calloc failed\n");
-        goto end;
-    }
+    consolePrint("batch list: %s\n", BATCH_LIST_PATH);
+    consoleRefresh();
 
-    /* Initialize NCA context. */
-    if (!ncaInitializeContext(nca_thread_data.nca_ctx, title_info->storage_id, (title_info->storage_id == NcmStorageId_GameCard ? HashFileSystemPartitionType_Secure : 0), \
-                              &(title_info->meta_key), content_info, NULL))
+    if (!batchDumpParseListFile(&jobs, &job_count)) goto end;
+
+    /* Look up title info entries for all valid jobs. */
+    for(u32 i = 0; i < job_count; i++)
     {
-        consolePrint("nca initialize ctx failed\n");
-        goto end;
+        BatchDumpJob *job = &(jobs[i]);
+        if (job->status != BatchDumpJobStatus_Pending) continue;
+
+        if (!(job->title_info = titleGetTitleInfoEntryFromStorageByTitleId(job->storage_id, job->title_id)))
+        {
+            consolePrint("line %u: title %016lX not found\n", job->line, job->title_id);
+            job->status = BatchDumpJobStatus_NotFound;
+            continue;
+        }
+
+        job->storage_id = job->title_info->storage_id;
     }
 
-    shared_thread_data->total_size = nca_thread_data.nca_ctx->content_size;
+    /* Group jobs by source storage, so we only need to switch between storages once. */
+    qsort(jobs, job_count, sizeof(BatchDumpJob), batchDumpJobSortFunction);
 
-    utilsGenerateFormattedSizeString((double)shared_thread_data->total_size, size_str, sizeof(size_str));
+    /* Wait for USB session (if needed). Otherwise, retrieve free space from the output storage once for the whole batch. */
+    if (useUsbHost())
+    {
+        if (!waitForUsb()) goto end;
+    } else {
+        snprintf(dev_path, MAX_ELEMENTS(dev_path), "%s/", dev_idx == 0 ? DEVOPTAB_SDMC_DEVICE : g_umsDevices[dev_idx - 2].name);
+        if (!utilsGetFileSystemStatsByPath(dev_path, NULL, &free_space))
+        {
+            consolePrint("failed to retrieve free space from selected device\n");
+            goto end;
+        }
+    }
+
+    /* Keep the ES ticket system savefiles open and certificate chains in memory across jobs. */
+    tikSetTicketCacheEnabled(true);
+    certSetRawCertificateChainCacheEnabled(true);
+
+    g_batchDumpActive = true;
+    utilsSetLongRunningProcessState(true);
+
+    batch_start_tick = armGetSystemTick();
+
+    for(u32 i = 0; i < job_count; i++)
+    {
+        BatchDumpJob *job = &(jobs[i]);
+        TitleInfo *title_info = job->title_info;
+        u64 start_tick = 0;
+        bool job_success = false;
+
+        if (job->status != BatchDumpJobStatus_Pending) continue;
+
+        if (cancelled)
+        {
+            job->status = BatchDumpJobStatus_Cancelled;
+            continue;
+        }
+
+        consoleClear();
+        consolePrint("batch job %u / %u (line %u): %s %016lX v%u (%s)\n\n", i + 1, job_count, job->line, g_batchDumpTypeNames[job->dump_type], job->title_id, \
+                     title_info->version.value, titleGetNcmStorageIdName(job->storage_id));
+        consoleRefresh();
+
+        /* Check if this job fits in the remaining free space. Retrieve it once again before giving up, in case previous jobs overwrote existing files. */
+        if (!useUsbHost() && job->dump_type == BatchDumpType_Nsp && title_info->size >= free_space && \
+            (!utilsGetFileSystemStatsByPath(dev_path, NULL, &free_space) || title_info->size >= free_space))
+        {
+            consolePrint("not enough free space available for this job, skipping\n");
+            job->status = BatchDumpJobStatus_NoSpace;
+            continue;
+        }
+
+        g_lastDumpOutputSize = 0;
+        start_tick = armGetSystemTick();
+
+        job_success = (job->dump_type == BatchDumpType_Nsp ? saveNintendoSubmissionPackage(title_info) : saveTicket(title_info));
+
+        job->elapsed_ns = armTicksToNs(armGetSystemTick() - start_tick);
+
+        /* Stop processing the queue if we're exiting, or if B is still being held after cancelling a dump. */
+        utilsScanPads();
+        if (!g_appletStatus || (utilsGetButtonsHeld() & HidNpadButton_B)) cancelled = true;
+
+        if (job_success)
+        {
+            job->size = g_lastDumpOutputSize;
+            job->status = BatchDumpJobStatus_Done;
+            free_space = (job->size < free_space ? (free_space - job->size) : 0);
+            done_count++;
+        } else {
+            job->status = (cancelled ? BatchDumpJobStatus_Cancelled : BatchDumpJobStatus_Failed);
+        }
+    }
+
+    consolePrint("\nbatch finished: %u out of %u job(s) completed in %lu seconds\n", done_count, job_count, armTicksToNs(armGetSystemTick() - batch_start_tick) / 1000000000);
+    if (cancelled) consolePrint("batch cancelled\n");
+
+    success = (done_count == job_count);
+
+end:
+    if (g_batchDumpActive)
+    {
+        utilsSetLongRunningProcessState(false);
+        g_batchDumpActive = false;
+
+        tikSetTicketCacheEnabled(false);
+        certSetRawCertificateChainCacheEnabled(false);
+
+        /* Update free space. */
+        if (!useUsbHost()) updateStorageList();
+    }
+
+    if (jobs)
+    {
+        if (batchDumpWriteReport(jobs, job_count)) consolePrint("batch report saved to \"%s\"\n", BATCH_REPORT_PATH);
+
+        for(u32 i = 0; i < job_count; i++) titleFreeTitleInfo(&(jobs[i].title_info));
+        free(jobs);
+    }
+
+    consoleRefresh();
+
+    return success;
+}
+
+static bool batchDumpParseListFile(BatchDumpJob **out_jobs, u32 *out_job_count)
+{
+    FILE *fp = NULL;
+    char line[0x100] = {0};
+    u32 line_num = 0, job_count = 0;
+
+    BatchDumpJob *jobs = NULL;
+    bool success = false;
+
+    if (!(fp = fopen(BATCH_LIST_PATH, "r")))
+    {
+        consolePrint("failed to open batch list! each line must hold a title id, a dump type (nsp, tik) and an optional source storage (gamecard, emmc, system, sdcard)\n");
+        return false;
+    }
+
+    if (!(jobs = calloc(BATCH_MAX_JOB_COUNT, sizeof(BatchDumpJob))))
+    {
+        consolePrint("batch jobs calloc failed\n");
+        goto end;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        char title_id_str[0x20] = {0}, type_str[0x10] = {0}, storage_str[0x10] = {0}, *endptr = NULL;
+        BatchDumpJob *job = NULL;
+        int field_count = 0;
+        u32 idx = 0;
+
+        line_num++;
+
+        /* Skip empty lines and comments. */
+        field_count = sscanf(line, "%31s %15s %15s", title_id_str, type_str, storage_str);
+        if (field_count <= 0 || title_id_str[0] == '#') continue;
+
+        if (job_count >= BATCH_MAX_JOB_COUNT)
+        {
+            consolePrint("batch list holds more than %u jobs, ignoring the rest\n", BATCH_MAX_JOB_COUNT);
+            break;
+        }
+
+        job = &(jobs[job_count++]);
+        job->line = line_num;
+        job->title_id = strtoull(title_id_str, &endptr, 16);
+        job->storage_id = NcmStorageId_Any;
+
+        job->dump_type = BatchDumpType_Count;
+
+        for(idx = 0; field_count >= 2 && idx < BatchDumpType_Count; idx++)
+        {
+            if (strcasecmp(type_str, g_batchDumpTypeNames[idx]) != 0) continue;
+            job->dump_type = (u8)idx;
+            break;
+        }
+
+        if (field_count == 3)
+        {
+            for(idx = 0; idx < g_batchDumpStorageCount; idx++)
+            {
+                if (!strcasecmp(storage_str, g_batchDumpStorages[idx].name)) break;
+            }
+
+            if (idx < g_batchDumpStorageCount) job->storage_id = g_batchDumpStorages[idx].storage_id;
+        }
+
+        if (!job->title_id || *endptr || job->dump_type >= BatchDumpType_Count || (field_count == 3 && job->storage_id == NcmStorageId_Any))
+        {
+            consolePrint("line %u: invalid job\n", line_num);
+            job->status = BatchDumpJobStatus_Invalid;
+        }
+    }
+
+    if (!job_count)
+    {
+        consolePrint("batch list is empty\n");
+        goto end;
+    }
+
+    *out_jobs = jobs;
+    *out_job_count = job_count;
+
+    success = true;
+
+end:
+    if (!success && jobs) free(jobs);
+
+    fclose(fp);
+
+    return success;
+}
+
+static u32 batchDumpGetStorageIndex(u8 storage_id)
+{
+    u32 idx = 0;
+
+    for(idx = 0; idx < g_batchDumpStorageCount; idx++)
+    {
+        if (g_batchDumpStorages[idx].storage_id == storage_id) break;
+    }
+
+    return idx;
+}
+
+static int batchDumpJobSortFunction(const void *a, const void *b)
+{
+    const BatchDumpJob *job_1 = (const BatchDumpJob*)a;
+    const BatchDumpJob *job_2 = (const BatchDumpJob*)b;
+
+    u32 storage_idx_1 = batchDumpGetStorageIndex(job_1->storage_id);
+    u32 storage_idx_2 = batchDumpGetStorageIndex(job_2->storage_id);
+
+    if (storage_idx_1 < storage_idx_2)
+    {
+        return -1;
+    } else
+    if (storage_idx_1 > storage_idx_2)
+    {
+        return 1;
+    }
+
+    return (job_1->line < job_2->line ? -1 : (job_1->line > job_2->line ? 1 : 0));
+}
+
+static bool batchDumpWriteReport(const BatchDumpJob *jobs, u32 job_count)
+{
+    FILE *fp = NULL;
+
+    if (!(fp = fopen(BATCH_REPORT_PATH, "w")))
+    {
+        consolePrint("failed to open \"%s\" for writing!\n", BATCH_REPORT_PATH);
+        return false;
+    }
+
+    /* The NCA worker thread count is included, so reports from repeated batch runs of the same list using different settings can be compared. */
+    /* Listing the same title more than once yields multiple samples from a single run. */
+    fprintf(fp, "line,title_id,version,source_storage,dump_type,nca_workers,status,size,elapsed_ms,mib_per_sec\n");
+
+    for(u32 i = 0; i < job_count; i++)
+    {
+        const BatchDumpJob *job = &(jobs[i]);
+        u32 storage_idx = batchDumpGetStorageIndex(job->storage_id);
+        double mib_per_sec = (job->elapsed_ns ? (((double)job->size / (double)0x100000) / ((double)job->elapsed_ns / 1000000000.0)) : 0.0);
+
+        fprintf(fp, "%u,%016lX,%u,%s,%s,%s,%s,%lu,%lu,%.2f\n", job->line, job->title_id, job->title_info ? job->title_info->version.value : 0, \
+                storage_idx < g_batchDumpStorageCount ? g_batchDumpStorages[storage_idx].name : "any", \
+                job->dump_type < BatchDumpType_Count ? g_batchDumpTypeNames[job->dump_type] : "unknown", \
+                job->dump_type == BatchDumpType_Nsp ? g_nspNcaWorkerCountStrings[g_nspNcaWorkerCountElementOption.selected] : "n/a", \
+                g_batchDumpJobStatusNames[job->status], job->size, job->elapsed_ns / 1000000, mib_per_sec);
+    }
+
+    fclose(fp);
+
+    return true;
+}
+
+static bool saveNintendoContentArchive(void *userdata)
+{
+    if (!userdata) return false;
+
+    NcaUserData *nca_user_data = (NcaUserData*)userdata;
+    TitleInfo *title_info = nca_user_data->title_info;
+    NcmContentInfo *content_info = &(title_info->content_infos[nca_user_data->content_idx]);
+
+    NcaThreadData nca_thread_data = {0};
+    SharedThreadData *shared_thread_data = &(nca_thread_data.shared_thread_data);
+
+    u64 free_space = 0;
+    char *filename = NULL, subdir[0x20] = {0};
+    u32 dev_idx = g_storageMenuElementOption.selected;
+    char size_str[16] = {0};
+
+    bool success = false;
+
+    /* Allocate buffer for NCA context. */
+    if (!(nca_thread_data.nca_ctx = calloc(1, sizeof(NcaContext))))
+    {
+        consolePrint("nca ctx calloc failed\n");
+        goto end;
+    }
+
+    /* Initialize NCA context. */
+    if (!ncaInitializeContext(nca_thread_data.nca_ctx, title_info->storage_id, (title_info->storage_id == NcmStorageId_GameCard ? HashFileSystemPartitionType_Secure : 0), \
+                              &(title_info->meta_key), content_info, NULL))
+    {
+        consolePrint("nca initialize ctx failed\n");
+        goto end;
+    }
+
+    shared_thread_data->total_size = nca_thread_data.nca_ctx->content_size;
+
+    utilsGenerateFormattedSizeString((double)shared_thread_data->total_size, size_str, sizeof(size_str));
     consolePrint("nca size: 0x%lX (%s)\n", shared_thread_data->total_size, size_str);
 
     snprintf(subdir, MAX_ELEMENTS(subdir), NCA_SUBDIR "/%s", nca_thread_data.nca_ctx->storage_id == NcmStorageId_BuiltInSystem ? "System" : "User");
@@ -4731,22 +5656,16 @@ end:
 
 static void xciReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     XciThreadData *xci_thread_data = (XciThreadData*)arg;
     SharedThreadData *shared_thread_data = &(xci_thread_data->shared_thread_data);
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !buf1 || !buf2)
+    if (!shared_thread_data->total_size)
     {
         shared_thread_data->read_error = true;
         goto end;
     }
 
-    shared_thread_data->data = NULL;
-    shared_thread_data->data_size = 0;
-
     bool prepend_key_area = (bool)getGameCardPrependKeyAreaOption();
     bool keep_certificate = (bool)getGameCardKeepCertificateOption();
     bool calculate_checksum = (bool)getGameCardCalculateChecksumOption();
@@ -4758,78 +5677,52 @@ static void xciReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
+        /* Wait until a ring slot is available. */
+        if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
         /* Read current data chunk */
-        shared_thread_data->read_error = !gamecardReadStorage(buf1, blksize, offset);
+        shared_thread_data->read_error = !gamecardReadStorage(buf, blksize, offset);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         /* Remove certificate */
-        if (!keep_certificate && offset == 0) memset((u8*)buf1 + GAMECARD_CERT_OFFSET, 0xFF, sizeof(FsGameCardCertificate));
+        if (!keep_certificate && offset == 0) memset((u8*)buf + GAMECARD_CERT_OFFSET, 0xFF, sizeof(FsGameCardCertificate));
 
         /* Update checksum */
         if (calculate_checksum)
         {
-            xci_thread_data->xci_crc = crc32CalculateWithSeed(xci_thread_data->xci_crc, buf1, blksize);
-            if (prepend_key_area) xci_thread_data->full_xci_crc = crc32CalculateWithSeed(xci_thread_data->full_xci_crc, buf1, blksize);
-        }
-
-        /* Wait until the previous data chunk has been written */
-        mutexLock(&g_fileMutex);
-
-        if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-        if (shared_thread_data->write_error)
-        {
-            mutexUnlock(&g_fileMutex);
-            break;
+            xci_thread_data->xci_crc = crc32CalculateWithSeed(xci_thread_data->xci_crc, buf, blksize);
+            if (prepend_key_area) xci_thread_data->full_xci_crc = crc32CalculateWithSeed(xci_thread_data->full_xci_crc, buf, blksize);
         }
 
-        /* Update shared object. */
-        shared_thread_data->data = buf1;
-        shared_thread_data->data_size = blksize;
-
-        /* Swap buffers. */
-        buf1 = buf2;
-        buf2 = shared_thread_data->data;
-
-        /* Wake up the write thread to continue writing data. */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_writeCondvar);
+        /* Hand the current data chunk over to the write thread. */
+        dumpRingCommit(&(shared_thread_data->ring), blksize);
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void rawHfsReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     HfsThreadData *hfs_thread_data = (HfsThreadData*)arg;
     SharedThreadData *shared_thread_data = &(hfs_thread_data->shared_thread_data);
     HashFileSystemContext *hfs_ctx = hfs_thread_data->hfs_ctx;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !hfs_ctx || !buf1 || !buf2)
+    if (!shared_thread_data->total_size || !hfs_ctx)
     {
         shared_thread_data->read_error = true;
         goto end;
     }
 
-    shared_thread_data->data = NULL;
-    shared_thread_data->data_size = 0;
-
     for(u64 offset = 0, blksize = BLOCK_SIZE; offset < shared_thread_data->total_size; offset += blksize)
     {
         if (blksize > (shared_thread_data->total_size - offset)) blksize = (shared_thread_data->total_size - offset);
@@ -4837,52 +5730,32 @@ static void rawHfsReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
+        /* Wait until a ring slot is available. */
+        if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
         /* Read current data chunk */
-        shared_thread_data->read_error = !hfsReadPartitionData(hfs_ctx, buf1, blksize, offset);
+        shared_thread_data->read_error = !hfsReadPartitionData(hfs_ctx, buf, blksize, offset);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
-            break;
-        }
-
-        /* Wait until the previous data chunk has been written */
-        mutexLock(&g_fileMutex);
-
-        if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-        if (shared_thread_data->write_error)
-        {
-            mutexUnlock(&g_fileMutex);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
-        /* Update shared object. */
-        shared_thread_data->data = buf1;
-        shared_thread_data->data_size = blksize;
-
-        /* Swap buffers. */
-        buf1 = buf2;
-        buf2 = shared_thread_data->data;
-
-        /* Wake up the write thread to continue writing data. */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_writeCondvar);
+        /* Hand the current data chunk over to the write thread. */
+        dumpRingCommit(&(shared_thread_data->ring), blksize);
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void extractedHfsReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     HfsThreadData *hfs_thread_data = (HfsThreadData*)arg;
     SharedThreadData *shared_thread_data = &(hfs_thread_data->shared_thread_data);
 
@@ -4898,14 +5771,11 @@ static void extractedHfsReadThreadFunc(void *arg)
     u64 free_space = 0;
     u32 dev_idx = g_storageMenuElementOption.selected;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
     snprintf(hfs_path, MAX_ELEMENTS(hfs_path), "/%s", hfs_ctx->name);
     filename = generateOutputGameCardFileName(HFS_SUBDIR "/Extracted", hfs_path, true);
     filename_len = (filename ? strlen(filename) : 0);
 
-    if (!shared_thread_data->total_size || !hfs_entry_count || !buf1 || !buf2 || !filename)
+    if (!shared_thread_data->total_size || !hfs_entry_count || !filename)
     {
         shared_thread_data->read_error = true;
         goto end;
@@ -4934,7 +5804,7 @@ static void extractedHfsReadThreadFunc(void *arg)
 
     if (shared_thread_data->read_error)
     {
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
         goto end;
     }
 
@@ -4944,18 +5814,14 @@ static void extractedHfsReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user. */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         if (dev_idx != 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Close file. */
             if (shared_thread_data->fp)
@@ -4970,7 +5836,7 @@ static void extractedHfsReadThreadFunc(void *arg)
         shared_thread_data->read_error = ((hfs_entry = hfsGetEntryByIndex(hfs_ctx, i)) == NULL || (hfs_entry_name = hfsGetEntryName(hfs_ctx, hfs_entry)) == NULL);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -4980,12 +5846,8 @@ static void extractedHfsReadThreadFunc(void *arg)
 
         if (dev_idx == 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Send current file properties */
             shared_thread_data->read_error = !usbSendFileProperties(hfs_entry->size, hfs_path);
@@ -5027,7 +5889,7 @@ static void extractedHfsReadThreadFunc(void *arg)
 
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -5038,40 +5900,23 @@ static void extractedHfsReadThreadFunc(void *arg)
             /* Check if the transfer has been cancelled by the user. */
             if (shared_thread_data->transfer_cancelled)
             {
-                condvarWakeAll(&g_writeCondvar);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
+            /* Wait until a ring slot is available. */
+            if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
             /* Read current file data chunk. */
-            shared_thread_data->read_error = !hfsReadEntryData(hfs_ctx, hfs_entry, buf1, blksize, offset);
+            shared_thread_data->read_error = !hfsReadEntryData(hfs_ctx, hfs_entry, buf, blksize, offset);
             if (shared_thread_data->read_error)
             {
-                condvarWakeAll(&g_writeCondvar);
-                break;
-            }
-
-            /* Wait until the previous file data chunk has been written. */
-            mutexLock(&g_fileMutex);
-
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-            if (shared_thread_data->write_error)
-            {
-                mutexUnlock(&g_fileMutex);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
-            /* Update shared object. */
-            shared_thread_data->data = buf1;
-            shared_thread_data->data_size = blksize;
-
-            /* Swap buffers. */
-            buf1 = buf2;
-            buf2 = shared_thread_data->data;
-
-            /* Wake up the write thread to continue writing data. */
-            mutexUnlock(&g_fileMutex);
-            condvarWakeAll(&g_writeCondvar);
+            /* Hand the current data chunk over to the write thread. */
+            dumpRingCommit(&(shared_thread_data->ring), blksize);
         }
 
         if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
@@ -5079,14 +5924,17 @@ static void extractedHfsReadThreadFunc(void *arg)
 
     if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
     {
-        /* Wait until the previous file data chunk has been written. */
-        mutexLock(&g_fileMutex);
-        if (shared_thread_data->data_size) condvarWait(&g_readCondvar, &g_fileMutex);
-        mutexUnlock(&g_fileMutex);
+        /* Wait until all queued file data chunks have been written. */
+        if (!dumpRingDrain(&(shared_thread_data->ring))) goto end;
 
-        if (dev_idx == 1) usbEndExtractedFsDump();
+        shared_thread_data->write_error = (dev_idx == 1 && !usbEndExtractedFsDump());
+        if (!shared_thread_data->write_error)
+        {
+            consolePrint("successfully saved extracted hfs partition data to \"%s\"\n", filename);
+        } else {
+            consolePrint("failed to send last file batch to host\n");
+        }
 
-        consolePrint("successfully saved extracted hfs partition data to \"%s\"\n", filename);
         consoleRefresh();
     }
 
@@ -5105,31 +5953,22 @@ end:
 
     if (filename) free(filename);
 
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void ncaReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     NcaThreadData *nca_thread_data = (NcaThreadData*)arg;
     SharedThreadData *shared_thread_data = &(nca_thread_data->shared_thread_data);
     NcaContext *nca_ctx = nca_thread_data->nca_ctx;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !nca_ctx || !buf1 || !buf2)
+    if (!shared_thread_data->total_size || !nca_ctx)
     {
         shared_thread_data->read_error = true;
         goto end;
     }
 
-    shared_thread_data->data = NULL;
-    shared_thread_data->data_size = 0;
-
     for(u64 offset = 0, blksize = BLOCK_SIZE; offset < shared_thread_data->total_size; offset += blksize)
     {
         if (blksize > (shared_thread_data->total_size - offset)) blksize = (shared_thread_data->total_size - offset);
@@ -5137,68 +5976,42 @@ static void ncaReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
+        /* Wait until a ring slot is available. */
+        if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
         /* Read current data chunk */
-        shared_thread_data->read_error = !ncaReadContentFile(nca_ctx, buf1, blksize, offset);
+        shared_thread_data->read_error = !ncaReadContentFile(nca_ctx, buf, blksize, offset);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
-            break;
-        }
-
-        /* Wait until the previous data chunk has been written */
-        mutexLock(&g_fileMutex);
-
-        if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-        if (shared_thread_data->write_error)
-        {
-            mutexUnlock(&g_fileMutex);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
-        /* Update shared object. */
-        shared_thread_data->data = buf1;
-        shared_thread_data->data_size = blksize;
-
-        /* Swap buffers. */
-        buf1 = buf2;
-        buf2 = shared_thread_data->data;
-
-        /* Wake up the write thread to continue writing data. */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_writeCondvar);
+        /* Hand the current data chunk over to the write thread. */
+        dumpRingCommit(&(shared_thread_data->ring), blksize);
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void rawPartitionFsReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     PfsThreadData *pfs_thread_data = (PfsThreadData*)arg;
     SharedThreadData *shared_thread_data = &(pfs_thread_data->shared_thread_data);
     PartitionFileSystemContext *pfs_ctx = pfs_thread_data->pfs_ctx;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !pfs_ctx || !buf1 || !buf2)
+    if (!shared_thread_data->total_size || !pfs_ctx)
     {
         shared_thread_data->read_error = true;
         goto end;
     }
 
-    shared_thread_data->data = NULL;
-    shared_thread_data->data_size = 0;
-
     for(u64 offset = 0, blksize = BLOCK_SIZE; offset < shared_thread_data->total_size; offset += blksize)
     {
         if (blksize > (shared_thread_data->total_size - offset)) blksize = (shared_thread_data->total_size - offset);
@@ -5206,52 +6019,32 @@ static void rawPartitionFsReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
+        /* Wait until a ring slot is available. */
+        if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
         /* Read current data chunk */
-        shared_thread_data->read_error = !pfsReadPartitionData(pfs_ctx, buf1, blksize, offset);
+        shared_thread_data->read_error = !pfsReadPartitionData(pfs_ctx, buf, blksize, offset);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
-            break;
-        }
-
-        /* Wait until the previous data chunk has been written */
-        mutexLock(&g_fileMutex);
-
-        if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-        if (shared_thread_data->write_error)
-        {
-            mutexUnlock(&g_fileMutex);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
-        /* Update shared object. */
-        shared_thread_data->data = buf1;
-        shared_thread_data->data_size = blksize;
-
-        /* Swap buffers. */
-        buf1 = buf2;
-        buf2 = shared_thread_data->data;
-
-        /* Wake up the write thread to continue writing data. */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_writeCondvar);
+        /* Hand the current data chunk over to the write thread. */
+        dumpRingCommit(&(shared_thread_data->ring), blksize);
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void extractedPartitionFsReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     PfsThreadData *pfs_thread_data = (PfsThreadData*)arg;
     SharedThreadData *shared_thread_data = &(pfs_thread_data->shared_thread_data);
 
@@ -5273,9 +6066,6 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
     u64 free_space = 0;
     u32 dev_idx = g_storageMenuElementOption.selected;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
     if (pfs_thread_data->use_layeredfs_dir)
     {
         /* Only use base title IDs if we're dealing with patches. */
@@ -5293,7 +6083,7 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
 
     filename_len = (filename ? strlen(filename) : 0);
 
-    if (!shared_thread_data->total_size || !pfs_entry_count || !buf1 || !buf2 || !filename)
+    if (!shared_thread_data->total_size || !pfs_entry_count || !filename)
     {
         shared_thread_data->read_error = true;
         goto end;
@@ -5322,7 +6112,7 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
 
     if (shared_thread_data->read_error)
     {
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
         goto end;
     }
 
@@ -5332,18 +6122,14 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user. */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         if (dev_idx != 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Close file. */
             if (shared_thread_data->fp)
@@ -5358,7 +6144,7 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
         shared_thread_data->read_error = ((pfs_entry = pfsGetEntryByIndex(pfs_ctx, i)) == NULL || (pfs_entry_name = pfsGetEntryName(pfs_ctx, pfs_entry)) == NULL);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -5368,12 +6154,8 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
 
         if (dev_idx == 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Send current file properties */
             shared_thread_data->read_error = !usbSendFileProperties(pfs_entry->size, pfs_path);
@@ -5415,7 +6197,7 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
 
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -5426,40 +6208,23 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
             /* Check if the transfer has been cancelled by the user. */
             if (shared_thread_data->transfer_cancelled)
             {
-                condvarWakeAll(&g_writeCondvar);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
+            /* Wait until a ring slot is available. */
+            if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
             /* Read current file data chunk. */
-            shared_thread_data->read_error = !pfsReadEntryData(pfs_ctx, pfs_entry, buf1, blksize, offset);
+            shared_thread_data->read_error = !pfsReadEntryData(pfs_ctx, pfs_entry, buf, blksize, offset);
             if (shared_thread_data->read_error)
             {
-                condvarWakeAll(&g_writeCondvar);
-                break;
-            }
-
-            /* Wait until the previous file data chunk has been written. */
-            mutexLock(&g_fileMutex);
-
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-            if (shared_thread_data->write_error)
-            {
-                mutexUnlock(&g_fileMutex);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
-            /* Update shared object. */
-            shared_thread_data->data = buf1;
-            shared_thread_data->data_size = blksize;
-
-            /* Swap buffers. */
-            buf1 = buf2;
-            buf2 = shared_thread_data->data;
-
-            /* Wake up the write thread to continue writing data. */
-            mutexUnlock(&g_fileMutex);
-            condvarWakeAll(&g_writeCondvar);
+            /* Hand the current data chunk over to the write thread. */
+            dumpRingCommit(&(shared_thread_data->ring), blksize);
         }
 
         if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
@@ -5467,14 +6232,17 @@ static void extractedPartitionFsReadThreadFunc(void *arg)
 
     if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
     {
-        /* Wait until the previous file data chunk has been written. */
-        mutexLock(&g_fileMutex);
-        if (shared_thread_data->data_size) condvarWait(&g_readCondvar, &g_fileMutex);
-        mutexUnlock(&g_fileMutex);
+        /* Wait until all queued file data chunks have been written. */
+        if (!dumpRingDrain(&(shared_thread_data->ring))) goto end;
 
-        if (dev_idx == 1) usbEndExtractedFsDump();
+        shared_thread_data->write_error = (dev_idx == 1 && !usbEndExtractedFsDump());
+        if (!shared_thread_data->write_error)
+        {
+            consolePrint("successfully saved extracted partitionfs section data to \"%s\"\n", filename);
+        } else {
+            consolePrint("failed to send last file batch to host\n");
+        }
 
-        consolePrint("successfully saved extracted partitionfs section data to \"%s\"\n", filename);
         consoleRefresh();
     }
 
@@ -5493,31 +6261,22 @@ end:
 
     if (filename) free(filename);
 
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void rawRomFsReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     RomFsThreadData *romfs_thread_data = (RomFsThreadData*)arg;
     SharedThreadData *shared_thread_data = &(romfs_thread_data->shared_thread_data);
     RomFileSystemContext *romfs_ctx = romfs_thread_data->romfs_ctx;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !romfs_ctx || !buf1 || !buf2)
+    if (!shared_thread_data->total_size || !romfs_ctx)
     {
         shared_thread_data->read_error = true;
         goto end;
     }
 
-    shared_thread_data->data = NULL;
-    shared_thread_data->data_size = 0;
-
     for(u64 offset = 0, blksize = BLOCK_SIZE; offset < shared_thread_data->total_size; offset += blksize)
     {
         if (blksize > (shared_thread_data->total_size - offset)) blksize = (shared_thread_data->total_size - offset);
@@ -5525,52 +6284,32 @@ static void rawRomFsReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
+        /* Wait until a ring slot is available. */
+        if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
         /* Read current data chunk */
-        shared_thread_data->read_error = !romfsReadFileSystemData(romfs_ctx, buf1, blksize, offset);
+        shared_thread_data->read_error = !romfsReadFileSystemData(romfs_ctx, buf, blksize, offset);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
-            break;
-        }
-
-        /* Wait until the previous data chunk has been written */
-        mutexLock(&g_fileMutex);
-
-        if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-        if (shared_thread_data->write_error)
-        {
-            mutexUnlock(&g_fileMutex);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
-        /* Update shared object. */
-        shared_thread_data->data = buf1;
-        shared_thread_data->data_size = blksize;
-
-        /* Swap buffers. */
-        buf1 = buf2;
-        buf2 = shared_thread_data->data;
-
-        /* Wake up the write thread to continue writing data. */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_writeCondvar);
+        /* Hand the current data chunk over to the write thread. */
+        dumpRingCommit(&(shared_thread_data->ring), blksize);
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void extractedRomFsReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     RomFsThreadData *romfs_thread_data = (RomFsThreadData*)arg;
     SharedThreadData *shared_thread_data = &(romfs_thread_data->shared_thread_data);
 
@@ -5591,9 +6330,6 @@ static void extractedRomFsReadThreadFunc(void *arg)
     u32 dev_idx = g_storageMenuElementOption.selected;
     u8 romfs_illegal_char_replace_type = (dev_idx != 0 ? RomFileSystemPathIllegalCharReplaceType_IllegalFsChars : RomFileSystemPathIllegalCharReplaceType_KeepAsciiCharsOnly);
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
     if (romfs_thread_data->use_layeredfs_dir)
     {
         /* Only use base title IDs if we're dealing with patches. */
@@ -5611,7 +6347,7 @@ static void extractedRomFsReadThreadFunc(void *arg)
 
     filename_len = (filename ? strlen(filename) : 0);
 
-    if (!shared_thread_data->total_size || !buf1 || !buf2 || !filename)
+    if (!shared_thread_data->total_size || !filename)
     {
         shared_thread_data->read_error = true;
         goto end;
@@ -5642,7 +6378,7 @@ static void extractedRomFsReadThreadFunc(void *arg)
 
     if (shared_thread_data->read_error)
     {
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
         goto end;
     }
 
@@ -5652,18 +6388,14 @@ static void extractedRomFsReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user. */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         if (dev_idx != 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Close file. */
             if (shared_thread_data->fp)
@@ -5679,18 +6411,14 @@ static void extractedRomFsReadThreadFunc(void *arg)
                                            !romfsGeneratePathFromFileEntry(romfs_ctx, romfs_file_entry, romfs_path + filename_len, sizeof(romfs_path) - filename_len, romfs_illegal_char_replace_type));
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         if (dev_idx == 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Send current file properties */
             shared_thread_data->read_error = !usbSendFileProperties(romfs_file_entry->size, romfs_path);
@@ -5732,7 +6460,7 @@ static void extractedRomFsReadThreadFunc(void *arg)
 
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -5743,40 +6471,23 @@ static void extractedRomFsReadThreadFunc(void *arg)
             /* Check if the transfer has been cancelled by the user. */
             if (shared_thread_data->transfer_cancelled)
             {
-                condvarWakeAll(&g_writeCondvar);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
+            /* Wait until a ring slot is available. */
+            if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
             /* Read current file data chunk. */
-            shared_thread_data->read_error = !romfsReadFileEntryData(romfs_ctx, romfs_file_entry, buf1, blksize, offset);
+            shared_thread_data->read_error = !romfsReadFileEntryData(romfs_ctx, romfs_file_entry, buf, blksize, offset);
             if (shared_thread_data->read_error)
             {
-                condvarWakeAll(&g_writeCondvar);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
-            /* Wait until the previous file data chunk has been written. */
-            mutexLock(&g_fileMutex);
-
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-            if (shared_thread_data->write_error)
-            {
-                mutexUnlock(&g_fileMutex);
-                break;
-            }
-
-            /* Update shared object. */
-            shared_thread_data->data = buf1;
-            shared_thread_data->data_size = blksize;
-
-            /* Swap buffers. */
-            buf1 = buf2;
-            buf2 = shared_thread_data->data;
-
-            /* Wake up the write thread to continue writing data. */
-            mutexUnlock(&g_fileMutex);
-            condvarWakeAll(&g_writeCondvar);
+            /* Hand the current data chunk over to the write thread. */
+            dumpRingCommit(&(shared_thread_data->ring), blksize);
         }
 
         if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
@@ -5787,14 +6498,17 @@ static void extractedRomFsReadThreadFunc(void *arg)
 
     if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
     {
-        /* Wait until the previous file data chunk has been written. */
-        mutexLock(&g_fileMutex);
-        if (shared_thread_data->data_size) condvarWait(&g_readCondvar, &g_fileMutex);
-        mutexUnlock(&g_fileMutex);
+        /* Wait until all queued file data chunks have been written. */
+        if (!dumpRingDrain(&(shared_thread_data->ring))) goto end;
 
-        if (dev_idx == 1) usbEndExtractedFsDump();
+        shared_thread_data->write_error = (dev_idx == 1 && !usbEndExtractedFsDump());
+        if (!shared_thread_data->write_error)
+        {
+            consolePrint("successfully saved extracted romfs section data to \"%s\"\n", filename);
+        } else {
+            consolePrint("failed to send last file batch to host\n");
+        }
 
-        consolePrint("successfully saved extracted romfs section data to \"%s\"\n", filename);
         consoleRefresh();
     }
 
@@ -5813,31 +6527,22 @@ end:
 
     if (filename) free(filename);
 
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void fsBrowserFileReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     FsBrowserFileThreadData *fs_browser_thread_data = (FsBrowserFileThreadData*)arg;
     SharedThreadData *shared_thread_data = &(fs_browser_thread_data->shared_thread_data);
     FILE *src = fs_browser_thread_data->src;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !src || !buf1 || !buf2)
+    if (!shared_thread_data->total_size || !src)
     {
         shared_thread_data->read_error = true;
         goto end;
     }
 
-    shared_thread_data->data = NULL;
-    shared_thread_data->data_size = 0;
-
     for(u64 offset = 0, blksize = BLOCK_SIZE; offset < shared_thread_data->total_size; offset += blksize)
     {
         if (blksize > (shared_thread_data->total_size - offset)) blksize = (shared_thread_data->total_size - offset);
@@ -5845,52 +6550,31 @@ static void fsBrowserFileReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
+        /* Wait until a ring slot is available. */
+        if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
         /* Read current data chunk */
-        shared_thread_data->read_error = (fread(buf1, 1, blksize, src) != blksize);
+        shared_thread_data->read_error = (fread(buf, 1, blksize, src) != blksize);
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
-            break;
-        }
-
-        /* Wait until the previous data chunk has been written */
-        mutexLock(&g_fileMutex);
-
-        if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-        if (shared_thread_data->write_error)
-        {
-            mutexUnlock(&g_fileMutex);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
-        /* Update shared object. */
-        shared_thread_data->data = buf1;
-        shared_thread_data->data_size = blksize;
-
-        /* Swap buffers. */
-        buf1 = buf2;
-        buf2 = shared_thread_data->data;
-
-        /* Wake up the write thread to continue writing data. */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_writeCondvar);
+        /* Hand the current data chunk over to the write thread. */
+        dumpRingCommit(&(shared_thread_data->ring), blksize);
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
 static void fsBrowserHighlightedEntriesReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
     FsBrowserHighlightedEntriesThreadData *fs_browser_thread_data = (FsBrowserHighlightedEntriesThreadData*)arg;
     SharedThreadData *shared_thread_data = &(fs_browser_thread_data->shared_thread_data);
 
@@ -5901,10 +6585,7 @@ static void fsBrowserHighlightedEntriesReadThreadFunc(void *arg)
 
     u32 dev_idx = g_storageMenuElementOption.selected;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
-    if (!shared_thread_data->total_size || !dir_path || !*dir_path || !entries || !entries_count || !base_out_path || !*base_out_path || !buf1 || !buf2)
+    if (!shared_thread_data->total_size || !dir_path || !*dir_path || !entries || !entries_count || !base_out_path || !*base_out_path)
     {
         shared_thread_data->read_error = true;
         goto end;
@@ -5936,28 +6617,31 @@ static void fsBrowserHighlightedEntriesReadThreadFunc(void *arg)
     if (!shared_thread_data->read_error)
     {
         /* Dump highlighted entries. */
-        fsBrowserHighlightedEntriesReadThreadLoop(shared_thread_data, dir_path, entries, entries_count, base_out_path, buf1, buf2);
+        fsBrowserHighlightedEntriesReadThreadLoop(shared_thread_data, dir_path, entries, entries_count, base_out_path);
 
         if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
         {
-            if (dev_idx == 1) usbEndExtractedFsDump();
+            shared_thread_data->write_error = (dev_idx == 1 && !usbEndExtractedFsDump());
+            if (!shared_thread_data->write_error)
+            {
+                consolePrint("successfully saved dumped data to \"%s\"\n", base_out_path);
+            } else {
+                consolePrint("failed to send last file batch to host\n");
+            }
 
-            consolePrint("successfully saved dumped data to \"%s\"\n", base_out_path);
             consoleRefresh();
         }
     } else {
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
     }
 
 end:
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
-
     threadExit();
 }
 
-static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_thread_data, const char *dir_path, const FsBrowserEntry *entries, u32 entries_count, const char *base_out_path, void *buf1, void *buf2)
+static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_thread_data, const char *dir_path, const FsBrowserEntry *entries, u32 entries_count, const char *base_out_path)
 {
+    void *buf = NULL;
     bool append_path_sep = (dir_path[strlen(dir_path) - 1] != '/');
     u32 dev_idx = g_storageMenuElementOption.selected;
     bool is_topmost = (entries && entries_count); /* If entry data is provided, it means we're dealing with the topmost directory. */
@@ -5971,14 +6655,14 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
     if ((shared_thread_data->read_error = (tmp_path == NULL)))
     {
         consolePrint("failed to allocate memory for path!\n");
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
         goto end;
     }
 
     /* Get directory entries, if needed. */
     if (!is_topmost && (shared_thread_data->read_error = !fsBrowserGetDirEntries(dir_path, (FsBrowserEntry**)&entries, &entries_count)))
     {
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
         goto end;
     }
 
@@ -5992,18 +6676,14 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
         /* Check if the transfer has been cancelled by the user. */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         if (dev_idx != 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Close file. */
             if (shared_thread_data->fp)
@@ -6020,7 +6700,7 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
         if (entry->dt.d_type == DT_DIR)
         {
             /* Dump directory. */
-            if (!fsBrowserHighlightedEntriesReadThreadLoop(shared_thread_data, tmp_path, NULL, 0, base_out_path, buf1, buf2)) break;
+            if (!fsBrowserHighlightedEntriesReadThreadLoop(shared_thread_data, tmp_path, NULL, 0, base_out_path)) break;
             continue;
         }
 
@@ -6029,7 +6709,7 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
         if ((shared_thread_data->read_error = (src == NULL)))
         {
             consolePrint("failed to open file \"%s\" for reading!\n", tmp_path);
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -6045,12 +6725,8 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
 
         if (dev_idx == 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Send current file properties */
             shared_thread_data->read_error = !usbSendFileProperties(entry->size, tmp_path);
@@ -6092,7 +6768,7 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
 
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -6104,40 +6780,23 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
             /* Check if the transfer has been cancelled by the user. */
             if (shared_thread_data->transfer_cancelled)
             {
-                condvarWakeAll(&g_writeCondvar);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
+            /* Wait until a ring slot is available. */
+            if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
             /* Read current file data chunk. */
-            shared_thread_data->read_error = (fread(buf1, 1, blksize, src) != blksize);
+            shared_thread_data->read_error = (fread(buf, 1, blksize, src) != blksize);
             if (shared_thread_data->read_error)
             {
-                condvarWakeAll(&g_writeCondvar);
-                break;
-            }
-
-            /* Wait until the previous file data chunk has been written. */
-            mutexLock(&g_fileMutex);
-
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-
-            if (shared_thread_data->write_error)
-            {
-                mutexUnlock(&g_fileMutex);
+                dumpRingAbort(&(shared_thread_data->ring));
                 break;
             }
 
-            /* Update shared object. */
-            shared_thread_data->data = buf1;
-            shared_thread_data->data_size = blksize;
-
-            /* Swap buffers. */
-            buf1 = buf2;
-            buf2 = shared_thread_data->data;
-
-            /* Wake up the write thread to continue writing data. */
-            mutexUnlock(&g_fileMutex);
-            condvarWakeAll(&g_writeCondvar);
+            /* Hand the current data chunk over to the write thread. */
+            dumpRingCommit(&(shared_thread_data->ring), blksize);
         }
 
         /* Close input file. */
@@ -6149,10 +6808,8 @@ static bool fsBrowserHighlightedEntriesReadThreadLoop(SharedThreadData *shared_t
 
     if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
     {
-        /* Wait until the previous file data chunk has been written. */
-        mutexLock(&g_fileMutex);
-        if (shared_thread_data->data_size) condvarWait(&g_readCondvar, &g_fileMutex);
-        mutexUnlock(&g_fileMutex);
+        /* Wait until all queued file data chunks have been written. */
+        if (!dumpRingDrain(&(shared_thread_data->ring))) goto end;
     }
 
 end:
@@ -6179,7 +6836,7 @@ end:
 
 static void systemUpdateReadThreadFunc(void *arg)
 {
-    void *buf1 = NULL, *buf2 = NULL;
+    void *buf = NULL;
     SystemUpdateThreadData *sys_upd_thread_data = (SystemUpdateThreadData*)arg;
     SharedThreadData *shared_thread_data = &(sys_upd_thread_data->shared_thread_data);
 
@@ -6194,15 +6851,12 @@ static void systemUpdateReadThreadFunc(void *arg)
     u64 nca_filesize = 0;
     char *nca_filename = NULL;
 
-    buf1 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-    buf2 = usbAllocatePageAlignedBuffer(BLOCK_SIZE);
-
     snprintf(sys_upd_path, MAX_ELEMENTS(sys_upd_path), "/%.*s (%s)", (int)sizeof(sys_upd_dump_ctx->version_file.display_title),
                                                                      sys_upd_dump_ctx->version_file.display_title, utilsIsDevelopmentUnit() ? "Dev" : "Prod");
     filename = generateOutputGameCardFileName(SYSTEM_UPDATE_SUBDIR, sys_upd_path, false);
     filename_len = (filename ? strlen(filename) : 0);
 
-    if (!shared_thread_data->total_size || !buf1 || !buf2 || !filename)
+    if (!shared_thread_data->total_size || !filename)
     {
         shared_thread_data->read_error = true;
         goto end;
@@ -6233,7 +6887,7 @@ static void systemUpdateReadThreadFunc(void *arg)
 
     if (shared_thread_data->read_error)
     {
-        condvarWakeAll(&g_writeCondvar);
+        dumpRingAbort(&(shared_thread_data->ring));
         goto end;
     }
 
@@ -6249,18 +6903,14 @@ static void systemUpdateReadThreadFunc(void *arg)
         /* Check if the transfer has been cancelled by the user. */
         if (shared_thread_data->transfer_cancelled)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
         if (dev_idx != 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Close file. */
             if (shared_thread_data->fp)
@@ -6276,7 +6926,7 @@ static void systemUpdateReadThreadFunc(void *arg)
                                           !(nca_filename = systemUpdateGetCurrentContentFileNameFromDumpContext(sys_upd_dump_ctx)));
         if (shared_thread_data->read_error)
         {
-            condvarWakeAll(&g_writeCondvar);
+            dumpRingAbort(&(shared_thread_data->ring));
             break;
         }
 
@@ -6286,12 +6936,8 @@ static void systemUpdateReadThreadFunc(void *arg)
 
         if (dev_idx == 1)
         {
-            /* Wait until the previous data chunk has been written */
-            mutexLock(&g_fileMutex);
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
-            mutexUnlock(&g_fileMutex);
-
-            if (shared_thread_data->write_error) break;
+            /* Wait until all queued data chunks have been written. */
+            if (!dumpRingDrain(&(shared_thread_data->ring))) break;
 
             /* Send current file properties */
             shared_thread_data->read_error = !usbSendFileProperties(nca_filesize, sys_upd_path);
@@ -6331,242 +6977,1129 @@ static void systemUpdateReadThreadFunc(void *arg)
             }
         }
 
-        if (shared_thread_data->read_error)
-        {
-            condvarWakeAll(&g_writeCondvar);
-            break;
-        }
+        if (shared_thread_data->read_error)
+        {
+            dumpRingAbort(&(shared_thread_data->ring));
+            break;
+        }
+
+        for(u64 offset = 0, blksize = BLOCK_SIZE; offset < nca_filesize; offset += blksize)
+        {
+            if (blksize > (nca_filesize - offset)) blksize = (nca_filesize - offset);
+
+            /* Check if the transfer has been cancelled by the user. */
+            if (shared_thread_data->transfer_cancelled)
+            {
+                dumpRingAbort(&(shared_thread_data->ring));
+                break;
+            }
+
+            /* Wait until a ring slot is available. */
+            if (!(buf = dumpRingAcquire(&(shared_thread_data->ring)))) break;
+
+            /* Read current file data chunk. */
+            shared_thread_data->read_error = !systemUpdateReadCurrentContentFileFromDumpContext(sys_upd_dump_ctx, buf, blksize);
+            if (shared_thread_data->read_error)
+            {
+                dumpRingAbort(&(shared_thread_data->ring));
+                break;
+            }
+
+            /* Hand the current data chunk over to the write thread. */
+            dumpRingCommit(&(shared_thread_data->ring), blksize);
+        }
+
+        if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
+    }
+
+    if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
+    {
+        /* Wait until all queued file data chunks have been written. */
+        if (!dumpRingDrain(&(shared_thread_data->ring))) goto end;
+
+        shared_thread_data->write_error = (dev_idx == 1 && !usbEndExtractedFsDump());
+        shared_thread_data->read_error = (!shared_thread_data->write_error && !systemUpdateIsDumpContextFinished(sys_upd_dump_ctx));
+
+        if (shared_thread_data->write_error)
+        {
+            consolePrint("failed to send last file batch to host\n");
+        } else
+        if (shared_thread_data->read_error)
+        {
+            consolePrint("unexpected sys upd dump ctx error\n");
+        } else {
+            consolePrint("successfully saved system update data to \"%s\"\n", filename);
+        }
+
+        consoleRefresh();
+    }
+
+end:
+    if (shared_thread_data->fp)
+    {
+        fclose(shared_thread_data->fp);
+        shared_thread_data->fp = NULL;
+
+        if ((shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) && dev_idx != 1)
+        {
+            utilsDeleteDirectoryRecursively(filename);
+            if (dev_idx == 0) utilsCommitSdCardFileSystemChanges();
+        }
+    }
+
+    if (nca_filename) free(nca_filename);
+
+    if (filename) free(filename);
+
+    threadExit();
+}
+
+static void gameCardTeeWriteThreadFunc(void *arg)
+{
+    GameCardTeeThreadData *tee_thread_data = (GameCardTeeThreadData*)arg;
+    SharedThreadData *shared_thread_data = &(tee_thread_data->xci_thread_data.shared_thread_data);
+    u32 dev_idx = g_storageMenuElementOption.selected;
+
+    while(shared_thread_data->data_written < shared_thread_data->total_size)
+    {
+        void *data = NULL;
+        size_t data_size = 0;
+
+        /* Wait until the current data chunk has been read */
+        if (!dumpRingPeek(&(shared_thread_data->ring), &data, &data_size) || shared_thread_data->read_error || shared_thread_data->transfer_cancelled) break;
+
+        /* Fan out the current data chunk to every sink it overlaps with. */
+        u64 blk_start = shared_thread_data->data_written, blk_end = (blk_start + data_size);
+
+        for(u32 i = 0; i < tee_thread_data->sink_count && !shared_thread_data->write_error; i++)
+        {
+            GameCardTeeSink *sink = &(tee_thread_data->sinks[i]);
+
+            u64 start = MAX(blk_start, sink->offset), end = MIN(blk_end, sink->offset + sink->size);
+            if (start >= end) continue;
+
+            u64 write_size = (end - start);
+
+            /* Open the output file as soon as we reach its data. */
+            if (!sink->fp && !sink->written && !gameCardTeeOpenSink(sink))
+            {
+                shared_thread_data->write_error = true;
+                break;
+            }
+
+            shared_thread_data->write_error = (fwrite((u8*)data + (start - blk_start), 1, write_size, sink->fp) != write_size);
+            if (shared_thread_data->write_error)
+            {
+                consolePrint("failed to write 0x%lX byte(s) to \"%s\"!\n", write_size, sink->path);
+                break;
+            }
+
+            sink->written += write_size;
+
+            /* Close the output file as soon as we're done with it. This keeps the number of simultaneously opened files low. */
+            if (sink->written == sink->size)
+            {
+                fclose(sink->fp);
+                sink->fp = NULL;
+                if (dev_idx == 0) utilsCommitSdCardFileSystemChanges();
+            }
+        }
+
+        if (shared_thread_data->write_error) break;
+
+        /* Give the buffer back to the read thread. */
+        shared_thread_data->data_written += data_size;
+        dumpRingConsume(&(shared_thread_data->ring));
+        dumpRingRelease(&(shared_thread_data->ring));
+    }
+
+    /* Wake up the read thread if we bailed out early. */
+    if (shared_thread_data->data_written < shared_thread_data->total_size) dumpRingAbort(&(shared_thread_data->ring));
+
+    threadExit();
+}
+
+static void genericWriteThreadFunc(void *arg)
+{
+    SharedThreadData *shared_thread_data = (SharedThreadData*)arg; // UB but we don't care
+    DumpRing *ring = &(shared_thread_data->ring);
+
+    while(shared_thread_data->data_written < shared_thread_data->total_size)
+    {
+        void *data = NULL;
+        size_t data_size = 0;
+
+        /* Buffers sent to the USB host are only given back once they have been received, which is checked while sending more data. */
+        /* Wait for them if the read thread hasn't committed anything else yet, so it doesn't run out of buffers. */
+        if (useUsbHost() && dumpRingIsConsumed(ring) && !dumpRingIsEmpty(ring)) usbFlushFileData();
+
+        /* Wait until the current file data chunk has been read */
+        if (!dumpRingPeek(&(shared_thread_data->ring), &data, &data_size) || shared_thread_data->read_error || shared_thread_data->transfer_cancelled || \
+            (!useUsbHost() && !shared_thread_data->fp)) break;
+
+        /* Write current file data chunk */
+        if (useUsbHost())
+        {
+            /* Ring buffers are page aligned, so we can skip the copy to the USB transfer queue. The read thread fills the other slots in the meantime. */
+            /* The buffer is given back to the read thread by the USB interface, once the USB host has received it. */
+            UsbFileDataFragment fragment = { .data = data, .size = data_size, .release = dumpRingReleaseCallback, .userdata = ring };
+            dumpRingConsume(ring);
+            shared_thread_data->write_error = !usbSendFileDataV(&fragment, 1);
+        } else {
+            shared_thread_data->write_error = (fwrite(data, 1, data_size, shared_thread_data->fp) != data_size);
+            if (!shared_thread_data->write_error)
+            {
+                dumpRingConsume(ring);
+                dumpRingRelease(ring);
+            }
+        }
+
+        if (shared_thread_data->write_error) break;
+
+        shared_thread_data->data_written += data_size;
+    }
+
+    if (shared_thread_data->data_written < shared_thread_data->total_size)
+    {
+        /* Ring buffers still held by the USB interface must be given back before the ring is freed, so the file transfer is always cancelled. */
+        if (useUsbHost()) usbCancelFileTransfer();
+
+        /* Wake up the read thread if we bailed out early. */
+        dumpRingAbort(&(shared_thread_data->ring));
+    }
+
+    threadExit();
+}
+
+static bool dumpRingInitialize(DumpRing *ring, u32 slot_count)
+{
+    if (!ring || slot_count < 2 || slot_count > DUMP_RING_MAX_SLOT_COUNT) return false;
+
+    memset(ring, 0, sizeof(DumpRing));
+
+    for(u32 i = 0; i < slot_count; i++)
+    {
+        if (!(ring->slots[i] = usbAllocatePageAlignedBuffer(BLOCK_SIZE)))
+        {
+            dumpRingFree(ring);
+            return false;
+        }
+
+        ring->slot_count++;
+    }
+
+    mutexInit(&(ring->mutex));
+    condvarInit(&(ring->producer_condvar));
+    condvarInit(&(ring->consumer_condvar));
+
+    return true;
+}
+
+static void dumpRingFree(DumpRing *ring)
+{
+    if (!ring) return;
+
+    for(u32 i = 0; i < ring->slot_count; i++)
+    {
+        if (ring->slots[i]) free(ring->slots[i]);
+        ring->slots[i] = NULL;
+    }
+
+    ring->slot_count = 0;
+}
+
+static bool dumpRingIsFull(DumpRing *ring)
+{
+    return ((__atomic_load_n(&(ring->head), __ATOMIC_SEQ_CST) - __atomic_load_n(&(ring->tail), __ATOMIC_SEQ_CST)) >= ring->slot_count);
+}
+
+static bool dumpRingIsEmpty(DumpRing *ring)
+{
+    return (__atomic_load_n(&(ring->head), __ATOMIC_SEQ_CST) == __atomic_load_n(&(ring->tail), __ATOMIC_SEQ_CST));
+}
+
+static bool dumpRingIsConsumed(DumpRing *ring)
+{
+    return (__atomic_load_n(&(ring->head), __ATOMIC_SEQ_CST) == __atomic_load_n(&(ring->read), __ATOMIC_SEQ_CST));
+}
+
+static bool dumpRingIsAborted(DumpRing *ring)
+{
+    return __atomic_load_n(&(ring->aborted), __ATOMIC_SEQ_CST);
+}
+
+static bool dumpRingProducerWait(DumpRing *ring, bool (*done)(DumpRing*))
+{
+    if (done(ring) || dumpRingIsAborted(ring)) return !dumpRingIsAborted(ring);
+
+    u64 start_tick = armGetSystemTick();
+
+    /* The waiting flag is set before checking the ring state once more, so the consumer either sees it or we see its update. */
+    mutexLock(&(ring->mutex));
+    __atomic_store_n(&(ring->producer_waiting), true, __ATOMIC_SEQ_CST);
+    while(!done(ring) && !dumpRingIsAborted(ring)) condvarWait(&(ring->producer_condvar), &(ring->mutex));
+    __atomic_store_n(&(ring->producer_waiting), false, __ATOMIC_SEQ_CST);
+    mutexUnlock(&(ring->mutex));
+
+    ring->producer_stall_count++;
+    ring->producer_stall_ticks += (armGetSystemTick() - start_tick);
+
+    return !dumpRingIsAborted(ring);
+}
+
+static bool dumpRingIsNotFull(DumpRing *ring)
+{
+    return !dumpRingIsFull(ring);
+}
+
+static void *dumpRingAcquire(DumpRing *ring)
+{
+    if (!dumpRingProducerWait(ring, dumpRingIsNotFull)) return NULL;
+    return ring->slots[ring->head % ring->slot_count];
+}
+
+static void dumpRingCommit(DumpRing *ring, size_t size)
+{
+    ring->slot_sizes[ring->head % ring->slot_count] = size;
+    __atomic_store_n(&(ring->head), ring->head + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&(ring->consumer_waiting), __ATOMIC_SEQ_CST))
+    {
+        mutexLock(&(ring->mutex));
+        condvarWakeAll(&(ring->consumer_condvar));
+        mutexUnlock(&(ring->mutex));
+    }
+}
+
+static bool dumpRingDrain(DumpRing *ring)
+{
+    return dumpRingProducerWait(ring, dumpRingIsEmpty);
+}
+
+static bool dumpRingPeek(DumpRing *ring, void **out_data, size_t *out_size)
+{
+    if (dumpRingIsConsumed(ring) && !dumpRingIsAborted(ring))
+    {
+        u64 start_tick = armGetSystemTick();
+
+        mutexLock(&(ring->mutex));
+        __atomic_store_n(&(ring->consumer_waiting), true, __ATOMIC_SEQ_CST);
+        while(dumpRingIsConsumed(ring) && !dumpRingIsAborted(ring)) condvarWait(&(ring->consumer_condvar), &(ring->mutex));
+        __atomic_store_n(&(ring->consumer_waiting), false, __ATOMIC_SEQ_CST);
+        mutexUnlock(&(ring->mutex));
+
+        ring->consumer_stall_count++;
+        ring->consumer_stall_ticks += (armGetSystemTick() - start_tick);
+    }
+
+    if (dumpRingIsAborted(ring)) return false;
+
+    u32 idx = (ring->read % ring->slot_count);
+    *out_data = ring->slots[idx];
+    *out_size = ring->slot_sizes[idx];
+
+    return true;
+}
+
+static void dumpRingConsume(DumpRing *ring)
+{
+    __atomic_store_n(&(ring->read), ring->read + 1, __ATOMIC_SEQ_CST);
+}
+
+static void dumpRingRelease(DumpRing *ring)
+{
+    /* Data chunks are always released in order, but not necessarily by the consumer thread. */
+    __atomic_add_fetch(&(ring->tail), 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&(ring->producer_waiting), __ATOMIC_SEQ_CST))
+    {
+        mutexLock(&(ring->mutex));
+        condvarWakeAll(&(ring->producer_condvar));
+        mutexUnlock(&(ring->mutex));
+    }
+}
+
+static void dumpRingReleaseCallback(void *userdata)
+{
+    dumpRingRelease((DumpRing*)userdata);
+}
+
+static void dumpRingAbort(DumpRing *ring)
+{
+    mutexLock(&(ring->mutex));
+    __atomic_store_n(&(ring->aborted), true, __ATOMIC_SEQ_CST);
+    condvarWakeAll(&(ring->producer_condvar));
+    condvarWakeAll(&(ring->consumer_condvar));
+    mutexUnlock(&(ring->mutex));
+}
+
+static bool spanDumpThreads(ThreadFunc read_func, ThreadFunc write_func, void *arg)
+{
+    SharedThreadData *shared_thread_data = (SharedThreadData*)arg; // UB but we don't care
+    Thread read_thread = {0}, write_thread = {0};
+
+    time_t start = 0, btn_cancel_start_tmr = 0, btn_cancel_end_tmr = 0;
+    bool btn_cancel_cur_state = false, btn_cancel_prev_state = false, success = false;
+
+    u64 prev_size = 0;
+    u8 prev_time = 0, percent = 0;
+
+    DumpRing *ring = &(shared_thread_data->ring);
+
+    if (!dumpRingInitialize(ring, DUMP_RING_SLOT_COUNT))
+    {
+        consolePrint("failed to allocate dump ring buffers\n");
+        return false;
+    }
+
+    consolePrint("creating threads\n");
+    utilsCreateThread(&read_thread, read_func, arg, 2);
+    utilsCreateThread(&write_thread, write_func, arg, 2);
+
+    consolePrint("hold b to cancel\n\n");
+    consoleRefresh();
+
+    start = time(NULL);
+
+    while(shared_thread_data->data_written < shared_thread_data->total_size)
+    {
+        g_appletStatus = appletMainLoop();
+        if (!g_appletStatus)
+        {
+            mutexLock(&g_fileMutex);
+            shared_thread_data->transfer_cancelled = true;
+            mutexUnlock(&g_fileMutex);
+        }
+
+        if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
+
+        struct tm ts = {0};
+        time_t now = time(NULL);
+        localtime_r(&now, &ts);
+
+        size_t size = shared_thread_data->data_written;
+
+        utilsScanPads();
+        btn_cancel_cur_state = (utilsGetButtonsHeld() & HidNpadButton_B);
+
+        if (btn_cancel_cur_state && btn_cancel_cur_state != btn_cancel_prev_state)
+        {
+            btn_cancel_start_tmr = now;
+        } else
+        if (btn_cancel_cur_state && btn_cancel_cur_state == btn_cancel_prev_state)
+        {
+            btn_cancel_end_tmr = now;
+            if ((btn_cancel_end_tmr - btn_cancel_start_tmr) >= 3)
+            {
+                mutexLock(&g_fileMutex);
+                shared_thread_data->transfer_cancelled = true;
+                mutexUnlock(&g_fileMutex);
+                break;
+            }
+        } else {
+            btn_cancel_start_tmr = btn_cancel_end_tmr = 0;
+        }
+
+        btn_cancel_prev_state = btn_cancel_cur_state;
+
+        if (prev_time == ts.tm_sec || prev_size == size) continue;
+
+        percent = (u8)((size * 100) / shared_thread_data->total_size);
+
+        prev_time = ts.tm_sec;
+        prev_size = size;
+
+        consolePrint("%lu / %lu (%u%%) | Time elapsed: %lu\n", size, shared_thread_data->total_size, percent, (now - start));
+        consoleRefresh();
+
+        utilsAppletLoopDelay();
+    }
+
+    /* Wake up any thread waiting on the ring if the process didn't finish. */
+    if (shared_thread_data->data_written < shared_thread_data->total_size) dumpRingAbort(ring);
+
+    consolePrint("\nwaiting for threads to join\n");
+    consoleRefresh();
+
+    utilsJoinThread(&read_thread);
+    consolePrint("read_thread done: %lu\n", time(NULL));
+
+    utilsJoinThread(&write_thread);
+    consolePrint("write_thread done: %lu\n", time(NULL));
+
+    consolePrint("ring slots: %u | read thread stalls: %lu (%lu ms) | write thread stalls: %lu (%lu ms)\n", ring->slot_count, \
+                 ring->producer_stall_count, armTicksToNs(ring->producer_stall_ticks) / 1000000, ring->consumer_stall_count, armTicksToNs(ring->consumer_stall_ticks) / 1000000);
+
+    dumpRingFree(ring);
+
+    if (shared_thread_data->read_error || shared_thread_data->write_error)
+    {
+        consolePrint("i/o error\n");
+    } else
+    if (shared_thread_data->transfer_cancelled)
+    {
+        consolePrint("process cancelled\n");
+    } else {
+        start = (time(NULL) - start);
+        consolePrint("process completed in %lu seconds\n", start);
+        success = true;
+    }
+
+    consoleRefresh();
+
+    return success;
+}
+
+static bool nspProcessNcaChunk(NcaContext *nca_ctx, FILE *src_fp, ContentMetaContext *cnmt_ctx, void *buf, u64 blksize, u64 offset, bool *dirty_header, Sha256Context *clean_sha256_ctx, Sha256Context *dirty_sha256_ctx)
+{
+    // read nca chunk
+    // chunks are always processed in order, so there's no need to seek within the source file
+    if ((src_fp && fread(buf, 1, blksize, src_fp) != blksize) || (!src_fp && !ncaReadContentFile(nca_ctx, buf, blksize, offset)))
+    {
+        consolePrint("nca read failed at 0x%lX for \"%s\"\n", offset, nca_ctx->content_id_str);
+        return false;
+    }
+
+    // update clean hash calculation
+    sha256ContextUpdate(clean_sha256_ctx, buf, blksize);
+
+    if (*dirty_header)
+    {
+        // write re-encrypted headers
+        if (!nca_ctx->header_written) ncaWriteEncryptedHeaderDataToMemoryBuffer(nca_ctx, buf, blksize, offset);
+
+        if (nca_ctx->content_type_ctx_patch)
+        {
+            // write content type context patch
+            switch(nca_ctx->content_type)
+            {
+                case NcmContentType_Meta:
+                    if (cnmt_ctx) cnmtWriteNcaPatch(cnmt_ctx, buf, blksize, offset);
+                    break;
+                case NcmContentType_Control:
+                    nacpWriteNcaPatch((NacpContext*)nca_ctx->content_type_ctx, buf, blksize, offset);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // update flag to avoid entering this code block if it's not needed anymore
+        *dirty_header = (!nca_ctx->header_written || nca_ctx->content_type_ctx_patch);
+    }
+
+    // update dirty hash calculation
+    sha256ContextUpdate(dirty_sha256_ctx, buf, blksize);
+
+    return true;
+}
+
+static char *generateContentStorePath(const char *filename, const char *extension)
+{
+    char *prefix = NULL, *output = NULL;
+    u32 dev_idx = g_storageMenuElementOption.selected;
+
+    if (dev_idx == 1 || !filename || !*filename)
+    {
+        consolePrint("failed to generate content store filename!\n");
+        goto end;
+    }
+
+    prefix = calloc(sizeof(char), FS_MAX_PATH);
+    if (!prefix)
+    {
+        consolePrint("failed to generate prefix!\n");
+        goto end;
+    }
+
+    sprintf(prefix, "%s/" OUTDIR "/" NSP_CONTENT_STORE_SUBDIR, dev_idx == 0 ? DEVOPTAB_SDMC_DEVICE : g_umsDevices[dev_idx - 2].name);
+
+    output = utilsGeneratePath(prefix, filename, extension);
+    if (!output) consolePrint("failed to generate content store filename!\n");
+
+end:
+    if (prefix) free(prefix);
+
+    return output;
+}
+
+static NspContentStoreEntry *nspContentStoreInitialize(NcaContext *nca_ctx, u32 nca_count, ContentMetaContext *cnmt_ctx, const bool *skip)
+{
+    NspContentStoreEntry *entries = NULL;
+    u32 dev_idx = g_storageMenuElementOption.selected, stored_count = 0, added_count = 0;
+    bool split_large_files = (dev_idx == 0 || g_umsDevices[dev_idx - 2].fs_type < UsbHsFsDeviceFileSystemType_exFAT);
+    char hash_str[SHA256_HASH_STR_SIZE] = {0};
+
+    if (!(entries = calloc(nca_count, sizeof(NspContentStoreEntry))))
+    {
+        consolePrint("content store entries calloc failed\n");
+        return NULL;
+    }
+
+    for(u32 i = 0; i < nca_count; i++)
+    {
+        NcaContext *cur_nca_ctx = &(nca_ctx[i]);
+        NspContentStoreEntry *entry = &(entries[i]);
+        NcmPackagedContentInfo *packaged_content_info = NULL;
+        struct stat st = {0};
+
+        // only ncas written without modifications can be shared across nsp dumps
+        // ncas that would need to be split are skipped as well, since content store files are always written as a single file
+        if ((skip && skip[i]) || cur_nca_ctx->content_type == NcmContentType_Meta || ncaIsHeaderDirty(cur_nca_ctx) || cur_nca_ctx->content_type_ctx_patch || \
+            (split_large_files && cur_nca_ctx->content_size > FAT32_FILESIZE_LIMIT) || \
+            !(packaged_content_info = cnmtGetPackagedContentInfoByContentId(cnmt_ctx, &(cur_nca_ctx->content_id)))) continue;
+
+        entry->eligible = true;
+        memcpy(entry->hash, packaged_content_info->hash, SHA256_HASH_SIZE);
+        utilsGenerateHexString(hash_str, sizeof(hash_str), entry->hash, SHA256_HASH_SIZE, false);
+
+        if (!(entry->path = generateContentStorePath(hash_str, ".nca")) || !(entry->tmp_path = generateContentStorePath(hash_str, ".nca.tmp"))) goto fail;
+
+        // reuse stored nca if its size matches
+        // its checksum is verified while it's being copied, just like any other nca
+        if (!stat(entry->path, &st) && (u64)st.st_size == cur_nca_ctx->content_size && (entry->fp = fopen(entry->path, "rb")))
+        {
+            entry->stored = true;
+            stored_count++;
+            continue;
+        }
+
+        // write a new content store file
+        utilsCreateDirectoryTree(entry->tmp_path, false);
+
+        if (!(entry->fp = fopen(entry->tmp_path, "wb")))
+        {
+            consolePrint("failed to open \"%s\" for writing!\n", entry->tmp_path);
+            goto fail;
+        }
+
+        setvbuf(entry->fp, NULL, _IONBF, 0);
+        added_count++;
+    }
+
+    consolePrint("content store: %u nca(s) reused, %u nca(s) to be added\n", stored_count, added_count);
+    consoleRefresh();
+
+    return entries;
+
+fail:
+    nspContentStoreFree(entries, nca_count);
+
+    return NULL;
+}
+
+static bool nspContentStoreFinalizeEntry(NspContentStoreEntry *entry, TitleInfo *title_info, NcaContext *nca_ctx)
+{
+    char *manifest_path = NULL, hash_str[SHA256_HASH_STR_SIZE] = {0};
+    FILE *manifest_fp = NULL;
+    bool success = false;
+
+    if (!entry->eligible || !entry->fp) return true;
+
+    fclose(entry->fp);
+    entry->fp = NULL;
+
+    if (!entry->stored)
+    {
+        // the nca checksum has already been verified, so we can move the new file into place
+        // any previous file with a mismatching size is replaced
+        remove(entry->path);
+
+        if (rename(entry->tmp_path, entry->path) != 0)
+        {
+            consolePrint("failed to rename \"%s\"!\n", entry->tmp_path);
+            goto end;
+        }
+    }
+
+    // keep track of the ncas referenced by each dumped title
+    if (!(manifest_path = generateContentStorePath(NSP_CONTENT_STORE_MANIFEST, NULL))) goto end;
+
+    if (!(manifest_fp = fopen(manifest_path, "a")))
+    {
+        consolePrint("failed to open \"%s\" for writing!\n", manifest_path);
+        goto end;
+    }
+
+    fseek(manifest_fp, 0, SEEK_END);
+    if (!ftell(manifest_fp)) fprintf(manifest_fp, "title_id,version,content_id,sha256,size,action\n");
+
+    utilsGenerateHexString(hash_str, sizeof(hash_str), entry->hash, SHA256_HASH_SIZE, false);
+    fprintf(manifest_fp, "%016lX,%u,%s,%s,%lu,%s\n", title_info->meta_key.id, title_info->version.value, nca_ctx->content_id_str, hash_str, nca_ctx->content_size, \
+            entry->stored ? "reused" : "added");
+
+    success = true;
+
+end:
+    if (manifest_fp) fclose(manifest_fp);
+
+    if (manifest_path) free(manifest_path);
+
+    return success;
+}
+
+static void nspContentStoreFree(NspContentStoreEntry *entries, u32 count)
+{
+    if (!entries) return;
+
+    for(u32 i = 0; i < count; i++)
+    {
+        NspContentStoreEntry *entry = &(entries[i]);
+
+        if (entry->fp)
+        {
+            fclose(entry->fp);
+
+            // discard incomplete content store files
+            if (!entry->stored) remove(entry->tmp_path);
+        }
+
+        if (entry->path) free(entry->path);
+        if (entry->tmp_path) free(entry->tmp_path);
+    }
+
+    free(entries);
+}
+
+static char *generateDeltaReferencePath(u64 title_id)
+{
+    char filename[0x11] = {0};
+    snprintf(filename, sizeof(filename), "%016lX", title_id);
+    return utilsGeneratePath(NSP_DELTA_REFERENCE_PATH, filename, ".cnmt");
+}
+
+static bool nspDeltaInitialize(NspDeltaContext *out, TitleInfo *title_info, NcaContext *nca_ctx, ContentMetaContext *cnmt_ctx)
+{
+    char *ref_path = NULL;
+    FILE *ref_fp = NULL;
+    ContentMetaPackagedContentMetaHeader *ref_header = NULL;
+    u64 ref_content_infos_offset = 0;
+    bool success = false;
+
+    memset(out, 0, sizeof(NspDeltaContext));
+
+    // keep a copy of the unmodified cnmt, since it's updated while dumping ncas
+    if (!(out->cnmt_data = malloc(cnmt_ctx->raw_data_size)))
+    {
+        consolePrint("cnmt copy alloc failed\n");
+        goto end;
+    }
+
+    memcpy(out->cnmt_data, cnmt_ctx->raw_data, cnmt_ctx->raw_data_size);
+    out->cnmt_data_size = cnmt_ctx->raw_data_size;
+
+    if (!(ref_path = generateDeltaReferencePath(title_info->meta_key.id))) goto end;
+
+    // load the reference cnmt from the last dumped version of this title
+    // a full nsp is dumped if it's not available
+    success = true;
+
+    if (!(ref_fp = fopen(ref_path, "rb")))
+    {
+        consolePrint("no reference cnmt available for this title, dumping full nsp\n");
+        goto end;
+    }
+
+    fseek(ref_fp, 0, SEEK_END);
+    out->ref_data_size = (u64)ftell(ref_fp);
+    rewind(ref_fp);
+
+    if (out->ref_data_size < sizeof(ContentMetaPackagedContentMetaHeader) || !(out->ref_data = malloc(out->ref_data_size)) || \
+        fread(out->ref_data, 1, out->ref_data_size, ref_fp) != out->ref_data_size)
+    {
+        consolePrint("failed to read reference cnmt, dumping full nsp\n");
+        goto end;
+    }
+
+    ref_header = (ContentMetaPackagedContentMetaHeader*)out->ref_data;
+    ref_content_infos_offset = (sizeof(ContentMetaPackagedContentMetaHeader) + ref_header->extended_header_size);
+
+    if (ref_header->title_id != title_info->meta_key.id || (ref_content_infos_offset + (ref_header->content_count * sizeof(NcmPackagedContentInfo))) > out->ref_data_size)
+    {
+        consolePrint("invalid reference cnmt, dumping full nsp\n");
+        goto end;
+    }
+
+    if (ref_header->version.value >= title_info->version.value)
+    {
+        consolePrint("reference cnmt (v%u) isn't older than the selected title, dumping full nsp\n", ref_header->version.value);
+        goto end;
+    }
+
+    out->ref_content_infos = (NcmPackagedContentInfo*)(out->ref_data + ref_content_infos_offset);
+    out->ref_content_count = ref_header->content_count;
+    out->base_version = ref_header->version.value;
+
+    if (!(out->skip = calloc(title_info->content_count * 2, sizeof(bool))))
+    {
+        consolePrint("delta skip list calloc failed\n");
+        success = false;
+        goto end;
+    }
+
+    out->rewritten = (out->skip + title_info->content_count);
+
+    for(u32 i = 0; i < title_info->content_count; i++)
+    {
+        NcaContext *cur_nca_ctx = &(nca_ctx[i]);
+        NcmPackagedContentInfo *packaged_content_info = NULL;
+
+        if (cur_nca_ctx->content_type == NcmContentType_Meta || !(packaged_content_info = cnmtGetPackagedContentInfoByContentId(cnmt_ctx, &(cur_nca_ctx->content_id))) || \
+            !nspDeltaGetReferenceContentInfo(out, packaged_content_info)) continue;
+
+        // ncas modified by the selected options are always dumped, since their content ids depend on their data
+        if (ncaIsHeaderDirty(cur_nca_ctx) || cur_nca_ctx->content_type_ctx_patch)
+        {
+            out->rewritten[i] = true;
+            continue;
+        }
+
+        out->skip[i] = true;
+        out->skip_count++;
+    }
+
+    consolePrint("delta dump against v%u: %u out of %u nca(s) unchanged\n", out->base_version, out->skip_count, title_info->content_count);
+
+end:
+    if (ref_fp) fclose(ref_fp);
+
+    if (ref_path) free(ref_path);
+
+    if (!out->skip && out->ref_data)
+    {
+        // not a delta dump, get rid of the reference cnmt
+        free(out->ref_data);
+        out->ref_data = NULL;
+        out->ref_data_size = 0;
+    }
+
+    if (!success) nspDeltaFreeContext(out);
+
+    consoleRefresh();
+
+    return success;
+}
+
+static NcmPackagedContentInfo *nspDeltaGetReferenceContentInfo(NspDeltaContext *delta_ctx, const NcmPackagedContentInfo *packaged_content_info)
+{
+    for(u16 i = 0; i < delta_ctx->ref_content_count; i++)
+    {
+        NcmPackagedContentInfo *ref_content_info = &(delta_ctx->ref_content_infos[i]);
+
+        // content ids are derived from nca checksums, but we compare the full checksums anyway
+        if (!memcmp(&(ref_content_info->info.content_id), &(packaged_content_info->info.content_id), sizeof(NcmContentId)) && \
+            !memcmp(ref_content_info->hash, packaged_content_info->hash, SHA256_HASH_SIZE)) return ref_content_info;
+    }
+
+    return NULL;
+}
+
+static bool nspDeltaWriteManifest(NspDeltaContext *delta_ctx, TitleInfo *title_info, NcaContext *nca_ctx, const char *nsp_filename)
+{
+    char *manifest_filename = NULL, *manifest = NULL, content_id_str[0x21] = {0};
+    const char *nsp_ext = NULL;
+    size_t manifest_size = 0;
+    bool success = false;
+
+    if (!(nsp_ext = strrchr(nsp_filename, '.')) || !(manifest_filename = calloc(sizeof(char), strlen(nsp_filename) + 1)))
+    {
+        consolePrint("failed to generate delta manifest filename!\n");
+        goto end;
+    }
+
+    sprintf(manifest_filename, "%.*s.csv", (int)(nsp_ext - nsp_filename), nsp_filename);
+
+    if (!utilsAppendFormattedStringToBuffer(&manifest, &manifest_size, "title_id,base_version,version,content_id,content_type,size,status\n")) goto end;
+
+    // list all ncas from the selected title
+    // ncas modified by the selected options are listed using their new content ids
+    for(u32 i = 0; i < title_info->content_count; i++)
+    {
+        NcaContext *cur_nca_ctx = &(nca_ctx[i]);
+        const char *status = (cur_nca_ctx->content_type == NcmContentType_Meta ? "meta" : (delta_ctx->skip[i] ? "unchanged" : (delta_ctx->rewritten[i] ? "rewritten" : "new")));
+
+        if (!utilsAppendFormattedStringToBuffer(&manifest, &manifest_size, "%016lX,%u,%u,%s,%s,%lu,%s\n", title_info->meta_key.id, delta_ctx->base_version, title_info->version.value, \
+                                                cur_nca_ctx->content_id_str, titleGetNcmContentTypeName(cur_nca_ctx->content_type), cur_nca_ctx->content_size, status)) goto end;
+    }
+
+    // list ncas from the reference cnmt that are no longer used
+    for(u16 i = 0; i < delta_ctx->ref_content_count; i++)
+    {
+        NcmPackagedContentInfo *ref_content_info = &(delta_ctx->ref_content_infos[i]);
+        ContentMetaPackagedContentMetaHeader *cnmt_header = (ContentMetaPackagedContentMetaHeader*)delta_ctx->cnmt_data;
+        NcmPackagedContentInfo *content_infos = (NcmPackagedContentInfo*)(delta_ctx->cnmt_data + sizeof(ContentMetaPackagedContentMetaHeader) + cnmt_header->extended_header_size);
+        bool found = false;
+        u64 content_size = 0;
+
+        for(u16 j = 0; j < cnmt_header->content_count && !found; j++) found = !memcmp(&(content_infos[j].info.content_id), &(ref_content_info->info.content_id), sizeof(NcmContentId));
+        if (found) continue;
+
+        utilsGenerateHexString(content_id_str, sizeof(content_id_str), ref_content_info->info.content_id.c, sizeof(ref_content_info->info.content_id.c), false);
+        ncmContentInfoSizeToU64(&(ref_content_info->info), &content_size);
+
+        if (!utilsAppendFormattedStringToBuffer(&manifest, &manifest_size, "%016lX,%u,%u,%s,%s,%lu,removed\n", title_info->meta_key.id, delta_ctx->base_version, title_info->version.value, \
+                                                content_id_str, titleGetNcmContentTypeName(ref_content_info->info.content_type), content_size)) goto end;
+    }
+
+    if (!(success = saveFileData(manifest_filename, manifest, strlen(manifest)))) goto end;
+
+    consolePrint("delta manifest saved as \"%s\"\n", manifest_filename);
+
+end:
+    if (manifest) free(manifest);
+
+    if (manifest_filename) free(manifest_filename);
 
-        for(u64 offset = 0, blksize = BLOCK_SIZE; offset < nca_filesize; offset += blksize)
-        {
-            if (blksize > (nca_filesize - offset)) blksize = (nca_filesize - offset);
+    return success;
+}
 
-            /* Check if the transfer has been cancelled by the user. */
-            if (shared_thread_data->transfer_cancelled)
-            {
-                condvarWakeAll(&g_writeCondvar);
-                break;
-            }
+static void nspDeltaSaveReference(NspDeltaContext *delta_ctx, u64 title_id)
+{
+    char *ref_path = NULL;
+    FILE *ref_fp = NULL;
 
-            /* Read current file data chunk. */
-            shared_thread_data->read_error = !systemUpdateReadCurrentContentFileFromDumpContext(sys_upd_dump_ctx, buf1, blksize);
-            if (shared_thread_data->read_error)
-            {
-                condvarWakeAll(&g_writeCondvar);
-                break;
-            }
+    if (!delta_ctx->cnmt_data || !(ref_path = generateDeltaReferencePath(title_id))) return;
 
-            /* Wait until the previous file data chunk has been written. */
-            mutexLock(&g_fileMutex);
+    utilsCreateDirectoryTree(ref_path, false);
 
-            if (shared_thread_data->data_size && !shared_thread_data->write_error) condvarWait(&g_readCondvar, &g_fileMutex);
+    // a failure here only affects the next delta dump for this title, so we don't treat it as an error
+    if (!(ref_fp = fopen(ref_path, "wb")) || fwrite(delta_ctx->cnmt_data, 1, delta_ctx->cnmt_data_size, ref_fp) != delta_ctx->cnmt_data_size)
+    {
+        consolePrint("failed to save reference cnmt to \"%s\"!\n", ref_path);
+    }
 
-            if (shared_thread_data->write_error)
-            {
-                mutexUnlock(&g_fileMutex);
-                break;
-            }
+    if (ref_fp) fclose(ref_fp);
 
-            /* Update shared object. */
-            shared_thread_data->data = buf1;
-            shared_thread_data->data_size = blksize;
+    free(ref_path);
+}
 
-            /* Swap buffers. */
-            buf1 = buf2;
-            buf2 = shared_thread_data->data;
+static void nspDeltaFreeContext(NspDeltaContext *delta_ctx)
+{
+    if (delta_ctx->cnmt_data) free(delta_ctx->cnmt_data);
+    if (delta_ctx->ref_data) free(delta_ctx->ref_data);
+    if (delta_ctx->skip) free(delta_ctx->skip);
+    memset(delta_ctx, 0, sizeof(NspDeltaContext));
+}
 
-            /* Wake up the write thread to continue writing data. */
-            mutexUnlock(&g_fileMutex);
-            condvarWakeAll(&g_writeCondvar);
-        }
+static bool nspNcaSchedulerStart(NspNcaScheduler *sched, NcaContext *nca_ctx, const bool *skip, NspContentStoreEntry *store_entries, u32 job_count, u32 worker_count)
+{
+    if (!sched || !nca_ctx || !job_count || !worker_count || worker_count > NSP_MAX_NCA_WORKER_COUNT) return false;
 
-        if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
+    memset(sched, 0, sizeof(NspNcaScheduler));
+
+    if (!(sched->jobs = calloc(job_count, sizeof(NspNcaJob))))
+    {
+        consolePrint("nca jobs calloc failed\n");
+        return false;
     }
 
-    if (!shared_thread_data->read_error && !shared_thread_data->write_error && !shared_thread_data->transfer_cancelled)
+    sched->job_count = job_count;
+
+    for(u32 i = 0; i < job_count; i++)
     {
-        /* Wait until the previous file data chunk has been written. */
-        mutexLock(&g_fileMutex);
-        if (shared_thread_data->data_size) condvarWait(&g_readCondvar, &g_fileMutex);
-        mutexUnlock(&g_fileMutex);
+        sched->jobs[i].nca_ctx = &(nca_ctx[i]);
+        sched->jobs[i].skip = (skip && skip[i]);
+        if (store_entries && store_entries[i].stored) sched->jobs[i].src_fp = store_entries[i].fp;
+    }
 
-        if (dev_idx == 1) usbEndExtractedFsDump();
+    mutexInit(&(sched->mutex));
+    condvarInit(&(sched->condvar));
 
-        shared_thread_data->read_error = !systemUpdateIsDumpContextFinished(sys_upd_dump_ctx);
-        if (!shared_thread_data->read_error)
+    for(u32 i = 0; i < NSP_NCA_BUFFER_COUNT; i++)
+    {
+        if (!(sched->buffers[i] = usbAllocatePageAlignedBuffer(BLOCK_SIZE)))
         {
-            consolePrint("successfully saved system update data to \"%s\"\n", filename);
-        } else {
-            consolePrint("unexpected sys upd dump ctx error\n");
+            consolePrint("nca worker buffer alloc failed\n");
+            nspNcaSchedulerStop(sched);
+            return false;
         }
 
-        consoleRefresh();
+        sched->free_buffers[sched->free_buffer_count++] = sched->buffers[i];
     }
 
-end:
-    if (shared_thread_data->fp)
-    {
-        fclose(shared_thread_data->fp);
-        shared_thread_data->fp = NULL;
+    // don't start more threads than needed
+    worker_count = MIN(worker_count, job_count);
 
-        if ((shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) && dev_idx != 1)
+    for(u32 i = 0; i < worker_count; i++)
+    {
+        if (!utilsCreateThread(&(sched->workers[i]), nspNcaWorkerThreadFunc, sched, (int)(i % 3)))
         {
-            utilsDeleteDirectoryRecursively(filename);
-            if (dev_idx == 0) utilsCommitSdCardFileSystemChanges();
+            consolePrint("nca worker thread #%u creation failed\n", i);
+            nspNcaSchedulerStop(sched);
+            return false;
         }
+
+        sched->worker_count++;
     }
 
-    if (nca_filename) free(nca_filename);
+    return true;
+}
 
-    if (filename) free(filename);
+static void nspNcaSchedulerStop(NspNcaScheduler *sched)
+{
+    if (!sched || !sched->jobs) return;
 
-    if (buf2) free(buf2);
-    if (buf1) free(buf1);
+    // wake up worker threads if they're still running
+    nspNcaSchedulerAbort(sched);
 
-    threadExit();
-}
+    for(u32 i = 0; i < sched->worker_count; i++) utilsJoinThread(&(sched->workers[i]));
 
-static void genericWriteThreadFunc(void *arg)
-{
-    SharedThreadData *shared_thread_data = (SharedThreadData*)arg; // UB but we don't care
+    if (sched->worker_count) consolePrint("nca worker threads: %u | buffers: %u | worker stalls: %lu | writer stalls: %lu\n", sched->worker_count, NSP_NCA_BUFFER_COUNT, \
+                                          sched->worker_stall_count, sched->writer_stall_count);
 
-    while(shared_thread_data->data_written < shared_thread_data->total_size)
+    for(u32 i = 0; i < NSP_NCA_BUFFER_COUNT; i++)
     {
-        /* Wait until the current file data chunk has been read */
-        mutexLock(&g_fileMutex);
+        if (sched->buffers[i]) free(sched->buffers[i]);
+    }
 
-        if (!shared_thread_data->data_size && !shared_thread_data->read_error) condvarWait(&g_writeCondvar, &g_fileMutex);
+    free(sched->jobs);
 
-        if (shared_thread_data->read_error || shared_thread_data->transfer_cancelled || (!useUsbHost() && !shared_thread_data->fp))
-        {
-            if (useUsbHost() && shared_thread_data->transfer_cancelled) usbCancelFileTransfer();
-            mutexUnlock(&g_fileMutex);
-            break;
-        }
+    memset(sched, 0, sizeof(NspNcaScheduler));
+}
 
-        /* Write current file data chunk */
-        if (useUsbHost())
-        {
-            shared_thread_data->write_error = !usbSendFileData(shared_thread_data->data, shared_thread_data->data_size);
-        } else {
-            shared_thread_data->write_error = (fwrite(shared_thread_data->data, 1, shared_thread_data->data_size, shared_thread_data->fp) != shared_thread_data->data_size);
-        }
+static void nspNcaSchedulerAbort(NspNcaScheduler *sched)
+{
+    mutexLock(&(sched->mutex));
+    sched->aborted = true;
+    condvarWakeAll(&(sched->condvar));
+    mutexUnlock(&(sched->mutex));
+}
 
-        if (!shared_thread_data->write_error)
-        {
-            shared_thread_data->data_written += shared_thread_data->data_size;
-            shared_thread_data->data_size = 0;
-        }
+static void *nspNcaSchedulerAcquireBuffer(NspNcaScheduler *sched, u32 job_idx)
+{
+    void *buf = NULL;
+    bool stalled = false;
 
-        /* Wake up the read thread to continue reading data */
-        mutexUnlock(&g_fileMutex);
-        condvarWakeAll(&g_readCondvar);
+    mutexLock(&(sched->mutex));
 
-        if (shared_thread_data->write_error) break;
+    // the last free buffer is reserved for the nca currently being written
+    while(!sched->aborted && !(sched->free_buffer_count > 1 || (sched->free_buffer_count && job_idx == sched->cur_job)))
+    {
+        if (!stalled) sched->worker_stall_count++;
+        stalled = true;
+        condvarWait(&(sched->condvar), &(sched->mutex));
     }
 
-    threadExit();
+    if (!sched->aborted) buf = sched->free_buffers[--sched->free_buffer_count];
+
+    mutexUnlock(&(sched->mutex));
+
+    return buf;
 }
 
-static bool spanDumpThreads(ThreadFunc read_func, ThreadFunc write_func, void *arg)
+static bool nspNcaSchedulerPopChunk(NspNcaScheduler *sched, u32 job_idx, void **out_chunk, u64 *out_size)
 {
-    SharedThreadData *shared_thread_data = (SharedThreadData*)arg; // UB but we don't care
-    Thread read_thread = {0}, write_thread = {0};
+    NspNcaJob *job = &(sched->jobs[job_idx]);
+    bool ret = false;
 
-    time_t start = 0, btn_cancel_start_tmr = 0, btn_cancel_end_tmr = 0;
-    bool btn_cancel_cur_state = false, btn_cancel_prev_state = false, success = false;
+    mutexLock(&(sched->mutex));
 
-    u64 prev_size = 0;
-    u8 prev_time = 0, percent = 0;
+    if (sched->cur_job != job_idx)
+    {
+        // let the worker thread handling this nca know it has priority now
+        sched->cur_job = job_idx;
+        condvarWakeAll(&(sched->condvar));
+    }
 
-    consolePrint("creating threads\n");
-    utilsCreateThread(&read_thread, read_func, arg, 2);
-    utilsCreateThread(&write_thread, write_func, arg, 2);
+    if (job->chunk_head == job->chunk_tail && !sched->aborted) sched->writer_stall_count++;
+    while(job->chunk_head == job->chunk_tail && !sched->aborted) condvarWait(&(sched->condvar), &(sched->mutex));
 
-    consolePrint("hold b to cancel\n\n");
-    consoleRefresh();
+    if (!sched->aborted)
+    {
+        u32 idx = (job->chunk_tail++ % NSP_NCA_BUFFER_COUNT);
+        *out_chunk = job->chunks[idx];
+        *out_size = job->chunk_sizes[idx];
+        ret = true;
+    }
 
-    start = time(NULL);
+    mutexUnlock(&(sched->mutex));
 
-    while(shared_thread_data->data_written < shared_thread_data->total_size)
-    {
-        g_appletStatus = appletMainLoop();
-        if (!g_appletStatus)
-        {
-            mutexLock(&g_fileMutex);
-            shared_thread_data->transfer_cancelled = true;
-            mutexUnlock(&g_fileMutex);
-        }
+    return ret;
+}
 
-        if (shared_thread_data->read_error || shared_thread_data->write_error || shared_thread_data->transfer_cancelled) break;
+static void nspNcaSchedulerReleaseBuffer(NspNcaScheduler *sched, void *buf)
+{
+    mutexLock(&(sched->mutex));
+    sched->free_buffers[sched->free_buffer_count++] = buf;
+    condvarWakeAll(&(sched->condvar));
+    mutexUnlock(&(sched->mutex));
+}
 
-        struct tm ts = {0};
-        time_t now = time(NULL);
-        localtime_r(&now, &ts);
+static bool nspNcaSchedulerWaitForJob(NspNcaScheduler *sched, u32 job_idx)
+{
+    NspNcaJob *job = &(sched->jobs[job_idx]);
+    bool ret = false;
 
-        size_t size = shared_thread_data->data_written;
+    mutexLock(&(sched->mutex));
+    while(!job->done && !sched->aborted) condvarWait(&(sched->condvar), &(sched->mutex));
+    ret = job->done;
+    mutexUnlock(&(sched->mutex));
 
-        utilsScanPads();
-        btn_cancel_cur_state = (utilsGetButtonsHeld() & HidNpadButton_B);
+    return ret;
+}
 
-        if (btn_cancel_cur_state && btn_cancel_cur_state != btn_cancel_prev_state)
-        {
-            btn_cancel_start_tmr = now;
-        } else
-        if (btn_cancel_cur_state && btn_cancel_cur_state == btn_cancel_prev_state)
-        {
-            btn_cancel_end_tmr = now;
-            if ((btn_cancel_end_tmr - btn_cancel_start_tmr) >= 3)
-            {
-                mutexLock(&g_fileMutex);
-                shared_thread_data->transfer_cancelled = true;
-                mutexUnlock(&g_fileMutex);
-                break;
-            }
-        } else {
-            btn_cancel_start_tmr = btn_cancel_end_tmr = 0;
-        }
+static void nspNcaWorkerThreadFunc(void *arg)
+{
+    NspNcaScheduler *sched = (NspNcaScheduler*)arg;
 
-        btn_cancel_prev_state = btn_cancel_cur_state;
+    while(true)
+    {
+        u32 job_idx = 0;
 
-        if (prev_time == ts.tm_sec || prev_size == size) continue;
+        // pick the next nca, in pfs entry order
+        mutexLock(&(sched->mutex));
+        while(sched->next_job < sched->job_count && sched->jobs[sched->next_job].skip) sched->next_job++;
+        bool stop = (sched->aborted || sched->next_job >= sched->job_count);
+        if (!stop) job_idx = sched->next_job++;
+        mutexUnlock(&(sched->mutex));
 
-        percent = (u8)((size * 100) / shared_thread_data->total_size);
+        if (stop) break;
 
-        prev_time = ts.tm_sec;
-        prev_size = size;
+        NspNcaJob *job = &(sched->jobs[job_idx]);
+        NcaContext *nca_ctx = job->nca_ctx;
+        bool dirty_header = ncaIsHeaderDirty(nca_ctx);
 
-        consolePrint("%lu / %lu (%u%%) | Time elapsed: %lu\n", size, shared_thread_data->total_size, percent, (now - start));
-        consoleRefresh();
+        Sha256Context clean_sha256_ctx = {0}, dirty_sha256_ctx = {0};
+        sha256ContextCreate(&clean_sha256_ctx);
+        sha256ContextCreate(&dirty_sha256_ctx);
 
-        utilsAppletLoopDelay();
-    }
+        for(u64 offset = 0, blksize = BLOCK_SIZE; offset < nca_ctx->content_size; offset += blksize)
+        {
+            if ((nca_ctx->content_size - offset) < blksize) blksize = (nca_ctx->content_size - offset);
 
-    consolePrint("\nwaiting for threads to join\n");
-    consoleRefresh();
+            void *buf = nspNcaSchedulerAcquireBuffer(sched, job_idx);
+            if (!buf) goto end;
 
-    utilsJoinThread(&read_thread);
-    consolePrint("read_thread done: %lu\n", time(NULL));
+            if (!nspProcessNcaChunk(nca_ctx, job->src_fp, NULL, buf, blksize, offset, &dirty_header, &clean_sha256_ctx, &dirty_sha256_ctx))
+            {
+                nspNcaSchedulerAbort(sched);
+                goto end;
+            }
 
-    utilsJoinThread(&write_thread);
-    consolePrint("write_thread done: %lu\n", time(NULL));
+            // both hashes must be available as soon as the last chunk is handed over
+            if ((offset + blksize) >= nca_ctx->content_size)
+            {
+                sha256ContextGetHash(&clean_sha256_ctx, job->clean_sha256_hash);
+                sha256ContextGetHash(&dirty_sha256_ctx, job->dirty_sha256_hash);
+            }
 
-    if (shared_thread_data->read_error || shared_thread_data->write_error)
-    {
-        consolePrint("i/o error\n");
-    } else
-    if (shared_thread_data->transfer_cancelled)
-    {
-        consolePrint("process cancelled\n");
-    } else {
-        start = (time(NULL) - start);
-        consolePrint("process completed in %lu seconds\n", start);
-        success = true;
-    }
+            // hand the processed chunk over to the nsp dump thread
+            mutexLock(&(sched->mutex));
+            u32 idx = (job->chunk_head++ % NSP_NCA_BUFFER_COUNT);
+            job->chunks[idx] = buf;
+            job->chunk_sizes[idx] = blksize;
+            condvarWakeAll(&(sched->condvar));
+            mutexUnlock(&(sched->mutex));
+        }
 
-    consoleRefresh();
+        mutexLock(&(sched->mutex));
+        job->done = true;
+        condvarWakeAll(&(sched->condvar));
+        mutexUnlock(&(sched->mutex));
+    }
 
-    return success;
+end:
+    threadExit();
 }
 
 static void nspThreadFunc(void *arg)
@@ -6623,6 +8156,16 @@ static void nspThreadFunc(void *arg)
     Sha256Context clean_sha256_ctx = {0}, dirty_sha256_ctx = {0};
     u8 clean_sha256_hash[SHA256_HASH_SIZE] = {0}, dirty_sha256_hash[SHA256_HASH_SIZE] = {0};
 
+    NspNcaScheduler nca_scheduler = {0};
+    u32 nca_worker_count = g_nspNcaWorkerCountElementOption.selected;
+
+    NspContentStoreEntry *store_entries = NULL;
+    bool use_content_store = (dev_idx != 1 && (bool)g_nspContentStoreElementOption.selected);
+
+    NspDeltaContext delta_ctx = {0};
+    bool delta_dump = (bool)g_nspDeltaElementOption.selected;
+    u32 nca_entry_idx = 0;
+
     if (!nsp_thread_data || !(title_info = (TitleInfo*)nsp_thread_data->data) || !title_info->content_count || !title_info->content_infos) goto end;
 
     /* Allocate memory for the dump process. */
@@ -6725,6 +8268,13 @@ static void nspThreadFunc(void *arg)
         // don't go any further with this nca if we can't access its fs data because it's pointless
         if (cur_nca_ctx->rights_id_available && !cur_nca_ctx->titlekey_retrieved && !no_titlekey_confirmation)
         {
+            // batch dumps can't wait for user input
+            if (g_batchDumpActive)
+            {
+                consolePrint("unable to retrieve titlekey for the selected title, skipping\n");
+                goto end;
+            }
+
             consolePrintReversedColors("\nunable to retrieve titlekey for the selected title");
             consolePrintReversedColors("\nif you proceed, nca modifications will be disabled, and content decryption");
             consolePrintReversedColors("\nwill not be possible for external tools (e.g. emulators, etc.)\n");
@@ -6898,10 +8448,25 @@ static void nspThreadFunc(void *arg)
         }
     }
 
+    // look up unchanged ncas using the reference cnmt from the last dumped version of this title
+    if (delta_dump)
+    {
+        if (!nspDeltaInitialize(&delta_ctx, title_info, nca_ctx, &cnmt_ctx)) goto end;
+
+        if (delta_ctx.skip)
+        {
+            free(filename);
+            sprintf(entry_name, " (delta from v%u).nsp", delta_ctx.base_version);
+            if (!(filename = generateOutputTitleFileName(title_info, NSP_SUBDIR, entry_name))) goto end;
+        }
+    }
+
     // add nca info
     for(u32 i = 0; i < title_info->content_count; i++)
     {
         NcaContext *cur_nca_ctx = &(nca_ctx[i]);
+        if (delta_ctx.skip && delta_ctx.skip[i]) continue;
+
         sprintf(entry_name, "%s.%s", cur_nca_ctx->content_id_str, cur_nca_ctx->content_type == NcmContentType_Meta ? "cnmt.nca" : "nca");
 
         if (!pfsAddEntryInformationToImageContext(&pfs_img_ctx, entry_name, cur_nca_ctx->content_size, NULL))
@@ -7065,11 +8630,36 @@ static void nspThreadFunc(void *arg)
     // set nsp size
     nsp_thread_data->total_size = nsp_size;
 
+    // look up unmodified ncas in the content store
+    // only gamecard titles use it: reading a stored nca from the output device is only faster than reading it from a gamecard
+    // sd card and emmc titles would just have their ncas read from another flash storage, and written twice on first dumps
+    if (use_content_store && title_info->storage_id != NcmStorageId_GameCard)
+    {
+        consolePrint("content store is only used with gamecard titles, skipping\n");
+        use_content_store = false;
+    }
+
+    if (use_content_store && !(store_entries = nspContentStoreInitialize(nca_ctx, title_info->content_count, &cnmt_ctx, delta_ctx.skip))) goto end;
+
+    // start nca worker threads, if needed
+    // the meta nca is always processed by this thread, since it depends on the hashes from all the other ncas
+    if (nca_worker_count && title_info->content_count > 1 && !nspNcaSchedulerStart(&nca_scheduler, nca_ctx, delta_ctx.skip, store_entries, title_info->content_count - 1, \
+                                                                                       nca_worker_count))
+    {
+        consolePrint("nca scheduler start failed\n");
+        goto end;
+    }
+
     // write ncas
     for(u32 i = 0; i < title_info->content_count; i++)
     {
         NcaContext *cur_nca_ctx = &(nca_ctx[i]);
+        NspContentStoreEntry *store_entry = (store_entries ? &(store_entries[i]) : NULL);
         u64 blksize = BLOCK_SIZE;
+        bool scheduled = (i < nca_scheduler.job_count);
+
+        // unchanged ncas are left out of delta dumps
+        if (delta_ctx.skip && delta_ctx.skip[i]) continue;
 
         sha256ContextCreate(&clean_sha256_ctx);
         sha256ContextCreate(&dirty_sha256_ctx);
@@ -7080,11 +8670,12 @@ static void nspThreadFunc(void *arg)
             goto end;
         }
 
-        bool dirty_header = ncaIsHeaderDirty(cur_nca_ctx);
+        // scheduled ncas are patched by their worker threads
+        bool dirty_header = (!scheduled && ncaIsHeaderDirty(cur_nca_ctx));
 
         if (dev_idx == 1)
         {
-            tmp_name = pfsGetEntryNameByIndexFromImageContext(&pfs_img_ctx, i);
+            tmp_name = pfsGetEntryNameByIndexFromImageContext(&pfs_img_ctx, nca_entry_idx);
             if (!usbSendFileProperties(cur_nca_ctx->content_size, tmp_name))
             {
                 consolePrint("usb send file properties \"%s\" failed\n", tmp_name);
@@ -7100,74 +8691,71 @@ static void nspThreadFunc(void *arg)
 
             if (cancelled) goto end;
 
-            if ((cur_nca_ctx->content_size - offset) < blksize) blksize = (cur_nca_ctx->content_size - offset);
+            void *chunk = buf;
 
-            // read nca chunk
-            if (!ncaReadContentFile(cur_nca_ctx, buf, blksize, offset))
+            if (scheduled)
             {
-                consolePrint("nca read failed at 0x%lX for \"%s\"\n", offset, cur_nca_ctx->content_id_str);
-                goto end;
-            }
+                // get the next processed nca chunk from the worker thread handling this nca
+                if (!nspNcaSchedulerPopChunk(&nca_scheduler, i, &chunk, &blksize)) goto end;
+            } else {
+                if ((cur_nca_ctx->content_size - offset) < blksize) blksize = (cur_nca_ctx->content_size - offset);
 
-            // update clean hash calculation
-            sha256ContextUpdate(&clean_sha256_ctx, buf, blksize);
+                // read and process nca chunk
+                if (!nspProcessNcaChunk(cur_nca_ctx, (store_entry && store_entry->stored) ? store_entry->fp : NULL, &cnmt_ctx, buf, blksize, offset, &dirty_header, \
+                                        &clean_sha256_ctx, &dirty_sha256_ctx)) goto end;
+            }
 
-            if ((offset + blksize) >= cur_nca_ctx->content_size)
+            // write nca chunk
+            if (dev_idx == 1)
             {
-                // get clean hash
-                sha256ContextGetHash(&clean_sha256_ctx, clean_sha256_hash);
-
-                // validate clean hash
-                if (!cnmtVerifyContentHash(&cnmt_ctx, cur_nca_ctx, clean_sha256_hash))
+                if (!usbSendFileData(chunk, blksize))
                 {
-                    consolePrint("sha256 checksum mismatch for nca \"%s\"\nplease check for corrupted data using the data management menu\n", cur_nca_ctx->content_id_str);
+                    consolePrint("send file data failed\n");
                     goto end;
                 }
-            }
-
-            if (dirty_header)
-            {
-                // write re-encrypted headers
-                if (!cur_nca_ctx->header_written) ncaWriteEncryptedHeaderDataToMemoryBuffer(cur_nca_ctx, buf, blksize, offset);
+            } else {
+                fwrite(chunk, 1, blksize, fp);
 
-                if (cur_nca_ctx->content_type_ctx_patch)
+                // add nca to the content store, if needed
+                if (store_entry && store_entry->fp && !store_entry->stored && fwrite(chunk, 1, blksize, store_entry->fp) != blksize)
                 {
-                    // write content type context patch
-                    switch(cur_nca_ctx->content_type)
-                    {
-                        case NcmContentType_Meta:
-                            cnmtWriteNcaPatch(&cnmt_ctx, buf, blksize, offset);
-                            break;
-                        case NcmContentType_Control:
-                            nacpWriteNcaPatch((NacpContext*)cur_nca_ctx->content_type_ctx, buf, blksize, offset);
-                            break;
-                        default:
-                            break;
-                    }
+                    consolePrint("failed to write content store file \"%s\"!\n", store_entry->tmp_path);
+                    if (scheduled) nspNcaSchedulerReleaseBuffer(&nca_scheduler, chunk);
+                    goto end;
                 }
-
-                // update flag to avoid entering this code block if it's not needed anymore
-                dirty_header = (!cur_nca_ctx->header_written || cur_nca_ctx->content_type_ctx_patch);
             }
 
-            // update dirty hash calculation
-            sha256ContextUpdate(&dirty_sha256_ctx, buf, blksize);
+            if (scheduled) nspNcaSchedulerReleaseBuffer(&nca_scheduler, chunk);
+        }
+
+        if (scheduled)
+        {
+            // wait until the worker thread is done with this nca, then get both hashes
+            if (!nspNcaSchedulerWaitForJob(&nca_scheduler, i)) goto end;
 
-            // write nca chunk
-            if (dev_idx == 1)
+            memcpy(clean_sha256_hash, nca_scheduler.jobs[i].clean_sha256_hash, SHA256_HASH_SIZE);
+            memcpy(dirty_sha256_hash, nca_scheduler.jobs[i].dirty_sha256_hash, SHA256_HASH_SIZE);
+        } else {
+            // get clean and dirty hashes
+            sha256ContextGetHash(&clean_sha256_ctx, clean_sha256_hash);
+            sha256ContextGetHash(&dirty_sha256_ctx, dirty_sha256_hash);
+        }
+
+        // validate clean hash
+        if (!cnmtVerifyContentHash(&cnmt_ctx, cur_nca_ctx, clean_sha256_hash))
+        {
+            if (store_entry && store_entry->stored)
             {
-                if (!usbSendFileData(buf, blksize))
-                {
-                    consolePrint("send file data failed\n");
-                    goto end;
-                }
+                consolePrint("sha256 checksum mismatch for nca \"%s\"\ncontent store file \"%s\" is corrupted, please remove it\n", cur_nca_ctx->content_id_str, store_entry->path);
             } else {
-                fwrite(buf, 1, blksize, fp);
+                consolePrint("sha256 checksum mismatch for nca \"%s\"\nplease check for corrupted data using the data management menu\n", cur_nca_ctx->content_id_str);
             }
+
+            goto end;
         }
 
-        // get dirty hash
-        sha256ContextGetHash(&dirty_sha256_ctx, dirty_sha256_hash);
+        // move new content store file into place and update the content store manifest
+        if (store_entry && !nspContentStoreFinalizeEntry(store_entry, title_info, cur_nca_ctx)) goto end;
 
         if (memcmp(clean_sha256_hash, dirty_sha256_hash, SHA256_HASH_SIZE) != 0)
         {
@@ -7182,12 +8770,14 @@ static void nspThreadFunc(void *arg)
             }
 
             // update pfs entry name
-            if (!pfsUpdateEntryNameFromImageContext(&pfs_img_ctx, i, cur_nca_ctx->content_id_str))
+            if (!pfsUpdateEntryNameFromImageContext(&pfs_img_ctx, nca_entry_idx, cur_nca_ctx->content_id_str))
             {
                 consolePrint("pfs update entry name failed for nca \"%s\"\n", cur_nca_ctx->content_id_str);
                 goto end;
             }
         }
+
+        nca_entry_idx++;
     }
 
     if (generate_authoringtool_data)
@@ -7370,9 +8960,20 @@ static void nspThreadFunc(void *arg)
 
     nsp_thread_data->data_written += nsp_header_size;
 
+    // write delta manifest
+    if (delta_ctx.skip && !nspDeltaWriteManifest(&delta_ctx, title_info, nca_ctx, filename)) goto end;
+
     success = true;
 
+    // the unmodified cnmt from this dump becomes the reference for the next delta dump
+    if (delta_dump) nspDeltaSaveReference(&delta_ctx, title_info->meta_key.id);
+
 end:
+    nspNcaSchedulerStop(&nca_scheduler);
+
+    // must be freed after stopping the nca worker threads, since they may still be reading from content store files
+    nspContentStoreFree(store_entries, title_info ? title_info->content_count : 0);
+
     consoleRefresh();
 
     mutexLock(&g_fileMutex);
@@ -7421,6 +9022,8 @@ end:
 
     cnmtFreeContext(&cnmt_ctx);
 
+    nspDeltaFreeContext(&delta_ctx);
+
     if (nca_ctx) free(nca_ctx);
 
     if (filename) free(filename);
@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+
+"""
+ * nxdt_bench.py
+ *
+ * Copyright (c) 2020-2024, DarkMatterCore <pabloacurielz@gmail.com>.
+ *
+ * This file is part of nxdumptool (https://github.com/DarkMatterCore/nxdumptool).
+ *
+ * nxdumptool is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nxdumptool is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""
+
+# Host-only USB ABI throughput simulation.
+# Numbers reported by this script do NOT reflect real usb:ds throughput: console-side storage reads, usb:ds URB handling and USB bus limits aren't part of it.
+# It only exercises the ABI command flow and the host-side code (nxdt_host.py) over a local TCP connection.
+# This script stands in for a console running nxdumptool: it listens on the TCP transport port, starts nxdt_host.py in CLI mode using its TCP transport,
+# and runs the same command flow nxdumptool uses for regular file dumps, NSP dumps and extracted FS dumps. No console is needed.
+# Optionally, lz4 may be installed to benchmark compressed transfers. nxdt_host.py dependencies must be installed as well.
+
+from __future__ import annotations
+
+import sys
+import os
+import socket
+import struct
+import hashlib
+import shutil
+import subprocess
+import tempfile
+import time
+
+from argparse import ArgumentParser
+
+try:
+    import lz4.block
+    g_lz4Available = True
+except ImportError:
+    g_lz4Available = False
+
+# TCP transport port.
+USB_TCP_PORT = 0x4E58
+
+# Reported application and ABI versions. The ABI version must match the one supported by nxdt_host.py.
+APP_VERSION = (2, 0, 0)
+USB_ABI_VERSION = 0x18
+
+# Data frame payload size range proposed during StartSession (log2).
+USB_CHUNK_SHIFT_MIN = 16
+USB_CHUNK_SHIFT_MAX = 23
+
+# Data frame payload size used during extracted FS dumps (log2).
+USB_CHUNK_SHIFT_FS_DUMP = 20
+
+# File batch limits.
+USB_BATCH_MAX_FILE_SIZE = 0x100000
+USB_BATCH_DATA_SIZE     = 0x400000
+USB_BATCH_MANIFEST_SIZE = 0x40000
+
+# USB command header/status magic word.
+USB_MAGIC_WORD = b'NXDT'
+
+# USB command IDs.
+USB_CMD_START_SESSION             = 0
+USB_CMD_SEND_FILE_PROPERTIES      = 1
+USB_CMD_SEND_NSP_HEADER           = 3
+USB_CMD_END_SESSION               = 4
+USB_CMD_START_EXTRACTED_FS_DUMP   = 5
+USB_CMD_END_EXTRACTED_FS_DUMP     = 6
+USB_CMD_SEND_FILE_DATA            = 7
+USB_CMD_FILL_FILE_DATA            = 8
+USB_CMD_SEND_FILE_BATCH           = 9
+USB_CMD_SEND_COMPRESSED_FILE_DATA = 10
+USB_CMD_SEND_FILE_HASH            = 11
+
+# USB ABI feature flags.
+USB_FEATURE_FILE_BATCH      = (1 << 0)
+USB_FEATURE_LZ4_COMPRESSION = (1 << 1)
+USB_FEATURE_FILE_HASH       = (1 << 2)
+USB_SUPPORTED_FEATURES      = (USB_FEATURE_FILE_BATCH | (USB_FEATURE_LZ4_COMPRESSION if g_lz4Available else 0) | USB_FEATURE_FILE_HASH)
+
+# USB status codes.
+USB_STATUS_SUCCESS = 0
+
+# Status response size.
+USB_STATUS_SIZE = 0x10
+
+# Source data block size. Random data blocks are reused throughout the benchmark.
+BENCH_BLOCK_SIZE = 0x800000
+
+class BenchError(Exception):
+    pass
+
+class BenchClient:
+    def __init__(self, sock: socket.socket, data_mode: str) -> None:
+        self.sock = sock
+        self.features = 0
+        self.chunk_shift = USB_CHUNK_SHIFT_MAX
+        self.max_chunk_shift = USB_CHUNK_SHIFT_MAX
+        self.data_block = (os.urandom(BENCH_BLOCK_SIZE) if (data_mode == 'random') else bytes(BENCH_BLOCK_SIZE))
+        self.zero_data = (data_mode == 'zero')
+
+    def recvExact(self, size: int) -> bytes:
+        buf = bytearray(size)
+        view = memoryview(buf)
+        offset = 0
+
+        while offset < size:
+            rd_size = self.sock.recv_into(view[offset:])
+            if not rd_size:
+                raise BenchError('Host disconnected.')
+            offset += rd_size
+
+        return bytes(buf)
+
+    def readStatus(self) -> tuple[int, int, int, int]:
+        (magic, status, max_packet_size, min_shift, max_shift, features) = struct.unpack('<4sIHBBH2x', self.recvExact(USB_STATUS_SIZE))
+        if magic != USB_MAGIC_WORD:
+            raise BenchError('Invalid status magic word.')
+
+        if status != USB_STATUS_SUCCESS:
+            raise BenchError(f'Host replied with status code {status}.')
+
+        return (max_packet_size, min_shift, max_shift, features)
+
+    def sendFrame(self, cmd: int, block: bytes | memoryview = b'') -> None:
+        self.sock.sendall(struct.pack('<4sII4x', USB_MAGIC_WORD, cmd, len(block)))
+        if len(block):
+            self.sock.sendall(block)
+
+    def sendCommand(self, cmd: int, block: bytes = b'') -> tuple[int, int, int, int]:
+        self.sendFrame(cmd, block)
+        return self.readStatus()
+
+    def startSession(self) -> None:
+        block = struct.pack('<BBBB8sBBH', APP_VERSION[0], APP_VERSION[1], APP_VERSION[2], USB_ABI_VERSION, b'bench', USB_CHUNK_SHIFT_MIN, USB_CHUNK_SHIFT_MAX, USB_SUPPORTED_FEATURES)
+        (_, min_shift, max_shift, features) = self.sendCommand(USB_CMD_START_SESSION, block)
+
+        if (min_shift < USB_CHUNK_SHIFT_MIN) or (max_shift > USB_CHUNK_SHIFT_MAX) or (min_shift > max_shift):
+            raise BenchError(f'Invalid data frame payload size range: [{min_shift}, {max_shift}].')
+
+        self.features = (features & USB_SUPPORTED_FEATURES)
+        self.max_chunk_shift = self.chunk_shift = max_shift
+
+        print(f'Session started. Data frame payload size: 0x{1 << min_shift:X} - 0x{1 << max_shift:X} bytes. Features: 0x{self.features:04X}.')
+
+    def endSession(self) -> None:
+        self.sendCommand(USB_CMD_END_SESSION)
+
+    def sendDataStream(self, size: int, allow_fill: bool = True) -> None:
+        file_hash = (hashlib.sha256() if (self.features & USB_FEATURE_FILE_HASH) else None)
+        frame_size = (1 << self.chunk_shift)
+        offset = 0
+
+        while offset < size:
+            cur_size = min(size - offset, frame_size)
+            offset += cur_size
+
+            # Zero data is sent as fill frames, just like nxdumptool does with long runs of identical bytes. File batches don't support them.
+            if self.zero_data and allow_fill:
+                self.sendFrame(USB_CMD_FILL_FILE_DATA, struct.pack('<QB7x', cur_size, 0))
+                if file_hash is not None:
+                    file_hash.update(memoryview(self.data_block)[:cur_size])
+                continue
+
+            chunk = memoryview(self.data_block)[:cur_size]
+            if file_hash is not None:
+                file_hash.update(chunk)
+
+            if self.features & USB_FEATURE_LZ4_COMPRESSION:
+                compressed = lz4.block.compress(chunk, store_size=False)
+                if (len(compressed) + 0x10) < cur_size:
+                    self.sendFrame(USB_CMD_SEND_COMPRESSED_FILE_DATA, struct.pack('<I12x', cur_size) + compressed)
+                    continue
+
+            self.sendFrame(USB_CMD_SEND_FILE_DATA, chunk)
+
+        if file_hash is not None:
+            self.sendFrame(USB_CMD_SEND_FILE_HASH, file_hash.digest())
+
+    def sendFileProperties(self, file_size: int, filename: str, nsp_header_size: int = 0) -> None:
+        raw_filename = filename.encode('utf-8')
+        block = struct.pack('<QII768s16x', file_size, len(raw_filename), nsp_header_size, raw_filename)
+        self.sendCommand(USB_CMD_SEND_FILE_PROPERTIES, block)
+
+    def sendFile(self, file_size: int, filename: str) -> None:
+        self.sendFileProperties(file_size, filename)
+        if file_size:
+            self.sendDataStream(file_size)
+            self.readStatus()
+
+    def sendNsp(self, entry_sizes: list[int], filename: str) -> None:
+        nsp_header_size = 0x400
+        self.sendFileProperties(nsp_header_size + sum(entry_sizes), filename, nsp_header_size)
+
+        for (idx, entry_size) in enumerate(entry_sizes):
+            self.sendFile(entry_size, f'{idx:02d}.nca')
+
+        self.sendCommand(USB_CMD_SEND_NSP_HEADER, b'PFS0' + bytes(nsp_header_size - 4))
+
+    def sendFileBatch(self, files: list[tuple[int, str]]) -> None:
+        manifest = bytearray()
+        for (file_size, filename) in files:
+            raw_filename = filename.encode('utf-8')
+            manifest += struct.pack('<QI4x', file_size, len(raw_filename)) + raw_filename + bytes(-len(raw_filename) % 8)
+
+        data_size = sum(file[0] for file in files)
+        self.sendFrame(USB_CMD_SEND_FILE_BATCH, struct.pack('<I4xQ', len(files), data_size) + manifest)
+
+        if data_size:
+            self.sendDataStream(data_size, False)
+
+        self.readStatus()
+
+    def sendExtractedFs(self, file_count: int, file_size: int, root_path: str) -> None:
+        fs_size = (file_count * file_size)
+        self.sendCommand(USB_CMD_START_EXTRACTED_FS_DUMP, struct.pack('<Q768s8x', fs_size, root_path.encode('utf-8')))
+        self.chunk_shift = min(self.max_chunk_shift, USB_CHUNK_SHIFT_FS_DUMP)
+
+        filenames = [ f'{root_path}/dir{idx // 100:03d}/file{idx:05d}.bin' for idx in range(file_count) ]
+
+        if (self.features & USB_FEATURE_FILE_BATCH) and (file_size <= USB_BATCH_MAX_FILE_SIZE):
+            batch: list[tuple[int, str]] = []
+            manifest_size = data_size = 0x10
+
+            for filename in filenames:
+                entry_size = (0x10 + ((len(filename.encode('utf-8')) + 7) & ~7))
+                if batch and (((manifest_size + entry_size) > USB_BATCH_MANIFEST_SIZE) or ((data_size + file_size) > USB_BATCH_DATA_SIZE)):
+                    self.sendFileBatch(batch)
+                    batch = []
+                    manifest_size = data_size = 0x10
+
+                batch.append((file_size, filename))
+                manifest_size += entry_size
+                data_size += file_size
+
+            if batch:
+                self.sendFileBatch(batch)
+        else:
+            for filename in filenames:
+                self.sendFile(file_size, filename)
+
+        self.sendCommand(USB_CMD_END_EXTRACTED_FS_DUMP)
+        self.chunk_shift = self.max_chunk_shift
+
+def benchRun(name: str, size: int, file_count: int, func) -> None:
+    start_time = time.perf_counter()
+    func()
+    elapsed = max(time.perf_counter() - start_time, 1e-9)
+
+    print(f'{name:<16} {size / 0x100000:10.1f} MiB {elapsed:8.2f} s {size / 0x100000 / elapsed:10.1f} MiB/s {file_count / elapsed:10.1f} files/s')
+
+def main() -> int:
+    parser = ArgumentParser(description='Host-only nxdumptool USB ABI throughput simulation over the TCP transport. Results do not reflect real usb:ds throughput.')
+    parser.add_argument('-p', '--port', type=int, default=USB_TCP_PORT, help=f'TCP port to listen on. Defaults to {USB_TCP_PORT}.')
+    parser.add_argument('-o', '--outdir', type=str, metavar='DIR', help='Output directory for nxdt_host.py. Defaults to a temporary directory, which is removed afterwards.')
+    parser.add_argument('-s', '--size', type=int, default=1024, metavar='MIB', help='Size of the single file and NSP transfers, in MiB. Defaults to 1024.')
+    parser.add_argument('-f', '--files', type=int, default=4000, help='Number of files in the extracted FS dump. Defaults to 4000.')
+    parser.add_argument('-k', '--file-size', type=int, default=16, metavar='KIB', help='Size of each file in the extracted FS dump, in KiB. Defaults to 16.')
+    parser.add_argument('-d', '--data', choices=[ 'random', 'zero' ], default='random', help='File data pattern. Defaults to "random".')
+    parser.add_argument('-e', '--external', action='store_true', default=False, help='Wait for an externally started nxdt_host.py instance instead of starting one.')
+    parser.add_argument('host_args', nargs='*', help='Additional arguments for nxdt_host.py (e.g. -- --no-compression --no-hash).')
+    args = parser.parse_args()
+
+    size = (args.size * 0x100000)
+    file_size = (args.file_size * 0x400)
+
+    outdir = (os.path.abspath(args.outdir) if args.outdir else tempfile.mkdtemp(prefix='nxdt_bench_'))
+    remove_outdir = (not args.outdir)
+
+    listen_sock = socket.create_server(('127.0.0.1', args.port))
+    host_proc: subprocess.Popen | None = None
+    ret = 1
+
+    try:
+        if not args.external:
+            host_script = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'nxdt_host.py')
+            host_cmd = [ sys.executable, host_script, '--cli', '--tcp', f'127.0.0.1:{args.port}', '--outdir', outdir ] + args.host_args
+            host_proc = subprocess.Popen(host_cmd, stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+
+        print(f'Waiting for nxdt_host.py on 127.0.0.1:{args.port}...')
+        listen_sock.settimeout(30)
+        (sock, _) = listen_sock.accept()
+        sock.settimeout(30)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+        client = BenchClient(sock, args.data)
+        client.startSession()
+
+        print(f'{"Phase":<16} {"Size":>14} {"Time":>10} {"Throughput":>15} {"Rate":>16}')
+        benchRun('file', size, 1, lambda: client.sendFile(size, 'bench/file.bin'))
+        benchRun('nsp', size, 1, lambda: client.sendNsp([ size // 4 ] * 4, 'bench/title.nsp'))
+        benchRun('extracted_fs', args.files * file_size, args.files, lambda: client.sendExtractedFs(args.files, file_size, 'bench/romfs'))
+
+        client.endSession()
+        sock.close()
+        ret = 0
+    except (BenchError, OSError) as e:
+        print(f'Benchmark failed: {e}')
+    finally:
+        listen_sock.close()
+
+        if host_proc is not None:
+            try:
+                host_proc.wait(timeout=10)
+            except subprocess.TimeoutExpired:
+                host_proc.kill()
+
+        if remove_outdir:
+            shutil.rmtree(outdir, ignore_errors=True)
+
+    return ret
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -23,6 +23,7 @@
 
 # This script depends on PyUSB and tqdm.
 # Optionally, comtypes may also be installed under Windows to provide taskbar progress functionality.
+# Optionally, lz4 may also be installed to support compressed USB transfers.
 
 # Use `pip -r requirements.txt` under Linux or MacOS to install these dependencies.
 # Windows users may just double-click `windows_install_deps.py` to achieve the same result.
@@ -44,6 +45,8 @@ import queue
 import shutil
 import time
 import struct
+import hashlib
+import socket
 import usb.core
 import usb.util
 import warnings
@@ -60,6 +63,13 @@ from argparse import ArgumentParser
 from io import BufferedWriter
 from typing import Generator, Any, Callable
 
+# LZ4 compressed transfers are only offered to the client if the lz4 package is available.
+try:
+    import lz4.block
+    g_lz4Available = True
+except ImportError:
+    g_lz4Available = False
+
 # Scaling factors.
 WINDOWS_SCALING_FACTOR = 96.0
 SCALE = 1.0
@@ -88,32 +98,67 @@ USB_TRANSFER_TIMEOUT = 10000
 # USB transfer block size.
 USB_TRANSFER_BLOCK_SIZE = 0x800000
 
+# Data frame payload size range supported by this script (log2). Negotiated with the target console during StartSession.
+# The upper limit matches the USB transfer block size.
+USB_CHUNK_SHIFT_MIN = 16
+USB_CHUNK_SHIFT_MAX = 23
+
+# TCP transport port used by nxdumptool builds with TCP transport support.
+USB_TCP_PORT = 0x4E58
+
+# Endpoint max packet size reported to nxdumptool over TCP. Stream sockets don't use Zero-Length Termination packets.
+USB_TCP_EP_MAX_PACKET_SIZE = 0x400
+
 # USB transfer threshold. Used to determine whether a progress bar should be displayed or not.
 USB_TRANSFER_THRESHOLD = (USB_TRANSFER_BLOCK_SIZE * 4)
 
+# Max number of received data chunks waiting to be written to the output file.
+USB_FILE_WRITER_QUEUE_DEPTH = 8
+
 # USB command header/status magic word.
 USB_MAGIC_WORD = b'NXDT'
 
 # Supported USB ABI version.
 USB_ABI_VERSION_MAJOR = 1
-USB_ABI_VERSION_MINOR = 2
+USB_ABI_VERSION_MINOR = 8
 
 # USB command header size.
 USB_CMD_HEADER_SIZE = 0x10
 
 # USB command IDs.
-USB_CMD_START_SESSION           = 0
-USB_CMD_SEND_FILE_PROPERTIES    = 1
-USB_CMD_CANCEL_FILE_TRANSFER    = 2
-USB_CMD_SEND_NSP_HEADER         = 3
-USB_CMD_END_SESSION             = 4
-USB_CMD_START_EXTRACTED_FS_DUMP = 5
-USB_CMD_END_EXTRACTED_FS_DUMP   = 6
+USB_CMD_START_SESSION             = 0
+USB_CMD_SEND_FILE_PROPERTIES      = 1
+USB_CMD_CANCEL_FILE_TRANSFER      = 2
+USB_CMD_SEND_NSP_HEADER           = 3
+USB_CMD_END_SESSION               = 4
+USB_CMD_START_EXTRACTED_FS_DUMP   = 5
+USB_CMD_END_EXTRACTED_FS_DUMP     = 6
+USB_CMD_SEND_FILE_DATA            = 7
+USB_CMD_FILL_FILE_DATA            = 8
+USB_CMD_SEND_FILE_BATCH           = 9
+USB_CMD_SEND_COMPRESSED_FILE_DATA = 10
+USB_CMD_SEND_FILE_HASH            = 11
+USB_CMD_RESUME_FILE_TRANSFER      = 12
 
 # USB command block sizes.
 USB_CMD_BLOCK_SIZE_START_SESSION           = 0x10
 USB_CMD_BLOCK_SIZE_SEND_FILE_PROPERTIES    = 0x320
 USB_CMD_BLOCK_SIZE_START_EXTRACTED_FS_DUMP = 0x310
+USB_CMD_BLOCK_SIZE_FILL_FILE_DATA          = 0x10
+USB_CMD_BLOCK_SIZE_SEND_FILE_BATCH         = 0x10   # Manifest header only. Followed by a variable number of file entries.
+USB_CMD_BLOCK_SIZE_COMPRESSED_FILE_DATA    = 0x10   # Compressed data frame block only. Followed by a LZ4 block.
+USB_CMD_BLOCK_SIZE_SEND_FILE_HASH          = 0x20
+USB_CMD_BLOCK_SIZE_RESUME_FILE_TRANSFER    = 0x10
+
+# File batch entry size (excluding the filename).
+USB_FILE_BATCH_ENTRY_SIZE = 0x10
+
+# USB ABI feature flags (negotiated during StartSession).
+USB_FEATURE_FILE_BATCH      = (1 << 0)
+USB_FEATURE_LZ4_COMPRESSION = (1 << 1)
+USB_FEATURE_FILE_HASH       = (1 << 2)
+USB_FEATURE_RESUME_TRANSFER = (1 << 3)
+USB_SUPPORTED_FEATURES      = (USB_FEATURE_FILE_BATCH | (USB_FEATURE_LZ4_COMPRESSION if g_lz4Available else 0) | USB_FEATURE_FILE_HASH | USB_FEATURE_RESUME_TRANSFER)
 
 # Max filename length (file properties).
 USB_FILE_PROPERTIES_MAX_NAME_LENGTH = 0x300
@@ -125,6 +170,7 @@ USB_STATUS_UNSUPPORTED_CMD         = 5
 USB_STATUS_UNSUPPORTED_ABI_VERSION = 6
 USB_STATUS_MALFORMED_CMD           = 7
 USB_STATUS_HOST_IO_ERROR           = 8
+USB_STATUS_FILE_HASH_MISMATCH      = 9
 
 # Script title.
 SCRIPT_TITLE = f'{USB_DEV_PRODUCT} host script v{APP_VERSION}'
@@ -331,6 +377,13 @@ g_taskbar: Any = None
 g_usbEpIn: Any = None
 g_usbEpOut: Any = None
 g_usbEpMaxPacketSize: int = 0
+g_usbChunkMinShift: int = 0
+g_usbChunkMaxShift: int = 0
+g_usbFeatures: int = 0
+g_usbDisabledFeatures: int = 0
+
+g_tcpAddress: tuple[str, int] | None = None
+g_tcpSocket: socket.socket | None = None
 
 g_nxdtVersionMajor: int = 0
 g_nxdtVersionMinor: int = 0
@@ -346,6 +399,99 @@ g_nspRemainingSize: int = 0
 g_nspFile: BufferedWriter | None = None
 g_nspFilePath: str = ''
 
+g_extractedFsDumpActive: bool = False
+g_extractedFsFileCount: int = 0
+g_extractedFsStartTime: float = 0.0
+
+g_resumeTransfer: UsbFileTransfer | None = None
+g_lastTransferId: int = 0
+
+# Holds the state of a file data transfer stage. Kept around if the connection is lost mid-transfer, so the client can resume it after reconnecting.
+class UsbFileTransfer:
+    def __init__(self, transfer_id: int, file: BufferedWriter, fullpath: str, file_size: int, use_pbar: bool) -> None:
+        self.transfer_id = transfer_id
+        self.file = file
+        self.fullpath = fullpath
+        self.file_size = file_size
+        self.use_pbar = use_pbar
+        self.offset: int = 0
+        self.last_frame_size: int = 0
+        self.start_time: float = time.time()
+
+        # Keep a running checksum of the received data, if the client is going to send its own.
+        self.file_hash: Any = (hashlib.sha256() if (g_usbFeatures & USB_FEATURE_FILE_HASH) else None)
+
+# Writes file data on a dedicated thread, so disk latency doesn't stall the USB pipe. Data chunks are handed over through a bounded queue.
+# The progress bar window is updated from here, which means it reflects the data that actually made it to the output file.
+class UsbFileWriter:
+    def __init__(self, file: BufferedWriter, use_pbar: bool) -> None:
+        self.file = file
+        self.use_pbar = use_pbar
+        self.error: OSError | None = None
+        self.queue: queue.Queue = queue.Queue(USB_FILE_WRITER_QUEUE_DEPTH)
+        self.thread = threading.Thread(target=self.run, daemon=True)
+        self.thread.start()
+
+    def write(self, chunk: bytes) -> None:
+        self.queue.put((chunk, 0, len(chunk)))
+
+    def fill(self, fill_value: int, fill_size: int) -> None:
+        self.queue.put((None, fill_value, fill_size))
+
+    def close(self) -> bool:
+        # Wait for all queued data to be written.
+        self.queue.put(None)
+        self.thread.join()
+        return (self.error is None)
+
+    def run(self) -> None:
+        while True:
+            op = self.queue.get()
+            if op is None:
+                break
+
+            # Keep draining the queue after a write error, so the receiver never blocks.
+            if self.error is not None:
+                continue
+
+            (chunk, fill_value, size) = op
+
+            try:
+                if chunk is not None:
+                    self.file.write(chunk)
+                elif fill_value == 0:
+                    # Skip zero fills altogether. Filesystems with sparse file support will store these as holes.
+                    self.file.seek(size, os.SEEK_CUR)
+                else:
+                    # Write fill data on our own.
+                    fill_block = bytes([ fill_value ]) * min(size, USB_TRANSFER_BLOCK_SIZE)
+                    fill_offset = 0
+
+                    while fill_offset < size:
+                        fill_size = min(size - fill_offset, len(fill_block))
+                        self.file.write(fill_block[:fill_size] if (fill_size < len(fill_block)) else fill_block)
+                        fill_offset += fill_size
+            except OSError as e:
+                self.error = e
+                continue
+
+            if self.use_pbar and (g_progressBarWindow is not None):
+                g_progressBarWindow.update(size)
+
+        if self.error is not None:
+            return
+
+        try:
+            # Only flush the output file once we're done with it.
+            self.file.flush()
+
+            # Seeking past the end of the file doesn't extend it on its own, so make sure a trailing hole is accounted for.
+            end_offset = self.file.tell()
+            if end_offset > os.fstat(self.file.fileno()).st_size:
+                self.file.truncate(end_offset)
+        except OSError as e:
+            self.error = e
+
 # Reference: https://beenje.github.io/blog/posts/logging-to-a-tkinter-scrolledtext-widget.
 class LogQueueHandler(logging.Handler):
     def __init__(self, log_queue: queue.Queue) -> None:
@@ -601,6 +747,10 @@ def utilsGetPath(path_arg: str, fallback_path: str, is_file: bool, create: bool
     return path
 
 def utilsIsValueAlignedToEndpointPacketSize(value: int) -> bool:
+    # ZLT packets are never sent over TCP.
+    if g_tcpSocket is not None:
+        return False
+
     return bool((value & (g_usbEpMaxPacketSize - 1)) == 0)
 
 def utilsResetNspInfo(delete: bool = False) -> None:
@@ -619,6 +769,27 @@ def utilsResetNspInfo(delete: bool = False) -> None:
     g_nspFile = None
     g_nspFilePath = ''
 
+def utilsPreallocateFile(file: BufferedWriter, size: int) -> None:
+    # Reserve disk space for the whole file right away, so it doesn't get fragmented while it grows.
+    # posix_fallocate() is only used on Linux, where most filesystems support it natively. Extending the file does the job under Windows.
+    # This is merely an optimization, so errors are ignored.
+    try:
+        if sys.platform == 'linux':
+            os.posix_fallocate(file.fileno(), 0, size)
+        elif g_isWindows:
+            file.truncate(size)
+    except OSError:
+        pass
+
+def utilsUpdateHashFill(file_hash: Any, fill_value: int, fill_size: int) -> None:
+    fill_block = bytes([ fill_value ]) * min(fill_size, USB_TRANSFER_BLOCK_SIZE)
+    fill_offset = 0
+
+    while fill_offset < fill_size:
+        hash_size = min(fill_size - fill_offset, len(fill_block))
+        file_hash.update(memoryview(fill_block)[:hash_size])
+        fill_offset += hash_size
+
 def utilsGetSizeUnitAndDivisor(size: int) -> tuple[str, int]:
     size_suffixes = [ 'B', 'KiB', 'MiB', 'GiB' ]
     size_suffixes_count = len(size_suffixes)
@@ -633,11 +804,97 @@ def utilsGetSizeUnitAndDivisor(size: int) -> tuple[str, int]:
 
     return ret
 
+def tcpConnect() -> bool:
+    global g_tcpSocket, g_usbEpMaxPacketSize
+
+    assert g_logger is not None
+    assert g_tcpAddress is not None
+
+    g_logger.info(f'Connecting to {USB_DEV_PRODUCT} at {g_tcpAddress[0]}:{g_tcpAddress[1]} over TCP.')
+
+    while True:
+        # Check if the user decided to stop the server.
+        if not g_cliMode:
+            assert g_stopEvent is not None
+            if g_stopEvent.is_set():
+                g_stopEvent.clear()
+                return False
+
+        try:
+            sock = socket.create_connection(g_tcpAddress, timeout=1)
+        except OSError:
+            time.sleep(0.5)
+            continue
+
+        break
+
+    # Frame headers are sent separately from their payloads, so disable Nagle's algorithm.
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    g_tcpSocket = sock
+    g_usbEpMaxPacketSize = USB_TCP_EP_MAX_PACKET_SIZE
+
+    g_logger.debug(f'Successfully connected to {g_tcpAddress[0]}:{g_tcpAddress[1]}!\n')
+
+    if g_cliMode:
+        g_logger.info(SERVER_STOP_MSG)
+
+    return True
+
+def tcpRead(size: int, timeout: int = -1) -> bytes:
+    assert g_tcpSocket is not None
+
+    rd = bytearray(size)
+    view = memoryview(rd)
+    offset = 0
+
+    try:
+        g_tcpSocket.settimeout(None if (timeout < 0) else (timeout / 1000))
+
+        while offset < size:
+            rd_size = g_tcpSocket.recv_into(view[offset:])
+            if not rd_size:
+                break
+            offset += rd_size
+    except OSError:
+        pass
+
+    if offset != size:
+        if g_logger is not None:
+            g_logger.error('\nTCP timeout triggered or console disconnected.')
+        return bytes(rd[:offset])
+
+    return bytes(rd)
+
+def tcpWrite(data: bytes, timeout: int = -1) -> int:
+    assert g_tcpSocket is not None
+
+    try:
+        g_tcpSocket.settimeout(None if (timeout < 0) else (timeout / 1000))
+        g_tcpSocket.sendall(data)
+    except OSError:
+        if g_logger is not None:
+            g_logger.error('\nTCP timeout triggered or console disconnected.')
+        return 0
+
+    return len(data)
+
+def tcpDisconnect() -> None:
+    global g_tcpSocket
+
+    if g_tcpSocket is not None:
+        g_tcpSocket.close()
+        g_tcpSocket = None
+
 def usbGetDeviceEndpoints() -> bool:
     global g_usbEpIn, g_usbEpOut, g_usbEpMaxPacketSize
 
     assert g_logger is not None
 
+    # Use TCP transport, if requested.
+    if g_tcpAddress is not None:
+        return tcpConnect()
+
     cur_dev: Generator[usb.core.Device, Any, None] | None = None
     prev_dev: usb.core.Device | None = None
     usb_ep_in_lambda = lambda ep: usb.util.endpoint_direction(ep.bEndpointAddress) == usb.util.ENDPOINT_IN
@@ -719,6 +976,9 @@ def usbGetDeviceEndpoints() -> bool:
     return True
 
 def usbRead(size: int, timeout: int = -1) -> bytes:
+    if g_tcpSocket is not None:
+        return tcpRead(size, timeout)
+
     rd = b''
 
     try:
@@ -734,6 +994,9 @@ def usbRead(size: int, timeout: int = -1) -> bytes:
     return rd
 
 def usbWrite(data: bytes, timeout: int = -1) -> int:
+    if g_tcpSocket is not None:
+        return tcpWrite(data, timeout)
+
     wr = 0
 
     try:
@@ -748,11 +1011,99 @@ def usbWrite(data: bytes, timeout: int = -1) -> int:
     return wr
 
 def usbSendStatus(code: int) -> bool:
-    status = struct.pack('<4sIH6x', USB_MAGIC_WORD, code, g_usbEpMaxPacketSize)
+    status = struct.pack('<4sIHBBH2x', USB_MAGIC_WORD, code, g_usbEpMaxPacketSize, g_usbChunkMinShift, g_usbChunkMaxShift, g_usbFeatures)
     return bool(usbWrite(status, USB_TRANSFER_TIMEOUT) == len(status))
 
+def usbReadDataFrame(remaining_size: int, allow_fill: bool) -> tuple[int, bytes] | None:
+    assert g_logger is not None
+
+    # Read data frame header.
+    frame_header = usbRead(USB_CMD_HEADER_SIZE, USB_TRANSFER_TIMEOUT)
+    if len(frame_header) != USB_CMD_HEADER_SIZE:
+        g_logger.error(f'Failed to read 0x{USB_CMD_HEADER_SIZE:X}-byte long data frame header!')
+        return None
+
+    (magic, cmd_id, frame_size) = struct.unpack_from('<4sII', frame_header, 0)
+
+    # CancelFileTransfer commands yield no command block. Let the caller handle them.
+    if (magic == USB_MAGIC_WORD) and (cmd_id == USB_CMD_CANCEL_FILE_TRANSFER):
+        return (cmd_id, b'')
+
+    # Validate data frame header.
+    # Compressed data frames are always smaller than their decompressed data.
+    valid_cmds = [ USB_CMD_SEND_FILE_DATA ]
+    if allow_fill:
+        valid_cmds.append(USB_CMD_FILL_FILE_DATA)
+    if g_usbFeatures & USB_FEATURE_LZ4_COMPRESSION:
+        valid_cmds.append(USB_CMD_SEND_COMPRESSED_FILE_DATA)
+
+    if (magic != USB_MAGIC_WORD) or (cmd_id not in valid_cmds) or (not frame_size) or (frame_size > (1 << g_usbChunkMaxShift)) or \
+       ((cmd_id in (USB_CMD_SEND_FILE_DATA, USB_CMD_SEND_COMPRESSED_FILE_DATA)) and (frame_size > remaining_size)) or \
+       ((cmd_id == USB_CMD_FILL_FILE_DATA) and (frame_size != USB_CMD_BLOCK_SIZE_FILL_FILE_DATA)) or \
+       ((cmd_id == USB_CMD_SEND_COMPRESSED_FILE_DATA) and (frame_size <= USB_CMD_BLOCK_SIZE_COMPRESSED_FILE_DATA)):
+        g_logger.error(f'Received invalid data frame header! (ID {cmd_id:02X}, size 0x{frame_size:X}).')
+        return None
+
+    # Handle Zero-Length Termination packet (if needed).
+    rd_size = frame_size
+    if utilsIsValueAlignedToEndpointPacketSize(frame_size):
+        rd_size += 1
+
+    # Read data frame payload.
+    chunk = usbRead(rd_size, USB_TRANSFER_TIMEOUT)
+    if len(chunk) != frame_size:
+        g_logger.error(f'Failed to read 0x{frame_size:X}-byte long data frame payload!')
+        return None
+
+    # Decompress LZ4 block. Callers get to handle it as a regular data frame.
+    if cmd_id == USB_CMD_SEND_COMPRESSED_FILE_DATA:
+        (decompressed_size,) = struct.unpack_from('<I', chunk, 0)
+        if (decompressed_size < frame_size) or (decompressed_size > min(remaining_size, 1 << g_usbChunkMaxShift)):
+            g_logger.error(f'Received invalid decompressed size! (0x{decompressed_size:X}).')
+            return None
+
+        try:
+            chunk = lz4.block.decompress(chunk[USB_CMD_BLOCK_SIZE_COMPRESSED_FILE_DATA:], uncompressed_size=decompressed_size)
+        except lz4.block.LZ4BlockError:
+            chunk = b''
+
+        if len(chunk) != decompressed_size:
+            g_logger.error(f'Failed to decompress 0x{frame_size:X}-byte long compressed data frame!')
+            return None
+
+        cmd_id = USB_CMD_SEND_FILE_DATA
+
+    return (cmd_id, chunk)
+
+def usbReadFileHash() -> bytes | None:
+    assert g_logger is not None
+
+    # Read data frame header.
+    frame_header = usbRead(USB_CMD_HEADER_SIZE, USB_TRANSFER_TIMEOUT)
+    if len(frame_header) != USB_CMD_HEADER_SIZE:
+        g_logger.error(f'Failed to read 0x{USB_CMD_HEADER_SIZE:X}-byte long file hash frame header!')
+        return None
+
+    (magic, cmd_id, frame_size) = struct.unpack_from('<4sII', frame_header, 0)
+    if (magic != USB_MAGIC_WORD) or (cmd_id != USB_CMD_SEND_FILE_HASH) or (frame_size != USB_CMD_BLOCK_SIZE_SEND_FILE_HASH):
+        g_logger.error(f'Received invalid file hash frame header! (ID {cmd_id:02X}, size 0x{frame_size:X}).')
+        return None
+
+    # Handle Zero-Length Termination packet (if needed).
+    rd_size = frame_size
+    if utilsIsValueAlignedToEndpointPacketSize(frame_size):
+        rd_size += 1
+
+    # Read file hash.
+    file_hash = usbRead(rd_size, USB_TRANSFER_TIMEOUT)
+    if len(file_hash) != frame_size:
+        g_logger.error(f'Failed to read 0x{frame_size:X}-byte long file hash!')
+        return None
+
+    return file_hash
+
 def usbHandleStartSession(cmd_block: bytes) -> int:
-    global g_nxdtVersionMajor, g_nxdtVersionMinor, g_nxdtVersionMicro, g_nxdtAbiVersionMajor, g_nxdtAbiVersionMinor, g_nxdtGitCommit
+    global g_nxdtVersionMajor, g_nxdtVersionMinor, g_nxdtVersionMicro, g_nxdtAbiVersionMajor, g_nxdtAbiVersionMinor, g_nxdtGitCommit, g_usbChunkMinShift, g_usbChunkMaxShift, g_usbFeatures
 
     assert g_logger is not None
 
@@ -762,7 +1113,7 @@ def usbHandleStartSession(cmd_block: bytes) -> int:
     g_logger.debug(f'Received StartSession ({USB_CMD_START_SESSION:02X}) command.')
 
     # Parse command block.
-    (g_nxdtVersionMajor, g_nxdtVersionMinor, g_nxdtVersionMicro, abi_version, git_commit) = struct.unpack_from('<BBBB8s', cmd_block, 0)
+    (g_nxdtVersionMajor, g_nxdtVersionMinor, g_nxdtVersionMicro, abi_version, git_commit, min_chunk_shift, max_chunk_shift, features) = struct.unpack_from('<BBBB8sBBH', cmd_block, 0)
     g_nxdtGitCommit = git_commit.decode('utf-8').strip('\x00')
 
     # Unpack ABI version.
@@ -777,11 +1128,26 @@ def usbHandleStartSession(cmd_block: bytes) -> int:
         g_logger.error('Unsupported ABI version!')
         return USB_STATUS_UNSUPPORTED_ABI_VERSION
 
+    # Negotiate data frame payload size range. We'll reply with the intersection between the client's range and our own.
+    g_usbChunkMinShift = max(min_chunk_shift, USB_CHUNK_SHIFT_MIN)
+    g_usbChunkMaxShift = min(max_chunk_shift, USB_CHUNK_SHIFT_MAX)
+
+    if g_usbChunkMinShift > g_usbChunkMaxShift:
+        g_logger.error(f'Unsupported data frame payload size range! (client: [{min_chunk_shift}, {max_chunk_shift}], host: [{USB_CHUNK_SHIFT_MIN}, {USB_CHUNK_SHIFT_MAX}]).')
+        g_usbChunkMinShift = g_usbChunkMaxShift = 0
+        return USB_STATUS_MALFORMED_CMD
+
+    g_logger.debug(f'Negotiated data frame payload size range: 0x{1 << g_usbChunkMinShift:X} - 0x{1 << g_usbChunkMaxShift:X} bytes.')
+
+    # Negotiate optional features. We'll reply with the features supported by both sides, minus the ones disabled by the user.
+    g_usbFeatures = (features & USB_SUPPORTED_FEATURES & ~g_usbDisabledFeatures)
+    g_logger.debug(f'Negotiated features: 0x{g_usbFeatures:04X}.')
+
     # Return status code.
     return USB_STATUS_SUCCESS
 
 def usbHandleSendFileProperties(cmd_block: bytes) -> int | None:
-    global g_nspTransferMode, g_nspSize, g_nspHeaderSize, g_nspRemainingSize, g_nspFile, g_nspFilePath, g_outputDir, g_tkRoot, g_progressBarWindow
+    global g_nspTransferMode, g_nspSize, g_nspHeaderSize, g_nspRemainingSize, g_nspFile, g_nspFilePath, g_outputDir, g_tkRoot, g_progressBarWindow, g_extractedFsFileCount, g_lastTransferId
 
     assert g_logger is not None
     assert g_progressBarWindow is not None
@@ -792,13 +1158,18 @@ def usbHandleSendFileProperties(cmd_block: bytes) -> int | None:
     g_logger.debug(f'Received SendFileProperties ({USB_CMD_SEND_FILE_PROPERTIES:02X}) command.')
 
     # Parse command block.
-    (file_size, filename_length, nsp_header_size, raw_filename) = struct.unpack_from(f'<QII{USB_FILE_PROPERTIES_MAX_NAME_LENGTH}s', cmd_block, 0)
+    (file_size, filename_length, nsp_header_size, raw_filename, transfer_id) = struct.unpack_from(f'<QII{USB_FILE_PROPERTIES_MAX_NAME_LENGTH}s4xI', cmd_block, 0)
     filename = raw_filename.decode('utf-8').strip('\x00')
 
+    # A new transfer is starting, so the client won't ask about the previous one anymore.
+    g_lastTransferId = 0
+
     # Print info.
     dbg_str = f'File size: 0x{file_size:X} | Filename length: 0x{filename_length:X}'
     if nsp_header_size > 0:
         dbg_str += f' | NSP header size: 0x{nsp_header_size:X}'
+    if transfer_id:
+        dbg_str += f' | Transfer ID: 0x{transfer_id:08X}'
     g_logger.debug(dbg_str + '.')
 
     file_type_str = ('file' if (not g_nspTransferMode) else 'NSP file entry')
@@ -819,6 +1190,10 @@ def usbHandleSendFileProperties(cmd_block: bytes) -> int | None:
         g_logger.error('Invalid filename length!\n')
         return USB_STATUS_MALFORMED_CMD
 
+    # Update extracted FS dump stats.
+    if g_extractedFsDumpActive:
+        g_extractedFsFileCount += 1
+
     # Enable NSP transfer mode (if needed).
     if (not g_nspTransferMode) and file_size and nsp_header_size:
         g_nspTransferMode = True
@@ -857,6 +1232,10 @@ def usbHandleSendFileProperties(cmd_block: bytes) -> int | None:
         # Get file object.
         file = open(fullpath, "wb")
 
+        # Preallocate the output file. Under NSP transfer mode, this covers the whole NSP.
+        if file_size:
+            utilsPreallocateFile(file, file_size)
+
         if g_nspTransferMode:
             # Update NSP file object.
             g_nspFile = file
@@ -888,9 +1267,6 @@ def usbHandleSendFileProperties(cmd_block: bytes) -> int | None:
     # Start data transfer stage.
     g_logger.debug(f'Data transfer started. {"Saving" if file_type_str == "file" else "Writing"} {file_type_str} to: "{printable_fullpath}".')
 
-    offset = 0
-    blksize = USB_TRANSFER_BLOCK_SIZE
-
     # Check if we should use the progress bar window.
     use_pbar = (((not g_nspTransferMode) and (file_size > USB_TRANSFER_THRESHOLD)) or (g_nspTransferMode and (g_nspSize > USB_TRANSFER_THRESHOLD)))
     if use_pbar:
@@ -917,84 +1293,158 @@ def usbHandleSendFileProperties(cmd_block: bytes) -> int | None:
             # Set current prefix (holds the filename for the current NSP file entry).
             g_progressBarWindow.set_prefix(prefix)
 
-    def cancelTransfer():
-        # Cancel file transfer.
-        if g_nspTransferMode:
-            utilsResetNspInfo(True)
-        else:
-            file.close()
-            os.remove(fullpath)
+    # Receive file data.
+    return usbReceiveFileData(UsbFileTransfer(transfer_id, file, fullpath, file_size, use_pbar))
 
-        if use_pbar and (g_progressBarWindow is not None):
-            g_progressBarWindow.end()
+def usbReceiveFileData(xfer: UsbFileTransfer) -> int | None:
+    global g_nspRemainingSize, g_lastTransferId
 
-    # Start transfer process.
-    start_time = time.time()
-
-    while offset < file_size:
-        # Update block size (if needed).
-        diff = (file_size - offset)
-        if blksize > diff: blksize = diff
+    assert g_logger is not None
+    assert g_progressBarWindow is not None
 
-        # Set block size and handle Zero-Length Termination packet (if needed).
-        rd_size = blksize
-        if ((offset + blksize) >= file_size) and utilsIsValueAlignedToEndpointPacketSize(blksize):
-            rd_size += 1
+    file_size = xfer.file_size
+    file_hash = xfer.file_hash
 
-        # Read current chunk.
-        chunk = usbRead(rd_size, USB_TRANSFER_TIMEOUT)
-        if not chunk:
-            g_logger.error(f'Failed to read 0x{rd_size:X}-byte long data chunk!')
+    # Hand file data over to a dedicated writer thread.
+    writer = UsbFileWriter(xfer.file, xfer.use_pbar)
 
-            # Cancel file transfer.
-            cancelTransfer()
+    while xfer.offset < file_size:
+        # Read data frame.
+        frame = usbReadDataFrame(file_size - xfer.offset, True)
+        if frame is None:
+            # Keep everything we've got so far if the client is able to resume this transfer.
+            # All queued data must be written beforehand, so the committed offset is accurate.
+            if (not writer.close()) or (not usbSuspendFileTransfer(xfer)):
+                utilsCancelFileTransfer(xfer)
 
             # Returning None will make the command handler exit right away.
             return None
 
-        chunk_size = len(chunk)
+        (cmd_id, chunk) = frame
+        frame_size = len(chunk)
 
         # Check if we're dealing with a CancelFileTransfer command.
-        if chunk_size == USB_CMD_HEADER_SIZE:
-            (magic, cmd_id, _) = struct.unpack_from('<4sII', chunk, 0)
-            if (magic == USB_MAGIC_WORD) and (cmd_id == USB_CMD_CANCEL_FILE_TRANSFER):
-                # Cancel file transfer.
-                cancelTransfer()
+        if cmd_id == USB_CMD_CANCEL_FILE_TRANSFER:
+            # Cancel file transfer.
+            writer.close()
+            utilsCancelFileTransfer(xfer)
+
+            g_logger.debug(f'Received CancelFileTransfer ({USB_CMD_CANCEL_FILE_TRANSFER:02X}) command.')
+            g_logger.warning('Transfer cancelled.')
 
-                g_logger.debug(f'Received CancelFileTransfer ({USB_CMD_CANCEL_FILE_TRANSFER:02X}) command.')
-                g_logger.warning('Transfer cancelled.')
+            # Let the command handler take care of sending the status response for us.
+            return USB_STATUS_SUCCESS
 
-                # Let the command handler take care of sending the status response for us.
-                return USB_STATUS_SUCCESS
+        if cmd_id == USB_CMD_SEND_FILE_DATA:
+            # Log data frame payload size changes. The client adjusts it at runtime based on measured throughput.
+            # The last data frame from each file is ignored, since it may hold a smaller file tail.
+            if (frame_size != xfer.last_frame_size) and (frame_size < (file_size - xfer.offset)):
+                g_logger.debug(f'Data frame payload size: 0x{frame_size:X} bytes.')
+                xfer.last_frame_size = frame_size
 
-        # Write current chunk.
-        file.write(chunk)
-        file.flush()
+            # Queue current chunk.
+            writer.write(chunk)
+            chunk_size = frame_size
 
-        # Update current offset.
-        offset = (offset + chunk_size)
+            if file_hash is not None:
+                file_hash.update(chunk)
+        else:
+            # Parse fill parameters. The writer thread takes care of writing fill data on its own.
+            (chunk_size, fill_value) = struct.unpack_from('<QB', chunk, 0)
+            if (not chunk_size) or (chunk_size > (file_size - xfer.offset)):
+                g_logger.error(f'Received invalid fill size! (0x{chunk_size:X}).')
+                writer.close()
+                utilsCancelFileTransfer(xfer)
+                return None
+
+            writer.fill(fill_value, chunk_size)
+
+            if file_hash is not None:
+                utilsUpdateHashFill(file_hash, fill_value, chunk_size)
+
+        # Update current offset. Everything up to this point is considered to be committed once the writer thread is done with it.
+        xfer.offset += chunk_size
 
         # Update remaining NSP data size.
         if g_nspTransferMode:
             g_nspRemainingSize -= chunk_size
 
-        # Update progress bar window (if needed).
-        if use_pbar:
-            g_progressBarWindow.update(chunk_size)
+    # Get the checksum sent by the client, if needed.
+    expected_hash: bytes | None = None
+    if file_hash is not None:
+        expected_hash = usbReadFileHash()
+        if expected_hash is None:
+            if (not writer.close()) or (not usbSuspendFileTransfer(xfer)):
+                utilsCancelFileTransfer(xfer)
+            return None
+
+    # Wait for all file data to be written.
+    if not writer.close():
+        g_logger.error(f'Failed to write file data! ({writer.error}).\n')
+        utilsCancelFileTransfer(xfer)
+        return USB_STATUS_HOST_IO_ERROR
+
+    # Verify file data using the checksum sent by the client.
+    if (file_hash is not None) and (expected_hash is not None):
+        if file_hash.digest() != expected_hash:
+            g_logger.error(f'File hash mismatch! (expected {expected_hash.hex()}, got {file_hash.hexdigest()}).\n')
+            utilsCancelFileTransfer(xfer)
+            return USB_STATUS_FILE_HASH_MISMATCH
 
-    elapsed_time = round(time.time() - start_time)
+        g_logger.debug(f'File hash verified: {file_hash.hexdigest()}.')
+
+    elapsed_time = round(time.time() - xfer.start_time)
     g_logger.debug(f'File transfer successfully completed in {tqdm.format_interval(elapsed_time)}!\n')
 
     # Close file handle (if needed).
     if not g_nspTransferMode:
-        file.close()
+        xfer.file.close()
 
     # Hide progress bar window (if needed).
-    if use_pbar and ((not g_nspTransferMode) or (not g_nspRemainingSize)):
+    if xfer.use_pbar and ((not g_nspTransferMode) or (not g_nspRemainingSize)):
         g_progressBarWindow.end()
 
+    # Remember this transfer in case the client misses our status response.
+    g_lastTransferId = xfer.transfer_id
+
     return USB_STATUS_SUCCESS
 
+def usbSuspendFileTransfer(xfer: UsbFileTransfer) -> bool:
+    global g_resumeTransfer
+
+    assert g_logger is not None
+
+    if (not xfer.transfer_id) or (not (g_usbFeatures & USB_FEATURE_RESUME_TRANSFER)):
+        return False
+
+    g_logger.warning(f'Transfer interrupted at offset 0x{xfer.offset:X}. Waiting for the console to resume it.')
+    g_resumeTransfer = xfer
+
+    return True
+
+def utilsCancelFileTransfer(xfer: UsbFileTransfer) -> None:
+    # Cancel file transfer.
+    if g_nspTransferMode:
+        utilsResetNspInfo(True)
+    else:
+        xfer.file.close()
+        os.remove(xfer.fullpath)
+
+    if xfer.use_pbar and (g_progressBarWindow is not None):
+        g_progressBarWindow.end()
+
+def utilsDiscardInterruptedTransfer() -> None:
+    global g_resumeTransfer
+
+    if g_resumeTransfer is None:
+        return
+
+    if g_logger is not None:
+        g_logger.warning('Discarding interrupted transfer.\n')
+
+    utilsCancelFileTransfer(g_resumeTransfer)
+    g_resumeTransfer = None
+
 def usbHandleCancelFileTransfer(cmd_block: bytes) -> int:
     assert g_logger is not None
 
@@ -1052,6 +1502,8 @@ def usbHandleEndSession(cmd_block: bytes) -> int:
     return USB_STATUS_SUCCESS
 
 def usbHandleStartExtractedFsDump(cmd_block: bytes) -> int:
+    global g_extractedFsDumpActive, g_extractedFsFileCount, g_extractedFsStartTime
+
     assert g_logger is not None
 
     g_logger.debug(f'Received StartExtractedFsDump ({USB_CMD_START_EXTRACTED_FS_DUMP:02X}) command.')
@@ -1066,16 +1518,242 @@ def usbHandleStartExtractedFsDump(cmd_block: bytes) -> int:
 
     g_logger.info(f'Starting extracted FS dump (size 0x{extracted_fs_size:X}, output relative path "{extracted_fs_root_path}").')
 
+    # Reset extracted FS dump stats.
+    g_extractedFsDumpActive = True
+    g_extractedFsFileCount = 0
+    g_extractedFsStartTime = time.time()
+
     # Return status code.
     return USB_STATUS_SUCCESS
 
 def usbHandleEndExtractedFsDump(cmd_block: bytes) -> int:
+    global g_extractedFsDumpActive
+
     assert g_logger is not None
+
     g_logger.debug(f'Received EndExtractedFsDump ({USB_CMD_END_EXTRACTED_FS_DUMP:02X}) command.')
-    g_logger.info(f'Finished extracted FS dump.')
+
+    # Print extracted FS dump stats. Useful to compare batched and non-batched transfers.
+    elapsed_time = max(time.time() - g_extractedFsStartTime, 0.001)
+    batch_str = ('enabled' if (g_usbFeatures & USB_FEATURE_FILE_BATCH) else 'disabled')
+    g_logger.info(f'Finished extracted FS dump. Received {g_extractedFsFileCount} file(s) in {tqdm.format_interval(round(elapsed_time))} ({g_extractedFsFileCount / elapsed_time:.2f} files/s, file batching {batch_str}).')
+
+    g_extractedFsDumpActive = False
+
     return USB_STATUS_SUCCESS
 
+def usbHandleSendFileBatch(cmd_block: bytes) -> int | None:
+    global g_extractedFsFileCount
+
+    assert g_logger is not None
+
+    g_logger.debug(f'Received SendFileBatch ({USB_CMD_SEND_FILE_BATCH:02X}) command.')
+
+    # Parse manifest header.
+    (file_count, data_size) = struct.unpack_from('<I4xQ', cmd_block, 0)
+    status = USB_STATUS_SUCCESS
+
+    if (not g_extractedFsDumpActive) or g_nspTransferMode or (not (g_usbFeatures & USB_FEATURE_FILE_BATCH)):
+        g_logger.error('Unexpected file batch!')
+        status = USB_STATUS_MALFORMED_CMD
+
+    # Parse file entries.
+    entries: list[tuple[int, str]] = []
+    offset = USB_CMD_BLOCK_SIZE_SEND_FILE_BATCH
+
+    while (status == USB_STATUS_SUCCESS) and (len(entries) < file_count):
+        if (offset + USB_FILE_BATCH_ENTRY_SIZE) > len(cmd_block):
+            g_logger.error('File batch manifest is truncated!')
+            status = USB_STATUS_MALFORMED_CMD
+            break
+
+        (file_size, filename_length) = struct.unpack_from('<QI4x', cmd_block, offset)
+        offset += USB_FILE_BATCH_ENTRY_SIZE
+
+        if (not filename_length) or (filename_length > USB_FILE_PROPERTIES_MAX_NAME_LENGTH) or ((offset + filename_length) > len(cmd_block)):
+            g_logger.error(f'Invalid filename length in file batch manifest! (0x{filename_length:X}).')
+            status = USB_STATUS_MALFORMED_CMD
+            break
+
+        filename = cmd_block[offset:offset + filename_length].decode('utf-8')
+        offset += ((filename_length + 7) & ~7)
+
+        entries.append((file_size, filename))
+
+    if (status == USB_STATUS_SUCCESS) and (sum(entry[0] for entry in entries) != data_size):
+        g_logger.error(f'File batch data size mismatch! (0x{data_size:X}).')
+        status = USB_STATUS_MALFORMED_CMD
+
+    if status == USB_STATUS_SUCCESS:
+        g_logger.info(f'Receiving file batch: {file_count} file(s), 0x{data_size:X} bytes.')
+
+        # Make sure we have enough free space.
+        (_, _, free_space) = shutil.disk_usage(g_outputDir)
+        if free_space <= data_size:
+            g_logger.error('Not enough free space available in output volume!\n')
+            status = USB_STATUS_HOST_IO_ERROR
+
+    # File data is received as a single stream, in the same order as the file entries.
+    # Empty files are created as soon as we get to them.
+    file: BufferedWriter | None = None
+    entry_idx = 0
+    file_remaining = 0
+
+    def openNextFile() -> None:
+        nonlocal file, entry_idx, file_remaining
+
+        while (file is None) and (entry_idx < len(entries)):
+            (file_size, filename) = entries[entry_idx]
+            entry_idx += 1
+
+            fullpath = os.path.abspath(g_outputDir + os.path.sep + filename)
+            os.makedirs(os.path.dirname(fullpath), exist_ok=True)
+
+            if os.path.exists(fullpath) and (not os.path.isfile(fullpath)):
+                raise IsADirectoryError(f'Output filepath points to an existing directory! ("{fullpath[4:] if g_isWindows else fullpath}").')
+
+            g_logger.debug(f'Receiving file: "{filename}" (0x{file_size:X} bytes).')
+
+            file = open(fullpath, 'wb')
+
+            if file_size:
+                file_remaining = file_size
+            else:
+                file.close()
+                file = None
+
+    received = 0
+
+    # The client sends a single checksum for the whole data stream.
+    batch_hash = (hashlib.sha256() if (g_usbFeatures & USB_FEATURE_FILE_HASH) else None)
+
+    try:
+        while received < data_size:
+            frame = usbReadDataFrame(data_size - received, False)
+            if (frame is None) or (frame[0] == USB_CMD_CANCEL_FILE_TRANSFER):
+                if frame is not None:
+                    g_logger.error('Unexpected transfer cancellation mid file batch.')
+
+                # Returning None will make the command handler exit right away.
+                return None
+
+            chunk = memoryview(frame[1])
+            received += len(chunk)
+
+            if batch_hash is not None:
+                batch_hash.update(chunk)
+
+            # Keep draining the data stream if something went wrong, so we stay in sync with the client.
+            if status != USB_STATUS_SUCCESS:
+                continue
+
+            try:
+                chunk_offset = 0
+
+                while chunk_offset < len(chunk):
+                    openNextFile()
+                    assert file is not None
+
+                    wr_size = min(file_remaining, len(chunk) - chunk_offset)
+                    file.write(chunk[chunk_offset:chunk_offset + wr_size])
+
+                    chunk_offset += wr_size
+                    file_remaining -= wr_size
+
+                    if not file_remaining:
+                        file.close()
+                        file = None
+            except OSError as e:
+                g_logger.error(f'Failed to write file batch data! ({e}).\n')
+                status = USB_STATUS_HOST_IO_ERROR
+
+        # Create trailing empty files.
+        if status == USB_STATUS_SUCCESS:
+            try:
+                openNextFile()
+            except OSError as e:
+                g_logger.error(f'Failed to create file! ({e}).\n')
+                status = USB_STATUS_HOST_IO_ERROR
+    finally:
+        if file is not None:
+            file.close()
+
+    # Verify the data stream using the checksum sent by the client. Empty batches have no data stream.
+    if (batch_hash is not None) and data_size:
+        expected_hash = usbReadFileHash()
+        if expected_hash is None:
+            return None
+
+        if (status == USB_STATUS_SUCCESS) and (batch_hash.digest() != expected_hash):
+            g_logger.error(f'File batch hash mismatch! (expected {expected_hash.hex()}, got {batch_hash.hexdigest()}).\n')
+            status = USB_STATUS_FILE_HASH_MISMATCH
+
+    if status == USB_STATUS_SUCCESS:
+        g_extractedFsFileCount += file_count
+
+    return status
+
+def usbHandleResumeFileTransfer(cmd_block: bytes) -> int | None:
+    global g_resumeTransfer, g_lastTransferId
+
+    assert g_logger is not None
+
+    g_logger.debug(f'Received ResumeFileTransfer ({USB_CMD_RESUME_FILE_TRANSFER:02X}) command.')
+
+    # Parse command block.
+    (transfer_id, file_size) = struct.unpack_from('<I4xQ', cmd_block, 0)
+    xfer = g_resumeTransfer
+
+    if (not transfer_id) or (not (g_usbFeatures & USB_FEATURE_RESUME_TRANSFER)):
+        g_logger.error('Unexpected transfer resume request!\n')
+        return USB_STATUS_MALFORMED_CMD
+
+    if (xfer is None) and (transfer_id == g_lastTransferId):
+        # We already sent the status response for this transfer, but the client didn't get it. Let it know there's nothing left to send.
+        g_logger.info(f'Transfer 0x{transfer_id:08X} was already completed.\n')
+        g_lastTransferId = 0
+
+        if (not usbSendStatus(USB_STATUS_SUCCESS)) or (not usbSendResumeInfo(file_size, True)):
+            return None
+
+        return USB_STATUS_SUCCESS
+
+    if (xfer is None) or (xfer.transfer_id != transfer_id) or (xfer.file_size != file_size):
+        g_logger.error(f'Unable to resume transfer 0x{transfer_id:08X}!')
+        utilsDiscardInterruptedTransfer()
+        return USB_STATUS_MALFORMED_CMD
+
+    g_logger.info(f'Resuming transfer 0x{transfer_id:08X} from offset 0x{xfer.offset:X}.')
+    g_resumeTransfer = None
+
+    # Let the client know how much data we have already committed. It'll send everything else.
+    if (not usbSendStatus(USB_STATUS_SUCCESS)) or (not usbSendResumeInfo(xfer.offset, False)):
+        usbSuspendFileTransfer(xfer)
+        return None
+
+    return usbReceiveFileData(xfer)
+
+def usbSendResumeInfo(committed_size: int, completed: bool) -> bool:
+    info = struct.pack('<QB7x', committed_size, int(completed))
+    return bool(usbWrite(info, USB_TRANSFER_TIMEOUT) == len(info))
+
+def usbReconnect() -> bool:
+    # Only wait for the client to reconnect if it's able to resume an interrupted transfer, or if it may have missed our last status response.
+    if (g_resumeTransfer is None) and (not g_lastTransferId):
+        return False
+
+    # Drop the current connection. The USB device is reset while retrieving its endpoints, which also makes the console notice we're back.
+    tcpDisconnect()
+
+    if not usbGetDeviceEndpoints():
+        utilsDiscardInterruptedTransfer()
+        return False
+
+    return True
+
 def usbCommandHandler() -> None:
+    global g_lastTransferId
+
     assert g_logger is not None
 
     cmd_dict = {
@@ -1085,7 +1763,9 @@ def usbCommandHandler() -> None:
         USB_CMD_SEND_NSP_HEADER:         usbHandleSendNspHeader,
         USB_CMD_END_SESSION:             usbHandleEndSession,
         USB_CMD_START_EXTRACTED_FS_DUMP: usbHandleStartExtractedFsDump,
-        USB_CMD_END_EXTRACTED_FS_DUMP:   usbHandleEndExtractedFsDump
+        USB_CMD_END_EXTRACTED_FS_DUMP:   usbHandleEndExtractedFsDump,
+        USB_CMD_SEND_FILE_BATCH:         usbHandleSendFileBatch,
+        USB_CMD_RESUME_FILE_TRANSFER:    usbHandleResumeFileTransfer
     }
 
     # Get device endpoints.
@@ -1110,6 +1790,8 @@ def usbCommandHandler() -> None:
         cmd_header = usbRead(USB_CMD_HEADER_SIZE)
         if (not cmd_header) or (len(cmd_header) != USB_CMD_HEADER_SIZE):
             g_logger.error(f'Failed to read 0x{USB_CMD_HEADER_SIZE:X}-byte long command header!')
+            if usbReconnect():
+                continue
             break
 
         # Parse command header.
@@ -1128,6 +1810,8 @@ def usbCommandHandler() -> None:
             cmd_block = usbRead(rd_size, USB_TRANSFER_TIMEOUT)
             if (not cmd_block) or (len(cmd_block) != cmd_block_size):
                 g_logger.error(f'Failed to read 0x{cmd_block_size:X}-byte long command block for command ID {cmd_id:02X}!')
+                if usbReconnect():
+                    continue
                 break
 
         # Verify magic word.
@@ -1147,19 +1831,37 @@ def usbCommandHandler() -> None:
         if (cmd_id == USB_CMD_START_SESSION and cmd_block_size != USB_CMD_BLOCK_SIZE_START_SESSION) or \
            (cmd_id == USB_CMD_SEND_FILE_PROPERTIES and cmd_block_size != USB_CMD_BLOCK_SIZE_SEND_FILE_PROPERTIES) or \
            (cmd_id == USB_CMD_SEND_NSP_HEADER and not cmd_block_size) or \
-           (cmd_id == USB_CMD_START_EXTRACTED_FS_DUMP and cmd_block_size != USB_CMD_BLOCK_SIZE_START_EXTRACTED_FS_DUMP):
+           (cmd_id == USB_CMD_START_EXTRACTED_FS_DUMP and cmd_block_size != USB_CMD_BLOCK_SIZE_START_EXTRACTED_FS_DUMP) or \
+           (cmd_id == USB_CMD_SEND_FILE_BATCH and cmd_block_size < USB_CMD_BLOCK_SIZE_SEND_FILE_BATCH) or \
+           (cmd_id == USB_CMD_RESUME_FILE_TRANSFER and cmd_block_size != USB_CMD_BLOCK_SIZE_RESUME_FILE_TRANSFER):
             g_logger.error(f'Invalid command block size for command ID {cmd_id:02X}! (0x{cmd_block_size:X}).\n')
             usbSendStatus(USB_STATUS_MALFORMED_CMD)
             continue
 
+        # Any command other than the ones used to resume an interrupted transfer means the client moved on.
+        if (cmd_id != USB_CMD_START_SESSION) and (cmd_id != USB_CMD_RESUME_FILE_TRANSFER):
+            utilsDiscardInterruptedTransfer()
+            g_lastTransferId = 0
+
         # Run command handler function.
-        # Send status response afterwards. Bail out if requested.
+        # Send status response afterwards. Bail out if requested, unless the connection was lost mid-transfer and the client is able to resume it.
         status = cmd_func(cmd_block)
-        if (status is None) or (not usbSendStatus(status)) or (cmd_id == USB_CMD_END_SESSION) or (status == USB_STATUS_UNSUPPORTED_ABI_VERSION):
+        if (status is None) or (not usbSendStatus(status)):
+            if usbReconnect():
+                continue
+            break
+
+        if (cmd_id == USB_CMD_END_SESSION) or (status == USB_STATUS_UNSUPPORTED_ABI_VERSION):
             break
 
     g_logger.info('\nStopping server.')
 
+    # Discard interrupted transfer (if needed).
+    utilsDiscardInterruptedTransfer()
+
+    # Close TCP connection (if needed).
+    tcpDisconnect()
+
     if not g_cliMode:
         # Update UI.
         uiToggleElements(True)
@@ -1410,7 +2112,7 @@ def cliInitialize() -> None:
     usbCommandHandler()
 
 def main() -> int:
-    global g_cliMode, g_outputDir, g_osType, g_osVersion, g_isWindows, g_isWindowsVista, g_isWindows7, g_logger
+    global g_cliMode, g_usbDisabledFeatures, g_tcpAddress, g_outputDir, g_osType, g_osVersion, g_isWindows, g_isWindowsVista, g_isWindows7, g_logger
 
     # Disable warnings.
     warnings.filterwarnings("ignore")
@@ -1420,12 +2122,23 @@ def main() -> int:
     parser.add_argument('-c', '--cli', required=False, action='store_true', default=False, help='Start the script in CLI mode.')
     parser.add_argument('-o', '--outdir', required=False, type=str, metavar='DIR', help=f'Path to output directory. Defaults to "{DEFAULT_DIR}".')
     parser.add_argument('-v', '--verbose', required=False, action='store_true', default=False, help='Enable verbose output.')
+    parser.add_argument('-n', '--no-batch', required=False, action='store_true', default=False, help='Disable file batching during extracted FS dumps.')
+    parser.add_argument('-z', '--no-compression', required=False, action='store_true', default=False, help='Disable LZ4 compressed transfers.')
+    parser.add_argument('-x', '--no-hash', required=False, action='store_true', default=False, help='Disable file data checksum verification.')
+    parser.add_argument('-r', '--no-resume', required=False, action='store_true', default=False, help='Disable resuming interrupted file transfers after reconnecting.')
+    parser.add_argument('-t', '--tcp', required=False, type=str, metavar='ADDR[:PORT]', help=f'Connect to a {USB_DEV_PRODUCT} build with TCP transport support instead of using USB. Port defaults to {USB_TCP_PORT}.')
     args = parser.parse_args()
 
     # Update global flags.
     g_cliMode = args.cli
+    g_usbDisabledFeatures = ((USB_FEATURE_FILE_BATCH if args.no_batch else 0) | (USB_FEATURE_LZ4_COMPRESSION if args.no_compression else 0) | \
+                             (USB_FEATURE_FILE_HASH if args.no_hash else 0) | (USB_FEATURE_RESUME_TRANSFER if args.no_resume else 0))
     g_outputDir = utilsGetPath(args.outdir, DEFAULT_DIR, False, True)
 
+    if args.tcp:
+        (tcp_host, _, tcp_port) = args.tcp.rpartition(':') if (':' in args.tcp) else (args.tcp, '', str(USB_TCP_PORT))
+        g_tcpAddress = (tcp_host, int(tcp_port))
+
     # Get OS information.
     g_osType = platform.system()
     g_osVersion = platform.version()
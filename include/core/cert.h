@@ -151,6 +151,11 @@ bool certRetrieveCertificateChainBySignatureIssuer(CertificateChain *dst, const
 /// Returns NULL if an error occurs.
 u8 *certGenerateRawCertificateChainBySignatureIssuer(const char *issuer, u64 *out_size);
 
+/// Enables or disables the raw certificate chain cache. While enabled, raw certificate chains generated by certGenerateRawCertificateChainBySignatureIssuer() are kept in memory,
+/// so the ES certificate system savefile doesn't need to be opened again for the same signature issuer. Disabling the cache frees all cached certificate chains.
+/// Meant to be used by batch operations that may need the same certificate chains more than once. Disabled by default.
+void certSetRawCertificateChainCacheEnabled(bool enabled);
+
 /// Returns a pointer to a dynamically allocated buffer that holds the concatenated raw contents from the certificate chain matching the input rights ID in the inserted gamecard.
 /// The returned buffer must be freed by the user.
 /// Returns NULL if an error occurs.
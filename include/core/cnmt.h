@@ -318,6 +318,10 @@ typedef struct {
 /// Initializes a ContentMetaContext using a previously initialized NcaContext (which must belong to a Meta NCA).
 bool cnmtInitializeContext(ContentMetaContext *out, NcaContext *nca_ctx);
 
+/// Returns a pointer to the NcmPackagedContentInfo entry with a content ID that matches the provided one. Meta NCAs aren't referenced by these entries.
+/// Returns NULL if an error occurs or if no matching entry is found.
+NcmPackagedContentInfo *cnmtGetPackagedContentInfoByContentId(ContentMetaContext *cnmt_ctx, const NcmContentId *content_id);
+
 /// Looks for a NcmPackagedContentInfo entry with a content ID that matches the one from the input NcaContext and verifies its hash.
 bool cnmtVerifyContentHash(ContentMetaContext *cnmt_ctx, NcaContext *nca_ctx, const u8 *hash);
 
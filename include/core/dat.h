@@ -0,0 +1,63 @@
+/*
+ * dat.h
+ *
+ * Copyright (c) 2020-2024, DarkMatterCore <pabloacurielz@gmail.com>.
+ *
+ * This file is part of nxdumptool (https://github.com/DarkMatterCore/nxdumptool).
+ *
+ * nxdumptool is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nxdumptool is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef __DAT_H__
+#define __DAT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DAT_NAME_LENGTH 0x200
+
+/// Checksum database entry retrieved by one of the lookup functions below.
+typedef struct {
+    char name[DAT_NAME_LENGTH]; ///< Game name, as stored in the DAT file.
+    u64 size;
+    u32 crc32;
+    u8 sha1[SHA1_HASH_SIZE];    ///< Zeroed out if unavailable in the DAT file.
+} DatEntryInfo;
+
+/// Offline checksum database interface (e.g. No-Intro DAT files).
+/// A sorted binary index is built from the Logiqx XML DAT file at DAT_FILE_PATH the first time it's needed, and stored at DAT_INDEX_FILE_PATH.
+/// The index is only rebuilt if the DAT file is updated. Lookups are performed in O(log n) time directly on the loaded index.
+
+/// Closes the checksum database interface, freeing the loaded index.
+void datExit(void);
+
+/// Returns true if a checksum database is available. Loads (or builds) the index if it hasn't been loaded yet.
+bool datIsAvailable(void);
+
+/// Looks up a checksum database entry by CRC32 checksum. If 'size' is non-zero, it will also be used to filter out entries with a mismatching size.
+/// Returns false if the checksum database is unavailable or if no entry was found.
+bool datLookupByCrc32(u32 crc32, u64 size, DatEntryInfo *out);
+
+/// Looks up a checksum database entry by SHA-1 checksum.
+/// Returns false if the checksum database is unavailable or if no entry was found.
+bool datLookupBySha1(const u8 *sha1, DatEntryInfo *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DAT_H__ */
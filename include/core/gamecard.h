@@ -340,6 +340,15 @@ typedef struct {
 
 NXDT_ASSERT(LotusAsicFirmwareBlob, 0x7800);
 
+/// Storage read statistics. Reset each time a gamecard is inserted or removed, or if gamecardResetReadStatistics() is called.
+typedef struct {
+    u64 request_count;          ///< Number of read requests received through gamecardReadStorage().
+    u64 storage_read_count;     ///< Number of fsStorageRead() calls issued to fulfill read requests.
+    u64 storage_read_size;      ///< Number of bytes read from the gamecard to fulfill read requests, including read-ahead data.
+    u64 read_ahead_hit_count;   ///< Number of read requests served straight from a read-ahead window.
+    u64 area_switch_count;      ///< Number of times a storage area had to be closed to open the other one.
+} GameCardReadStatistics;
+
 /// Initializes data needed to access raw gamecard storage areas.
 /// Also spans a background thread to automatically detect gamecard status changes and to cache data from the inserted gamecard.
 bool gamecardInitialize(void);
@@ -369,9 +378,16 @@ bool gamecardGetLotusAsicFirmwareBlob(LotusAsicFirmwareBlob *out_lafw_blob, u64
 
 /// Used to read raw data from the inserted gamecard. Supports unaligned reads.
 /// All required handles, changes between normal <-> secure storage areas and proper offset calculations are managed internally.
+/// Small and unaligned reads are served through internal read-ahead windows. Each storage area keeps its own, so interleaved reads from both areas don't discard each other's buffered data.
 /// 'offset' + 'read_size' must not exceed the value returned by gamecardGetTotalSize().
 bool gamecardReadStorage(void *out, u64 read_size, u64 offset);
 
+/// Fills the provided GameCardReadStatistics pointer with the current storage read statistics.
+void gamecardGetReadStatistics(GameCardReadStatistics *out);
+
+/// Resets storage read statistics.
+void gamecardResetReadStatistics(void);
+
 /// Fills the provided GameCardHeader pointer.
 /// This area can also be read using gamecardReadStorage(), starting at offset 0.
 bool gamecardGetHeader(GameCardHeader *out);
@@ -189,6 +189,11 @@ typedef struct {
 /// Titlekey is also RSA-OAEP unwrapped (if needed) and titlekek-decrypted right away.
 bool tikRetrieveTicketByRightsId(Ticket *dst, const FsRightsId *id, u8 key_generation, bool use_gamecard);
 
+/// Enables or disables the ticket cache. While enabled, the ES ticket system savefiles opened by tikRetrieveTicketByRightsId() are kept open, and their ticket_list.bin entries are kept in memory.
+/// This lets further tikRetrieveTicketByRightsId() calls look up any rights ID without opening and scanning the savefiles again.
+/// Disabling the cache closes the savefiles. Meant to be used by batch operations that retrieve multiple tickets. Disabled by default.
+void tikSetTicketCacheEnabled(bool enabled);
+
 /// Converts a TikTitleKeyType_Personalized ticket into a TikTitleKeyType_Common ticket and optionally generates a raw certificate chain for the new signature issuer.
 /// Bear in mind the 'size' member from the Ticket parameter will be updated by this function to remove any possible references to ESV1/ESV2 records.
 /// If both 'out_raw_cert_chain' and 'out_raw_cert_chain_size' pointers are provided, raw certificate chain data will be saved to them.
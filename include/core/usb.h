@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #define USB_TRANSFER_BUFFER_SIZE    0x800000    /* 8 MiB. */
+#define USB_TRANSFER_ALIGNMENT      0x1000      /* 4 KiB. */
 
 /// Used to indicate the USB speed selected by the host device.
 typedef enum {
@@ -42,7 +43,16 @@ typedef enum {
     UsbHostSpeed_Count      = 4     ///< Total values supported by this enum.
 } UsbHostSpeed;
 
+/// Used to describe a file data fragment for usbSendFileDataV().
+typedef struct {
+    const void *data;                   ///< Must be aligned to USB_TRANSFER_ALIGNMENT. Buffers returned by usbAllocatePageAlignedBuffer() always are.
+    u64 size;
+    void (*release)(void *userdata);    ///< Optional. Called once the host device has received the whole fragment, or if the file data transfer fails. The buffer must not be modified until then.
+    void *userdata;                     ///< Passed to the release callback.
+} UsbFileDataFragment;
+
 /// Initializes the USB interface, input and output endpoints and allocates an internal transfer buffer.
+/// If nxdumptool was built with USB_TRANSPORT_TCP set to 1, a TCP listener is started instead, and all USB transfers take place over a single TCP connection established by the host device. The TCP transport is left out of all other builds.
 bool usbInitialize(void);
 
 /// Closes the USB interface, input and output endpoints and frees the transfer buffer.
@@ -69,11 +79,40 @@ bool usbSendNspProperties(u64 nsp_size, const char *filename, u32 nsp_header_siz
 
 /// Performs a file data transfer. Must be continuously called after usbSendFileProperties() / usbSendNspProperties() until all file data has been transferred.
 /// Data chunk size must not exceed USB_TRANSFER_BUFFER_SIZE.
-/// If the last file data chunk is aligned to the endpoint max packet size, the host device should expect a Zero Length Termination (ZLT) packet.
+/// Each data chunk is sent as one or more SendFileData frames. Frame payload sizes are adjusted at runtime within the range negotiated with the host device, based on measured throughput.
+/// If a frame payload is aligned to the endpoint max packet size, the host device should expect a Zero Length Termination (ZLT) packet.
+/// Runs of at least 64 KiB of identical bytes (e.g. zero padding) found within a data chunk are sent as FillFileData frames instead.
+/// If supported by the host device, a SHA-256 checksum of the whole file is sent right after the last data chunk, and verified by the host device before sending its status response.
+/// If supported by the host device, a file data transfer interrupted by a connection loss is resumed as soon as a new USB session is established, starting at the offset already written by the host device.
+/// This function blocks for up to 60 seconds while waiting for that to happen. File batches sent during extracted filesystem dumps can't be resumed.
 /// Calling this function if there's no remaining data to transfer will result in an error.
+/// This is a wrapper for usbSubmitFileData().
 bool usbSendFileData(const void *data, u64 data_size);
 
+/// Queues a file data chunk for transfer. Returns as soon as the chunk has been copied to an internal page aligned buffer, so the caller may reuse its own buffer right away.
+/// A small number of chunks can be in flight at once. This function only blocks if the queue is full, in which case it waits for the oldest chunk to be received by the host device.
+/// The queue is automatically flushed after submitting the last chunk from a file, before reading the status response from the host device.
+bool usbSubmitFileData(const void *data, u64 data_size);
+
+/// Blocks until all queued file data chunks have been received by the host device.
+/// Release callbacks from all fragments previously sent using usbSendFileDataV() are invoked by the time this function returns.
+bool usbFlushFileData(void);
+
+/// Performs a file data transfer straight from the provided page aligned buffers, without copying file data to internal buffers first.
+/// Fragments are sent in order, as if usbSendFileData() had been called for each one of them. Fragment sizes aren't capped to USB_TRANSFER_BUFFER_SIZE.
+/// Returns as soon as all fragments have been queued. Each fragment buffer is held until the host device receives it, which lets the file data transfer stage be resumed if the connection is lost.
+/// The release callback from each fragment is always invoked exactly once, either from this function or from a later USB call (possibly from another thread, with the USB interface mutex held).
+/// Callers must not call any other USB functions from release callbacks. They should call usbFlushFileData() before waiting on their own buffers if they have nothing else to send.
+/// Fill runs are only detected at USB_TRANSFER_ALIGNMENT granularity. Fragments without a release callback are copied to internal buffers using usbSendFileData().
+/// The same takes place if the host device requested compressed file data, or if a file batch is active, in which case release callbacks are invoked right away.
+bool usbSendFileDataV(const UsbFileDataFragment *fragments, u32 fragment_count);
+
+/// Makes the host device write 'fill_size' bytes set to 'fill_value' to the output file, without transferring the actual data. Can be freely mixed with usbSendFileData() calls.
+/// 'fill_size' must not exceed the remaining file size. Calling this function if there's no remaining data to transfer will result in an error.
+bool usbSendFileFill(u8 fill_value, u64 fill_size);
+
 /// Used to gracefully cancel an ongoing file transfer. The current USB session is kept alive.
+/// Release callbacks from all pending usbSendFileDataV() fragments are invoked before this function returns.
 void usbCancelFileTransfer(void);
 
 /// Sends NSP header data to the host device, making it rewind the NSP file pointer to write this data, essentially finishing the NSP transfer process.
@@ -82,11 +121,14 @@ void usbCancelFileTransfer(void);
 bool usbSendNspHeader(const void *nsp_header, u32 nsp_header_size);
 
 /// Informs the host device that an extracted filesystem dump (e.g. HFS, PFS, RomFS) is about to begin.
+/// If supported by the host device, small files sent during an extracted filesystem dump are batched: usbSendFileProperties() and usbSendFileData() calls for these files
+/// return right away, and file data is transferred in batches, which are only acknowledged once by the host device. This means errors for a given file may be reported by a later call.
 bool usbStartExtractedFsDump(u64 extracted_fs_size, const char *extracted_fs_root_path);
 
 /// Informs the host device that a previously started filesystem dump (via usbStartExtractedFsDump()) has finished.
-/// This is only issued after all extracted file entries have been successfully transferred to the host device.
-void usbEndExtractedFsDump(void);
+/// This must only be called after all extracted file entries have been transferred. Any pending file batch is sent to the host device beforehand.
+/// Returns false if the last file batch couldn't be transferred.
+bool usbEndExtractedFsDump(void);
 
 #ifdef __cplusplus
 }
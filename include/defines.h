@@ -103,6 +103,11 @@
 #define PROD_KEYS_FILE_PATH             DEVOPTAB_SDMC_DEVICE HBMENU_BASE_PATH "prod.keys"               /* Retail unit keys. */
 #define DEV_KEYS_FILE_PATH              DEVOPTAB_SDMC_DEVICE HBMENU_BASE_PATH "dev.keys"                /* Development unit keys. */
 
+#define DAT_FILE_PATH                   DEVOPTAB_SDMC_DEVICE APP_BASE_PATH "checksums.dat"              /* Logiqx XML DAT file (e.g. No-Intro). */
+#define DAT_INDEX_FILE_PATH             DAT_FILE_PATH ".idx"
+
+#define TITLE_CACHE_FILE_PATH           DEVOPTAB_SDMC_DEVICE APP_BASE_PATH "title_cache.bin"            /* Application metadata retrieved from ns. */
+
 #define LOG_FILE_NAME                   APP_TITLE ".log"
 #define LOG_BUF_SIZE                    0x400000                                                        /* 4 MiB. */
 #define LOG_FORCE_FLUSH                 0                                                               /* Forces a log buffer flush each time the logfile is written to. */
@@ -28,18 +28,29 @@
 #include <mutex>
 
 #include "data_transfer_task.hpp"
+#include "../core/dat.h"
+#include "../utils/file_writer.hpp"
 
 namespace nxdt::tasks
 {
     typedef std::optional<std::string> GameCardDumpTaskError;
 
     /* Generates an image dump out of the inserted gamecard. */
-    class GameCardImageDumpTask: public DataTransferTask<GameCardDumpTaskError, std::string, bool, bool, bool, bool, bool>
+    class GameCardImageDumpTask: public DataTransferTask<GameCardDumpTaskError, std::string, std::string, bool, bool, bool, bool, bool>
     {
         private:
             std::mutex task_mtx;
             bool calculate_checksum = false, lookup_checksum = false;
             u32 gc_img_crc = 0, full_gc_img_crc = 0;
+            bool checksum_match = false;
+            DatEntryInfo checksum_match_info{};
+
+            /* Fills the provided journal state with our current checksums. */
+            const nxdt::utils::FileWriter::JournalState& GetJournalState(nxdt::utils::FileWriter::JournalState& out);
+
+            /* Returns the offset at which 0xFF padding starts within an untrimmed gamecard image of the provided size. */
+            /* Returns the provided size if the padding area can't be synthesized. */
+            size_t GetPaddingStartOffset(const size_t& gc_img_size);
 
         protected:
             /* Set class as non-copyable and non-moveable. */
@@ -47,7 +58,8 @@ namespace nxdt::tasks
             NON_MOVEABLE(GameCardImageDumpTask);
 
             /* Runs in the background thread. */
-            GameCardDumpTaskError DoInBackground(const std::string& output_path, const bool& prepend_key_area, const bool& keep_certificate, const bool& trim_dump,
+            /* If 'mirror_path' isn't empty, the gamecard image is also written to it. */
+            GameCardDumpTaskError DoInBackground(const std::string& output_path, const std::string& mirror_path, const bool& prepend_key_area, const bool& keep_certificate, const bool& trim_dump,
                                                  const bool& calculate_checksum, const bool& lookup_checksum) override final;
 
         public:
@@ -68,6 +80,16 @@ namespace nxdt::tasks
                 std::scoped_lock lock(this->task_mtx);
                 return ((this->calculate_checksum && this->IsFinished() && !this->IsCancelled()) ? this->full_gc_img_crc : 0);
             }
+
+            /* Returns true if the CRC32 calculated over the gamecard image matched an entry from the offline checksum database, in which case 'out' is updated. */
+            /* Returns false if checksum lookup wasn't enabled, if no match was found, if the task hasn't finished yet or if the task was cancelled. */
+            ALWAYS_INLINE bool GetChecksumLookupResult(DatEntryInfo& out)
+            {
+                std::scoped_lock lock(this->task_mtx);
+                bool ret = (this->lookup_checksum && this->checksum_match && this->IsFinished() && !this->IsCancelled());
+                if (ret) out = this->checksum_match_info;
+                return ret;
+            }
     };
 }
 
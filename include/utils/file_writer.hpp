@@ -26,6 +26,12 @@
 
 #include <borealis.hpp>
 #include <optional>
+#include <array>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "../core/nxdt_utils.h"
 #include "../core/usb.h"
@@ -34,6 +40,13 @@ namespace nxdt::utils
 {
     /* Writes output files to different storage locations based on the provided input path. */
     /* It also handles file splitting in FAT-based UMS volumes. */
+    /* If a journal ID is provided, written chunks are recorded in a journal file stored next to the output file (SD card and UMS devices only). */
+    /* This lets interrupted dumps be resumed from the last chunk that can still be verified within the partial output file. */
+    /* If asynchronous writes are requested, data is copied to a small pool of page aligned buffers (allocated on demand) and written to the output device by a dedicated thread. */
+    /* Write errors are then reported by the next Write() / WriteFill() / Flush() / Close() call. Queued data is coalesced into large extents aligned to the buffer size. */
+    /* Output files (or part files) stored on the SD card or UMS devices are preallocated right after being created, which keeps them from getting fragmented. */
+    /* Preallocated space that doesn't get written to is trimmed once the file is closed, so incomplete files don't end with a garbage tail. */
+    /* Data can also be mirrored to additional output files stored in other storage devices (e.g. SD card + USB host), each one written from its own thread. */
     class FileWriter
     {
         public:
@@ -45,7 +58,33 @@ namespace nxdt::utils
                 UmsDevice = 3
             } StorageType;
 
+            /* Opaque data stored in journal files. Used both to identify the dumped data and to keep track of caller state after each written chunk (e.g. rolling checksums). */
+            typedef std::array<u8, 0x10> JournalState;
+
         private:
+            /* Request types processed by the asynchronous writer thread. */
+            typedef enum : u8 {
+                Data    = 0,
+                Fill    = 1,    ///< Only used with USB hosts.
+                Journal = 2
+            } AsyncRequestType;
+
+            typedef struct {
+                AsyncRequestType type;
+                u8 *buf;            ///< Pooled buffer. Only used by data requests.
+                size_t offset;      ///< Output file offset.
+                size_t size;
+                u8 fill_value;      ///< Only used by fill requests.
+                u32 crc;            ///< Only used by journal requests.
+                JournalState state; ///< Only used by journal requests.
+            } AsyncRequest;
+
+            /* Used to hand pooled buffers back to the asynchronous writer once they're no longer needed by the USB interface. */
+            typedef struct {
+                FileWriter *writer;
+                u8 *buf;
+            } AsyncBufferRef;
+
             std::string output_path{};
             size_t total_size = 0, cur_size = 0;
 
@@ -59,37 +98,126 @@ namespace nxdt::utils
             FILE *fp = nullptr;
             u8 split_file_part_cnt = 0, split_file_part_idx = 0;
             size_t split_file_part_size = 0;
+            size_t cur_file_size = 0, cur_file_alloc_size = 0;
+
+            std::vector<u8> fill_buf{};
+
+            std::string journal_path{};
+            FILE *journal_fp = nullptr;
+            JournalState journal_id{}, resume_state{};
+            size_t resume_offset = 0;
+
+            bool async_write = false, async_exit = false, async_discard = false, async_error = false, async_journal = false;
+            std::thread async_thread{};
+            std::mutex async_mtx{};
+            std::condition_variable async_cond{};
+            std::deque<AsyncRequest> async_queue{};
+            std::vector<u8*> async_bufs{}, async_free_bufs{};
+            std::vector<AsyncBufferRef> async_buf_refs{};
+            size_t async_buf_size = 0;
+            size_t async_usb_pending = 0;   ///< Number of pooled buffers held by the USB interface.
+            bool async_busy = false;
+            size_t async_written_size = 0;
+
+            u8 *async_cur_buf = nullptr;
+            size_t async_cur_offset = 0, async_cur_size = 0;
+            std::vector<AsyncRequest> async_cur_journal{};
+
+            u64 alloc_ticks = 0, write_ticks = 0, async_wait_ticks = 0;
+
+            std::vector<std::unique_ptr<FileWriter>> mirrors{};
 
             std::optional<std::string> CheckFreeSpace(void);
 
+            bool ResumeFromJournal(void);
+            bool CreateJournal(void);
+            void AppendJournalEntry(const size_t& offset, const size_t& size, const u32& crc, const JournalState& state);
+            void CloseJournal(bool remove_journal);
+
+            bool ReadOutputData(void *out, const size_t& read_size, const size_t& offset);
+            bool OpenOutputFileAtOffset(const size_t& offset);
+
             void CloseCurrentFile(void);
 
             bool OpenNextFile(void);
+            size_t GetCurrentFileFinalSize(void);
+            void PreallocateCurrentFile(const size_t& size);
 
             bool CreateInitialFile(void);
 
+            bool WriteChunk(const void *data, const size_t& data_size);
+            bool WriteData(const void *data, const size_t& data_size, const size_t& offset);
+            void RecordChunk(const size_t& offset, const size_t& size, const u32& crc, const JournalState& state);
+            bool IsJournaling(void);
+
+            bool StartAsyncWriter(void);
+            void StopAsyncWriter(bool discard);
+            bool QueueAsyncRequest(const AsyncRequest& request, const void *data);
+            bool AllocateAsyncBuffer(void);
+            void SubmitAsyncBuffer(void);
+            void AsyncWriterThreadFunc(void);
+            static void ReleaseAsyncBuffer(void *userdata);
+
         protected:
             /* Set class as non-copyable and non-moveable. */
             NON_COPYABLE(FileWriter);
             NON_MOVEABLE(FileWriter);
 
         public:
-            FileWriter(const std::string& output_path, const size_t& total_size, const u32& nsp_header_size = 0);
+            /* If mirror paths are provided, all data is also written to them. Mirrors must be stored in storage devices other than the main one, and only one of them may be a USB host. */
+            /* Journaling isn't available with mirrors, and asynchronous writes are always enabled. */
+            FileWriter(const std::string& output_path, const size_t& total_size, const u32& nsp_header_size = 0, const JournalState *journal_id = nullptr, const bool& async_write = false,
+                       const std::vector<std::string>& mirror_paths = {});
             ~FileWriter();
 
             /* Writes data to the output file. */
             /* Takes care of seamlessly switching to a new part file if needed. */
             bool Write(const void *data, const size_t& data_size);
 
+            /* Same as Write(), but it also records the written chunk in the journal file alongside the provided caller state. */
+            bool Write(const void *data, const size_t& data_size, const JournalState& state);
+
+            /* Writes 'fill_size' bytes set to 'fill_value' to the output file. */
+            /* USB hosts receive a single fill command instead of the actual data. */
+            bool WriteFill(const u8& fill_value, const size_t& fill_size);
+
+            /* Same as WriteFill(), but it also records the written chunk in the journal file alongside the provided caller state. */
+            bool WriteFill(const u8& fill_value, const size_t& fill_size, const JournalState& state);
+
+            /* Returns the output file offset from which a resumed dump must continue. Returns zero if nothing was resumed. */
+            /* Data written by callers must start at this offset. */
+            size_t GetResumeOffset(void);
+
+            /* Returns the caller state recorded alongside the last verified chunk from a resumed dump. Only meaningful if GetResumeOffset() returns a non-zero value. */
+            const JournalState& GetResumeState(void);
+
             /* Writes NSP header data to offset 0. */
             /* Only valid if dealing with a NSP file. */
             bool WriteNspHeader(const void *nsp_header, const u32& nsp_header_size);
 
+            /* Blocks until all data queued for asynchronous writing has reached the output device. */
+            /* Returns false if any asynchronous write failed. Always returns true if asynchronous writes aren't enabled. */
+            bool Flush(void);
+
             /* Closes the file and deletes it if it's incomplete (or if forcefully requested). */
-            void Close(bool force_delete = false);
+            /* Incomplete files are kept on the output device if journaling is enabled, unless a forced deletion is requested. */
+            /* Returns false if any asynchronous write failed, in which case the output file is treated as incomplete. */
+            bool Close(bool force_delete = false);
 
             /* Returns the storage type for this file. */
             StorageType GetStorageType(void);
+
+            /* Returns the storage type for the provided output path. */
+            static StorageType GetStorageTypeFromPath(const std::string& path);
+
+            /* Returns the time spent preallocating output files, in nanoseconds. */
+            u64 GetAllocationTime(void);
+
+            /* Returns the time spent writing data to output files, in nanoseconds. Doesn't include USB transfers, nor the time spent waiting for asynchronous writes. */
+            u64 GetWriteTime(void);
+
+            /* Returns the time spent by producers waiting for a free asynchronous write buffer, in nanoseconds. Always zero if asynchronous writes aren't enabled. */
+            u64 GetAsyncWaitTime(void);
     };
 }
 
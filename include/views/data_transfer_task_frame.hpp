@@ -95,7 +95,7 @@ namespace nxdt::views
                         if (ret)
                         {
                             /* Store notification message. */
-                            this->notification = brls::i18n::getStr("generic/process_complete");
+                            this->notification = this->GetCompletionMessage();
 
                             /* Pop view. */
                             this->onCancel();
@@ -136,6 +136,12 @@ namespace nxdt::views
             /* If the task failed, false shall be returned and `error_msg` shall be updated to reflect the error reason. */
             virtual bool GetTaskResult(std::string& error_msg) = 0;
 
+            /* May be overridden by derived classes to customize the notification message displayed after the background task succeeds. */
+            virtual std::string GetCompletionMessage(void)
+            {
+                return brls::i18n::getStr("generic/process_complete");
+            }
+
         public:
             template<typename... Params>
             DataTransferTaskFrame(const std::string& title, const Params&... params) : brls::AppletFrame(true, true)
@@ -55,6 +55,8 @@ namespace nxdt::views
 
             void UpdateStoragePrefix(u32 selected);
 
+            bool GenerateOutputFilePath(const std::string& storage_prefix, u32 selected, const std::string& extension, std::string& output);
+
         protected:
             DumpOptionsFrame(RootView *root_view, const std::string& title, const std::string& base_output_path, const std::string& raw_filename);
             DumpOptionsFrame(RootView *root_view, const std::string& title, brls::Image *icon, const std::string& base_output_path, const std::string& raw_filename);
@@ -66,6 +68,14 @@ namespace nxdt::views
 
             bool GetOutputFilePath(const std::string& extension, std::string& output);
 
+            /* Same as GetOutputFilePath(), but it always generates a path within the SD card. */
+            bool GetSdCardOutputFilePath(const std::string& extension, std::string& output);
+
+            ALWAYS_INLINE u32 GetSelectedOutputStorage(void)
+            {
+                return this->output_storage->getSelectedValue();
+            }
+
             ALWAYS_INLINE brls::GenericEvent::Subscription RegisterButtonListener(brls::GenericEvent::Callback cb)
             {
                 return this->button_click_event->subscribe([this, cb](brls::View *view){
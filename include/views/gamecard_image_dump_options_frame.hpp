@@ -39,6 +39,7 @@ namespace nxdt::views
             brls::ToggleListItem *trim_dump = nullptr;
             brls::ToggleListItem *calculate_checksum = nullptr;
             brls::ToggleListItem *lookup_checksum = nullptr;
+            brls::ToggleListItem *mirror_to_sd_card = nullptr;
 
         public:
             GameCardImageDumpOptionsFrame(RootView *root_view, std::string raw_filename);
@@ -48,6 +48,14 @@ namespace nxdt::views
                 return true;
             }
 
+            std::string GetCompletionMessage(void) override final
+            {
+                /* Display the matching checksum database entry, if available. */
+                DatEntryInfo dat_entry{};
+                if (this->task.GetChecksumLookupResult(dat_entry)) return brls::i18n::getStr("generic/process_complete_checksum_match", dat_entry.name);
+                return brls::i18n::getStr("generic/process_complete");
+            }
+
         public:
             template<typename... Params>
             GameCardImageDumpTaskFrame(Params... params) :
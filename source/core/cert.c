@@ -28,14 +28,29 @@
 #define CERT_BIS_SYSTEM_SAVEFILE_PATH   "/save/80000000000000e0"
 #define CERT_SAVEFILE_STORAGE_BASE_PATH "/certificate/"
 
+#define CERT_CACHE_ENTRY_COUNT          4
+
 #define CERT_TYPE(sig)                  (pub_key_type == CertPubKeyType_Rsa4096 ? CertType_Sig##sig##_PubKeyRsa4096 : \
                                         (pub_key_type == CertPubKeyType_Rsa2048 ? CertType_Sig##sig##_PubKeyRsa2048 : CertType_Sig##sig##_PubKeyEcc480))
 
+/* Type definitions. */
+
+/// Used to cache raw certificate chains generated by certGenerateRawCertificateChainBySignatureIssuer().
+typedef struct {
+    char issuer[0x40];
+    u8 *raw_chain;
+    u64 raw_chain_size;
+} CertRawChainCacheEntry;
+
 /* Global variables. */
 
 static Mutex g_esCertSaveMutex = 0;
 static save_ctx_t *g_esCertSaveCtx = NULL;
 
+static bool g_certCacheEnabled = false;
+static CertRawChainCacheEntry g_certCache[CERT_CACHE_ENTRY_COUNT] = {0};
+static u32 g_certCacheNextIdx = 0;
+
 /* Function prototypes. */
 
 static bool certOpenEsCertSaveFile(void);
@@ -49,6 +64,10 @@ static u32 certGetCertificateCountInSignatureIssuer(const char *issuer);
 
 static void certCopyCertificateChainDataToMemoryBuffer(void *dst, const CertificateChain *chain);
 
+static u8 *certRetrieveRawCertificateChainFromCache(const char *issuer, u64 *out_size);
+static void certAddRawCertificateChainToCache(const char *issuer, const u8 *raw_chain, u64 raw_chain_size);
+static void certFreeCacheEntries(void);
+
 bool certRetrieveCertificateByName(Certificate *dst, const char *name)
 {
     if (!dst || !name || !*name)
@@ -100,6 +119,9 @@ u8 *certGenerateRawCertificateChainBySignatureIssuer(const char *issuer, u64 *ou
     CertificateChain chain = {0};
     u8 *raw_chain = NULL;
 
+    /* Check if this certificate chain has already been cached. */
+    if ((raw_chain = certRetrieveRawCertificateChainFromCache(issuer, out_size))) return raw_chain;
+
     /* Get full certificate chain using the provided issuer. */
     if (!certRetrieveCertificateChainBySignatureIssuer(&chain, issuer))
     {
@@ -121,12 +143,24 @@ u8 *certGenerateRawCertificateChainBySignatureIssuer(const char *issuer, u64 *ou
     /* Update output size. */
     *out_size = chain.size;
 
+    /* Cache certificate chain, if needed. */
+    certAddRawCertificateChainToCache(issuer, raw_chain, chain.size);
+
 end:
     certFreeCertificateChain(&chain);
 
     return raw_chain;
 }
 
+void certSetRawCertificateChainCacheEnabled(bool enabled)
+{
+    SCOPED_LOCK(&g_esCertSaveMutex)
+    {
+        if (!enabled) certFreeCacheEntries();
+        g_certCacheEnabled = enabled;
+    }
+}
+
 u8 *certRetrieveRawCertificateChainFromGameCardByRightsId(const FsRightsId *id, u64 *out_size)
 {
     if (!id || !out_size)
@@ -420,3 +454,65 @@ static void certCopyCertificateChainDataToMemoryBuffer(void *dst, const Certific
         dst_u8 += cert->size;
     }
 }
+
+static u8 *certRetrieveRawCertificateChainFromCache(const char *issuer, u64 *out_size)
+{
+    u8 *raw_chain = NULL;
+
+    SCOPED_LOCK(&g_esCertSaveMutex)
+    {
+        if (!g_certCacheEnabled) break;
+
+        for(u32 i = 0; i < CERT_CACHE_ENTRY_COUNT; i++)
+        {
+            CertRawChainCacheEntry *entry = &(g_certCache[i]);
+            if (!entry->raw_chain || strcmp(entry->issuer, issuer) != 0) continue;
+
+            /* Return a copy, since the caller takes ownership of the buffer. */
+            if (!(raw_chain = malloc(entry->raw_chain_size)))
+            {
+                LOG_MSG_ERROR("Unable to allocate memory for cached raw \"%s\" certificate chain! (0x%lX).", issuer, entry->raw_chain_size);
+                break;
+            }
+
+            memcpy(raw_chain, entry->raw_chain, entry->raw_chain_size);
+            *out_size = entry->raw_chain_size;
+            break;
+        }
+    }
+
+    return raw_chain;
+}
+
+static void certAddRawCertificateChainToCache(const char *issuer, const u8 *raw_chain, u64 raw_chain_size)
+{
+    SCOPED_LOCK(&g_esCertSaveMutex)
+    {
+        if (!g_certCacheEnabled || strlen(issuer) >= MEMBER_SIZE(CertRawChainCacheEntry, issuer)) break;
+
+        /* Overwrite the oldest entry if the cache is full. */
+        CertRawChainCacheEntry *entry = &(g_certCache[g_certCacheNextIdx]);
+
+        if (entry->raw_chain) free(entry->raw_chain);
+        memset(entry, 0, sizeof(CertRawChainCacheEntry));
+
+        if (!(entry->raw_chain = malloc(raw_chain_size))) break;
+
+        snprintf(entry->issuer, sizeof(entry->issuer), "%s", issuer);
+        memcpy(entry->raw_chain, raw_chain, raw_chain_size);
+        entry->raw_chain_size = raw_chain_size;
+
+        g_certCacheNextIdx = ((g_certCacheNextIdx + 1) % CERT_CACHE_ENTRY_COUNT);
+    }
+}
+
+static void certFreeCacheEntries(void)
+{
+    for(u32 i = 0; i < CERT_CACHE_ENTRY_COUNT; i++)
+    {
+        if (g_certCache[i].raw_chain) free(g_certCache[i].raw_chain);
+        memset(&(g_certCache[i]), 0, sizeof(CertRawChainCacheEntry));
+    }
+
+    g_certCacheNextIdx = 0;
+}
@@ -269,31 +269,39 @@ end:
     return success;
 }
 
-bool cnmtVerifyContentHash(ContentMetaContext *cnmt_ctx, NcaContext *nca_ctx, const u8 *hash)
+NcmPackagedContentInfo *cnmtGetPackagedContentInfoByContentId(ContentMetaContext *cnmt_ctx, const NcmContentId *content_id)
 {
-    if (!cnmtIsValidContext(cnmt_ctx) || !nca_ctx || !*(nca_ctx->content_id_str) || nca_ctx->content_type > NcmContentType_DeltaFragment || !nca_ctx->content_size || !hash)
+    if (!cnmtIsValidContext(cnmt_ctx) || !content_id)
     {
         LOG_MSG_ERROR("Invalid parameters!");
-        return false;
+        return NULL;
     }
 
-    /* Return right away if we're dealing with a Meta NCA. */
-    if (nca_ctx->content_type == NcmContentType_Meta) return true;
-
-    NcmPackagedContentInfo *packaged_content_info = NULL;
-    bool success = false;
-
     /* Loop through all of our content info entries. */
     for(u16 i = 0; i < cnmt_ctx->packaged_header->content_count; i++)
     {
         /* Check if we got a matching content ID. */
-        packaged_content_info = &(cnmt_ctx->packaged_content_info[i]);
+        NcmPackagedContentInfo *packaged_content_info = &(cnmt_ctx->packaged_content_info[i]);
+        if (!memcmp(&(packaged_content_info->info.content_id), content_id, sizeof(NcmContentId))) return packaged_content_info;
+    }
 
-        if (!memcmp(&(packaged_content_info->info.content_id), &(nca_ctx->content_id), sizeof(NcmContentId))) break;
+    return NULL;
+}
 
-        packaged_content_info = NULL;
+bool cnmtVerifyContentHash(ContentMetaContext *cnmt_ctx, NcaContext *nca_ctx, const u8 *hash)
+{
+    if (!cnmtIsValidContext(cnmt_ctx) || !nca_ctx || !*(nca_ctx->content_id_str) || nca_ctx->content_type > NcmContentType_DeltaFragment || !nca_ctx->content_size || !hash)
+    {
+        LOG_MSG_ERROR("Invalid parameters!");
+        return false;
     }
 
+    /* Return right away if we're dealing with a Meta NCA. */
+    if (nca_ctx->content_type == NcmContentType_Meta) return true;
+
+    NcmPackagedContentInfo *packaged_content_info = cnmtGetPackagedContentInfoByContentId(cnmt_ctx, &(nca_ctx->content_id));
+    bool success = false;
+
     if (!packaged_content_info)
     {
         LOG_MSG_ERROR("Unable to find CNMT content record for \"%s\" NCA! (title ID %016lX, size 0x%lX, type 0x%02X, ID offset 0x%02X).", nca_ctx->content_id_str, \
@@ -0,0 +1,598 @@
+/*
+ * dat.c
+ *
+ * Copyright (c) 2020-2024, DarkMatterCore <pabloacurielz@gmail.com>.
+ *
+ * This file is part of nxdumptool (https://github.com/DarkMatterCore/nxdumptool).
+ *
+ * nxdumptool is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nxdumptool is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <core/nxdt_utils.h>
+#include <core/dat.h>
+
+#define DAT_INDEX_MAGIC         0x4E584449  /* "NXDI". */
+#define DAT_INDEX_VERSION       1
+
+#define DAT_ATTRIBUTE_LENGTH    0x80
+
+/* Type definitions. */
+
+typedef struct {
+    u32 magic;              ///< "NXDI".
+    u32 version;
+    u32 entry_count;
+    u32 name_table_size;
+    u64 dat_size;           ///< Used to detect DAT file updates.
+    u64 dat_mtime;          ///< Used to detect DAT file updates.
+} DatIndexHeader;
+
+NXDT_ASSERT(DatIndexHeader, 0x20);
+
+/// Sorted by CRC32, then by size.
+/// The index file holds DatIndexHeader + (DatIndexEntry * entry_count) + (u32 SHA-1 order table * entry_count) + name table.
+typedef struct {
+    u32 crc32;
+    u32 name_offset;        ///< Relative to the start of the name table.
+    u64 size;
+    u8 sha1[SHA1_HASH_SIZE];
+    u8 reserved[0x4];
+} DatIndexEntry;
+
+NXDT_ASSERT(DatIndexEntry, 0x28);
+
+typedef struct {
+    u8 sha1[SHA1_HASH_SIZE];
+    u32 idx;
+} DatIndexSha1Entry;
+
+/* Global variables. */
+
+static Mutex g_datMutex = 0;
+static bool g_datIndexLoaded = false, g_datIndexLoadFailed = false;
+
+static u8 *g_datIndex = NULL;
+static DatIndexHeader *g_datIndexHeader = NULL;
+static DatIndexEntry *g_datIndexEntries = NULL;
+static u32 *g_datIndexSha1Order = NULL;
+static char *g_datIndexNameTable = NULL;
+
+/* Function prototypes. */
+
+static bool datLoadIndex(void);
+static bool datReadIndexFile(const struct stat *dat_st);
+static bool datBuildIndexFile(const struct stat *dat_st);
+static void datFreeIndex(void);
+
+static bool datGetXmlAttribute(const char *tag, const char *tag_end, const char *name, char *out, size_t out_size);
+static void datUnescapeXmlString(char *str);
+
+static void datCopyEntryInfo(const DatIndexEntry *entry, DatEntryInfo *out);
+
+static int datIndexEntrySortFunction(const void *a, const void *b);
+static int datIndexSha1EntrySortFunction(const void *a, const void *b);
+
+void datExit(void)
+{
+    SCOPED_LOCK(&g_datMutex)
+    {
+        datFreeIndex();
+        g_datIndexLoadFailed = false;
+    }
+}
+
+bool datIsAvailable(void)
+{
+    bool ret = false;
+    SCOPED_LOCK(&g_datMutex) ret = datLoadIndex();
+    return ret;
+}
+
+bool datLookupByCrc32(u32 crc32, u64 size, DatEntryInfo *out)
+{
+    if (!out)
+    {
+        LOG_MSG_ERROR("Invalid parameters!");
+        return false;
+    }
+
+    bool ret = false;
+
+    SCOPED_LOCK(&g_datMutex)
+    {
+        if (!datLoadIndex()) break;
+
+        /* Find the first entry with a matching CRC32 checksum. */
+        u32 lo = 0, hi = g_datIndexHeader->entry_count;
+
+        while(lo < hi)
+        {
+            u32 mid = (lo + ((hi - lo) / 2));
+            const DatIndexEntry *entry = &(g_datIndexEntries[mid]);
+
+            if (entry->crc32 < crc32 || (entry->crc32 == crc32 && size && entry->size < size))
+            {
+                lo = (mid + 1);
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo >= g_datIndexHeader->entry_count) break;
+
+        const DatIndexEntry *entry = &(g_datIndexEntries[lo]);
+        if (entry->crc32 != crc32 || (size && entry->size != size)) break;
+
+        datCopyEntryInfo(entry, out);
+        ret = true;
+    }
+
+    return ret;
+}
+
+bool datLookupBySha1(const u8 *sha1, DatEntryInfo *out)
+{
+    u8 zero_sha1[SHA1_HASH_SIZE] = {0};
+
+    /* Entries without a SHA-1 checksum are stored with a zeroed out hash. */
+    if (!sha1 || !out || !memcmp(sha1, zero_sha1, SHA1_HASH_SIZE))
+    {
+        LOG_MSG_ERROR("Invalid parameters!");
+        return false;
+    }
+
+    bool ret = false;
+
+    SCOPED_LOCK(&g_datMutex)
+    {
+        if (!datLoadIndex()) break;
+
+        u32 lo = 0, hi = g_datIndexHeader->entry_count;
+
+        while(lo < hi)
+        {
+            u32 mid = (lo + ((hi - lo) / 2));
+            const DatIndexEntry *entry = &(g_datIndexEntries[g_datIndexSha1Order[mid]]);
+
+            int res = memcmp(entry->sha1, sha1, SHA1_HASH_SIZE);
+            if (!res)
+            {
+                datCopyEntryInfo(entry, out);
+                ret = true;
+                break;
+            }
+
+            if (res < 0)
+            {
+                lo = (mid + 1);
+            } else {
+                hi = mid;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static bool datLoadIndex(void)
+{
+    if (g_datIndexLoaded) return true;
+
+    /* Don't retry over and over if we already failed. */
+    if (g_datIndexLoadFailed) return false;
+
+    struct stat dat_st = {0};
+    bool dat_available = (stat(DAT_FILE_PATH, &dat_st) == 0 && S_ISREG(dat_st.st_mode) && dat_st.st_size > 0);
+
+    /* Try to load an existing index first. It'll be discarded if it's stale. */
+    g_datIndexLoaded = datReadIndexFile(dat_available ? &dat_st : NULL);
+    if (!g_datIndexLoaded && dat_available)
+    {
+        /* (Re)build index from the DAT file. */
+        g_datIndexLoaded = (datBuildIndexFile(&dat_st) && datReadIndexFile(&dat_st));
+    }
+
+    if (g_datIndexLoaded)
+    {
+        LOG_MSG_INFO("Loaded checksum database index with %u entr%s.", g_datIndexHeader->entry_count, g_datIndexHeader->entry_count == 1 ? "y" : "ies");
+    } else {
+        LOG_MSG_WARNING("Checksum database unavailable.");
+        g_datIndexLoadFailed = true;
+    }
+
+    return g_datIndexLoaded;
+}
+
+static bool datReadIndexFile(const struct stat *dat_st)
+{
+    FILE *fp = NULL;
+    struct stat index_st = {0};
+    u64 expected_size = 0;
+    bool success = false;
+
+    if (stat(DAT_INDEX_FILE_PATH, &index_st) != 0 || !S_ISREG(index_st.st_mode) || (u64)index_st.st_size < sizeof(DatIndexHeader)) goto end;
+
+    fp = fopen(DAT_INDEX_FILE_PATH, "rb");
+    if (!fp)
+    {
+        LOG_MSG_ERROR("Failed to open \"%s\"!", DAT_INDEX_FILE_PATH);
+        goto end;
+    }
+
+    /* Read the whole index in one go. Lookups are performed directly on this buffer, so no further parsing is needed. */
+    g_datIndex = malloc(index_st.st_size);
+    if (!g_datIndex)
+    {
+        LOG_MSG_ERROR("Failed to allocate 0x%lX bytes for the checksum database index!", (u64)index_st.st_size);
+        goto end;
+    }
+
+    if (fread(g_datIndex, 1, index_st.st_size, fp) != (size_t)index_st.st_size)
+    {
+        LOG_MSG_ERROR("Failed to read checksum database index!");
+        goto end;
+    }
+
+    g_datIndexHeader = (DatIndexHeader*)g_datIndex;
+
+    if (g_datIndexHeader->magic != __builtin_bswap32(DAT_INDEX_MAGIC) || g_datIndexHeader->version != DAT_INDEX_VERSION || !g_datIndexHeader->entry_count)
+    {
+        LOG_MSG_WARNING("Invalid checksum database index header!");
+        goto end;
+    }
+
+    expected_size = (sizeof(DatIndexHeader) + ((u64)g_datIndexHeader->entry_count * (sizeof(DatIndexEntry) + sizeof(u32))) + g_datIndexHeader->name_table_size);
+    if (expected_size != (u64)index_st.st_size || !g_datIndexHeader->name_table_size || g_datIndex[index_st.st_size - 1] != '\0')
+    {
+        LOG_MSG_WARNING("Checksum database index size mismatch! (0x%lX != 0x%lX).", expected_size, (u64)index_st.st_size);
+        goto end;
+    }
+
+    if (dat_st && (g_datIndexHeader->dat_size != (u64)dat_st->st_size || g_datIndexHeader->dat_mtime != (u64)dat_st->st_mtime))
+    {
+        LOG_MSG_INFO("Checksum database index is stale.");
+        goto end;
+    }
+
+    g_datIndexEntries = (DatIndexEntry*)(g_datIndex + sizeof(DatIndexHeader));
+    g_datIndexSha1Order = (u32*)(g_datIndexEntries + g_datIndexHeader->entry_count);
+    g_datIndexNameTable = (char*)(g_datIndexSha1Order + g_datIndexHeader->entry_count);
+
+    /* Validate offsets. */
+    for(u32 i = 0; i < g_datIndexHeader->entry_count; i++)
+    {
+        if (g_datIndexEntries[i].name_offset >= g_datIndexHeader->name_table_size || g_datIndexSha1Order[i] >= g_datIndexHeader->entry_count)
+        {
+            LOG_MSG_WARNING("Invalid checksum database index entry #%u!", i);
+            goto end;
+        }
+    }
+
+    success = true;
+
+end:
+    if (fp) fclose(fp);
+
+    if (!success) datFreeIndex();
+
+    return success;
+}
+
+static bool datBuildIndexFile(const struct stat *dat_st)
+{
+    FILE *fp = NULL;
+    char *dat_buf = NULL, *ptr = NULL;
+
+    DatIndexHeader header = {0};
+    DatIndexEntry *entries = NULL, *tmp_entries = NULL;
+    DatIndexSha1Entry *sha1_entries = NULL;
+    u32 *sha1_order = NULL, entry_count = 0, entry_alloc_count = 0;
+
+    char *name_table = NULL, *tmp_name_table = NULL;
+    u32 name_table_size = 0, name_table_alloc_size = 0, cur_name_offset = 0;
+    bool cur_name_available = false;
+
+    char name[DAT_NAME_LENGTH] = {0}, attr[DAT_ATTRIBUTE_LENGTH] = {0};
+
+    bool success = false;
+
+    LOG_MSG_INFO("Building checksum database index from \"%s\"...", DAT_FILE_PATH);
+
+    /* Read the whole DAT file. */
+    fp = fopen(DAT_FILE_PATH, "rb");
+    if (!fp)
+    {
+        LOG_MSG_ERROR("Failed to open \"%s\"!", DAT_FILE_PATH);
+        goto end;
+    }
+
+    dat_buf = malloc(dat_st->st_size + 1);
+    if (!dat_buf)
+    {
+        LOG_MSG_ERROR("Failed to allocate 0x%lX bytes for the DAT file!", (u64)dat_st->st_size);
+        goto end;
+    }
+
+    if (fread(dat_buf, 1, dat_st->st_size, fp) != (size_t)dat_st->st_size)
+    {
+        LOG_MSG_ERROR("Failed to read DAT file!");
+        goto end;
+    }
+
+    dat_buf[dat_st->st_size] = '\0';
+
+    fclose(fp);
+    fp = NULL;
+
+    /* Parse game and rom elements. We don't need a full XML parser for this. */
+    ptr = dat_buf;
+
+    while((ptr = strchr(ptr, '<')) != NULL)
+    {
+        char *tag_end = strchr(ptr, '>');
+        if (!tag_end) break;
+
+        if (!strncmp(ptr, "<game ", 6) || !strncmp(ptr, "<machine ", 9))
+        {
+            /* Game names are only stored once in the name table, regardless of the number of roms. */
+            cur_name_available = datGetXmlAttribute(ptr, tag_end, "name", name, sizeof(name));
+            if (cur_name_available)
+            {
+                datUnescapeXmlString(name);
+
+                size_t name_len = (strlen(name) + 1);
+
+                if ((name_table_size + name_len) > name_table_alloc_size)
+                {
+                    name_table_alloc_size = ((name_table_alloc_size ? (name_table_alloc_size * 2) : 0x10000) + name_len);
+
+                    tmp_name_table = realloc(name_table, name_table_alloc_size);
+                    if (!tmp_name_table)
+                    {
+                        LOG_MSG_ERROR("Failed to reallocate name table!");
+                        goto end;
+                    }
+
+                    name_table = tmp_name_table;
+                    tmp_name_table = NULL;
+                }
+
+                cur_name_offset = name_table_size;
+                memcpy(name_table + name_table_size, name, name_len);
+                name_table_size += (u32)name_len;
+            }
+        } else
+        if (!strncmp(ptr, "<rom ", 5) && cur_name_available)
+        {
+            DatIndexEntry entry = { .name_offset = cur_name_offset };
+
+            /* Size and CRC32 are mandatory. */
+            if (!datGetXmlAttribute(ptr, tag_end, "size", attr, sizeof(attr)) || !(entry.size = strtoull(attr, NULL, 10)) || \
+                !datGetXmlAttribute(ptr, tag_end, "crc", attr, sizeof(attr)) || strlen(attr) != 8)
+            {
+                ptr = tag_end;
+                continue;
+            }
+
+            entry.crc32 = (u32)strtoul(attr, NULL, 16);
+
+            if (datGetXmlAttribute(ptr, tag_end, "sha1", attr, sizeof(attr)) && !utilsParseHexString(entry.sha1, sizeof(entry.sha1), attr, 0)) memset(entry.sha1, 0, sizeof(entry.sha1));
+
+            if (entry_count >= entry_alloc_count)
+            {
+                entry_alloc_count = (entry_alloc_count ? (entry_alloc_count * 2) : 0x400);
+
+                tmp_entries = realloc(entries, entry_alloc_count * sizeof(DatIndexEntry));
+                if (!tmp_entries)
+                {
+                    LOG_MSG_ERROR("Failed to reallocate index entries!");
+                    goto end;
+                }
+
+                entries = tmp_entries;
+                tmp_entries = NULL;
+            }
+
+            memcpy(&(entries[entry_count++]), &entry, sizeof(DatIndexEntry));
+        }
+
+        ptr = tag_end;
+    }
+
+    if (!entry_count)
+    {
+        LOG_MSG_ERROR("No valid entries found in DAT file!");
+        goto end;
+    }
+
+    /* Sort entries by CRC32 and size. */
+    if (entry_count > 1) qsort(entries, entry_count, sizeof(DatIndexEntry), &datIndexEntrySortFunction);
+
+    /* Generate SHA-1 order table. */
+    sha1_entries = calloc(entry_count, sizeof(DatIndexSha1Entry));
+    sha1_order = calloc(entry_count, sizeof(u32));
+    if (!sha1_entries || !sha1_order)
+    {
+        LOG_MSG_ERROR("Failed to allocate memory for the SHA-1 order table!");
+        goto end;
+    }
+
+    for(u32 i = 0; i < entry_count; i++)
+    {
+        memcpy(sha1_entries[i].sha1, entries[i].sha1, SHA1_HASH_SIZE);
+        sha1_entries[i].idx = i;
+    }
+
+    if (entry_count > 1) qsort(sha1_entries, entry_count, sizeof(DatIndexSha1Entry), &datIndexSha1EntrySortFunction);
+
+    for(u32 i = 0; i < entry_count; i++) sha1_order[i] = sha1_entries[i].idx;
+
+    /* Write index file. */
+    header.magic = __builtin_bswap32(DAT_INDEX_MAGIC);
+    header.version = DAT_INDEX_VERSION;
+    header.entry_count = entry_count;
+    header.name_table_size = name_table_size;
+    header.dat_size = (u64)dat_st->st_size;
+    header.dat_mtime = (u64)dat_st->st_mtime;
+
+    fp = fopen(DAT_INDEX_FILE_PATH, "wb");
+    if (!fp)
+    {
+        LOG_MSG_ERROR("Failed to open \"%s\" for writing!", DAT_INDEX_FILE_PATH);
+        goto end;
+    }
+
+    if (fwrite(&header, 1, sizeof(DatIndexHeader), fp) != sizeof(DatIndexHeader) || fwrite(entries, sizeof(DatIndexEntry), entry_count, fp) != entry_count || \
+        fwrite(sha1_order, sizeof(u32), entry_count, fp) != entry_count || fwrite(name_table, 1, name_table_size, fp) != name_table_size)
+    {
+        LOG_MSG_ERROR("Failed to write checksum database index!");
+        goto end;
+    }
+
+    LOG_MSG_INFO("Successfully built checksum database index (%u entr%s).", entry_count, entry_count == 1 ? "y" : "ies");
+
+    success = true;
+
+end:
+    if (fp)
+    {
+        fclose(fp);
+        if (!success) remove(DAT_INDEX_FILE_PATH);
+        utilsCommitSdCardFileSystemChanges();
+    }
+
+    if (sha1_order) free(sha1_order);
+    if (sha1_entries) free(sha1_entries);
+    if (name_table) free(name_table);
+    if (entries) free(entries);
+    if (dat_buf) free(dat_buf);
+
+    return success;
+}
+
+static void datFreeIndex(void)
+{
+    if (g_datIndex) free(g_datIndex);
+
+    g_datIndex = NULL;
+    g_datIndexHeader = NULL;
+    g_datIndexEntries = NULL;
+    g_datIndexSha1Order = NULL;
+    g_datIndexNameTable = NULL;
+
+    g_datIndexLoaded = false;
+}
+
+static bool datGetXmlAttribute(const char *tag, const char *tag_end, const char *name, char *out, size_t out_size)
+{
+    size_t name_len = strlen(name);
+
+    /* Only look within the current tag. */
+    for(const char *ptr = tag; (ptr + name_len + 3) < tag_end; ptr++)
+    {
+        /* Make sure we're dealing with a full attribute name. */
+        if (!isspace((unsigned char)*ptr) || strncmp(ptr + 1, name, name_len) != 0 || ptr[name_len + 1] != '=' || (ptr[name_len + 2] != '"' && ptr[name_len + 2] != '\'')) continue;
+
+        const char quote = ptr[name_len + 2], *value = (ptr + name_len + 3), *value_end = memchr(value, quote, tag_end - value);
+        if (!value_end || (size_t)(value_end - value) >= out_size) return false;
+
+        memcpy(out, value, value_end - value);
+        out[value_end - value] = '\0';
+
+        return true;
+    }
+
+    return false;
+}
+
+static void datUnescapeXmlString(char *str)
+{
+    static const struct {
+        const char *entity;
+        char chr;
+    } xml_entities[] = {
+        { "&amp;",  '&'  },
+        { "&lt;",   '<'  },
+        { "&gt;",   '>'  },
+        { "&quot;", '"'  },
+        { "&apos;", '\'' }
+    };
+
+    char *src = str, *dst = str;
+
+    while(*src)
+    {
+        bool replaced = false;
+
+        if (*src == '&')
+        {
+            for(u32 i = 0; i < MAX_ELEMENTS(xml_entities); i++)
+            {
+                size_t entity_len = strlen(xml_entities[i].entity);
+                if (strncmp(src, xml_entities[i].entity, entity_len) != 0) continue;
+
+                *dst++ = xml_entities[i].chr;
+                src += entity_len;
+                replaced = true;
+                break;
+            }
+        }
+
+        if (!replaced) *dst++ = *src++;
+    }
+
+    *dst = '\0';
+}
+
+static void datCopyEntryInfo(const DatIndexEntry *entry, DatEntryInfo *out)
+{
+    snprintf(out->name, sizeof(out->name), "%s", g_datIndexNameTable + entry->name_offset);
+    out->size = entry->size;
+    out->crc32 = entry->crc32;
+    memcpy(out->sha1, entry->sha1, SHA1_HASH_SIZE);
+}
+
+static int datIndexEntrySortFunction(const void *a, const void *b)
+{
+    const DatIndexEntry *entry_1 = (const DatIndexEntry*)a;
+    const DatIndexEntry *entry_2 = (const DatIndexEntry*)b;
+
+    if (entry_1->crc32 < entry_2->crc32)
+    {
+        return -1;
+    } else
+    if (entry_1->crc32 > entry_2->crc32)
+    {
+        return 1;
+    }
+
+    if (entry_1->size < entry_2->size)
+    {
+        return -1;
+    } else
+    if (entry_1->size > entry_2->size)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int datIndexSha1EntrySortFunction(const void *a, const void *b)
+{
+    const DatIndexSha1Entry *entry_1 = (const DatIndexSha1Entry*)a;
+    const DatIndexSha1Entry *entry_2 = (const DatIndexSha1Entry*)b;
+
+    return memcmp(entry_1->sha1, entry_2->sha1, SHA1_HASH_SIZE);
+}
@@ -25,7 +25,9 @@
 #include <core/keys.h>
 #include <core/rsa.h>
 
-#define GAMECARD_READ_BUFFER_SIZE               0x800000                /* 8 MiB. */
+#define GAMECARD_READ_BUFFER_SIZE               0x800000                /* 8 MiB. Used with the secure storage area. */
+#define GAMECARD_NORMAL_READ_BUFFER_SIZE        0x200000                /* 2 MiB. Used with the normal storage area. */
+#define GAMECARD_READ_AHEAD_SIZE                0x100000                /* 1 MiB. Must not exceed GAMECARD_NORMAL_READ_BUFFER_SIZE. */
 
 #define GAMECARD_ACCESS_DELAY                   3                       /* Seconds. */
 
@@ -44,6 +46,14 @@ typedef enum {
     GameCardStorageArea_Secure = 2
 } GameCardStorageArea;
 
+/* Read-ahead window. Each storage area gets its own, so interleaved reads from both areas don't keep discarding each other's data. */
+typedef struct {
+    u8 *buf;        ///< Read buffer. Points to an area within g_gameCardReadBuf.
+    u64 buf_size;   ///< Read buffer size.
+    u64 offset;     ///< Offset of the buffered data, relative to the start of the storage area.
+    u64 size;       ///< Size of the buffered data. Zero if the window is empty.
+} GameCardReadWindow;
+
 typedef enum {
     GameCardCapacity_1GiB  = BITL(30),
     GameCardCapacity_2GiB  = BITL(31),
@@ -77,6 +87,13 @@ static FsStorage g_gameCardStorage = {0};
 static u8 g_gameCardCurrentStorageArea = GameCardStorageArea_None;
 static u8 *g_gameCardReadBuf = NULL;
 
+static GameCardReadWindow g_gameCardReadWindows[2] = {
+    [GameCardStorageArea_Normal - 1] = { .buf = NULL, .buf_size = GAMECARD_NORMAL_READ_BUFFER_SIZE, .offset = 0, .size = 0 },
+    [GameCardStorageArea_Secure - 1] = { .buf = NULL, .buf_size = GAMECARD_READ_BUFFER_SIZE, .offset = 0, .size = 0 }
+};
+
+static GameCardReadStatistics g_gameCardReadStats = {0};
+
 static GameCardHeader g_gameCardHeader = {0};
 static GameCardInfo g_gameCardInfoArea = {0};
 
@@ -140,6 +157,8 @@ static bool gamecardGetHandleAndStorage(u32 partition);
 
 static bool gamecardOpenStorageArea(u8 area);
 static bool gamecardReadStorageArea(void *out, u64 read_size, u64 offset);
+static bool gamecardReadStorageAreaFromBuffer(u8 area, void *out, u64 read_size, u64 base_offset);
+static void gamecardInvalidateReadBuffers(void);
 static void gamecardCloseStorageArea(void);
 
 static bool gamecardGetStorageAreasSizes(void);
@@ -158,14 +177,17 @@ bool gamecardInitialize(void)
         ret = g_gameCardInterfaceInit;
         if (ret) break;
 
-        /* Allocate memory for the gamecard read buffer. */
-        g_gameCardReadBuf = malloc(GAMECARD_READ_BUFFER_SIZE);
+        /* Allocate memory for the gamecard read buffer. It's shared by the read-ahead windows from both storage areas. */
+        g_gameCardReadBuf = malloc(GAMECARD_NORMAL_READ_BUFFER_SIZE + GAMECARD_READ_BUFFER_SIZE);
         if (!g_gameCardReadBuf)
         {
             LOG_MSG_ERROR("Unable to allocate memory for the gamecard read buffer!");
             break;
         }
 
+        g_gameCardReadWindows[GameCardStorageArea_Normal - 1].buf = g_gameCardReadBuf;
+        g_gameCardReadWindows[GameCardStorageArea_Secure - 1].buf = (g_gameCardReadBuf + GAMECARD_NORMAL_READ_BUFFER_SIZE);
+
         /* Open device operator. */
         rc = fsOpenDeviceOperator(&g_deviceOperator);
         if (R_FAILED(rc))
@@ -261,6 +283,8 @@ void gamecardExit(void)
             g_gameCardReadBuf = NULL;
         }
 
+        for(u8 i = 0; i < MAX_ELEMENTS(g_gameCardReadWindows); i++) g_gameCardReadWindows[i].buf = NULL;
+
         /* Make sure NS can access the gamecard. */
         /* Fixes gamecard launch errors after exiting the application. */
         /* TODO: find out why this doesn't work. */
@@ -338,10 +362,27 @@ bool gamecardGetLotusAsicFirmwareBlob(LotusAsicFirmwareBlob *out_lafw_blob, u64
 bool gamecardReadStorage(void *out, u64 read_size, u64 offset)
 {
     bool ret = false;
-    SCOPED_LOCK(&g_gameCardMutex) ret = gamecardReadStorageArea(out, read_size, offset);
+
+    SCOPED_LOCK(&g_gameCardMutex)
+    {
+        g_gameCardReadStats.request_count++;
+        ret = gamecardReadStorageArea(out, read_size, offset);
+    }
+
     return ret;
 }
 
+void gamecardGetReadStatistics(GameCardReadStatistics *out)
+{
+    if (!out) return;
+    SCOPED_LOCK(&g_gameCardMutex) memcpy(out, &g_gameCardReadStats, sizeof(GameCardReadStatistics));
+}
+
+void gamecardResetReadStatistics(void)
+{
+    SCOPED_LOCK(&g_gameCardMutex) memset(&g_gameCardReadStats, 0, sizeof(GameCardReadStatistics));
+}
+
 bool gamecardGetHeader(GameCardHeader *out)
 {
     bool ret = false;
@@ -879,6 +920,14 @@ static void gamecardFreeInfo(bool clear_status)
 
     gamecardCloseStorageArea();
 
+    gamecardInvalidateReadBuffers();
+
+    LOG_MSG_DEBUG("Gamecard read statistics: %lu request(s), %lu storage read(s), 0x%lX byte(s) read, %lu read-ahead hit(s), %lu storage area switch(es).", \
+                  g_gameCardReadStats.request_count, g_gameCardReadStats.storage_read_count, g_gameCardReadStats.storage_read_size, g_gameCardReadStats.read_ahead_hit_count, \
+                  g_gameCardReadStats.area_switch_count);
+
+    memset(&g_gameCardReadStats, 0, sizeof(GameCardReadStatistics));
+
     if (clear_status) atomic_store(&g_gameCardStatus, GameCardStatus_NotInserted);
 }
 
@@ -1095,6 +1144,9 @@ static bool gamecardOpenStorageArea(u8 area)
     /* Return right away if a valid handle has already been retrieved and the desired gamecard storage area is currently open. */
     if (g_gameCardHandle.value && serviceIsActive(&(g_gameCardStorage.s)) && g_gameCardCurrentStorageArea == area) return true;
 
+    /* Update statistics if we're about to switch between storage areas. */
+    if (g_gameCardCurrentStorageArea != GameCardStorageArea_None && g_gameCardCurrentStorageArea != area) g_gameCardReadStats.area_switch_count++;
+
     /* Close both the gamecard handle and the open storage area. */
     gamecardCloseStorageArea();
 
@@ -1143,6 +1195,18 @@ static bool gamecardReadStorageArea(void *out, u64 read_size, u64 offset)
         area = GameCardStorageArea_Secure;
     }
 
+    /* Calculate proper storage area offset. */
+    u64 base_offset = (area == GameCardStorageArea_Normal ? offset : (offset - g_gameCardNormalAreaSize));
+
+    /* Serve this request straight from the read-ahead window, if possible. */
+    /* This doesn't need the target storage area to be open, so it also spares us a storage area switch. */
+    if (gamecardReadStorageAreaFromBuffer(area, out_u8, read_size, base_offset))
+    {
+        g_gameCardReadStats.read_ahead_hit_count++;
+        success = true;
+        goto end;
+    }
+
     /* Open a storage area if needed. */
     /* If the right storage area has already been opened, this will return true. */
     if (!gamecardOpenStorageArea(area))
@@ -1151,12 +1215,14 @@ static bool gamecardReadStorageArea(void *out, u64 read_size, u64 offset)
         goto end;
     }
 
-    /* Calculate proper storage area offset. */
-    u64 base_offset = (area == GameCardStorageArea_Normal ? offset : (offset - g_gameCardNormalAreaSize));
+    /* Fix offset and/or size to avoid unaligned reads. */
+    u64 block_start_offset = ALIGN_DOWN(base_offset, GAMECARD_PAGE_SIZE);
+    u64 block_end_offset = ALIGN_UP(base_offset + read_size, GAMECARD_PAGE_SIZE);
+    u64 block_size = (block_end_offset - block_start_offset);
 
-    if (!(base_offset % GAMECARD_PAGE_SIZE) && !(read_size % GAMECARD_PAGE_SIZE))
+    if (block_size > GAMECARD_READ_AHEAD_SIZE && !(base_offset % GAMECARD_PAGE_SIZE) && !(read_size % GAMECARD_PAGE_SIZE))
     {
-        /* Optimization for reads that are already aligned to a GAMECARD_PAGE_SIZE boundary. */
+        /* Optimization for large reads that are already aligned to a GAMECARD_PAGE_SIZE boundary. */
         rc = fsStorageRead(&g_gameCardStorage, base_offset, out_u8, read_size);
         if (R_FAILED(rc))
         {
@@ -1164,33 +1230,63 @@ static bool gamecardReadStorageArea(void *out, u64 read_size, u64 offset)
             goto end;
         }
 
+        g_gameCardReadStats.storage_read_count++;
+        g_gameCardReadStats.storage_read_size += read_size;
+
         success = true;
     } else {
-        /* Fix offset and/or size to avoid unaligned reads. */
-        u64 block_start_offset = ALIGN_DOWN(base_offset, GAMECARD_PAGE_SIZE);
-        u64 block_end_offset = ALIGN_UP(base_offset + read_size, GAMECARD_PAGE_SIZE);
-        u64 block_size = (block_end_offset - block_start_offset);
-
+        GameCardReadWindow *window = &(g_gameCardReadWindows[area - 1]);
+        u64 area_size = (area == GameCardStorageArea_Normal ? g_gameCardNormalAreaSize : g_gameCardSecureAreaSize);
         u64 data_start_offset = (base_offset - block_start_offset);
-        u64 chunk_size = (block_size > GAMECARD_READ_BUFFER_SIZE ? GAMECARD_READ_BUFFER_SIZE : block_size);
-        u64 out_chunk_size = (block_size > GAMECARD_READ_BUFFER_SIZE ? (GAMECARD_READ_BUFFER_SIZE - data_start_offset) : read_size);
+        u64 chunk_size = (block_size > window->buf_size ? window->buf_size : block_size);
+        u64 out_chunk_size = (block_size > window->buf_size ? (window->buf_size - data_start_offset) : read_size);
 
-        rc = fsStorageRead(&g_gameCardStorage, block_start_offset, g_gameCardReadBuf, chunk_size);
+        /* Read ahead if we're dealing with a small read. Follow-up reads will most likely be served by the read-ahead window for this storage area. */
+        if (chunk_size < GAMECARD_READ_AHEAD_SIZE) chunk_size = MIN(GAMECARD_READ_AHEAD_SIZE, ALIGN_DOWN(area_size - block_start_offset, GAMECARD_PAGE_SIZE));
+        if (chunk_size < block_size && block_size <= window->buf_size) chunk_size = block_size;
+
+        /* Invalidate the read-ahead window beforehand, in case the read fails. */
+        window->size = 0;
+
+        rc = fsStorageRead(&g_gameCardStorage, block_start_offset, window->buf, chunk_size);
         if (R_FAILED(rc))
         {
             LOG_MSG_ERROR("fsStorageRead failed to read 0x%lX bytes at offset 0x%lX from %s storage area! (0x%X) (unaligned).", chunk_size, block_start_offset, GAMECARD_STORAGE_AREA_NAME(area), rc);
             goto end;
         }
 
-        memcpy(out_u8, g_gameCardReadBuf + data_start_offset, out_chunk_size);
+        g_gameCardReadStats.storage_read_count++;
+        g_gameCardReadStats.storage_read_size += chunk_size;
+
+        /* Keep track of the data we just read. */
+        window->offset = block_start_offset;
+        window->size = chunk_size;
 
-        success = (block_size > GAMECARD_READ_BUFFER_SIZE ? gamecardReadStorageArea(out_u8 + out_chunk_size, read_size - out_chunk_size, offset + out_chunk_size) : true);
+        memcpy(out_u8, window->buf + data_start_offset, out_chunk_size);
+
+        success = (block_size > window->buf_size ? gamecardReadStorageArea(out_u8 + out_chunk_size, read_size - out_chunk_size, offset + out_chunk_size) : true);
     }
 
 end:
     return success;
 }
 
+static bool gamecardReadStorageAreaFromBuffer(u8 area, void *out, u64 read_size, u64 base_offset)
+{
+    GameCardReadWindow *window = &(g_gameCardReadWindows[area - 1]);
+
+    if (!window->size || base_offset < window->offset || (base_offset + read_size) > (window->offset + window->size)) return false;
+
+    memcpy(out, window->buf + (base_offset - window->offset), read_size);
+
+    return true;
+}
+
+static void gamecardInvalidateReadBuffers(void)
+{
+    for(u8 i = 0; i < MAX_ELEMENTS(g_gameCardReadWindows); i++) g_gameCardReadWindows[i].offset = g_gameCardReadWindows[i].size = 0;
+}
+
 static void gamecardCloseStorageArea(void)
 {
     if (g_gameCardCurrentStorageArea == GameCardStorageArea_None) return;
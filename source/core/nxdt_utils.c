@@ -33,6 +33,7 @@
 #include <core/system_update.h>
 #include <core/devoptab/nxdt_devoptab.h>
 #include <core/bis_storage.h>
+#include <core/dat.h>
 
 /* Type definitions. */
 
@@ -283,6 +284,9 @@ void utilsCloseResources(void)
         /* Close configuration interface. */
         configExit();
 
+        /* Close checksum database interface. */
+        datExit();
+
         /* Unmount application RomFS. */
         romfsExit();
 
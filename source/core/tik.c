@@ -38,6 +38,8 @@
 #define TIK_LIST_SAVEFILE_STORAGE_PATH              "/ticket_list.bin"
 #define TIK_DB_SAVEFILE_STORAGE_PATH                "/ticket.bin"
 
+#define TIK_LIST_READ_CHUNK_SIZE                    0x40000     /* 256 KiB. */
+
 #define TIK_COMMON_CERT_NAME                        "XS00000020"
 #define TIK_DEV_CERT_ISSUER                         "CA00000004"
 
@@ -53,6 +55,13 @@ typedef struct {
 
 NXDT_ASSERT(TikListEntry, 0x20);
 
+/// Holds an opened ES ticket system savefile and an in-memory copy of its ticket_list.bin entries.
+typedef struct {
+    save_ctx_t *save_ctx;
+    TikListEntry *ticket_list;
+    u32 ticket_list_count;
+} TikEsSaveContext;
+
 /// 9.x+ CTR key entry in ES .data segment. Used to store CTR key/IV data for encrypted volatile tickets in ticket.bin and/or encrypted entries in ticket_list.bin.
 /// This is always stored in pairs. The first entry holds the key/IV for the encrypted volatile ticket, while the second entry holds the key/IV for the encrypted entry in ticket_list.bin.
 /// First index in this list is always 0.
@@ -77,6 +86,9 @@ NXDT_ASSERT(TikEsCtrKeyPattern9x, 0x28);
 
 static Mutex g_esTikSaveMutex = 0;
 
+static bool g_tikEsSaveCacheEnabled = false;
+static TikEsSaveContext g_tikEsSaveCache[TikTitleKeyType_Count] = {0};
+
 #if LOG_LEVEL <= LOG_LEVEL_ERROR
 static const char *g_tikTitleKeyTypeStrings[] = {
     [TikTitleKeyType_Common] = "common",
@@ -96,6 +108,9 @@ static MemoryLocation g_esMemoryLocation = {
 static bool tikRetrieveTicketFromGameCardByRightsId(Ticket *dst, const FsRightsId *id);
 static bool tikRetrieveTicketFromEsSaveDataByRightsId(Ticket *dst, const FsRightsId *id);
 
+static bool tikOpenEsSaveContext(TikEsSaveContext *es_save_ctx, u8 titlekey_type);
+static void tikCloseEsSaveContext(TikEsSaveContext *es_save_ctx);
+
 static bool tikFixTamperedCommonTicket(Ticket *tik);
 static bool tikVerifyRsa2048Sha256Signature(const TikCommonBlock *tik_common_block, u64 hash_area_size, const u8 *signature);
 
@@ -105,7 +120,8 @@ static bool tikGetDecryptedTitleKey(void *dst, const void *src, u8 key_generatio
 static bool tikGetTitleKeyTypeForRightsId(const FsRightsId *id, u8 *out);
 static bool tikRetrieveRightsIdsByTitleKeyType(FsRightsId **out, u32 *out_count, bool personalized);
 
-static bool tikGetTicketEntryOffsetFromTicketList(save_ctx_t *save_ctx, u8 *buf, u64 buf_size, const FsRightsId *id, u8 titlekey_type, u64 *out_offset);
+static bool tikReadTicketList(save_ctx_t *save_ctx, u8 titlekey_type, TikListEntry **out_entries, u32 *out_count);
+static bool tikGetTicketEntryOffsetFromTicketList(const TikEsSaveContext *es_save_ctx, const FsRightsId *id, u64 *out_offset);
 static bool tikRetrieveTicketEntryFromTicketBin(save_ctx_t *save_ctx, u8 *buf, u64 buf_size, const FsRightsId *id, u8 titlekey_type, u64 ticket_offset);
 static bool tikDecryptVolatileTicket(u8 *buf, u64 ticket_offset);
 
@@ -190,6 +206,22 @@ end:
     return success;
 }
 
+void tikSetTicketCacheEnabled(bool enabled)
+{
+    SCOPED_LOCK(&g_esTikSaveMutex)
+    {
+        if (enabled == g_tikEsSaveCacheEnabled) break;
+
+        /* Close ES ticket system savefiles opened while the cache was enabled. */
+        if (!enabled)
+        {
+            for(u8 i = TikTitleKeyType_Common; i < TikTitleKeyType_Count; i++) tikCloseEsSaveContext(&(g_tikEsSaveCache[i]));
+        }
+
+        g_tikEsSaveCacheEnabled = enabled;
+    }
+}
+
 bool tikConvertPersonalizedTicketToCommonTicket(Ticket *tik, u8 **out_raw_cert_chain, u64 *out_raw_cert_chain_size)
 {
     TikCommonBlock *tik_common_block = NULL;
@@ -321,23 +353,13 @@ static bool tikRetrieveTicketFromEsSaveDataByRightsId(Ticket *dst, const FsRight
 
     u8 titlekey_type = 0;
 
-    const char *mount_name = NULL;
-    char savefile_path[64] = {0};
-    save_ctx_t *save_ctx = NULL;
+    TikEsSaveContext tmp_es_save_ctx = {0}, *es_save_ctx = NULL;
 
-    u64 buf_size = (SIGNED_TIK_MAX_SIZE * 0x100);
-    u8 *buf = NULL;
+    u8 buf[SIGNED_TIK_MAX_SIZE] = {0};
     u64 ticket_offset = 0;
 
     bool success = false;
 
-    /* Allocate memory to retrieve the ticket. */
-    if (!(buf = malloc(buf_size)))
-    {
-        LOG_MSG_ERROR("Unable to allocate 0x%lX bytes block for temporary read buffer!", buf_size);
-        goto end;
-    }
-
     /* Get titlekey type. */
     if (!tikGetTitleKeyTypeForRightsId(id, &titlekey_type))
     {
@@ -349,32 +371,19 @@ static bool tikRetrieveTicketFromEsSaveDataByRightsId(Ticket *dst, const FsRight
     const char *tik_titlekey_type_str = g_tikTitleKeyTypeStrings[titlekey_type];
 #endif
 
-    /* Retrieve mount name for the eMMC BIS System partition. */
-    if (!(mount_name = bisStorageGetMountNameByBisPartitionId(FsBisPartitionId_System)))
-    {
-        LOG_MSG_ERROR("Failed to mount eMMC BIS System partition!");
-        goto end;
-    }
-
-    /* Generate savefile path. */
-    snprintf(savefile_path, sizeof(savefile_path), "%s:%s", mount_name, titlekey_type == TikTitleKeyType_Common ? TIK_COMMON_BIS_SYSTEM_SAVEFILE_PATH : TIK_PERSONALIZED_BIS_SYSTEM_SAVEFILE_PATH);
-
-    /* Open ES common/personalized system savefile. */
-    if (!(save_ctx = save_open_savefile(savefile_path, 0)))
-    {
-        LOG_MSG_ERROR("Failed to open ES %s ticket system savefile!", tik_titlekey_type_str);
-        goto end;
-    }
+    /* Reuse the ES ticket system savefile opened by a previous call if the cache is enabled. */
+    es_save_ctx = (g_tikEsSaveCacheEnabled ? &(g_tikEsSaveCache[titlekey_type]) : &tmp_es_save_ctx);
+    if (!es_save_ctx->save_ctx && !tikOpenEsSaveContext(es_save_ctx, titlekey_type)) goto end;
 
     /* Get ticket entry offset from ticket_list.bin. */
-    if (!tikGetTicketEntryOffsetFromTicketList(save_ctx, buf, buf_size, id, titlekey_type, &ticket_offset))
+    if (!tikGetTicketEntryOffsetFromTicketList(es_save_ctx, id, &ticket_offset))
     {
         LOG_MSG_ERROR("Unable to find an entry with a matching Rights ID in \"%s\" from ES %s ticket system save!", TIK_LIST_SAVEFILE_STORAGE_PATH, tik_titlekey_type_str);
         goto end;
     }
 
     /* Get ticket entry from ticket.bin. */
-    if (!tikRetrieveTicketEntryFromTicketBin(save_ctx, buf, buf_size, id, titlekey_type, ticket_offset))
+    if (!tikRetrieveTicketEntryFromTicketBin(es_save_ctx->save_ctx, buf, sizeof(buf), id, titlekey_type, ticket_offset))
     {
         LOG_MSG_ERROR("Unable to find a matching %s ticket entry for the provided Rights ID!", tik_titlekey_type_str);
         goto end;
@@ -391,13 +400,60 @@ static bool tikRetrieveTicketFromEsSaveDataByRightsId(Ticket *dst, const FsRight
     memcpy(dst->data, buf, dst->size);
 
 end:
-    if (save_ctx) save_close_savefile(&save_ctx);
+    tikCloseEsSaveContext(&tmp_es_save_ctx);
+
+    return success;
+}
+
+static bool tikOpenEsSaveContext(TikEsSaveContext *es_save_ctx, u8 titlekey_type)
+{
+    const char *mount_name = NULL;
+    char savefile_path[64] = {0};
+    bool success = false;
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+    const char *tik_titlekey_type_str = g_tikTitleKeyTypeStrings[titlekey_type];
+#endif
 
-    if (buf) free(buf);
+    /* Retrieve mount name for the eMMC BIS System partition. */
+    if (!(mount_name = bisStorageGetMountNameByBisPartitionId(FsBisPartitionId_System)))
+    {
+        LOG_MSG_ERROR("Failed to mount eMMC BIS System partition!");
+        goto end;
+    }
+
+    /* Generate savefile path. */
+    snprintf(savefile_path, sizeof(savefile_path), "%s:%s", mount_name, titlekey_type == TikTitleKeyType_Common ? TIK_COMMON_BIS_SYSTEM_SAVEFILE_PATH : TIK_PERSONALIZED_BIS_SYSTEM_SAVEFILE_PATH);
+
+    /* Open ES common/personalized system savefile. */
+    if (!(es_save_ctx->save_ctx = save_open_savefile(savefile_path, 0)))
+    {
+        LOG_MSG_ERROR("Failed to open ES %s ticket system savefile!", tik_titlekey_type_str);
+        goto end;
+    }
+
+    /* Read all ticket_list.bin entries. Lookups are carried out in memory afterwards. */
+    success = tikReadTicketList(es_save_ctx->save_ctx, titlekey_type, &(es_save_ctx->ticket_list), &(es_save_ctx->ticket_list_count));
+
+end:
+    if (!success) tikCloseEsSaveContext(es_save_ctx);
 
     return success;
 }
 
+static void tikCloseEsSaveContext(TikEsSaveContext *es_save_ctx)
+{
+    if (es_save_ctx->save_ctx) save_close_savefile(&(es_save_ctx->save_ctx));
+
+    if (es_save_ctx->ticket_list)
+    {
+        free(es_save_ctx->ticket_list);
+        es_save_ctx->ticket_list = NULL;
+    }
+
+    es_save_ctx->ticket_list_count = 0;
+}
+
 static bool tikFixTamperedCommonTicket(Ticket *tik)
 {
     TikCommonBlock *tik_common_block = NULL;
@@ -661,16 +717,19 @@ end:
     return success;
 }
 
-static bool tikGetTicketEntryOffsetFromTicketList(save_ctx_t *save_ctx, u8 *buf, u64 buf_size, const FsRightsId *id, u8 titlekey_type, u64 *out_offset)
+static bool tikReadTicketList(save_ctx_t *save_ctx, u8 titlekey_type, TikListEntry **out_entries, u32 *out_count)
 {
-    if (!save_ctx || !buf || !buf_size || (buf_size % sizeof(TikListEntry)) != 0 || !id || titlekey_type >= TikTitleKeyType_Count || !out_offset)
+    if (!save_ctx || titlekey_type >= TikTitleKeyType_Count || !out_entries || !out_count)
     {
         LOG_MSG_ERROR("Invalid parameters!");
         return false;
     }
 
     allocation_table_storage_ctx_t fat_storage = {0};
-    u64 ticket_list_bin_size = 0, br = 0, total_br = 0;
+    u64 ticket_list_bin_size = 0, chunk_size = 0, offset = 0;
+
+    TikListEntry *entries = NULL;
+    u32 count = 0;
 
     u8 last_rights_id[0x10] = {0};
     memset(last_rights_id, 0xFF, sizeof(last_rights_id));
@@ -695,53 +754,74 @@ static bool tikGetTicketEntryOffsetFromTicketList(save_ctx_t *save_ctx, u8 *buf,
         goto end;
     }
 
-    /* Look for an entry matching our rights ID in ticket_list.bin. */
-    while(total_br < ticket_list_bin_size)
+    /* Allocate memory for the ticket list entries. */
+    if (!(entries = malloc(ticket_list_bin_size)))
+    {
+        LOG_MSG_ERROR("Unable to allocate 0x%lX bytes block for \"%s\" entries!", ticket_list_bin_size, TIK_LIST_SAVEFILE_STORAGE_PATH);
+        goto end;
+    }
+
+    /* Read ticket_list.bin in chunks until we find the last entry. */
+    while(offset < ticket_list_bin_size && !last_entry_found)
     {
         /* Update chunk size, if needed. */
-        if (buf_size > (ticket_list_bin_size - total_br)) buf_size = (ticket_list_bin_size - total_br);
+        chunk_size = MIN(TIK_LIST_READ_CHUNK_SIZE, ticket_list_bin_size - offset);
 
         /* Read current chunk. */
-        if ((br = save_allocation_table_storage_read(&fat_storage, buf, total_br, buf_size)) != buf_size)
+        if (save_allocation_table_storage_read(&fat_storage, (u8*)entries + offset, offset, chunk_size) != chunk_size)
         {
-            LOG_MSG_ERROR("Failed to read 0x%lX bytes chunk at offset 0x%lX from \"%s\" in ES %s ticket system save!", buf_size, total_br, TIK_LIST_SAVEFILE_STORAGE_PATH, tik_titlekey_type_str);
-            break;
+            LOG_MSG_ERROR("Failed to read 0x%lX bytes chunk at offset 0x%lX from \"%s\" in ES %s ticket system save!", chunk_size, offset, TIK_LIST_SAVEFILE_STORAGE_PATH, tik_titlekey_type_str);
+            goto end;
         }
 
-        /* Process individual ticket list entries. */
-        for(u64 i = 0; i < buf_size; i += sizeof(TikListEntry))
+        /* Count ticket list entries until we find the last one. */
+        for(u64 i = 0; i < chunk_size; i += sizeof(TikListEntry), count++)
         {
-            if ((buf_size - i) < sizeof(TikListEntry)) break;
-
-            u64 entry_offset = (total_br + i);
-            TikListEntry *entry = (TikListEntry*)(buf + i);
-
-            /* Check if we found the last entry. */
-            if (!memcmp(entry->rights_id.c, last_rights_id, sizeof(last_rights_id)))
+            if (!memcmp(entries[count].rights_id.c, last_rights_id, sizeof(last_rights_id)))
             {
                 last_entry_found = true;
                 break;
             }
-
-            /* Check if this is the entry we're looking for. */
-            if (!memcmp(entry->rights_id.c, id->c, sizeof(id->c)))
-            {
-                /* Jackpot. */
-                *out_offset = (entry_offset << 5); /* (entry_offset / sizeof(TikListEntry)) * SIGNED_TIK_MAX_SIZE */
-                success = true;
-                break;
-            }
         }
 
-        total_br += br;
-
-        if (last_entry_found || success) break;
+        offset += chunk_size;
     }
 
+    /* Update output values. */
+    *out_entries = entries;
+    *out_count = count;
+
+    LOG_MSG_DEBUG("Read %u entries from \"%s\" in ES %s ticket system save.", count, TIK_LIST_SAVEFILE_STORAGE_PATH, tik_titlekey_type_str);
+
+    success = true;
+
 end:
+    if (!success && entries) free(entries);
+
     return success;
 }
 
+static bool tikGetTicketEntryOffsetFromTicketList(const TikEsSaveContext *es_save_ctx, const FsRightsId *id, u64 *out_offset)
+{
+    if (!es_save_ctx || !es_save_ctx->ticket_list || !id || !out_offset)
+    {
+        LOG_MSG_ERROR("Invalid parameters!");
+        return false;
+    }
+
+    /* Look for an entry matching our rights ID. */
+    for(u32 i = 0; i < es_save_ctx->ticket_list_count; i++)
+    {
+        if (memcmp(es_save_ctx->ticket_list[i].rights_id.c, id->c, sizeof(id->c)) != 0) continue;
+
+        /* Jackpot. */
+        *out_offset = ((u64)i * SIGNED_TIK_MAX_SIZE);
+        return true;
+    }
+
+    return false;
+}
+
 static bool tikRetrieveTicketEntryFromTicketBin(save_ctx_t *save_ctx, u8 *buf, u64 buf_size, const FsRightsId *id, u8 titlekey_type, u64 ticket_offset)
 {
     if (!save_ctx || !buf || buf_size < SIGNED_TIK_MAX_SIZE || !id || titlekey_type >= TikTitleKeyType_Count || (ticket_offset % SIGNED_TIK_MAX_SIZE) != 0)
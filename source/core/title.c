@@ -32,6 +32,12 @@
 
 #define NCM_CMT_APP_OFFSET                  0x7A
 
+#define TITLE_CACHE_MAGIC                   0x4E585443                              /* "NXTC". */
+#define TITLE_CACHE_VERSION                 1
+#define TITLE_CACHE_META_STATUS_BLOCK_SIZE  16
+
+#define TITLE_WORKER_THREAD_COUNT           3                                       /* Max thread count for worker pools, including the calling thread. Core 3 is reserved for HOS. */
+
 /* Type definitions. */
 
 typedef struct {
@@ -53,6 +59,67 @@ typedef struct {
     NcmContentMetaKey meta_key;
 } TitleGameCardContentMetaContext;
 
+/// The title metadata cache file holds TitleMetadataCacheHeader + (TitleMetadataCacheEntry * entry_count) + icon data.
+typedef struct {
+    u32 magic;                      ///< "NXTC".
+    u32 version;
+    u32 entry_count;
+    u32 icon_data_size;
+    u64 language_code;              ///< Cached entries are discarded if the system language changes.
+    u8 reserved[0x8];
+} TitleMetadataCacheHeader;
+
+NXDT_ASSERT(TitleMetadataCacheHeader, 0x20);
+
+/// Used to determine if a cached entry is still valid.
+typedef struct {
+    u64 title_id;                   ///< Application ID.
+    u32 version;                    ///< Latest application / patch version available for this application.
+    u8 storage_id;                  ///< NcmStorageId where the latest application / patch version is stored.
+    u8 reserved[0x3];
+} TitleMetadataCacheKey;
+
+NXDT_ASSERT(TitleMetadataCacheKey, 0x10);
+
+/// Sorted by application ID.
+typedef struct {
+    TitleMetadataCacheKey key;
+    u32 icon_offset;                ///< Relative to the start of the icon data.
+    u32 icon_size;
+    u8 reserved[0x8];
+    NacpLanguageEntry lang_entry;
+} TitleMetadataCacheEntry;
+
+NXDT_ASSERT(TitleMetadataCacheEntry, 0x320);
+
+typedef struct {
+    u8 *data;
+    TitleMetadataCacheHeader *header;
+    TitleMetadataCacheEntry *entries;
+    u8 *icon_data;
+} TitleMetadataCache;
+
+typedef void (*TitleWorkerJobFunc)(void *job_data, u32 job_idx);
+
+/// Jobs are picked in order by worker threads until none are left.
+typedef struct {
+    Mutex mutex;
+    u32 next_job;
+    u32 job_count;
+    TitleWorkerJobFunc job_func;
+    void *job_data;
+} TitleWorkerPool;
+
+/// Used to retrieve application metadata for NS application records from worker threads.
+typedef struct {
+    const NsApplicationRecord *app_records;
+    TitleMetadataCache *cache;
+    TitleMetadataCacheKey *cache_keys;          ///< One entry per application record. May be NULL, in which case the title metadata cache isn't used.
+    TitleApplicationMetadata **app_metadata;    ///< One entry per application record. Set to NULL if application metadata couldn't be retrieved.
+    Mutex mutex;
+    u32 cache_hit_count;
+} TitleNsRecordJobData;
+
 /* Global variables. */
 
 static Mutex g_titleMutex = 0;
@@ -556,9 +623,10 @@ NX_INLINE void titleFreeApplicationMetadata(void);
 static bool titleReallocateApplicationMetadata(u32 extra_app_count, bool is_system, bool free_entries);
 
 NX_INLINE bool titleInitializePersistentTitleStorages(void);
+static void titleInitializePersistentTitleStorageJob(void *job_data, u32 job_idx);
 NX_INLINE void titleCloseTitleStorages(void);
 
-static bool titleInitializeTitleStorage(u8 storage_id);
+static bool titleInitializeTitleStorage(u8 storage_id, bool update_linked_lists);
 static bool titleInitializeGameCardTitleStorageByHashFileSystem(u8 hfs_partition_type);
 static void titleCloseTitleStorage(u8 storage_id);
 static bool titleReallocateTitleInfoFromStorage(TitleStorage *title_storage, u32 extra_title_count, bool free_entries);
@@ -568,9 +636,10 @@ static void titleAddOrphanTitleInfoEntry(TitleInfo *orphan_title);
 
 static bool titleGenerateMetadataEntriesFromSystemTitles(void);
 static bool titleGenerateMetadataEntriesFromNsRecords(void);
+static void titleGenerateUserMetadataEntryFromNsRecordJob(void *job_data, u32 job_idx);
 
 static TitleApplicationMetadata *titleGetSystemMetadataEntry(u64 title_id);
-static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromNs(u64 title_id);
+static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromNs(u64 title_id, NsApplicationControlData *control_data);
 static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromControlNca(TitleInfo *title_info);
 
 static bool titleGetApplicationControlDataFromNs(u64 title_id, NsApplicationControlData *out_control_data, u64 *out_control_data_size);
@@ -578,6 +647,12 @@ static bool titleGetApplicationControlDataFromControlNca(TitleInfo *title_info,
 
 static TitleApplicationMetadata *titleInitializeUserMetadataEntryFromControlData(u64 title_id, const NsApplicationControlData *control_data, u64 control_data_size);
 
+static bool titleReadMetadataCacheFile(TitleMetadataCache *out, u64 language_code);
+static bool titleWriteMetadataCacheFile(TitleApplicationMetadata **app_metadata, const TitleMetadataCacheKey *keys, u32 count, u64 language_code);
+static void titleFreeMetadataCache(TitleMetadataCache *cache);
+static bool titleGetMetadataCacheKey(u64 app_id, TitleMetadataCacheKey *out);
+static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromCache(TitleMetadataCache *cache, const TitleMetadataCacheKey *key);
+
 static void titleGenerateFilteredApplicationMetadataPointerArray(bool is_system);
 static bool titleIsUserApplicationContentAvailable(u64 app_id);
 
@@ -585,7 +660,7 @@ NX_INLINE TitleApplicationMetadata *titleFindApplicationMetadataByTitleId(u64 ti
 
 NX_INLINE u64 titleGetApplicationIdByContentMetaKey(const NcmContentMetaKey *meta_key);
 
-static bool titleGenerateTitleInfoEntriesForTitleStorage(TitleStorage *title_storage);
+static bool titleGenerateTitleInfoEntriesForTitleStorage(TitleStorage *title_storage, bool update_linked_lists);
 static bool titleGenerateTitleInfoEntriesByHashFileSystemForGameCardTitleStorage(TitleStorage *title_storage, HashFileSystemContext *hfs_ctx);
 
 static TitleInfo *titleGenerateTitleInfoEntry(u8 storage_id, const NcmContentMetaKey *meta_key, NcmContentInfo *content_infos, u32 content_count, bool get_control_nca_metadata);
@@ -610,6 +685,9 @@ static TitleInfo *titleDuplicateTitleInfo(TitleInfo *title_info);
 
 static char *titleGetDisplayVersionString(TitleInfo *title_info);
 
+static void titleRunWorkerPool(u32 job_count, u32 max_thread_count, TitleWorkerJobFunc job_func, void *job_data);
+static void titleWorkerPoolThreadFunc(void *arg);
+
 static bool titleCreateGameCardInfoThread(void);
 static void titleDestroyGameCardInfoThread(void);
 static void titleGameCardInfoThreadFunc(void *arg);
@@ -626,6 +704,7 @@ static int titleSystemMetadataSortFunction(const void *a, const void *b);
 static int titleUserMetadataSortFunction(const void *a, const void *b);
 static int titleInfoSortFunction(const void *a, const void *b);
 static int titleGameCardApplicationMetadataSortFunction(const void *a, const void *b);
+static int titleMetadataCacheEntrySortFunction(const void *a, const void *b);
 static int titleGameCardContentMetaContextSortFunction(const void *a, const void *b);
 
 bool titleInitialize(void)
@@ -1433,15 +1512,24 @@ end:
 
 NX_INLINE bool titleInitializePersistentTitleStorages(void)
 {
+    bool storage_init[NcmStorageId_SdCard - NcmStorageId_BuiltInSystem + 1] = {0};
+
+    /* Initialize persistent title storages in parallel. Each one uses its own ncm database and storage sessions. */
+    titleRunWorkerPool(MAX_ELEMENTS(storage_init), TITLE_WORKER_THREAD_COUNT, &titleInitializePersistentTitleStorageJob, storage_init);
+
     for(u8 i = NcmStorageId_BuiltInSystem; i <= NcmStorageId_SdCard; i++)
     {
-        if (!titleInitializeTitleStorage(i))
+        if (!storage_init[i - NcmStorageId_BuiltInSystem])
         {
             LOG_MSG_ERROR("Failed to initialize title storage with ID %u!", i);
             return false;
         }
     }
 
+    /* Update linked lists for user applications, patches and add-on contents. */
+    /* This must only take place after all title storages have been initialized, since it processes all of them. */
+    titleUpdateTitleInfoLinkedLists();
+
 #if LOG_LEVEL <= LOG_LEVEL_INFO
 #define ORPHAN_INFO_LOG(fmt, ...) utilsAppendFormattedStringToBuffer(&orphan_info_buf, &orphan_info_buf_size, fmt, ##__VA_ARGS__)
 
@@ -1472,12 +1560,18 @@ NX_INLINE bool titleInitializePersistentTitleStorages(void)
     return true;
 }
 
+static void titleInitializePersistentTitleStorageJob(void *job_data, u32 job_idx)
+{
+    bool *storage_init = (bool*)job_data;
+    storage_init[job_idx] = titleInitializeTitleStorage((u8)(NcmStorageId_BuiltInSystem + job_idx), false);
+}
+
 NX_INLINE void titleCloseTitleStorages(void)
 {
     for(u8 i = NcmStorageId_GameCard; i <= NcmStorageId_SdCard; i++) titleCloseTitleStorage(i);
 }
 
-static bool titleInitializeTitleStorage(u8 storage_id)
+static bool titleInitializeTitleStorage(u8 storage_id, bool update_linked_lists)
 {
     if (storage_id < NcmStorageId_GameCard || storage_id > NcmStorageId_SdCard)
     {
@@ -1521,7 +1615,7 @@ static bool titleInitializeTitleStorage(u8 storage_id)
     }
 
     /* Generate title info entries for this storage. */
-    if (!titleGenerateTitleInfoEntriesForTitleStorage(title_storage))
+    if (!titleGenerateTitleInfoEntriesForTitleStorage(title_storage, update_linked_lists))
     {
         LOG_MSG_ERROR("Failed to generate title info entries for %s!", titleGetNcmStorageIdName(storage_id));
         goto end;
@@ -1774,6 +1868,13 @@ static bool titleGenerateMetadataEntriesFromNsRecords(void)
     u32 app_records_block_count = 0, app_records_count = 0, extra_app_count = 0;
     size_t app_records_size = 0, app_records_block_size = (NS_APPLICATION_RECORD_BLOCK_SIZE * sizeof(NsApplicationRecord));
 
+    TitleMetadataCache cache = {0};
+    TitleMetadataCacheKey *cache_keys = NULL;
+    u64 language_code = 0;
+    u32 cache_key_count = 0;
+
+    TitleNsRecordJobData job_data = {0};
+
     bool success = false, free_entries = false;
 
     /* Retrieve NS application records in a loop until we get them all. */
@@ -1822,16 +1923,44 @@ static bool titleGenerateMetadataEntriesFromNsRecords(void)
 
     free_entries = true;
 
+    /* Load the title metadata cache. Cached names are only valid for the current system language. */
+    /* The cache is ignored altogether if we can't retrieve it. */
+    rc = setGetSystemLanguage(&language_code);
+    if (R_SUCCEEDED(rc))
+    {
+        cache_keys = calloc(app_records_count, sizeof(TitleMetadataCacheKey));
+        if (cache_keys) titleReadMetadataCacheFile(&cache, language_code);
+    } else {
+        LOG_MSG_ERROR("setGetSystemLanguage failed! (0x%X).", rc);
+    }
+
     /* Retrieve application metadata for each NS application record. */
+    /* This is done using a single thread: both cache key generation and metadata retrieval go through our only ns session, so IPC calls from multiple threads just get serialized. */
+    /* Application metadata entry pointers are directly set on the newly allocated elements from the application metadata pointer array. */
+    job_data.app_records = app_records;
+    job_data.cache = &cache;
+    job_data.cache_keys = cache_keys;
+    job_data.app_metadata = &(g_userMetadata[g_userMetadataCount]);
+    mutexInit(&(job_data.mutex));
+
+    titleRunWorkerPool(app_records_count, 1, &titleGenerateUserMetadataEntryFromNsRecordJob, &job_data);
+
+    /* Get rid of the elements we didn't fill, while keeping the NS application record order. */
     for(u32 i = 0; i < app_records_count; i++)
     {
-        /* Retrieve application metadata. */
-        TitleApplicationMetadata *cur_app_metadata = titleGenerateUserMetadataEntryFromNs(app_records[i].application_id);
+        TitleApplicationMetadata *cur_app_metadata = job_data.app_metadata[i];
         if (!cur_app_metadata) continue;
 
         /* Set application metadata entry pointer. */
         g_userMetadata[g_userMetadataCount + extra_app_count] = cur_app_metadata;
 
+        /* Keep the cache key for this application. */
+        if (cache_keys)
+        {
+            if (extra_app_count != i) memcpy(&(cache_keys[extra_app_count]), &(cache_keys[i]), sizeof(TitleMetadataCacheKey));
+            if (cache_keys[extra_app_count].title_id) cache_key_count++;
+        }
+
         /* Increase extra application metadata counter. */
         extra_app_count++;
     }
@@ -1843,6 +1972,14 @@ static bool titleGenerateMetadataEntriesFromNsRecords(void)
         goto end;
     }
 
+    LOG_MSG_INFO("Retrieved %u application metadata entr%s from the title metadata cache.", job_data.cache_hit_count, job_data.cache_hit_count == 1 ? "y" : "ies");
+
+    /* Update the title metadata cache if we retrieved any new entries from ns, or if any cached entries are no longer valid. Ignore return value. */
+    if (cache_keys && (job_data.cache_hit_count != cache_key_count || job_data.cache_hit_count != (cache.header ? cache.header->entry_count : 0)))
+    {
+        titleWriteMetadataCacheFile(&(g_userMetadata[g_userMetadataCount]), cache_keys, extra_app_count, language_code);
+    }
+
     /* Update application metadata count. */
     g_userMetadataCount += extra_app_count;
 
@@ -1856,6 +1993,10 @@ static bool titleGenerateMetadataEntriesFromNsRecords(void)
     success = true;
 
 end:
+    titleFreeMetadataCache(&cache);
+
+    if (cache_keys) free(cache_keys);
+
     if (app_records) free(app_records);
 
     /* Free previously allocated application metadata pointers. Ignore return value. */
@@ -1864,6 +2005,40 @@ end:
     return success;
 }
 
+static void titleGenerateUserMetadataEntryFromNsRecordJob(void *job_data, u32 job_idx)
+{
+    TitleNsRecordJobData *data = (TitleNsRecordJobData*)job_data;
+    u64 app_id = data->app_records[job_idx].application_id;
+    TitleMetadataCacheKey *cache_key = (data->cache_keys ? &(data->cache_keys[job_idx]) : NULL);
+    NsApplicationControlData *control_data = NULL;
+    TitleApplicationMetadata *app_metadata = NULL;
+
+    /* Retrieve application metadata from the cache, if it's still valid. */
+    if (cache_key && titleGetMetadataCacheKey(app_id, cache_key) && (app_metadata = titleGenerateUserMetadataEntryFromCache(data->cache, cache_key)))
+    {
+        SCOPED_LOCK(&(data->mutex)) data->cache_hit_count++;
+        goto end;
+    }
+
+    /* Otherwise, retrieve it from ns. We don't use the global ns application control data buffer here, since jobs may run on worker threads. */
+    control_data = malloc(sizeof(NsApplicationControlData));
+    if (!control_data)
+    {
+        LOG_MSG_ERROR("Failed to allocate memory for the ns application control data! (%016lX).", app_id);
+        goto end;
+    }
+
+    app_metadata = titleGenerateUserMetadataEntryFromNs(app_id, control_data);
+
+    free(control_data);
+
+end:
+    /* Don't keep the cache key for this application if we couldn't retrieve its metadata. */
+    if (!app_metadata && cache_key) memset(cache_key, 0, sizeof(TitleMetadataCacheKey));
+
+    data->app_metadata[job_idx] = app_metadata;
+}
+
 static TitleApplicationMetadata *titleGetSystemMetadataEntry(u64 title_id)
 {
     if (!title_id)
@@ -1922,9 +2097,9 @@ end:
     return app_metadata;
 }
 
-static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromNs(u64 title_id)
+static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromNs(u64 title_id, NsApplicationControlData *control_data)
 {
-    if (!g_nsAppControlData || !title_id)
+    if (!control_data || !title_id)
     {
         LOG_MSG_ERROR("Invalid parameters!");
         return NULL;
@@ -1934,14 +2109,14 @@ static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromNs(u64 title_
     TitleApplicationMetadata *app_metadata = NULL;
 
     /* Retrieve application control data from ns. */
-    if (!titleGetApplicationControlDataFromNs(title_id, g_nsAppControlData, &control_data_size))
+    if (!titleGetApplicationControlDataFromNs(title_id, control_data, &control_data_size))
     {
         LOG_MSG_ERROR("Failed to retrieve application control data for %016lX!", title_id);
         goto end;
     }
 
     /* Initialize application metadata entry using the control data we just retrieved. */
-    app_metadata = titleInitializeUserMetadataEntryFromControlData(title_id, g_nsAppControlData, control_data_size);
+    app_metadata = titleInitializeUserMetadataEntryFromControlData(title_id, control_data, control_data_size);
     if (!app_metadata) LOG_MSG_ERROR("Failed to generate application metadata entry for %016lX!", title_id);
 
 end:
@@ -2200,6 +2375,267 @@ end:
     return out;
 }
 
+static bool titleReadMetadataCacheFile(TitleMetadataCache *out, u64 language_code)
+{
+    FILE *fp = NULL;
+    struct stat cache_st = {0};
+    u64 expected_size = 0;
+    bool success = false;
+
+    memset(out, 0, sizeof(TitleMetadataCache));
+
+    if (stat(TITLE_CACHE_FILE_PATH, &cache_st) != 0 || !S_ISREG(cache_st.st_mode) || (u64)cache_st.st_size < sizeof(TitleMetadataCacheHeader)) goto end;
+
+    fp = fopen(TITLE_CACHE_FILE_PATH, "rb");
+    if (!fp)
+    {
+        LOG_MSG_ERROR("Failed to open \"%s\"!", TITLE_CACHE_FILE_PATH);
+        goto end;
+    }
+
+    /* Read the whole cache in one go. Lookups are performed directly on this buffer. */
+    out->data = malloc(cache_st.st_size);
+    if (!out->data)
+    {
+        LOG_MSG_ERROR("Failed to allocate 0x%lX bytes for the title metadata cache!", (u64)cache_st.st_size);
+        goto end;
+    }
+
+    if (fread(out->data, 1, cache_st.st_size, fp) != (size_t)cache_st.st_size)
+    {
+        LOG_MSG_ERROR("Failed to read title metadata cache!");
+        goto end;
+    }
+
+    out->header = (TitleMetadataCacheHeader*)out->data;
+
+    if (out->header->magic != __builtin_bswap32(TITLE_CACHE_MAGIC) || out->header->version != TITLE_CACHE_VERSION)
+    {
+        LOG_MSG_WARNING("Invalid title metadata cache header!");
+        goto end;
+    }
+
+    expected_size = (sizeof(TitleMetadataCacheHeader) + ((u64)out->header->entry_count * sizeof(TitleMetadataCacheEntry)) + out->header->icon_data_size);
+    if (expected_size != (u64)cache_st.st_size)
+    {
+        LOG_MSG_WARNING("Title metadata cache size mismatch! (0x%lX != 0x%lX).", expected_size, (u64)cache_st.st_size);
+        goto end;
+    }
+
+    if (out->header->language_code != language_code)
+    {
+        LOG_MSG_INFO("Title metadata cache is stale (system language changed).");
+        goto end;
+    }
+
+    out->entries = (TitleMetadataCacheEntry*)(out->data + sizeof(TitleMetadataCacheHeader));
+    out->icon_data = (u8*)(out->entries + out->header->entry_count);
+
+    /* Validate icon offsets. */
+    for(u32 i = 0; i < out->header->entry_count; i++)
+    {
+        TitleMetadataCacheEntry *cur_entry = &(out->entries[i]);
+
+        if (((u64)cur_entry->icon_offset + cur_entry->icon_size) > out->header->icon_data_size || (i > 0 && cur_entry->key.title_id < out->entries[i - 1].key.title_id))
+        {
+            LOG_MSG_WARNING("Invalid title metadata cache entry #%u!", i);
+            goto end;
+        }
+    }
+
+    success = true;
+
+end:
+    if (fp) fclose(fp);
+
+    if (!success) titleFreeMetadataCache(out);
+
+    return success;
+}
+
+static bool titleWriteMetadataCacheFile(TitleApplicationMetadata **app_metadata, const TitleMetadataCacheKey *keys, u32 count, u64 language_code)
+{
+    FILE *fp = NULL;
+    TitleMetadataCacheHeader header = {0};
+    TitleMetadataCacheEntry *entries = NULL;
+    u32 entry_count = 0, icon_data_size = 0;
+    bool success = false;
+
+    entries = calloc(count, sizeof(TitleMetadataCacheEntry));
+    if (!entries)
+    {
+        LOG_MSG_ERROR("Failed to allocate memory for title metadata cache entries!");
+        goto end;
+    }
+
+    /* Only cache entries with a valid key. Icons are stored in the same order as the application metadata entries. */
+    for(u32 i = 0; i < count; i++)
+    {
+        if (!keys[i].title_id) continue;
+
+        TitleMetadataCacheEntry *cur_entry = &(entries[entry_count++]);
+
+        memcpy(&(cur_entry->key), &(keys[i]), sizeof(TitleMetadataCacheKey));
+        cur_entry->icon_offset = icon_data_size;
+        cur_entry->icon_size = app_metadata[i]->icon_size;
+        memcpy(&(cur_entry->lang_entry), &(app_metadata[i]->lang_entry), sizeof(NacpLanguageEntry));
+
+        icon_data_size += app_metadata[i]->icon_size;
+    }
+
+    if (entry_count > 1) qsort(entries, entry_count, sizeof(TitleMetadataCacheEntry), &titleMetadataCacheEntrySortFunction);
+
+    header.magic = __builtin_bswap32(TITLE_CACHE_MAGIC);
+    header.version = TITLE_CACHE_VERSION;
+    header.entry_count = entry_count;
+    header.icon_data_size = icon_data_size;
+    header.language_code = language_code;
+
+    utilsCreateDirectoryTree(TITLE_CACHE_FILE_PATH, false);
+
+    fp = fopen(TITLE_CACHE_FILE_PATH, "wb");
+    if (!fp)
+    {
+        LOG_MSG_ERROR("Failed to open \"%s\" for writing!", TITLE_CACHE_FILE_PATH);
+        goto end;
+    }
+
+    if (fwrite(&header, 1, sizeof(TitleMetadataCacheHeader), fp) != sizeof(TitleMetadataCacheHeader) || \
+        fwrite(entries, sizeof(TitleMetadataCacheEntry), entry_count, fp) != entry_count)
+    {
+        LOG_MSG_ERROR("Failed to write title metadata cache!");
+        goto end;
+    }
+
+    for(u32 i = 0; i < count; i++)
+    {
+        if (!keys[i].title_id || !app_metadata[i]->icon_size) continue;
+
+        if (fwrite(app_metadata[i]->icon, 1, app_metadata[i]->icon_size, fp) != app_metadata[i]->icon_size)
+        {
+            LOG_MSG_ERROR("Failed to write title metadata cache icon data!");
+            goto end;
+        }
+    }
+
+    LOG_MSG_INFO("Successfully updated title metadata cache (%u entr%s).", entry_count, entry_count == 1 ? "y" : "ies");
+
+    success = true;
+
+end:
+    if (fp)
+    {
+        fclose(fp);
+        if (!success) remove(TITLE_CACHE_FILE_PATH);
+        utilsCommitSdCardFileSystemChanges();
+    }
+
+    if (entries) free(entries);
+
+    return success;
+}
+
+static void titleFreeMetadataCache(TitleMetadataCache *cache)
+{
+    if (cache->data) free(cache->data);
+    memset(cache, 0, sizeof(TitleMetadataCache));
+}
+
+static bool titleGetMetadataCacheKey(u64 app_id, TitleMetadataCacheKey *out)
+{
+    Result rc = 0;
+    NsApplicationContentMetaStatus meta_status[TITLE_CACHE_META_STATUS_BLOCK_SIZE] = {0};
+    s32 meta_status_count = 0, meta_status_offset = 0;
+    bool found = false;
+
+    memset(out, 0, sizeof(TitleMetadataCacheKey));
+
+    /* Look for the latest application / patch version available for this application, which is the one ns retrieves control data from. */
+    /* This is much cheaper than retrieving the control data itself. */
+    do {
+        rc = nsListApplicationContentMetaStatus(app_id, meta_status_offset, meta_status, TITLE_CACHE_META_STATUS_BLOCK_SIZE, &meta_status_count);
+        if (R_FAILED(rc))
+        {
+            LOG_MSG_ERROR("nsListApplicationContentMetaStatus failed for %016lX! (0x%X).", app_id, rc);
+            return false;
+        }
+
+        for(s32 i = 0; i < meta_status_count; i++)
+        {
+            NsApplicationContentMetaStatus *cur_meta_status = &(meta_status[i]);
+
+            if ((cur_meta_status->meta_type != NcmContentMetaType_Application && cur_meta_status->meta_type != NcmContentMetaType_Patch) || \
+                (found && cur_meta_status->version <= out->version)) continue;
+
+            out->version = cur_meta_status->version;
+            out->storage_id = cur_meta_status->storageID;
+            found = true;
+        }
+
+        meta_status_offset += meta_status_count;
+    } while(meta_status_count >= TITLE_CACHE_META_STATUS_BLOCK_SIZE);
+
+    /* Applications without any installed contents can't be validated, so they won't be cached. */
+    if (found) out->title_id = app_id;
+
+    return found;
+}
+
+static TitleApplicationMetadata *titleGenerateUserMetadataEntryFromCache(TitleMetadataCache *cache, const TitleMetadataCacheKey *key)
+{
+    if (!cache->header || !cache->header->entry_count) return NULL;
+
+    TitleMetadataCacheEntry *cache_entry = NULL;
+    TitleApplicationMetadata *out = NULL;
+    u32 lo = 0, hi = cache->header->entry_count;
+
+    /* Look for a cache entry with a matching application ID. */
+    while(lo < hi)
+    {
+        u32 mid = (lo + ((hi - lo) / 2));
+
+        if (cache->entries[mid].key.title_id < key->title_id)
+        {
+            lo = (mid + 1);
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo >= cache->header->entry_count) return NULL;
+
+    /* Discard the cache entry if a different application / patch version is now available. */
+    cache_entry = &(cache->entries[lo]);
+    if (cache_entry->key.title_id != key->title_id || cache_entry->key.version != key->version || cache_entry->key.storage_id != key->storage_id) return NULL;
+
+    /* Allocate memory for our application metadata entry. */
+    out = calloc(1, sizeof(TitleApplicationMetadata));
+    if (!out)
+    {
+        LOG_MSG_ERROR("Error allocating memory for application metadata entry for %016lX!", key->title_id);
+        return NULL;
+    }
+
+    if (cache_entry->icon_size)
+    {
+        out->icon = malloc(cache_entry->icon_size);
+        if (!out->icon)
+        {
+            LOG_MSG_ERROR("Error allocating memory for the icon buffer! (0x%X, %016lX).", cache_entry->icon_size, key->title_id);
+            free(out);
+            return NULL;
+        }
+
+        memcpy(out->icon, cache->icon_data + cache_entry->icon_offset, cache_entry->icon_size);
+        out->icon_size = cache_entry->icon_size;
+    }
+
+    out->title_id = key->title_id;
+    memcpy(&(out->lang_entry), &(cache_entry->lang_entry), sizeof(NacpLanguageEntry));
+
+    return out;
+}
+
 static void titleGenerateFilteredApplicationMetadataPointerArray(bool is_system)
 {
     TitleApplicationMetadata **filtered_app_metadata = NULL, **tmp_filtered_app_metadata = NULL;
@@ -2347,7 +2783,7 @@ NX_INLINE u64 titleGetApplicationIdByContentMetaKey(const NcmContentMetaKey *met
     return app_id;
 }
 
-static bool titleGenerateTitleInfoEntriesForTitleStorage(TitleStorage *title_storage)
+static bool titleGenerateTitleInfoEntriesForTitleStorage(TitleStorage *title_storage, bool update_linked_lists)
 {
     if (!title_storage || title_storage->storage_id < NcmStorageId_GameCard || title_storage->storage_id > NcmStorageId_SdCard || !serviceIsActive(&(title_storage->ncm_db.s)))
     {
@@ -2429,7 +2865,8 @@ static bool titleGenerateTitleInfoEntriesForTitleStorage(TitleStorage *title_sto
 
     /* Update linked lists for user applications, patches and add-on contents. */
     /* This will also keep track of orphan titles - titles with no available application metadata. */
-    titleUpdateTitleInfoLinkedLists();
+    /* Skipped if other title storages are being initialized at the same time. */
+    if (update_linked_lists) titleUpdateTitleInfoLinkedLists();
 
     /* Update flag. */
     success = true;
@@ -3363,6 +3800,60 @@ end:
     return str;
 }
 
+static void titleRunWorkerPool(u32 job_count, u32 max_thread_count, TitleWorkerJobFunc job_func, void *job_data)
+{
+    TitleWorkerPool pool = {0};
+    Thread threads[TITLE_WORKER_THREAD_COUNT - 1] = {0};
+    u32 thread_count = 0;
+    u64 start_tick = 0;
+
+    if (!job_count) return;
+
+    max_thread_count = MIN(MAX(max_thread_count, 1), TITLE_WORKER_THREAD_COUNT);
+    start_tick = armGetSystemTick();
+
+    mutexInit(&(pool.mutex));
+    pool.job_count = job_count;
+    pool.job_func = job_func;
+    pool.job_data = job_data;
+
+    /* Create worker threads. The calling thread also takes part, so jobs still get processed if worker threads can't be created. */
+    for(u32 i = 0; (i + 1) < max_thread_count && (i + 1) < job_count; i++)
+    {
+        if (!utilsCreateThread(&(threads[thread_count]), titleWorkerPoolThreadFunc, &pool, (int)i)) break;
+        thread_count++;
+    }
+
+    titleWorkerPoolThreadFunc(&pool);
+
+    /* Wait for all worker threads to finish. */
+    for(u32 i = 0; i < thread_count; i++) utilsJoinThread(&(threads[i]));
+
+    /* Log elapsed time, so cold start times can be compared across different thread counts. */
+    LOG_MSG_INFO("Processed %u job(s) using %u thread(s) in %lu ms.", job_count, thread_count + 1, armTicksToNs(armGetSystemTick() - start_tick) / 1000000);
+}
+
+static void titleWorkerPoolThreadFunc(void *arg)
+{
+    TitleWorkerPool *pool = (TitleWorkerPool*)arg;
+
+    while(true)
+    {
+        u32 job_idx = 0;
+        bool done = false;
+
+        /* Pick the next job. */
+        mutexLock(&(pool->mutex));
+        done = (pool->next_job >= pool->job_count);
+        if (!done) job_idx = pool->next_job++;
+        mutexUnlock(&(pool->mutex));
+
+        if (done) break;
+
+        pool->job_func(pool->job_data, job_idx);
+    }
+}
+
 static bool titleCreateGameCardInfoThread(void)
 {
     if (!utilsCreateThread(&g_titleGameCardInfoThread, titleGameCardInfoThreadFunc, NULL, 1))
@@ -3443,7 +3934,7 @@ static bool titleRefreshGameCardTitleInfo(void)
     }
 
     /* Initialize gamecard title storage. */
-    if (!titleInitializeTitleStorage(NcmStorageId_GameCard))
+    if (!titleInitializeTitleStorage(NcmStorageId_GameCard, true))
     {
         /* Try to initialize the gamecard title storage manually. */
         if (!(hfs_init = titleInitializeGameCardTitleStorageByHashFileSystem(HashFileSystemPartitionType_Secure)))
@@ -3500,7 +3991,7 @@ static bool titleRefreshGameCardTitleInfo(void)
         if (cur_title_info->app_metadata != NULL || (cur_title_info->app_metadata = titleFindApplicationMetadataByTitleId(app_id, false, extra_app_count)) != NULL) continue;
 
         /* Retrieve application metadata. */
-        cur_title_info->app_metadata = titleGenerateUserMetadataEntryFromNs(app_id);
+        cur_title_info->app_metadata = titleGenerateUserMetadataEntryFromNs(app_id, g_nsAppControlData);
         if (!cur_title_info->app_metadata) continue;
 
         /* Set application metadata entry pointer. */
@@ -3849,6 +4340,23 @@ static int titleGameCardApplicationMetadataSortFunction(const void *a, const voi
     return strcasecmp(gc_app_metadata_1->app_metadata->lang_entry.name, gc_app_metadata_2->app_metadata->lang_entry.name);
 }
 
+static int titleMetadataCacheEntrySortFunction(const void *a, const void *b)
+{
+    const TitleMetadataCacheEntry *cache_entry_1 = (const TitleMetadataCacheEntry*)a;
+    const TitleMetadataCacheEntry *cache_entry_2 = (const TitleMetadataCacheEntry*)b;
+
+    if (cache_entry_1->key.title_id < cache_entry_2->key.title_id)
+    {
+        return -1;
+    } else
+    if (cache_entry_1->key.title_id > cache_entry_2->key.title_id)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
 static int titleGameCardContentMetaContextSortFunction(const void *a, const void *b)
 {
     const TitleGameCardContentMetaContext *gc_meta_ctx_1 = (const TitleGameCardContentMetaContext*)a;
@@ -25,15 +25,60 @@
 #include <core/nxdt_utils.h>
 #include <core/usb.h>
 
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* Set to 1 to listen for host device connections over TCP instead of using usb:ds. Meant for protocol testing and benchmarking. */
+/* The TCP transport isn't built at all unless this is set. */
+#ifndef USB_TRANSPORT_TCP
+#define USB_TRANSPORT_TCP           0
+#endif
+
+#if USB_TRANSPORT_TCP
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#endif
+
 #define USB_ABI_VERSION_MAJOR       1
-#define USB_ABI_VERSION_MINOR       2
+#define USB_ABI_VERSION_MINOR       8
 #define USB_ABI_VERSION             ((USB_ABI_VERSION_MAJOR << 4) | USB_ABI_VERSION_MINOR)
 
 #define USB_CMD_HEADER_MAGIC        0x4E584454                  /* "NXDT". */
 
-#define USB_TRANSFER_ALIGNMENT      0x1000                      /* 4 KiB. */
 #define USB_TRANSFER_TIMEOUT        10                          /* 10 seconds. */
 
+#define USB_RESUME_TIMEOUT          60                          /* 60 seconds. Max time spent waiting for an interrupted file data transfer stage to be resumed. */
+#define USB_RESUME_POLL_INTERVAL    100                         /* 100 milliseconds. */
+
+#define USB_URB_QUEUE_DEPTH         3                           /* Max number of in-flight file data frames. Each one takes two URBs, and usb:ds report data only holds 8 entries. */
+
+#define USB_CHUNK_SHIFT_MIN         16                          /* 64 KiB. Smallest data frame payload size we propose during StartSession. */
+#define USB_CHUNK_SHIFT_MAX         23                          /* 8 MiB (USB_TRANSFER_BUFFER_SIZE). Largest data frame payload size we propose during StartSession. */
+#define USB_CHUNK_SHIFT_FS_DUMP     20                          /* 1 MiB. Initial and max data frame payload size used during extracted FS dumps, which mostly hold small files. */
+
+#define USB_CHUNK_WINDOW_FRAMES     8                           /* Number of full-size data frames used to measure throughput before re-evaluating the data frame payload size. */
+#define USB_CHUNK_HOLD_WINDOWS      8                           /* Number of measurement windows to wait before probing a new data frame payload size after a throughput drop. */
+
+#define USB_BATCH_MAX_FILE_SIZE     0x100000                    /* 1 MiB. Files up to this size are batched during extracted FS dumps. */
+#define USB_BATCH_DATA_SIZE         0x400000                    /* 4 MiB. */
+#define USB_BATCH_MANIFEST_SIZE     0x40000                     /* 256 KiB. */
+
+#define USB_FILL_RUN_MIN_SIZE       0x10000                     /* 64 KiB. Smallest byte run sent as a FillFileData frame instead of actual file data. */
+#define USB_FILL_SCAN_BLOCK_SIZE    0x10                        /* Fill runs are only detected at this granularity. */
+
+#define USB_FILE_HASH_FILL_SIZE     0x1000                      /* 4 KiB. Block size used to hash fill data. */
+
+#define USB_SUPPORTED_FEATURES      (UsbFeatureFlag_FileBatch | UsbFeatureFlag_Lz4Compression | UsbFeatureFlag_FileHash | UsbFeatureFlag_ResumeTransfer)
+
+#if USB_TRANSPORT_TCP
+#define USB_TCP_PORT                0x4E58                      /* 20056 ("NX"). */
+#define USB_TCP_POLL_TIMEOUT        100                         /* 100 milliseconds. */
+#define USB_TCP_SOCKET_BUFFER_SIZE  0x40000                     /* 256 KiB. */
+#endif
+
 #define USB_DEV_VID                 0x057E                      /* VID officially used by Nintendo in usb:ds. */
 #define USB_DEV_PID                 0x3000                      /* PID officially used by Nintendo in usb:ds. */
 #define USB_DEV_BCD_REL             0x0100                      /* Device release number. Always 1.0. */
@@ -57,16 +102,31 @@
 /* Type definitions. */
 
 typedef enum {
-    UsbCommandType_StartSession         = 0,
-    UsbCommandType_SendFileProperties   = 1,
-    UsbCommandType_CancelFileTransfer   = 2,
-    UsbCommandType_SendNspHeader        = 3,
-    UsbCommandType_EndSession           = 4,
-    UsbCommandType_StartExtractedFsDump = 5,
-    UsbCommandType_EndExtractedFsDump   = 6,
-    UsbCommandType_Count                = 7     ///< Total values supported by this enum.
+    UsbCommandType_StartSession             = 0,
+    UsbCommandType_SendFileProperties       = 1,
+    UsbCommandType_CancelFileTransfer       = 2,
+    UsbCommandType_SendNspHeader            = 3,
+    UsbCommandType_EndSession               = 4,
+    UsbCommandType_StartExtractedFsDump     = 5,
+    UsbCommandType_EndExtractedFsDump       = 6,
+    UsbCommandType_SendFileData             = 7,    ///< Only issued during file data transfer stages.
+    UsbCommandType_FillFileData             = 8,    ///< Only issued during file data transfer stages.
+    UsbCommandType_SendFileBatch            = 9,    ///< Only issued during extracted FS dumps, if UsbFeatureFlag_FileBatch has been negotiated.
+    UsbCommandType_SendCompressedFileData   = 10,   ///< Only issued during file data transfer stages, if UsbFeatureFlag_Lz4Compression has been negotiated.
+    UsbCommandType_SendFileHash             = 11,   ///< Only issued at the end of file data transfer stages, if UsbFeatureFlag_FileHash has been negotiated.
+    UsbCommandType_ResumeFileTransfer       = 12,   ///< Only issued right after StartSession, if UsbFeatureFlag_ResumeTransfer has been negotiated and a file data transfer stage was interrupted.
+    UsbCommandType_Count                    = 13    ///< Total values supported by this enum.
 } UsbCommandType;
 
+/// Optional ABI features, negotiated during StartSession.
+typedef enum {
+    UsbFeatureFlag_None           = 0,
+    UsbFeatureFlag_FileBatch      = BIT(0), ///< SendFileBatch command support.
+    UsbFeatureFlag_Lz4Compression = BIT(1), ///< SendCompressedFileData data frame support.
+    UsbFeatureFlag_FileHash       = BIT(2), ///< SendFileHash data frame support.
+    UsbFeatureFlag_ResumeTransfer = BIT(3)  ///< ResumeFileTransfer command support.
+} UsbFeatureFlag;
+
 typedef struct {
     u32 magic;
     u32 cmd;
@@ -82,7 +142,9 @@ typedef struct {
     u8 app_ver_micro;
     u8 abi_version;
     char git_commit[8];
-    u8 reserved[0x4];
+    u8 min_chunk_shift;     ///< Smallest data frame payload size supported by nxdumptool (log2).
+    u8 max_chunk_shift;     ///< Largest data frame payload size supported by nxdumptool (log2).
+    u16 features;           ///< UsbFeatureFlag bitmask. Features supported by nxdumptool.
 } UsbCommandStartSession;
 
 NXDT_ASSERT(UsbCommandStartSession, 0x10);
@@ -92,7 +154,9 @@ typedef struct {
     u32 filename_length;
     u32 nsp_header_size;
     char filename[FS_MAX_PATH];
-    u8 reserved[0xF];
+    u8 reserved_1[0x3];
+    u32 transfer_id;        ///< Non-zero if the file data transfer stage that follows can be resumed using a ResumeFileTransfer command.
+    u8 reserved_2[0x8];
 } UsbCommandSendFileProperties;
 
 NXDT_ASSERT(UsbCommandSendFileProperties, 0x320);
@@ -105,6 +169,65 @@ typedef struct {
 
 NXDT_ASSERT(UsbCommandStartExtractedFsDump, 0x310);
 
+typedef struct {
+    u64 fill_size;
+    u8 fill_value;
+    u8 reserved[0x7];
+} UsbCommandFillFileData;
+
+NXDT_ASSERT(UsbCommandFillFileData, 0x10);
+
+/// Followed by a LZ4 block holding 'decompressed_size' bytes of file data.
+typedef struct {
+    u32 decompressed_size;
+    u8 reserved[0xC];
+} UsbCommandCompressedFileData;
+
+NXDT_ASSERT(UsbCommandCompressedFileData, 0x10);
+
+/// Sent right after the last data frame from a file data transfer stage (single file or file batch), before the host device sends its status response.
+typedef struct {
+    u8 hash[SHA256_HASH_SIZE];  ///< SHA-256 checksum calculated over all file data from the transfer stage, including fill data.
+} UsbCommandSendFileHash;
+
+NXDT_ASSERT(UsbCommandSendFileHash, 0x20);
+
+/// Followed by 'file_count' UsbFileBatchEntry elements.
+typedef struct {
+    u32 file_count;
+    u8 reserved[0x4];
+    u64 data_size;          ///< Sum of all file sizes. File data is transferred as a single stream of data frames, in the same order as the file entries.
+} UsbCommandSendFileBatch;
+
+NXDT_ASSERT(UsbCommandSendFileBatch, 0x10);
+
+/// Followed by the filename (not NULL-terminated), padded with zeroes to a 0x8-byte boundary.
+typedef struct {
+    u64 file_size;
+    u32 filename_length;
+    u8 reserved[0x4];
+} UsbFileBatchEntry;
+
+NXDT_ASSERT(UsbFileBatchEntry, 0x10);
+
+typedef struct {
+    u32 transfer_id;        ///< Transfer ID from the SendFileProperties command that started the interrupted file data transfer stage.
+    u8 reserved[0x4];
+    u64 file_size;
+} UsbCommandResumeFileTransfer;
+
+NXDT_ASSERT(UsbCommandResumeFileTransfer, 0x10);
+
+/// Sent by the host device right after the status response to a successful ResumeFileTransfer command.
+/// Data frames are then sent starting at 'committed_size', followed by the status response for the whole file data transfer stage.
+typedef struct {
+    u64 committed_size;     ///< File data size already written by the host device.
+    u8 completed;           ///< Set to 1 if the host device already finished this file data transfer stage. No data frames must be sent in this case.
+    u8 reserved[0x7];
+} UsbResumeFileTransferInfo;
+
+NXDT_ASSERT(UsbResumeFileTransferInfo, 0x10);
+
 typedef enum {
     ///< Expected response code.
     UsbStatusType_Success               = 0,
@@ -120,19 +243,72 @@ typedef enum {
     UsbStatusType_UnsupportedAbiVersion = 6,
     UsbStatusType_MalformedCommand      = 7,
     UsbStatusType_HostIoError           = 8,
+    UsbStatusType_FileHashMismatch      = 9,
 
-    UsbStatusType_Count                 = 9         ///< Total values supported by this enum.
+    UsbStatusType_Count                 = 10        ///< Total values supported by this enum.
 } UsbStatusType;
 
 typedef struct {
     u32 magic;
     u32 status;             ///< UsbStatusType.
     u16 max_packet_size;    ///< USB host endpoint max packet size.
-    u8 reserved[0x6];
+    u8 min_chunk_shift;     ///< Only set in StartSession status responses. Smallest data frame payload size accepted by the host device (log2).
+    u8 max_chunk_shift;     ///< Only set in StartSession status responses. Largest data frame payload size accepted by the host device (log2).
+    u16 features;           ///< Only set in StartSession status responses. UsbFeatureFlag bitmask. Features accepted by the host device.
+    u8 reserved[0x2];
 } UsbStatus;
 
 NXDT_ASSERT(UsbStatus, 0x10);
 
+/// URB status values from UsbDsReportEntry.
+typedef enum {
+    UsbUrbStatus_Done      = 3,
+    UsbUrbStatus_Cancelled = 4,
+    UsbUrbStatus_Failed    = 5
+} UsbUrbStatus;
+
+/// Used to keep track of in-flight file data frames.
+typedef struct {
+    u8 *buf;                ///< Page aligned. Holds the frame header, followed by the frame payload at USB_TRANSFER_ALIGNMENT.
+    const u8 *payload;      ///< Frame payload. Either points to the payload area from 'buf', or to a page aligned buffer provided by the caller of usbSendFileDataV(). NULL if the latter was already released.
+    bool external;          ///< Set if 'payload' points to a buffer provided by the caller of usbSendFileDataV().
+    void (*release)(void *userdata);    ///< Release callback from the usbSendFileDataV() fragment whose last frame is held by this slot. Invoked once the host device has received this frame.
+    void *userdata;
+    u32 header_urb_id;
+    u32 payload_urb_id;
+    u32 payload_size;
+    u32 raw_size;           ///< File data size held by this frame, before compression.
+    u8 chunk_shift;         ///< Data frame payload size (log2) in use when this frame was queued.
+    u64 submit_tick;
+    u64 seq;                ///< Queue order. Zero if this slot doesn't hold a frame that can be replayed.
+    u64 data_offset;        ///< Offset of the file data range covered by this frame.
+    u64 data_size;          ///< Size of the file data range covered by this frame. Zero for file hash frames.
+} UsbUrbSlot;
+
+/// Used to hand file data frames over to the USB compression thread.
+typedef struct {
+    UsbUrbSlot *slot;       ///< URB slot reserved for this frame. The worker thread writes the frame payload into it.
+    u32 size;               ///< Raw frame payload size, held in the staging buffer.
+    u32 cmd;                ///< Set by the worker thread. UsbCommandType_SendCompressedFileData or UsbCommandType_SendFileData (if the data was incompressible).
+    u32 payload_size;       ///< Set by the worker thread.
+    bool pending;
+} UsbCompressionJob;
+
+/// USB transport backend. All traffic between nxdumptool and the host device goes through one of these.
+/// Asynchronous writes must complete in the same order they were posted, and can't be mixed with synchronous transfers.
+typedef struct {
+    const char *name;
+    bool (*init)(void);                                                 ///< Called while initializing the USB interface.
+    void (*exit)(void);                                                 ///< Called while closing the USB interface.
+    Waiter (*get_state_change_waiter)(void);                            ///< Waiter for an event that's signaled whenever a host device connects or disconnects.
+    bool (*is_host_available)(void);
+    bool (*transfer)(void *buf, u64 size, bool write);                  ///< Synchronous transfer. 'buf' must be page aligned.
+    bool (*post_async)(void *buf, u32 size, u32 *out_id);               ///< Posts an asynchronous write. 'buf' must be page aligned.
+    bool (*wait_async)(const u32 *ids, const u32 *sizes, u32 count);    ///< Waits for the provided asynchronous writes to complete.
+    void (*cancel_async)(void);                                         ///< Cancels all in-flight asynchronous writes.
+    void (*set_zlt)(bool enable);                                       ///< Toggles Zero Length Termination for writes aligned to the endpoint max packet size.
+} UsbTransport;
+
 /// Imported from libusb, with some adjustments.
 enum usb_bos_type {
     USB_BT_WIRELESS_USB_DEVICE_CAPABILITY = 1,
@@ -201,6 +377,15 @@ static UsbDsEndpoint *g_usbEndpointIn = NULL, *g_usbEndpointOut = NULL;
 static bool g_usbInterfaceInit = false, g_usbHos5xEnabled = false;
 
 static Event *g_usbStateChangeEvent = NULL;
+
+#if USB_TRANSPORT_TCP
+static int g_usbTcpListenSocket = -1;
+static atomic_int g_usbTcpClientSocket = -1;
+static Thread g_usbTcpListenerThread = {0};
+static UEvent g_usbTcpStateChangeEvent = {0}, g_usbTcpListenerExitEvent = {0};
+static bool g_usbTcpListenerThreadCreated = false;
+static u32 g_usbTcpWriteId = 0;
+#endif
 static Thread g_usbDetectionThread = {0};
 static UEvent g_usbDetectionThreadExitEvent = {0}, g_usbTimeoutEvent = {0};
 static bool g_usbHostAvailable = false, g_usbSessionStarted = false, g_usbDetectionThreadExitFlag = false, g_nspTransferMode = false;
@@ -210,6 +395,36 @@ static u8 *g_usbTransferBuffer = NULL;
 static u64 g_usbTransferRemainingSize = 0, g_usbTransferWrittenSize = 0;
 static atomic_ushort g_usbEndpointMaxPacketSize = 0;
 
+static UsbUrbSlot g_usbUrbQueue[USB_URB_QUEUE_DEPTH] = {0};
+static u32 g_usbUrbQueueHead = 0, g_usbUrbQueueCount = 0;
+static u64 g_usbUrbSlotSize = 0;
+static u64 g_usbUrbLastReapTick = 0, g_usbUrbQueueSeq = 0;
+
+static u32 g_usbTransferId = 0, g_usbNextTransferId = 0;
+static bool g_usbTransferInterrupted = false;
+
+static u8 g_usbChunkMinShift = 0, g_usbChunkMaxShift = 0, g_usbChunkShift = 0;
+static s8 g_usbChunkStep = 0;
+static u32 g_usbChunkWindowFrames = 0, g_usbChunkHoldWindows = 0;
+static u64 g_usbChunkWindowSize = 0, g_usbChunkWindowTicks = 0, g_usbChunkPrevRate = 0;
+static bool g_usbExtractedFsDumpActive = false;
+
+static u16 g_usbFeatures = 0;
+
+static Sha256Context g_usbFileHashCtx = {0};
+static bool g_usbFileHashActive = false;
+
+static Thread g_usbCompressionThread = {0};
+static UEvent g_usbCompressionStartEvent = {0}, g_usbCompressionDoneEvent = {0}, g_usbCompressionThreadExitEvent = {0};
+static bool g_usbCompressionThreadCreated = false;
+static u8 *g_usbCompressionBuffer = NULL;
+static UsbCompressionJob g_usbCompressionJob = {0};
+
+static u8 *g_usbBatchManifest = NULL, *g_usbBatchData = NULL;
+static u32 g_usbBatchManifestSize = 0, g_usbBatchFileCount = 0;
+static u64 g_usbBatchDataSize = 0;
+static bool g_usbBatchFileActive = false;
+
 /* Function prototypes. */
 
 static bool usbCreateDetectionThread(void);
@@ -228,12 +443,67 @@ static void usbLogStatusDetail(u32 status);
 NX_INLINE bool usbAllocateTransferBuffer(void);
 NX_INLINE void usbFreeTransferBuffer(void);
 
+NX_INLINE bool usbAllocateUrbQueue(void);
+NX_INLINE void usbFreeUrbQueue(void);
+
+NX_INLINE bool usbAllocateFileBatchBuffers(void);
+NX_INLINE void usbFreeFileBatchBuffers(void);
+
+NX_INLINE bool usbAllocateSessionBuffers(void);
+NX_INLINE void usbFreeSessionBuffers(void);
+
 static bool usbInitializeComms(void);
 static bool usbInitializeComms5x(void);
 static bool usbInitializeComms1x(void);
 static void usbCloseComms(void);
 
 static bool _usbSendFileProperties(u64 file_size, const char *filename, u32 nsp_header_size, bool enforce_nsp_mode);
+static bool _usbSubmitFileData(const void *data, u64 data_size);
+
+NX_INLINE bool usbIsFileTransferActive(void);
+NX_INLINE UsbUrbSlot *usbReserveUrbSlot(u64 file_data_size);
+static bool usbSubmitFileDataFrame(u32 cmd, const void *data, u32 data_size, u64 file_data_size);
+static bool usbSubmitExternalFileDataFrame(const void *data, u32 data_size);
+static bool usbSubmitFileDataFragment(const u8 *data, u64 data_size);
+static bool usbSubmitCompressedFileDataFrame(const void *data, u32 data_size);
+static bool usbFinishCompressionJob(void);
+static bool usbPostUrbSlot(UsbUrbSlot *slot, u32 cmd, u32 payload_size, u32 raw_size);
+NX_INLINE void usbAppendUrbSlot(UsbUrbSlot *slot, u32 cmd, u32 payload_size, u32 raw_size);
+static bool usbSendUrbSlot(UsbUrbSlot *slot);
+static bool usbSubmitFileDataChunk(const void *data, u32 data_size);
+static bool usbSubmitFileFillFrame(u8 fill_value, u64 fill_size);
+
+static bool usbFindFillRun(const u8 *data, u64 size, u64 *out_offset, u64 *out_size, u8 *out_value);
+static u64 usbGetFillRunSize(const u8 *data, u64 size, u8 value);
+
+static bool usbCreateCompressionThread(void);
+static void usbDestroyCompressionThread(void);
+static void usbCompressionThreadFunc(void *arg);
+static bool usbUpdateFileTransferProgress(u64 size);
+static void usbStartFileHash(bool enable);
+static void usbUpdateFileHashFill(u8 fill_value, u64 fill_size);
+static bool usbSubmitFileHash(void);
+static bool usbReadFileTransferStatus(void);
+
+static bool usbRecoverFileTransfer(void);
+static bool usbWaitForFileTransferResume(void);
+static void usbResumeFileTransfer(u16 prev_features, u8 prev_max_chunk_shift);
+NX_INLINE void usbAbortFileTransfer(void);
+
+static bool usbAppendFileBatchEntry(u64 file_size, const char *filename, u32 filename_length);
+static void usbAppendFileBatchData(const void *data, u8 fill_value, u64 size);
+static bool usbFlushFileBatch(void);
+NX_INLINE void usbResetFileBatch(void);
+
+static bool usbReapUrbSlot(void);
+static bool usbFlushUrbQueue(void);
+static void usbCancelUrbQueue(void);
+NX_INLINE void usbReleaseUrbSlot(UsbUrbSlot *slot);
+static void usbReleaseUrbSlots(void);
+static bool usbWaitForUrbCompletion(UsbDsEndpoint *endpoint, const u32 *urb_ids, const u32 *urb_sizes, u32 urb_count);
+
+static void usbResetChunkSize(u8 shift);
+static void usbUpdateChunkSize(const UsbUrbSlot *slot, u64 busy_ticks);
 
 NX_INLINE bool usbIsHostAvailable(void);
 
@@ -243,6 +513,65 @@ NX_INLINE bool usbRead(void *buf, size_t size);
 NX_INLINE bool usbWrite(void *buf, size_t size);
 static bool usbTransferData(void *buf, size_t size, UsbDsEndpoint *endpoint);
 
+static bool usbDsTransportInitialize(void);
+static void usbDsTransportExit(void);
+static Waiter usbDsTransportGetStateChangeWaiter(void);
+static bool usbDsTransportIsHostAvailable(void);
+static bool usbDsTransportTransfer(void *buf, u64 size, bool write);
+static bool usbDsTransportPostAsync(void *buf, u32 size, u32 *out_id);
+static bool usbDsTransportWaitAsync(const u32 *ids, const u32 *sizes, u32 count);
+static void usbDsTransportCancelAsync(void);
+static void usbDsTransportSetZlt(bool enable);
+
+#if USB_TRANSPORT_TCP
+static bool usbTcpTransportInitialize(void);
+static void usbTcpTransportExit(void);
+static Waiter usbTcpTransportGetStateChangeWaiter(void);
+static bool usbTcpTransportIsHostAvailable(void);
+static bool usbTcpTransportTransfer(void *buf, u64 size, bool write);
+static bool usbTcpTransportPostAsync(void *buf, u32 size, u32 *out_id);
+static bool usbTcpTransportWaitAsync(const u32 *ids, const u32 *sizes, u32 count);
+static void usbTcpTransportCancelAsync(void);
+static void usbTcpTransportSetZlt(bool enable);
+static void usbTcpTransportDisconnect(void);
+static void usbTcpListenerThreadFunc(void *arg);
+#endif
+
+/* USB transport backends. */
+
+/* usb:ds is left unused under TCP builds. */
+__attribute__((unused)) static const UsbTransport g_usbDsTransport = {
+    .name = "usb:ds",
+    .init = &usbDsTransportInitialize,
+    .exit = &usbDsTransportExit,
+    .get_state_change_waiter = &usbDsTransportGetStateChangeWaiter,
+    .is_host_available = &usbDsTransportIsHostAvailable,
+    .transfer = &usbDsTransportTransfer,
+    .post_async = &usbDsTransportPostAsync,
+    .wait_async = &usbDsTransportWaitAsync,
+    .cancel_async = &usbDsTransportCancelAsync,
+    .set_zlt = &usbDsTransportSetZlt
+};
+
+#if USB_TRANSPORT_TCP
+static const UsbTransport g_usbTcpTransport = {
+    .name = "TCP",
+    .init = &usbTcpTransportInitialize,
+    .exit = &usbTcpTransportExit,
+    .get_state_change_waiter = &usbTcpTransportGetStateChangeWaiter,
+    .is_host_available = &usbTcpTransportIsHostAvailable,
+    .transfer = &usbTcpTransportTransfer,
+    .post_async = &usbTcpTransportPostAsync,
+    .wait_async = &usbTcpTransportWaitAsync,
+    .cancel_async = &usbTcpTransportCancelAsync,
+    .set_zlt = &usbTcpTransportSetZlt
+};
+
+static const UsbTransport *g_usbTransport = &g_usbTcpTransport;
+#else
+static const UsbTransport *g_usbTransport = &g_usbDsTransport;
+#endif
+
 bool usbInitialize(void)
 {
     bool ret = false;
@@ -259,18 +588,12 @@ bool usbInitialize(void)
             break;
         }
 
-        /* Initialize USB comms. */
-        if (!usbInitializeComms())
-        {
-            LOG_MSG_ERROR("Failed to initialize USB comms!");
-            break;
-        }
+        /* URB queue, file batch and compression buffers are allocated on a per-session basis, depending on the features negotiated with the host device. */
 
-        /* Retrieve USB state change kernel event. */
-        g_usbStateChangeEvent = usbDsGetStateChangeEvent();
-        if (!g_usbStateChangeEvent)
+        /* Initialize USB transport. */
+        if (!g_usbTransport->init())
         {
-            LOG_MSG_ERROR("Failed to retrieve USB state change kernel event!");
+            LOG_MSG_ERROR("Failed to initialize %s transport!", g_usbTransport->name);
             break;
         }
 
@@ -280,6 +603,15 @@ bool usbInitialize(void)
         /* Create user-mode USB timeout event. */
         ueventCreate(&g_usbTimeoutEvent, true);
 
+        /* Create user-mode USB compression events. */
+        ueventCreate(&g_usbCompressionStartEvent, true);
+        ueventCreate(&g_usbCompressionDoneEvent, true);
+        ueventCreate(&g_usbCompressionThreadExitEvent, true);
+
+        /* Create USB compression thread. */
+        g_usbCompressionThreadCreated = usbCreateCompressionThread();
+        if (!g_usbCompressionThreadCreated) break;
+
         /* Create USB detection thread. */
         atomic_store(&g_usbDetectionThreadCreated, usbCreateDetectionThread());
         if (!atomic_load(&g_usbDetectionThreadCreated)) break;
@@ -303,11 +635,18 @@ void usbExit(void)
     /* Now we can safely lock. */
     SCOPED_LOCK(&g_usbInterfaceMutex)
     {
-        /* Clear USB state change kernel event. */
-        g_usbStateChangeEvent = NULL;
+        /* Destroy USB compression thread. No compression jobs can be pending at this point. */
+        if (g_usbCompressionThreadCreated)
+        {
+            usbDestroyCompressionThread();
+            g_usbCompressionThreadCreated = false;
+        }
 
-        /* Close USB device interface. */
-        usbCloseComms();
+        /* Close USB transport. */
+        g_usbTransport->exit();
+
+        /* Free session buffers. */
+        usbFreeSessionBuffers();
 
         /* Free USB transfer buffer. */
         usbFreeTransferBuffer();
@@ -361,95 +700,158 @@ bool usbSendNspProperties(u64 nsp_size, const char *filename, u32 nsp_header_siz
 }
 
 bool usbSendFileData(const void *data, u64 data_size)
+{
+    return usbSubmitFileData(data, data_size);
+}
+
+bool usbSubmitFileData(const void *data, u64 data_size)
+{
+    bool ret = false;
+    SCOPED_LOCK(&g_usbInterfaceMutex) ret = _usbSubmitFileData(data, data_size);
+    return ret;
+}
+
+bool usbSendFileFill(u8 fill_value, u64 fill_size)
 {
     bool ret = false;
 
     SCOPED_LOCK(&g_usbInterfaceMutex)
     {
-        void *buf = NULL;
-        bool zlt_required = false;
+        /* Wait for the current file data transfer stage to be resumed if the connection was lost. */
+        if (g_usbTransferInterrupted && !usbWaitForFileTransferResume()) goto end;
 
-        if (!g_usbTransferBuffer || !g_usbInterfaceInit || !g_usbHostAvailable || !g_usbSessionStarted || !g_usbTransferRemainingSize || !data || !data_size || \
-            data_size > USB_TRANSFER_BUFFER_SIZE || data_size > g_usbTransferRemainingSize)
+        if (!usbIsFileTransferActive() || !fill_size || fill_size > g_usbTransferRemainingSize)
         {
             LOG_MSG_ERROR("Invalid parameters!");
             goto end;
         }
 
-        /* Optimization for buffers that already are page aligned. */
-        if (IS_ALIGNED((u64)data, USB_TRANSFER_ALIGNMENT))
+        /* Append fill data to the current file batch, if needed. It'll be sent along with the rest of the batch. */
+        if (g_usbBatchFileActive)
         {
-            buf = (void*)data;
-        } else {
-            buf = g_usbTransferBuffer;
-            memcpy(buf, data, data_size);
+            usbAppendFileBatchData(NULL, fill_value, fill_size);
+            ret = true;
+            goto end;
+        }
+
+        /* Update file hash. */
+        if (g_usbFileHashActive) usbUpdateFileHashFill(fill_value, fill_size);
+
+        /* Send fill command. */
+        ret = usbSubmitFileFillFrame(fill_value, fill_size);
+
+end:
+        /* Reset variables in case of errors. */
+        if (!ret)
+        {
+            g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+            g_usbTransferId = 0;
+            g_nspTransferMode = false;
+            usbResetFileBatch();
+            usbReleaseUrbSlots();
         }
+    }
+
+    return ret;
+}
+
+bool usbFlushFileData(void)
+{
+    bool ret = false;
+    SCOPED_LOCK(&g_usbInterfaceMutex)
+    {
+        /* Wait for the current file data transfer stage to be resumed if the connection was lost. */
+        if (g_usbTransferInterrupted && !usbWaitForFileTransferResume()) break;
+
+        ret = usbFlushUrbQueue();
+    }
 
-        /* Determine if we'll need to set a Zero Length Termination (ZLT) packet. */
-        /* This is automatically handled by usbDsEndpoint_PostBufferAsync(), depending on the ZLT setting from the input (write) endpoint. */
-        /* First, check if this is the last data chunk for this file. */
-        if ((g_usbTransferRemainingSize - data_size) == 0)
+    return ret;
+}
+
+bool usbSendFileDataV(const UsbFileDataFragment *fragments, u32 fragment_count)
+{
+    u64 total_size = 0;
+    u32 released_count = 0;
+    bool ret = false;
+
+    SCOPED_LOCK(&g_usbInterfaceMutex)
+    {
+        /* Wait for the current file data transfer stage to be resumed if the connection was lost. */
+        if (g_usbTransferInterrupted && !usbWaitForFileTransferResume()) goto end;
+
+        for(u32 i = 0; fragments && i < fragment_count; i++)
         {
-            /* Enable ZLT if the last chunk size is aligned to the USB endpoint max packet size. */
-            if (IS_ALIGNED(data_size, atomic_load(&g_usbEndpointMaxPacketSize)))
-            {
-                zlt_required = true;
-                usbSetZltPacket(true);
-                LOG_MSG_DEBUG("ZLT enabled. Last chunk size: 0x%lX bytes.", data_size);
-            }
-        } else {
-            /* Disable ZLT if this is the first of multiple data chunks. */
-            if (!g_usbTransferWrittenSize)
+            if (!fragments[i].data || !IS_ALIGNED((u64)fragments[i].data, USB_TRANSFER_ALIGNMENT) || !fragments[i].size)
             {
-                usbSetZltPacket(false);
-                LOG_MSG_DEBUG("ZLT disabled (first chunk).");
+                total_size = 0;
+                break;
             }
+
+            total_size += fragments[i].size;
         }
 
-        /* Send data chunk. */
-        if (!(ret = usbWrite(buf, data_size)))
+        if (!usbIsFileTransferActive() || !total_size || total_size > g_usbTransferRemainingSize)
         {
-            LOG_MSG_ERROR("Failed to write 0x%lX bytes long file data chunk from offset 0x%lX! (total size: 0x%lX).", data_size, g_usbTransferWrittenSize, \
-                                                                                                                      g_usbTransferRemainingSize + g_usbTransferWrittenSize);
+            LOG_MSG_ERROR("Invalid parameters!");
             goto end;
         }
 
-        g_usbTransferRemainingSize -= data_size;
-        g_usbTransferWrittenSize += data_size;
-
-        /* Check if this is the last chunk. */
-        if (!g_usbTransferRemainingSize)
+        for(u32 i = 0; i < fragment_count; i++)
         {
-            /* Check response from host device. */
-            if (!(ret = usbRead(g_usbTransferBuffer, sizeof(UsbStatus))))
-            {
-                LOG_MSG_ERROR("Failed to read 0x%lX bytes long status block!", sizeof(UsbStatus));
-                goto end;
-            }
-
-            UsbStatus *cmd_status = (UsbStatus*)g_usbTransferBuffer;
+            const UsbFileDataFragment *fragment = &(fragments[i]);
+            const u8 *data = (const u8*)fragment->data;
+            u64 chunk_size = 0;
 
-            if (!(ret = (cmd_status->magic == __builtin_bswap32(USB_CMD_HEADER_MAGIC))))
+            /* Frame payloads can't be sent straight from the provided buffer if they have to be compressed or batched, or if the caller can't wait for the buffer to be released. */
+            if (g_usbBatchFileActive || (g_usbFeatures & UsbFeatureFlag_Lz4Compression) || !fragment->release)
             {
-                LOG_MSG_ERROR("Invalid status block magic word! (0x%08X).", __builtin_bswap32(cmd_status->magic));
-                goto end;
+                for(u64 offset = 0; offset < fragment->size; offset += chunk_size)
+                {
+                    chunk_size = MIN(fragment->size - offset, (u64)USB_TRANSFER_BUFFER_SIZE);
+                    if (!(ret = _usbSubmitFileData(data + offset, chunk_size))) goto end;
+                }
+            } else {
+                if (!(ret = usbSubmitFileDataFragment(data, fragment->size))) goto end;
+
+                /* Hand the release callback over to the URB slot holding the last frame from this fragment. Frames are always received in order. */
+                /* The queue is already empty if this fragment held the last file data chunk, in which case we'll just release it right away. */
+                if (g_usbUrbQueueCount)
+                {
+                    UsbUrbSlot *slot = &(g_usbUrbQueue[(g_usbUrbQueueHead + g_usbUrbQueueCount - 1) % USB_URB_QUEUE_DEPTH]);
+                    if (!slot->release)
+                    {
+                        slot->release = fragment->release;
+                        slot->userdata = fragment->userdata;
+                        released_count++;
+                        continue;
+                    }
+
+                    /* This slot already holds a pending release callback. Wait for all in-flight frames to complete instead of overwriting it. */
+                    if (!(ret = usbFlushUrbQueue())) goto end;
+                }
             }
 
-            ret = (cmd_status->status == UsbStatusType_Success);
-#if LOG_LEVEL <= LOG_LEVEL_INFO
-            if (!ret) usbLogStatusDetail(cmd_status->status);
-#endif
+            /* The host device is already done with this fragment. */
+            if (fragment->release) fragment->release(fragment->userdata);
+            released_count++;
         }
 
 end:
-        /* Disable ZLT if it was previously enabled. */
-        if (zlt_required) usbSetZltPacket(false);
-
         /* Reset variables in case of errors. */
         if (!ret)
         {
             g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+            g_usbTransferId = 0;
             g_nspTransferMode = false;
+            usbResetFileBatch();
+            usbReleaseUrbSlots();
+        }
+
+        /* Release all fragments we didn't get to hand over. */
+        for(u32 i = released_count; fragments && i < fragment_count; i++)
+        {
+            if (fragments[i].release) fragments[i].release(fragments[i].userdata);
         }
     }
 
@@ -460,12 +862,31 @@ void usbCancelFileTransfer(void)
 {
     SCOPED_LOCK(&g_usbInterfaceMutex)
     {
-        if (!g_usbInterfaceInit || !g_usbTransferBuffer || !g_usbHostAvailable || !g_usbSessionStarted || (!g_usbTransferRemainingSize && !g_nspTransferMode)) break;
+        /* Don't bother waiting for an interrupted file data transfer stage to be resumed. The host device discards it on its own. */
+        if (g_usbTransferInterrupted) usbAbortFileTransfer();
+        g_usbTransferId = 0;
+
+        /* Let in-flight frames reach the host device before cancelling the file data transfer stage. Buffers provided by the caller of usbSendFileDataV() are released afterwards. */
+        if (g_usbSessionStarted) usbFlushUrbQueue();
+        usbReleaseUrbSlots();
+
+        if (!g_usbInterfaceInit || !g_usbTransferBuffer || !g_usbHostAvailable || !g_usbSessionStarted) break;
+
+        /* Discard the current file batch. The host device doesn't know anything about it yet. */
+        bool batch_file_active = g_usbBatchFileActive;
+        usbResetFileBatch();
+
+        g_usbFileHashActive = false;
+
+        if (!g_usbTransferRemainingSize && !g_nspTransferMode) break;
 
         /* Reset variables right away. */
         g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
         g_nspTransferMode = false;
 
+        /* Don't send a CancelFileTransfer command if the file we're cancelling was part of the discarded file batch. */
+        if (batch_file_active) break;
+
         /* Prepare command data. */
         usbPrepareCommandHeader(UsbCommandType_CancelFileTransfer, 0);
 
@@ -521,23 +942,42 @@ bool usbStartExtractedFsDump(u64 extracted_fs_size, const char *extracted_fs_roo
 
         /* Send command. */
         ret = usbSendCommand();
+        if (ret)
+        {
+            /* Extracted FS dumps mostly consist of small files, so we'll favor latency over throughput by starting with a smaller data frame payload size. */
+            g_usbExtractedFsDumpActive = true;
+            usbResetChunkSize(USB_CHUNK_SHIFT_FS_DUMP);
+        }
     }
 
     return ret;
 }
 
-void usbEndExtractedFsDump(void)
+bool usbEndExtractedFsDump(void)
 {
+    bool ret = false;
+
     SCOPED_LOCK(&g_usbInterfaceMutex)
     {
         if (!g_usbInterfaceInit || !g_usbTransferBuffer || !g_usbHostAvailable || !g_usbSessionStarted || g_usbTransferRemainingSize || g_nspTransferMode) break;
 
-        /* Prepare command data. */
-        usbPrepareCommandHeader(UsbCommandType_EndExtractedFsDump, 0);
+        /* Send the last file batch. */
+        ret = usbFlushFileBatch();
+        if (ret)
+        {
+            /* Prepare command data. */
+            usbPrepareCommandHeader(UsbCommandType_EndExtractedFsDump, 0);
 
-        /* Send command. We don't care about the result here. */
-        usbSendCommand();
+            /* Send command. We don't care about the result here. */
+            usbSendCommand();
+        }
+
+        /* Go back to the largest data frame payload size for bulk transfers. */
+        g_usbExtractedFsDumpActive = false;
+        usbResetChunkSize(g_usbChunkMaxShift);
     }
+
+    return ret;
 }
 
 static bool usbCreateDetectionThread(void)
@@ -567,7 +1007,7 @@ static void usbDetectionThreadFunc(void *arg)
     Result rc = 0;
     int idx = 0;
 
-    Waiter usb_change_event_waiter = waiterForEvent(g_usbStateChangeEvent);
+    Waiter usb_change_event_waiter = g_usbTransport->get_state_change_waiter();
     Waiter usb_timeout_event_waiter = waiterForUEvent(&g_usbTimeoutEvent);
     Waiter exit_event_waiter = waiterForUEvent(&g_usbDetectionThreadExitEvent);
 
@@ -588,8 +1028,21 @@ static void usbDetectionThreadFunc(void *arg)
             /* Only proceed if we're dealing with a status change. */
             g_usbHostAvailable = usbIsHostAvailable();
             g_usbSessionStarted = false;
-            g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
             atomic_store(&g_usbEndpointMaxPacketSize, 0);
+            usbCancelUrbQueue();
+            usbResetFileBatch();
+
+            /* Keep the current file transfer state around if it can be resumed once a new session is established. */
+            if (g_usbTransferId)
+            {
+                g_usbTransferInterrupted = true;
+            } else {
+                g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+                usbReleaseUrbSlots();
+            }
+
+            /* Free session buffers. URB slots are kept around if they hold frames from an interrupted file data transfer stage. */
+            usbFreeSessionBuffers();
 
             /* Start a USB session if we're connected to a host device. */
             /* This will essentially hang this thread and all other threads that call USB-related functions until: */
@@ -598,11 +1051,17 @@ static void usbDetectionThreadFunc(void *arg)
             /* c) The thread exit event is triggered. */
             if (g_usbHostAvailable)
             {
+                u16 prev_features = g_usbFeatures;
+                u8 prev_max_chunk_shift = g_usbChunkMaxShift;
+
                 /* Wait until a session is established. */
                 g_usbSessionStarted = usbStartSession();
                 if (g_usbSessionStarted)
                 {
                     LOG_MSG_INFO("USB session successfully established. Endpoint max packet size: 0x%04X.", atomic_load(&g_usbEndpointMaxPacketSize));
+
+                    /* Resume the interrupted file data transfer stage, if needed. */
+                    if (g_usbTransferInterrupted) usbResumeFileTransfer(prev_features, prev_max_chunk_shift);
                 } else {
                     /* Update exit flag. */
                     exit_flag = g_usbDetectionThreadExitFlag;
@@ -616,8 +1075,16 @@ static void usbDetectionThreadFunc(void *arg)
 
     SCOPED_LOCK(&g_usbInterfaceMutex)
     {
+        /* Interrupted file data transfer stages can't be resumed anymore. */
+        g_usbTransferId = 0;
+        g_usbTransferInterrupted = false;
+
         /* Close USB session if needed. */
         if (g_usbHostAvailable && g_usbSessionStarted) usbEndSession();
+        usbCancelUrbQueue();
+        usbResetFileBatch();
+        usbReleaseUrbSlots();
+        usbFreeSessionBuffers();
         g_usbHostAvailable = g_usbSessionStarted = g_usbDetectionThreadExitFlag = false;
         g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
         atomic_store(&g_usbEndpointMaxPacketSize, 0);
@@ -647,22 +1114,57 @@ static bool usbStartSession(void)
     cmd_block->app_ver_micro = VERSION_MICRO;
     cmd_block->abi_version = USB_ABI_VERSION;
     snprintf(cmd_block->git_commit, sizeof(cmd_block->git_commit), "%s", GIT_COMMIT);
+    cmd_block->min_chunk_shift = USB_CHUNK_SHIFT_MIN;
+    cmd_block->max_chunk_shift = USB_CHUNK_SHIFT_MAX;
+    cmd_block->features = USB_SUPPORTED_FEATURES;
 
     ret = usbSendCommand();
     if (ret)
     {
+        UsbStatus *cmd_status = (UsbStatus*)g_usbTransferBuffer;
+
         /* Get the endpoint max packet size from the response sent by the USB host. */
         /* This is done to accurately know when and where to enable Zero Length Termination (ZLT) packets during bulk transfers. */
         /* As much as I'd like to avoid this, the GetUsbDeviceSpeed cmd from usb:ds is only available in HOS 8.0.0+ -- and we definitely want to provide USB comms under older versions. */
-        u16 max_packet_size = ((UsbStatus*)g_usbTransferBuffer)->max_packet_size;
+        u16 max_packet_size = cmd_status->max_packet_size;
         if (max_packet_size != USB_FS_EP_MAX_PACKET_SIZE && max_packet_size != USB_HS_EP_MAX_PACKET_SIZE && max_packet_size != USB_SS_EP_MAX_PACKET_SIZE)
         {
             LOG_MSG_ERROR("Invalid endpoint max packet size value received from USB host: 0x%04X.", max_packet_size);
 
             /* Reset flags. */
             ret = false;
-        } else {
-            atomic_store(&g_usbEndpointMaxPacketSize, max_packet_size);
+            goto end;
+        }
+
+        /* Get the data frame payload size range accepted by the USB host. It must be a subset of the range we proposed. */
+        u8 min_chunk_shift = cmd_status->min_chunk_shift, max_chunk_shift = cmd_status->max_chunk_shift;
+        if (min_chunk_shift < USB_CHUNK_SHIFT_MIN || max_chunk_shift > USB_CHUNK_SHIFT_MAX || min_chunk_shift > max_chunk_shift)
+        {
+            LOG_MSG_ERROR("Invalid data frame payload size range received from USB host: [%u, %u].", min_chunk_shift, max_chunk_shift);
+
+            /* Reset flags. */
+            ret = false;
+            goto end;
+        }
+
+        atomic_store(&g_usbEndpointMaxPacketSize, max_packet_size);
+
+        g_usbChunkMinShift = min_chunk_shift;
+        g_usbChunkMaxShift = max_chunk_shift;
+        g_usbExtractedFsDumpActive = false;
+        usbResetChunkSize(g_usbChunkMaxShift);
+
+        /* Only keep the features we actually proposed. */
+        g_usbFeatures = (cmd_status->features & USB_SUPPORTED_FEATURES);
+
+        LOG_MSG_INFO("Negotiated USB data frame payload size range: 0x%X - 0x%X bytes. Features: 0x%04X.", (u32)BIT(g_usbChunkMinShift), (u32)BIT(g_usbChunkMaxShift), g_usbFeatures);
+
+        /* Allocate session buffers. */
+        if (!usbAllocateSessionBuffers())
+        {
+            LOG_MSG_ERROR("Failed to allocate memory for USB session buffers!");
+            usbFreeSessionBuffers();
+            ret = false;
         }
     }
 
@@ -817,6 +1319,9 @@ static void usbLogStatusDetail(u32 status)
         case UsbStatusType_HostIoError:
             LOG_MSG_INFO("Host replied with I/O Error status code.");
             break;
+        case UsbStatusType_FileHashMismatch:
+            LOG_MSG_INFO("Host replied with File Hash Mismatch status code.");
+            break;
         default:
             LOG_MSG_INFO("Unknown status code: 0x%X.", status);
             break;
@@ -838,6 +1343,104 @@ NX_INLINE void usbFreeTransferBuffer(void)
     g_usbTransferBuffer = NULL;
 }
 
+NX_INLINE bool usbAllocateUrbQueue(void)
+{
+    /* URB slots only need to hold the largest data frame payload size accepted by the host device. */
+    u64 slot_size = (USB_TRANSFER_ALIGNMENT + BIT(g_usbChunkMaxShift));
+
+    /* Slots kept around for an interrupted file data transfer stage can only be reused if the data frame payload size range didn't change. */
+    /* The interrupted file data transfer stage can't be resumed otherwise. */
+    if (g_usbUrbSlotSize != slot_size)
+    {
+        if (g_usbTransferInterrupted)
+        {
+            LOG_MSG_ERROR("USB session parameters changed! File data transfer stage 0x%08X can't be resumed.", g_usbTransferId);
+            usbAbortFileTransfer();
+        }
+
+        usbFreeUrbQueue();
+    }
+
+    for(u32 i = 0; i < USB_URB_QUEUE_DEPTH; i++)
+    {
+        UsbUrbSlot *slot = &(g_usbUrbQueue[i]);
+        if (!slot->buf && !(slot->buf = memalign(USB_TRANSFER_ALIGNMENT, slot_size))) return false;
+    }
+
+    g_usbUrbSlotSize = slot_size;
+
+    return true;
+}
+
+NX_INLINE void usbFreeUrbQueue(void)
+{
+    /* Hand all buffers provided by the caller of usbSendFileDataV() back to their owners first. */
+    usbReleaseUrbSlots();
+
+    for(u32 i = 0; i < USB_URB_QUEUE_DEPTH; i++)
+    {
+        UsbUrbSlot *slot = &(g_usbUrbQueue[i]);
+        if (slot->buf) free(slot->buf);
+        memset(slot, 0, sizeof(UsbUrbSlot));
+    }
+
+    g_usbUrbQueueHead = g_usbUrbQueueCount = 0;
+    g_usbUrbSlotSize = 0;
+}
+
+NX_INLINE bool usbAllocateFileBatchBuffers(void)
+{
+    if (!g_usbBatchManifest && !(g_usbBatchManifest = memalign(USB_TRANSFER_ALIGNMENT, USB_BATCH_MANIFEST_SIZE))) return false;
+    if (!g_usbBatchData && !(g_usbBatchData = malloc(USB_BATCH_DATA_SIZE))) return false;
+
+    usbResetFileBatch();
+
+    return true;
+}
+
+NX_INLINE void usbFreeFileBatchBuffers(void)
+{
+    if (g_usbBatchManifest)
+    {
+        free(g_usbBatchManifest);
+        g_usbBatchManifest = NULL;
+    }
+
+    if (g_usbBatchData)
+    {
+        free(g_usbBatchData);
+        g_usbBatchData = NULL;
+    }
+
+    usbResetFileBatch();
+}
+
+NX_INLINE bool usbAllocateSessionBuffers(void)
+{
+    if (!usbAllocateUrbQueue()) return false;
+
+    /* Only allocate file batch and compression buffers if the host device supports these features. */
+    if ((g_usbFeatures & UsbFeatureFlag_FileBatch) && !usbAllocateFileBatchBuffers()) return false;
+
+    if ((g_usbFeatures & UsbFeatureFlag_Lz4Compression) && !g_usbCompressionBuffer && !(g_usbCompressionBuffer = malloc(BIT(g_usbChunkMaxShift)))) return false;
+
+    return true;
+}
+
+NX_INLINE void usbFreeSessionBuffers(void)
+{
+    /* URB slots holding frames from an interrupted file data transfer stage are needed to resume it. */
+    if (!g_usbTransferInterrupted) usbFreeUrbQueue();
+
+    usbFreeFileBatchBuffers();
+
+    if (g_usbCompressionBuffer)
+    {
+        free(g_usbCompressionBuffer);
+        g_usbCompressionBuffer = NULL;
+    }
+}
+
 static bool usbInitializeComms(void)
 {
     Result rc = 0;
@@ -1263,6 +1866,7 @@ static bool _usbSendFileProperties(u64 file_size, const char *filename, u32 nsp_
 {
     bool ret = false;
     size_t filename_length = 0;
+    u32 transfer_id = 0;
 
     /* Disallow sending new files if we're not in NSP transfer mode and the remaining transfer size isn't zero. */
     /* Allow empty files if we're not in NSP transfer mode. */
@@ -1275,6 +1879,26 @@ static bool _usbSendFileProperties(u64 file_size, const char *filename, u32 nsp_
         return false;
     }
 
+    /* Batch small files during extracted FS dumps. This saves us a command round trip per file. */
+    if (g_usbExtractedFsDumpActive && (g_usbFeatures & UsbFeatureFlag_FileBatch) && !enforce_nsp_mode && file_size <= USB_BATCH_MAX_FILE_SIZE)
+    {
+        ret = usbAppendFileBatchEntry(file_size, filename, (u32)filename_length);
+        if (!ret)
+        {
+            g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+            usbResetFileBatch();
+        }
+
+        return ret;
+    }
+
+    /* Send the current file batch before sending any files that can't be batched, in order to preserve the file order. */
+    if (!usbFlushFileBatch())
+    {
+        g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+        return false;
+    }
+
     /* Prepare command data. */
     usbPrepareCommandHeader(UsbCommandType_SendFileProperties, (u32)sizeof(UsbCommandSendFileProperties));
 
@@ -1286,41 +1910,1087 @@ static bool _usbSendFileProperties(u64 file_size, const char *filename, u32 nsp_
     cmd_block->nsp_header_size = nsp_header_size;
     snprintf(cmd_block->filename, sizeof(cmd_block->filename), "%s", filename);
 
-    /* Send command. */
+    /* Assign a transfer ID to the file data transfer stage if it can be resumed after losing the connection. This covers NSP file entries as well. */
+    /* Extracted FS dumps are excluded, since the host device keeps track of their state on its own, and starting a new session resets it. */
+    if ((g_usbFeatures & UsbFeatureFlag_ResumeTransfer) && file_size && !enforce_nsp_mode && !g_usbExtractedFsDumpActive)
+    {
+        if (!++g_usbNextTransferId) g_usbNextTransferId++;
+        cmd_block->transfer_id = transfer_id = g_usbNextTransferId;
+    }
+
+    /* Send command. */
     ret = usbSendCommand();
     if (ret)
     {
-        g_usbTransferRemainingSize = file_size;
-        g_usbTransferWrittenSize = 0;
-        if (!g_nspTransferMode && enforce_nsp_mode) g_nspTransferMode = true;
+        g_usbTransferRemainingSize = file_size;
+        g_usbTransferWrittenSize = 0;
+        g_usbTransferId = transfer_id;
+
+        /* Frames from previous file data transfer stages must never be replayed. */
+        for(u32 i = 0; i < USB_URB_QUEUE_DEPTH; i++) g_usbUrbQueue[i].seq = 0;
+
+        if (!g_nspTransferMode && enforce_nsp_mode) g_nspTransferMode = true;
+
+        /* The first SendFileProperties command from a NSP isn't followed by a data transfer stage. */
+        usbStartFileHash(file_size > 0 && !enforce_nsp_mode);
+    } else {
+        g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+        g_nspTransferMode = false;
+    }
+
+    return ret;
+}
+
+static bool _usbSubmitFileData(const void *data, u64 data_size)
+{
+    u64 frame_size = 0;
+    bool ret = false;
+
+    /* Wait for the current file data transfer stage to be resumed if the connection was lost. */
+    if (g_usbTransferInterrupted && !usbWaitForFileTransferResume()) goto end;
+
+    if (!usbIsFileTransferActive() || !data || !data_size || data_size > USB_TRANSFER_BUFFER_SIZE || data_size > g_usbTransferRemainingSize)
+    {
+        LOG_MSG_ERROR("Invalid parameters!");
+        goto end;
+    }
+
+    /* Append data chunk to the current file batch, if needed. It'll be sent along with the rest of the batch. */
+    if (g_usbBatchFileActive)
+    {
+        usbAppendFileBatchData(data, 0, data_size);
+        ret = true;
+        goto end;
+    }
+
+    const u8 *data_u8 = (const u8*)data;
+    u64 offset = 0;
+
+    /* Update file hash. Fill runs are hashed here as well. */
+    if (g_usbFileHashActive) sha256ContextUpdate(&g_usbFileHashCtx, data, data_size);
+
+    while(offset < data_size)
+    {
+        u64 run_offset = 0, run_size = 0;
+        u8 fill_value = 0;
+
+        /* Look for the next long run of identical bytes. These are sent as FillFileData frames instead of actual file data. */
+        if (usbFindFillRun(data_u8 + offset, data_size - offset, &run_offset, &run_size, &fill_value))
+        {
+            run_offset += offset;
+        } else {
+            run_offset = data_size;
+            run_size = 0;
+        }
+
+        /* Queue file data up to the fill run. It's split into multiple data frames if it exceeds the current data frame payload size. */
+        for(; offset < run_offset; offset += frame_size)
+        {
+            frame_size = MIN(run_offset - offset, (u64)BIT(g_usbChunkShift));
+
+            if (!(ret = usbSubmitFileDataChunk(data_u8 + offset, (u32)frame_size)))
+            {
+                LOG_MSG_ERROR("Failed to write 0x%lX bytes long file data chunk from offset 0x%lX! (total size: 0x%lX).", frame_size, g_usbTransferWrittenSize, \
+                                                                                                                      g_usbTransferRemainingSize + g_usbTransferWrittenSize);
+                goto end;
+            }
+
+            /* Update transfer sizes and check the response from the host device if this is the last chunk. */
+            if (!(ret = usbUpdateFileTransferProgress(frame_size))) goto end;
+        }
+
+        /* Queue fill run. */
+        if (run_size)
+        {
+            if (!(ret = usbSubmitFileFillFrame(fill_value, run_size))) goto end;
+            offset += run_size;
+        }
+    }
+
+end:
+    /* Reset variables in case of errors. */
+    if (!ret)
+    {
+        g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+        g_usbTransferId = 0;
+        g_nspTransferMode = false;
+        usbResetFileBatch();
+        usbReleaseUrbSlots();
+    }
+
+    return ret;
+}
+
+NX_INLINE bool usbIsFileTransferActive(void)
+{
+    return (g_usbInterfaceInit && g_usbTransferBuffer && g_usbHostAvailable && g_usbSessionStarted && g_usbTransferRemainingSize);
+}
+
+NX_INLINE UsbUrbSlot *usbReserveUrbSlot(u64 file_data_size)
+{
+    UsbUrbSlot *slot = &(g_usbUrbQueue[(g_usbUrbQueueHead + g_usbUrbQueueCount) % USB_URB_QUEUE_DEPTH]);
+
+    /* The frame previously held by this slot isn't in flight anymore, so any buffer still attached to it can be released. */
+    usbReleaseUrbSlot(slot);
+
+    /* The frame previously held by this slot can't be replayed anymore. */
+    slot->seq = 0;
+    slot->data_offset = g_usbTransferWrittenSize;
+    slot->data_size = file_data_size;
+
+    slot->payload = (slot->buf + USB_TRANSFER_ALIGNMENT);
+    slot->external = false;
+
+    return slot;
+}
+
+static bool usbSubmitFileDataFrame(u32 cmd, const void *data, u32 data_size, u64 file_data_size)
+{
+    UsbUrbSlot *slot = NULL;
+
+    /* Post the frame from the pending compression job first, if needed. This preserves frame order. */
+    if (!usbFinishCompressionJob()) return false;
+
+    /* Wait for the oldest in-flight frame to complete if the queue is full. */
+    /* This is a loop because the queue may be full again if the file data transfer stage was resumed in the meantime. */
+    while(g_usbUrbQueueCount == USB_URB_QUEUE_DEPTH)
+    {
+        if (!usbReapUrbSlot()) return false;
+    }
+
+    slot = usbReserveUrbSlot(file_data_size);
+
+    /* Copy frame payload. This lets the caller reuse its buffer right away, while this frame is still in flight. */
+    memcpy(slot->buf + USB_TRANSFER_ALIGNMENT, data, data_size);
+
+    return usbPostUrbSlot(slot, cmd, data_size, data_size);
+}
+
+static bool usbSubmitExternalFileDataFrame(const void *data, u32 data_size)
+{
+    UsbUrbSlot *slot = NULL;
+
+    /* Post the frame from the pending compression job first, if needed. This preserves frame order. */
+    if (!usbFinishCompressionJob()) return false;
+
+    /* Wait for the oldest in-flight frame to complete if the queue is full. */
+    while(g_usbUrbQueueCount == USB_URB_QUEUE_DEPTH)
+    {
+        if (!usbReapUrbSlot()) return false;
+    }
+
+    slot = usbReserveUrbSlot(data_size);
+
+    /* Send frame payload straight from the caller's buffer. */
+    slot->payload = (const u8*)data;
+    slot->external = true;
+
+    return usbPostUrbSlot(slot, UsbCommandType_SendFileData, data_size, data_size);
+}
+
+static bool usbSubmitFileDataFragment(const u8 *data, u64 data_size)
+{
+    u64 offset = 0, frame_size = 0;
+
+    /* Update file hash. Fill runs are hashed here as well. */
+    if (g_usbFileHashActive) sha256ContextUpdate(&g_usbFileHashCtx, data, data_size);
+
+    while(offset < data_size)
+    {
+        u64 run_offset = 0, run_size = 0, run_end = 0;
+        u8 fill_value = 0;
+
+        /* Look for the next long run of identical bytes. These are sent as FillFileData frames instead of actual file data. */
+        if (usbFindFillRun(data + offset, data_size - offset, &run_offset, &run_size, &fill_value))
+        {
+            /* Data frame payloads must stay page aligned, so the fill run is trimmed to page boundaries. It's sent as file data if it gets too short. */
+            run_end = (offset + run_offset + run_size);
+            if (run_end < data_size) run_end = ALIGN_DOWN(run_end, USB_TRANSFER_ALIGNMENT);
+
+            run_offset = ALIGN_UP(offset + run_offset, USB_TRANSFER_ALIGNMENT);
+            run_size = (run_end > run_offset ? (run_end - run_offset) : 0);
+
+            if (run_size < USB_FILL_RUN_MIN_SIZE)
+            {
+                run_offset = MAX(run_offset, run_end);
+                run_size = 0;
+            }
+        } else {
+            run_offset = data_size;
+            run_size = 0;
+        }
+
+        /* Send file data up to the fill run. Frame payload sizes are always page aligned, except for the last one. */
+        for(; offset < run_offset; offset += frame_size)
+        {
+            frame_size = MIN(run_offset - offset, (u64)BIT(g_usbChunkShift));
+
+            if (!usbSubmitExternalFileDataFrame(data + offset, (u32)frame_size))
+            {
+                LOG_MSG_ERROR("Failed to write 0x%lX bytes long file data chunk from offset 0x%lX! (total size: 0x%lX).", frame_size, g_usbTransferWrittenSize, \
+                                                                                                                      g_usbTransferRemainingSize + g_usbTransferWrittenSize);
+                return false;
+            }
+
+            /* Update transfer sizes and check the response from the host device if this is the last chunk. */
+            if (!usbUpdateFileTransferProgress(frame_size)) return false;
+        }
+
+        /* Send fill run. */
+        if (run_size)
+        {
+            if (!usbSubmitFileFillFrame(fill_value, run_size)) return false;
+            offset += run_size;
+        }
+    }
+
+    return true;
+}
+
+static bool usbSubmitCompressedFileDataFrame(const void *data, u32 data_size)
+{
+    UsbUrbSlot *slot = NULL;
+
+    /* Post the frame from the previous compression job. */
+    if (!usbFinishCompressionJob()) return false;
+
+    /* Wait for the oldest in-flight frame to complete if the queue is full. */
+    /* The slot right after the last in-flight frame is reserved for the new compression job until it's posted. */
+    while(g_usbUrbQueueCount == USB_URB_QUEUE_DEPTH)
+    {
+        if (!usbReapUrbSlot()) return false;
+    }
+
+    slot = usbReserveUrbSlot(data_size);
+
+    /* Copy frame payload to the staging buffer. This lets the caller reuse its buffer right away, while the worker thread compresses this frame. */
+    memcpy(g_usbCompressionBuffer, data, data_size);
+
+    g_usbCompressionJob.slot = slot;
+    g_usbCompressionJob.size = data_size;
+    g_usbCompressionJob.pending = true;
+
+    ueventSignal(&g_usbCompressionStartEvent);
+
+    return true;
+}
+
+static bool usbFinishCompressionJob(void)
+{
+    if (!g_usbCompressionJob.pending) return true;
+
+    /* Wait for the worker thread to finish compressing the frame. */
+    waitSingle(waiterForUEvent(&g_usbCompressionDoneEvent), UINT64_MAX);
+    g_usbCompressionJob.pending = false;
+
+    return usbPostUrbSlot(g_usbCompressionJob.slot, g_usbCompressionJob.cmd, g_usbCompressionJob.payload_size, g_usbCompressionJob.size);
+}
+
+static bool usbPostUrbSlot(UsbUrbSlot *slot, u32 cmd, u32 payload_size, u32 raw_size)
+{
+    /* Enable Zero Length Termination (ZLT) for as long as the queue isn't empty. */
+    /* usb:ds only appends a ZLT packet to transfers aligned to the USB endpoint max packet size, and frame headers never are. */
+    if (!g_usbUrbQueueCount) usbSetZltPacket(true);
+
+    usbAppendUrbSlot(slot, cmd, payload_size, raw_size);
+
+    if (usbSendUrbSlot(slot)) return true;
+
+    usbCancelUrbQueue();
+
+    /* Replay this frame once the file data transfer stage is resumed, if possible. */
+    return usbRecoverFileTransfer();
+}
+
+NX_INLINE void usbAppendUrbSlot(UsbUrbSlot *slot, u32 cmd, u32 payload_size, u32 raw_size)
+{
+    /* Prepare frame header. This lets the host device know how much data it should expect for this frame. */
+    UsbCommandHeader *frame_header = (UsbCommandHeader*)slot->buf;
+    memset(frame_header, 0, sizeof(UsbCommandHeader));
+    frame_header->magic = __builtin_bswap32(USB_CMD_HEADER_MAGIC);
+    frame_header->cmd = cmd;
+    frame_header->cmd_block_size = payload_size;
+
+    slot->payload_size = payload_size;
+    slot->raw_size = raw_size;
+    slot->chunk_shift = g_usbChunkShift;
+    slot->seq = ++g_usbUrbQueueSeq;
+
+    g_usbUrbQueueCount++;
+}
+
+static bool usbSendUrbSlot(UsbUrbSlot *slot)
+{
+    if (!usbIsHostAvailable())
+    {
+        LOG_MSG_ERROR("USB host unavailable!");
+        return false;
+    }
+
+    slot->submit_tick = armGetSystemTick();
+
+    /* Post frame header and frame payload without waiting for them to complete. URBs from the same endpoint always complete in order. */
+    if (!g_usbTransport->post_async(slot->buf, (u32)sizeof(UsbCommandHeader), &(slot->header_urb_id)) || \
+        !g_usbTransport->post_async((void*)slot->payload, slot->payload_size, &(slot->payload_urb_id)))
+    {
+        LOG_MSG_ERROR("Failed to post type 0x%X data frame!", ((UsbCommandHeader*)slot->buf)->cmd);
+        return false;
+    }
+
+    return true;
+}
+
+static bool usbSubmitFileDataChunk(const void *data, u32 data_size)
+{
+    /* Compress file data on the fly if the host device supports it. */
+    return ((g_usbFeatures & UsbFeatureFlag_Lz4Compression) ? usbSubmitCompressedFileDataFrame(data, data_size) : \
+                                                              usbSubmitFileDataFrame(UsbCommandType_SendFileData, data, data_size, data_size));
+}
+
+static bool usbSubmitFileFillFrame(u8 fill_value, u64 fill_size)
+{
+    UsbCommandFillFileData cmd_block = {0};
+    cmd_block.fill_size = fill_size;
+    cmd_block.fill_value = fill_value;
+
+    /* Send fill command. No actual file data is transferred for this range. */
+    if (!usbSubmitFileDataFrame(UsbCommandType_FillFileData, &cmd_block, (u32)sizeof(UsbCommandFillFileData), fill_size))
+    {
+        LOG_MSG_ERROR("Failed to send 0x%lX bytes long file data fill (0x%02X) from offset 0x%lX! (total size: 0x%lX).", fill_size, fill_value, g_usbTransferWrittenSize, \
+                                                                                                                         g_usbTransferRemainingSize + g_usbTransferWrittenSize);
+        return false;
+    }
+
+    /* Update transfer sizes and check the response from the host device if this was the last file range. */
+    return usbUpdateFileTransferProgress(fill_size);
+}
+
+static bool usbFindFillRun(const u8 *data, u64 size, u64 *out_offset, u64 *out_size, u8 *out_value)
+{
+    u64 offset = 0, words[USB_FILL_SCAN_BLOCK_SIZE / sizeof(u64)] = {0};
+
+    static_assert(sizeof(words) == (2 * sizeof(u64)), "Fill run scan blocks must span two 64-bit words.");
+
+    while((offset + USB_FILL_RUN_MIN_SIZE) <= size)
+    {
+        /* Skip scan blocks that aren't made of a single byte value. Both 64-bit words must match each other, as well as their own lowest byte replicated across all eight bytes. */
+        /* This loop is where most of the data gets scanned, so we only call usbGetFillRunSize() once a candidate run has been found. */
+        memcpy(words, data + offset, sizeof(words));
+        if (words[0] != words[1] || words[0] != (0x0101010101010101ULL * (words[0] & 0xFF)))
+        {
+            offset += USB_FILL_SCAN_BLOCK_SIZE;
+            continue;
+        }
+
+        u8 value = (u8)(words[0] & 0xFF);
+        u64 run_size = (USB_FILL_SCAN_BLOCK_SIZE + usbGetFillRunSize(data + offset + USB_FILL_SCAN_BLOCK_SIZE, size - offset - USB_FILL_SCAN_BLOCK_SIZE, value));
+
+        if (run_size >= USB_FILL_RUN_MIN_SIZE)
+        {
+            /* Extend the run over any trailing bytes that don't make up a full scan block. */
+            while((offset + run_size) < size && data[offset + run_size] == value) run_size++;
+
+            *out_offset = offset;
+            *out_size = run_size;
+            *out_value = value;
+
+            return true;
+        }
+
+        /* Skip the scan block that broke the run. */
+        offset += (run_size + USB_FILL_SCAN_BLOCK_SIZE);
+    }
+
+    return false;
+}
+
+static u64 usbGetFillRunSize(const u8 *data, u64 size, u8 value)
+{
+    u64 offset = 0;
+
+#ifdef __ARM_NEON
+    uint8x16_t ref = vdupq_n_u8(value);
+
+    /* Compare four vectors per iteration. vminvq_u8() yields 0xFF if all lanes matched. */
+    for(; (offset + 0x40) <= size; offset += 0x40)
+    {
+        uint8x16_t eq0 = vandq_u8(vceqq_u8(vld1q_u8(data + offset), ref), vceqq_u8(vld1q_u8(data + offset + 0x10), ref));
+        uint8x16_t eq1 = vandq_u8(vceqq_u8(vld1q_u8(data + offset + 0x20), ref), vceqq_u8(vld1q_u8(data + offset + 0x30), ref));
+        if (vminvq_u8(vandq_u8(eq0, eq1)) != 0xFF) break;
+    }
+
+    /* Narrow it down to a single scan block. */
+    for(; (offset + USB_FILL_SCAN_BLOCK_SIZE) <= size; offset += USB_FILL_SCAN_BLOCK_SIZE)
+    {
+        if (vminvq_u8(vceqq_u8(vld1q_u8(data + offset), ref)) != 0xFF) break;
+    }
+#else
+    for(; (offset + USB_FILL_SCAN_BLOCK_SIZE) <= size; offset += USB_FILL_SCAN_BLOCK_SIZE)
+    {
+        u32 i = 0;
+        for(i = 0; i < USB_FILL_SCAN_BLOCK_SIZE && data[offset + i] == value; i++);
+        if (i < USB_FILL_SCAN_BLOCK_SIZE) break;
+    }
+#endif
+
+    return offset;
+}
+
+static bool usbCreateCompressionThread(void)
+{
+    if (!utilsCreateThread(&g_usbCompressionThread, usbCompressionThreadFunc, NULL, 1))
+    {
+        LOG_MSG_ERROR("Failed to create USB compression thread!");
+        return false;
+    }
+
+    return true;
+}
+
+static void usbDestroyCompressionThread(void)
+{
+    /* Signal the exit event to terminate the USB compression thread. */
+    ueventSignal(&g_usbCompressionThreadExitEvent);
+
+    /* Wait for the USB compression thread to exit. */
+    utilsJoinThread(&g_usbCompressionThread);
+}
+
+static void usbCompressionThreadFunc(void *arg)
+{
+    NX_IGNORE_ARG(arg);
+
+    Result rc = 0;
+    int idx = 0;
+
+    Waiter start_event_waiter = waiterForUEvent(&g_usbCompressionStartEvent);
+    Waiter exit_event_waiter = waiterForUEvent(&g_usbCompressionThreadExitEvent);
+
+    while(true)
+    {
+        /* Wait until an event is triggered. */
+        rc = waitMulti(&idx, -1, start_event_waiter, exit_event_waiter);
+        if (R_FAILED(rc)) continue;
+
+        /* Exit event triggered. */
+        if (idx == 1) break;
+
+        UsbCompressionJob *job = &g_usbCompressionJob;
+        u8 *payload = (job->slot->buf + USB_TRANSFER_ALIGNMENT);
+        UsbCommandCompressedFileData *cmd_block = (UsbCommandCompressedFileData*)payload;
+
+        /* Compress frame payload right into the URB slot, after the compressed data frame block. */
+        /* Output size is capped so that the compressed frame is always smaller than the raw frame. LZ4_compress_default() returns zero if the output doesn't fit. */
+        int dst_capacity = (int)(job->size - sizeof(UsbCommandCompressedFileData) - 1);
+        int compressed_size = (dst_capacity > 0 ? LZ4_compress_default((const char*)g_usbCompressionBuffer, (char*)(payload + sizeof(UsbCommandCompressedFileData)), (int)job->size, dst_capacity) : 0);
+
+        if (compressed_size > 0)
+        {
+            memset(cmd_block, 0, sizeof(UsbCommandCompressedFileData));
+            cmd_block->decompressed_size = job->size;
+
+            job->cmd = UsbCommandType_SendCompressedFileData;
+            job->payload_size = (u32)(sizeof(UsbCommandCompressedFileData) + compressed_size);
+        } else {
+            /* Incompressible data. Fall back to a raw data frame. */
+            memcpy(payload, g_usbCompressionBuffer, job->size);
+
+            job->cmd = UsbCommandType_SendFileData;
+            job->payload_size = job->size;
+        }
+
+        ueventSignal(&g_usbCompressionDoneEvent);
+    }
+
+    threadExit();
+}
+
+static bool usbUpdateFileTransferProgress(u64 size)
+{
+    g_usbTransferRemainingSize -= size;
+    g_usbTransferWrittenSize += size;
+
+    /* Return right away if this isn't the last file range. */
+    if (g_usbTransferRemainingSize) return true;
+
+    /* Send file hash right after the last data frame, if needed. */
+    if (g_usbFileHashActive && !usbSubmitFileHash()) return false;
+
+    /* Wait for all in-flight frames to complete. */
+    if (!usbFlushUrbQueue()) return false;
+
+    /* Check response from host device. The file data transfer stage can't be resumed past this point. */
+    bool ret = usbReadFileTransferStatus();
+    g_usbTransferId = 0;
+
+    return ret;
+}
+
+static void usbStartFileHash(bool enable)
+{
+    g_usbFileHashActive = (enable && (g_usbFeatures & UsbFeatureFlag_FileHash));
+    if (g_usbFileHashActive) sha256ContextCreate(&g_usbFileHashCtx);
+}
+
+static void usbUpdateFileHashFill(u8 fill_value, u64 fill_size)
+{
+    u8 fill_block[USB_FILE_HASH_FILL_SIZE] = {0};
+    u64 block_size = 0;
+
+    memset(fill_block, fill_value, MIN(fill_size, sizeof(fill_block)));
+
+    for(u64 offset = 0; offset < fill_size; offset += block_size)
+    {
+        block_size = MIN(fill_size - offset, sizeof(fill_block));
+        sha256ContextUpdate(&g_usbFileHashCtx, fill_block, block_size);
+    }
+}
+
+static bool usbSubmitFileHash(void)
+{
+    UsbCommandSendFileHash cmd_block = {0};
+
+    sha256ContextGetHash(&g_usbFileHashCtx, cmd_block.hash);
+    g_usbFileHashActive = false;
+
+    if (!usbSubmitFileDataFrame(UsbCommandType_SendFileHash, &cmd_block, (u32)sizeof(UsbCommandSendFileHash), 0))
+    {
+        LOG_MSG_ERROR("Failed to send file hash!");
+        return false;
+    }
+
+    return true;
+}
+
+static bool usbReadFileTransferStatus(void)
+{
+    while(!usbRead(g_usbTransferBuffer, sizeof(UsbStatus)))
+    {
+        LOG_MSG_ERROR("Failed to read 0x%lX bytes long status block!", sizeof(UsbStatus));
+
+        /* Try again once the file data transfer stage is resumed, if possible. Any frames replayed by then must be flushed first. */
+        if (!usbRecoverFileTransfer() || !usbFlushUrbQueue()) return false;
+    }
+
+    UsbStatus *cmd_status = (UsbStatus*)g_usbTransferBuffer;
+
+    if (cmd_status->magic != __builtin_bswap32(USB_CMD_HEADER_MAGIC))
+    {
+        LOG_MSG_ERROR("Invalid status block magic word! (0x%08X).", __builtin_bswap32(cmd_status->magic));
+        return false;
+    }
+
+    bool ret = (cmd_status->status == UsbStatusType_Success);
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+    if (!ret) usbLogStatusDetail(cmd_status->status);
+#endif
+
+    return ret;
+}
+
+static bool usbRecoverFileTransfer(void)
+{
+    /* Only file data transfer stages with a transfer ID can be resumed. */
+    if (!g_usbTransferId) return false;
+
+    LOG_MSG_WARNING("File data transfer stage 0x%08X interrupted at offset 0x%lX. Waiting for it to be resumed.", g_usbTransferId, g_usbTransferWrittenSize);
+
+    /* The USB detection thread has already been signaled by now. It'll resume this transfer as soon as a new session is established. */
+    g_usbTransferInterrupted = true;
+
+    return usbWaitForFileTransferResume();
+}
+
+static bool usbWaitForFileTransferResume(void)
+{
+    u64 start_tick = armGetSystemTick(), timeout_ticks = (USB_RESUME_TIMEOUT * armGetSystemTickFreq());
+
+    /* Temporarily release the USB interface mutex, so the USB detection thread can establish a new session. */
+    while(g_usbTransferInterrupted && g_usbInterfaceInit && (armGetSystemTick() - start_tick) < timeout_ticks)
+    {
+        mutexUnlock(&g_usbInterfaceMutex);
+        svcSleepThread(USB_RESUME_POLL_INTERVAL * (u64)1000000);
+        mutexLock(&g_usbInterfaceMutex);
+    }
+
+    if (g_usbTransferInterrupted)
+    {
+        LOG_MSG_ERROR("Timed out waiting for file data transfer stage 0x%08X to be resumed!", g_usbTransferId);
+        usbAbortFileTransfer();
+    }
+
+    /* The transfer ID is cleared if the file data transfer stage couldn't be resumed. */
+    return (g_usbTransferId != 0);
+}
+
+static void usbResumeFileTransfer(u16 prev_features, u8 prev_max_chunk_shift)
+{
+    UsbCommandResumeFileTransfer *cmd_block = NULL;
+    UsbResumeFileTransferInfo *resume_info = (UsbResumeFileTransferInfo*)g_usbTransferBuffer;
+    UsbUrbSlot *tail = NULL;
+    u64 file_size = (g_usbTransferRemainingSize + g_usbTransferWrittenSize), committed_size = 0, end_offset = 0;
+    u32 tail_idx = 0, count = 0;
+    bool keep_transfer = false;
+
+    /* Queued frames can only be replayed if the host device still accepts them. */
+    if (!(g_usbFeatures & UsbFeatureFlag_ResumeTransfer) || g_usbFeatures != prev_features || g_usbChunkMaxShift != prev_max_chunk_shift)
+    {
+        LOG_MSG_ERROR("USB session parameters changed! File data transfer stage 0x%08X can't be resumed.", g_usbTransferId);
+        goto end;
+    }
+
+    /* Prepare command data. */
+    usbPrepareCommandHeader(UsbCommandType_ResumeFileTransfer, (u32)sizeof(UsbCommandResumeFileTransfer));
+
+    cmd_block = (UsbCommandResumeFileTransfer*)(g_usbTransferBuffer + sizeof(UsbCommandHeader));
+    memset(cmd_block, 0, sizeof(UsbCommandResumeFileTransfer));
+
+    cmd_block->transfer_id = g_usbTransferId;
+    cmd_block->file_size = file_size;
+
+    /* Send command, then get the file data size already written by the host device. */
+    if (!usbSendCommand() || !usbRead(resume_info, sizeof(UsbResumeFileTransferInfo)))
+    {
+        LOG_MSG_ERROR("Host device refused to resume file data transfer stage 0x%08X!", g_usbTransferId);
+        goto end;
+    }
+
+    committed_size = resume_info->committed_size;
+
+    /* Find the last queued frame. */
+    for(u32 i = 0; i < USB_URB_QUEUE_DEPTH; i++)
+    {
+        UsbUrbSlot *slot = &(g_usbUrbQueue[i]);
+        if (!slot->seq || (tail && slot->seq < tail->seq)) continue;
+        tail = slot;
+        tail_idx = i;
+    }
+
+    end_offset = (tail ? (tail->data_offset + tail->data_size) : 0);
+
+    /* Walk back from the last queued frame to find all frames the host device didn't get to write. Queued frames always take up consecutive slots. */
+    /* Frames sent straight from buffers that were already released can't be replayed, but the host device has received them by then. */
+    /* None of them must be replayed if the host device already finished the whole file data transfer stage. */
+    if (!resume_info->completed && tail)
+    {
+        for(count = 0; count < USB_URB_QUEUE_DEPTH; count++)
+        {
+            UsbUrbSlot *slot = &(g_usbUrbQueue[(tail_idx + USB_URB_QUEUE_DEPTH - count) % USB_URB_QUEUE_DEPTH]);
+            if (slot->seq != (tail->seq - count) || slot->data_offset < committed_size || !slot->payload) break;
+            end_offset = slot->data_offset;
+        }
+    }
+
+    /* The oldest frame we're about to replay must start right where the host device left off. */
+    if (committed_size > file_size || (!resume_info->completed && end_offset != committed_size))
+    {
+        LOG_MSG_ERROR("Unable to replay data frames for file data transfer stage 0x%08X from offset 0x%lX!", g_usbTransferId, committed_size);
+        goto end;
+    }
+
+    LOG_MSG_INFO("Resuming file data transfer stage 0x%08X from offset 0x%lX (%u data frame[s] to replay).", g_usbTransferId, committed_size, count);
+
+    /* Replay frames. The queue now starts at the oldest one. */
+    keep_transfer = true;
+    g_usbUrbQueueHead = ((tail_idx + USB_URB_QUEUE_DEPTH + 1 - count) % USB_URB_QUEUE_DEPTH);
+    g_usbUrbQueueCount = 0;
+
+    /* The host device already got all frames we won't replay, so the buffers attached to them can be released. */
+    for(u32 i = count; i < USB_URB_QUEUE_DEPTH; i++) usbReleaseUrbSlot(&(g_usbUrbQueue[(g_usbUrbQueueHead + i) % USB_URB_QUEUE_DEPTH]));
+
+    if (count) usbSetZltPacket(true);
+
+    for(u32 i = 0; i < count; i++)
+    {
+        UsbUrbSlot *slot = &(g_usbUrbQueue[(g_usbUrbQueueHead + i) % USB_URB_QUEUE_DEPTH]);
+
+        g_usbUrbQueueCount++;
+
+        if (!usbSendUrbSlot(slot))
+        {
+            /* Try again with the next session. */
+            usbCancelUrbQueue();
+            goto end;
+        }
+    }
+
+    g_usbTransferInterrupted = false;
+
+end:
+    if (!keep_transfer) usbAbortFileTransfer();
+}
+
+NX_INLINE void usbAbortFileTransfer(void)
+{
+    g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+    g_usbTransferId = 0;
+    g_usbTransferInterrupted = g_usbFileHashActive = g_nspTransferMode = false;
+    usbReleaseUrbSlots();
+}
+
+static bool usbReapUrbSlot(void)
+{
+    if (!g_usbUrbQueueCount) return true;
+
+    UsbUrbSlot *slot = &(g_usbUrbQueue[g_usbUrbQueueHead]);
+    u32 urb_ids[2] = { slot->header_urb_id, slot->payload_urb_id };
+    u32 urb_sizes[2] = { (u32)sizeof(UsbCommandHeader), slot->payload_size };
+
+    bool ret = g_usbTransport->wait_async(urb_ids, urb_sizes, 2);
+    if (ret)
+    {
+        /* Only account for the time this frame spent at the head of the queue, so in-flight frames don't get their transfer times counted twice. */
+        u64 reap_tick = armGetSystemTick();
+        usbUpdateChunkSize(slot, reap_tick - MAX(slot->submit_tick, g_usbUrbLastReapTick));
+        g_usbUrbLastReapTick = reap_tick;
+
+        /* The host device has received this frame, so we no longer need to hold on to any buffers provided by the caller of usbSendFileDataV(). */
+        usbReleaseUrbSlot(slot);
+
+        g_usbUrbQueueHead = ((g_usbUrbQueueHead + 1) % USB_URB_QUEUE_DEPTH);
+        g_usbUrbQueueCount--;
+    } else {
+        usbCancelUrbQueue();
+
+        /* Replay all cancelled frames the host device didn't get to write once the file data transfer stage is resumed, if possible. */
+        ret = usbRecoverFileTransfer();
+    }
+
+    return ret;
+}
+
+static bool usbFlushUrbQueue(void)
+{
+    /* Post the frame from the pending compression job, if needed. */
+    if (!usbFinishCompressionJob()) return false;
+
+    if (!g_usbUrbQueueCount) return true;
+
+    while(g_usbUrbQueueCount)
+    {
+        if (!usbReapUrbSlot()) return false;
+    }
+
+    /* Disable ZLT. It was enabled when the first frame was queued. */
+    usbSetZltPacket(false);
+
+    return true;
+}
+
+static void usbCancelUrbQueue(void)
+{
+    /* Drop the pending compression job, if needed. We can't interrupt the worker thread, so we'll just wait for it. */
+    if (g_usbCompressionJob.pending)
+    {
+        waitSingle(waiterForUEvent(&g_usbCompressionDoneEvent), UINT64_MAX);
+        g_usbCompressionJob.pending = false;
+
+        /* Keep the frame around if the current file data transfer stage can be resumed. It'll be replayed along with the rest. */
+        if (g_usbTransferId) usbAppendUrbSlot(g_usbCompressionJob.slot, g_usbCompressionJob.cmd, g_usbCompressionJob.payload_size, g_usbCompressionJob.size);
+    }
+
+    if (!g_usbUrbQueueCount) return;
+
+    LOG_MSG_WARNING("Cancelling %u in-flight USB data frame(s).", g_usbUrbQueueCount);
+
+    g_usbUrbQueueHead = g_usbUrbQueueCount = 0;
+
+    /* Cancel all in-flight transfers. */
+    g_usbTransport->cancel_async();
+
+    usbSetZltPacket(false);
+
+    /* Signal user-mode USB timeout event if needed. */
+    /* The host device is most likely out of sync by now, so we'll "reset" the USB connection. */
+    if (g_usbSessionStarted) ueventSignal(&g_usbTimeoutEvent);
+}
+
+NX_INLINE void usbReleaseUrbSlot(UsbUrbSlot *slot)
+{
+    /* Frames sent straight from a released buffer can't be replayed anymore. */
+    if (slot->external) slot->payload = NULL;
+
+    if (slot->release)
+    {
+        void (*release)(void*) = slot->release;
+        slot->release = NULL;
+        release(slot->userdata);
+    }
+}
+
+static void usbReleaseUrbSlots(void)
+{
+    /* Make sure no buffers provided by the caller of usbSendFileDataV() are still in use by in-flight transfers. */
+    if (g_usbUrbQueueCount) usbCancelUrbQueue();
+
+    for(u32 i = 0; i < USB_URB_QUEUE_DEPTH; i++) usbReleaseUrbSlot(&(g_usbUrbQueue[i]));
+}
+
+static bool usbWaitForUrbCompletion(UsbDsEndpoint *endpoint, const u32 *urb_ids, const u32 *urb_sizes, u32 urb_count)
+{
+    Result rc = 0;
+    UsbDsReportData report_data = {0};
+    u32 done_count = 0;
+
+    while(true)
+    {
+        /* Clear the completion event before retrieving report data, so we don't miss any completions that take place afterwards. */
+        eventClear(&(endpoint->CompletionEvent));
+
+        rc = usbDsEndpoint_GetReportData(endpoint, &report_data);
+        if (R_FAILED(rc))
+        {
+            LOG_MSG_ERROR("usbDsEndpoint_GetReportData failed! (0x%X).", rc);
+            return false;
+        }
+
+        /* Look for our URBs in the report entries. */
+        done_count = 0;
+
+        for(u32 i = 0; i < urb_count; i++)
+        {
+            for(u32 j = 0; j < MIN(report_data.report_count, MAX_ELEMENTS(report_data.report)); j++)
+            {
+                UsbDsReportEntry *entry = &(report_data.report[j]);
+                if (entry->id != urb_ids[i]) continue;
+
+                if (entry->urb_status == UsbUrbStatus_Cancelled || entry->urb_status == UsbUrbStatus_Failed)
+                {
+                    LOG_MSG_ERROR("USB transfer failed! URB ID %u, status %u.", urb_ids[i], entry->urb_status);
+                    return false;
+                }
+
+                if (entry->urb_status == UsbUrbStatus_Done)
+                {
+                    if (entry->transferredSize != urb_sizes[i])
+                    {
+                        LOG_MSG_ERROR("USB transfer failed! Expected 0x%X bytes, got 0x%X bytes (URB ID %u).", urb_sizes[i], entry->transferredSize, urb_ids[i]);
+                        return false;
+                    }
+
+                    done_count++;
+                }
+
+                break;
+            }
+        }
+
+        if (done_count == urb_count) break;
+
+        /* Wait for the next completion. */
+        rc = eventWait(&(endpoint->CompletionEvent), USB_TRANSFER_TIMEOUT * (u64)1000000000);
+        if (R_FAILED(rc))
+        {
+            LOG_MSG_ERROR("eventWait failed! (0x%X) (URB ID %u).", rc, urb_ids[urb_count - 1]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void usbResetChunkSize(u8 shift)
+{
+    u8 max_shift = (g_usbExtractedFsDumpActive ? MIN(g_usbChunkMaxShift, USB_CHUNK_SHIFT_FS_DUMP) : g_usbChunkMaxShift);
+
+    g_usbChunkShift = MIN(MAX(shift, g_usbChunkMinShift), max_shift);
+    g_usbChunkStep = -1;
+    g_usbChunkWindowFrames = g_usbChunkHoldWindows = 0;
+    g_usbChunkWindowSize = g_usbChunkWindowTicks = g_usbChunkPrevRate = 0;
+
+    LOG_MSG_DEBUG("USB data frame payload size set to 0x%X bytes (%s).", (u32)BIT(g_usbChunkShift), g_usbExtractedFsDumpActive ? "extracted FS dump" : "bulk transfer");
+}
+
+static void usbUpdateChunkSize(const UsbUrbSlot *slot, u64 busy_ticks)
+{
+    /* Only take full-size data frames queued with the current data frame payload size into account. */
+    /* File tails, fill frames and frames queued before the last size change would skew our measurements. */
+    /* Compressed frames are accounted for using their raw size, which makes compression count towards the measured throughput. */
+    if (!g_usbChunkShift || slot->chunk_shift != g_usbChunkShift || slot->raw_size != BIT(g_usbChunkShift)) return;
+
+    g_usbChunkWindowSize += slot->raw_size;
+    g_usbChunkWindowTicks += busy_ticks;
+    if (++g_usbChunkWindowFrames < USB_CHUNK_WINDOW_FRAMES) return;
+
+    /* Calculate throughput for this window (bytes per second), then start a new window. */
+    u64 rate = ((g_usbChunkWindowSize * armGetSystemTickFreq()) / MAX(g_usbChunkWindowTicks, 1));
+    u64 prev_rate = g_usbChunkPrevRate;
+
+    g_usbChunkWindowFrames = 0;
+    g_usbChunkWindowSize = g_usbChunkWindowTicks = 0;
+    g_usbChunkPrevRate = rate;
+
+    if (g_usbChunkHoldWindows)
+    {
+        /* Keep the current size for a while after stepping back, then probe the next size in the current direction. */
+        if (--g_usbChunkHoldWindows) return;
+    } else
+    if (prev_rate && rate <= (prev_rate + (prev_rate / 20)))
+    {
+        /* Hill climbing: the last step didn't improve throughput by more than 5%, so step back and hold. */
+        /* Otherwise, keep moving in the same direction. */
+        g_usbChunkStep = -g_usbChunkStep;
+        g_usbChunkHoldWindows = USB_CHUNK_HOLD_WINDOWS;
+    }
+
+    u8 max_shift = (g_usbExtractedFsDumpActive ? MIN(g_usbChunkMaxShift, USB_CHUNK_SHIFT_FS_DUMP) : g_usbChunkMaxShift);
+    u8 cur_shift = g_usbChunkShift;
+
+    /* Bounce off the negotiated limits. */
+    if (g_usbChunkMinShift == max_shift) return;
+    if ((g_usbChunkStep < 0 && cur_shift <= g_usbChunkMinShift) || (g_usbChunkStep > 0 && cur_shift >= max_shift)) g_usbChunkStep = -g_usbChunkStep;
+
+    g_usbChunkShift = (u8)(cur_shift + g_usbChunkStep);
+
+    LOG_MSG_DEBUG("USB data frame payload size changed from 0x%X to 0x%X bytes (measured throughput: %lu KiB/s).", (u32)BIT(cur_shift), (u32)BIT(g_usbChunkShift), rate / 1024);
+}
+
+static bool usbAppendFileBatchEntry(u64 file_size, const char *filename, u32 filename_length)
+{
+    u32 entry_size = (u32)(sizeof(UsbFileBatchEntry) + ALIGN_UP(filename_length, 0x8));
+
+    /* Send the current file batch if this file doesn't fit in it. */
+    if (((g_usbBatchManifestSize + entry_size) > USB_BATCH_MANIFEST_SIZE || (g_usbBatchDataSize + file_size) > USB_BATCH_DATA_SIZE) && !usbFlushFileBatch()) return false;
+
+    /* Append file entry to the manifest. */
+    UsbFileBatchEntry *entry = (UsbFileBatchEntry*)(g_usbBatchManifest + g_usbBatchManifestSize);
+    memset(entry, 0, entry_size);
+
+    entry->file_size = file_size;
+    entry->filename_length = filename_length;
+    memcpy((u8*)entry + sizeof(UsbFileBatchEntry), filename, filename_length);
+
+    g_usbBatchManifestSize += entry_size;
+    g_usbBatchFileCount++;
+
+    /* File data will be appended to the batch data buffer by usbSubmitFileData() / usbSendFileFill(). */
+    g_usbTransferRemainingSize = file_size;
+    g_usbTransferWrittenSize = 0;
+    g_usbBatchFileActive = (file_size > 0);
+
+    return true;
+}
+
+static void usbAppendFileBatchData(const void *data, u8 fill_value, u64 size)
+{
+    if (data)
+    {
+        memcpy(g_usbBatchData + g_usbBatchDataSize, data, size);
     } else {
-        g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
-        g_nspTransferMode = false;
+        memset(g_usbBatchData + g_usbBatchDataSize, fill_value, size);
+    }
+
+    g_usbBatchDataSize += size;
+
+    g_usbTransferRemainingSize -= size;
+    g_usbTransferWrittenSize += size;
+
+    if (!g_usbTransferRemainingSize) g_usbBatchFileActive = false;
+}
+
+static bool usbFlushFileBatch(void)
+{
+    if (!g_usbBatchFileCount) return true;
+
+    u32 manifest_size = g_usbBatchManifestSize, file_count = g_usbBatchFileCount;
+    u64 data_size = g_usbBatchDataSize, frame_size = 0;
+    bool ret = false, zlt_required = false;
+
+    /* Fill manifest header. */
+    UsbCommandSendFileBatch *batch_header = (UsbCommandSendFileBatch*)g_usbBatchManifest;
+    batch_header->file_count = file_count;
+    batch_header->data_size = data_size;
+
+    /* Reset batch right away. We'll reuse the file transfer state to keep track of the data stream. */
+    usbResetFileBatch();
+
+    /* Write command header. No status response is expected until the whole data stream has been transferred. */
+    usbPrepareCommandHeader(UsbCommandType_SendFileBatch, manifest_size);
+    if (!usbWrite(g_usbTransferBuffer, sizeof(UsbCommandHeader)))
+    {
+        LOG_MSG_ERROR("Failed to write header for file batch command! (%u file[s]).", file_count);
+        goto end;
+    }
+
+    /* Write manifest. */
+    zlt_required = IS_ALIGNED(manifest_size, atomic_load(&g_usbEndpointMaxPacketSize));
+    if (zlt_required) usbSetZltPacket(true);
+
+    ret = usbWrite(g_usbBatchManifest, manifest_size);
+
+    if (zlt_required) usbSetZltPacket(false);
+
+    if (!ret)
+    {
+        LOG_MSG_ERROR("Failed to write 0x%X bytes long file batch manifest! (%u file[s]).", manifest_size, file_count);
+        goto end;
+    }
+
+    /* Empty files only. Just read the status response. */
+    if (!data_size)
+    {
+        ret = usbReadFileTransferStatus();
+        goto end;
+    }
+
+    /* Send data stream. The status response is read by usbUpdateFileTransferProgress() after the last data frame. */
+    g_usbTransferRemainingSize = data_size;
+    g_usbTransferWrittenSize = 0;
+
+    /* The file hash for a file batch covers its whole data stream. */
+    usbStartFileHash(true);
+    if (g_usbFileHashActive) sha256ContextUpdate(&g_usbFileHashCtx, g_usbBatchData, data_size);
+
+    for(u64 offset = 0; offset < data_size; offset += frame_size)
+    {
+        frame_size = MIN(data_size - offset, (u64)BIT(g_usbChunkShift));
+
+        if (!(ret = usbSubmitFileDataChunk(g_usbBatchData + offset, (u32)frame_size)))
+        {
+            LOG_MSG_ERROR("Failed to write 0x%lX bytes long file batch data frame from offset 0x%lX! (total size: 0x%lX).", frame_size, offset, data_size);
+            break;
+        }
+
+        if (!(ret = usbUpdateFileTransferProgress(frame_size))) break;
     }
 
+    g_usbTransferRemainingSize = g_usbTransferWrittenSize = 0;
+    g_usbFileHashActive = false;
+
+end:
+    if (ret) LOG_MSG_DEBUG("Sent file batch: %u file(s), 0x%lX bytes.", file_count, data_size);
+
     return ret;
 }
 
+NX_INLINE void usbResetFileBatch(void)
+{
+    g_usbBatchManifestSize = (u32)sizeof(UsbCommandSendFileBatch);
+    g_usbBatchFileCount = 0;
+    g_usbBatchDataSize = 0;
+    g_usbBatchFileActive = false;
+}
+
 NX_INLINE bool usbIsHostAvailable(void)
 {
-    UsbState state = UsbState_Detached;
-    Result rc = usbDsGetState(&state);
-    return (R_SUCCEEDED(rc) && state == UsbState_Configured);
+    return g_usbTransport->is_host_available();
 }
 
 NX_INLINE void usbSetZltPacket(bool enable)
 {
-    usbDsEndpoint_SetZlt(g_usbEndpointIn, enable);
+    g_usbTransport->set_zlt(enable);
 }
 
 NX_INLINE bool usbRead(void *buf, u64 size)
 {
-    return usbTransferData(buf, size, g_usbEndpointOut);
+    return g_usbTransport->transfer(buf, size, false);
 }
 
 NX_INLINE bool usbWrite(void *buf, u64 size)
 {
-    return usbTransferData(buf, size, g_usbEndpointIn);
+    /* Synchronous transfers can't be mixed with in-flight file data frames. */
+    if (!usbFlushUrbQueue()) return false;
+    return g_usbTransport->transfer(buf, size, true);
 }
 
 static bool usbTransferData(void *buf, u64 size, UsbDsEndpoint *endpoint)
@@ -1413,3 +3083,332 @@ static bool usbTransferData(void *buf, u64 size, UsbDsEndpoint *endpoint)
 
     return true;
 }
+
+static bool usbDsTransportInitialize(void)
+{
+    /* Initialize USB comms. */
+    if (!usbInitializeComms())
+    {
+        LOG_MSG_ERROR("Failed to initialize USB comms!");
+        return false;
+    }
+
+    /* Retrieve USB state change kernel event. */
+    g_usbStateChangeEvent = usbDsGetStateChangeEvent();
+    if (!g_usbStateChangeEvent)
+    {
+        LOG_MSG_ERROR("Failed to retrieve USB state change kernel event!");
+        return false;
+    }
+
+    return true;
+}
+
+static void usbDsTransportExit(void)
+{
+    /* Clear USB state change kernel event. */
+    g_usbStateChangeEvent = NULL;
+
+    /* Close USB device interface. */
+    usbCloseComms();
+}
+
+static Waiter usbDsTransportGetStateChangeWaiter(void)
+{
+    return waiterForEvent(g_usbStateChangeEvent);
+}
+
+static bool usbDsTransportIsHostAvailable(void)
+{
+    UsbState state = UsbState_Detached;
+    Result rc = usbDsGetState(&state);
+    return (R_SUCCEEDED(rc) && state == UsbState_Configured);
+}
+
+static bool usbDsTransportTransfer(void *buf, u64 size, bool write)
+{
+    return usbTransferData(buf, size, write ? g_usbEndpointIn : g_usbEndpointOut);
+}
+
+static bool usbDsTransportPostAsync(void *buf, u32 size, u32 *out_id)
+{
+    Result rc = usbDsEndpoint_PostBufferAsync(g_usbEndpointIn, buf, size, out_id);
+    if (R_FAILED(rc)) LOG_MSG_ERROR("usbDsEndpoint_PostBufferAsync failed! (0x%X).", rc);
+    return R_SUCCEEDED(rc);
+}
+
+static bool usbDsTransportWaitAsync(const u32 *ids, const u32 *sizes, u32 count)
+{
+    return usbWaitForUrbCompletion(g_usbEndpointIn, ids, sizes, count);
+}
+
+static void usbDsTransportCancelAsync(void)
+{
+    if (!g_usbEndpointIn) return;
+
+    Result rc = 0;
+    UsbDsReportData report_data = {0};
+    bool pending = false;
+
+    usbDsEndpoint_Cancel(g_usbEndpointIn);
+
+    /* Wait until no URBs are reported as pending. The caller may reuse the buffers from cancelled URBs as soon as we return. */
+    while(true)
+    {
+        /* Clear the completion event before retrieving report data, so we don't miss any completions that take place afterwards. */
+        eventClear(&(g_usbEndpointIn->CompletionEvent));
+
+        rc = usbDsEndpoint_GetReportData(g_usbEndpointIn, &report_data);
+        if (R_FAILED(rc))
+        {
+            LOG_MSG_ERROR("usbDsEndpoint_GetReportData failed! (0x%X).", rc);
+            break;
+        }
+
+        pending = false;
+
+        for(u32 i = 0; i < MIN(report_data.report_count, MAX_ELEMENTS(report_data.report)); i++)
+        {
+            if (report_data.report[i].urb_status < UsbUrbStatus_Done)
+            {
+                pending = true;
+                break;
+            }
+        }
+
+        if (!pending) break;
+
+        /* Wait for the next completion. */
+        rc = eventWait(&(g_usbEndpointIn->CompletionEvent), USB_TRANSFER_TIMEOUT * (u64)1000000000);
+        if (R_FAILED(rc))
+        {
+            LOG_MSG_ERROR("eventWait failed! (0x%X). Cancelled URBs never completed.", rc);
+            break;
+        }
+    }
+}
+
+static void usbDsTransportSetZlt(bool enable)
+{
+    usbDsEndpoint_SetZlt(g_usbEndpointIn, enable);
+}
+
+#if USB_TRANSPORT_TCP
+static bool usbTcpTransportInitialize(void)
+{
+    struct sockaddr_in addr = {0};
+    int opt = 1;
+
+    /* Create listening socket. */
+    g_usbTcpListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (g_usbTcpListenSocket < 0)
+    {
+        LOG_MSG_ERROR("socket failed! (%d).", errno);
+        goto end;
+    }
+
+    setsockopt(g_usbTcpListenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(USB_TCP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(g_usbTcpListenSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(g_usbTcpListenSocket, 1) < 0)
+    {
+        LOG_MSG_ERROR("Failed to listen on TCP port %u! (%d).", USB_TCP_PORT, errno);
+        goto end;
+    }
+
+    /* Create user-mode events. */
+    ueventCreate(&g_usbTcpStateChangeEvent, true);
+    ueventCreate(&g_usbTcpListenerExitEvent, true);
+
+    /* Create TCP listener thread. */
+    if (!utilsCreateThread(&g_usbTcpListenerThread, usbTcpListenerThreadFunc, NULL, 1))
+    {
+        LOG_MSG_ERROR("Failed to create TCP listener thread!");
+        goto end;
+    }
+
+    g_usbTcpListenerThreadCreated = true;
+
+    LOG_MSG_INFO("Listening for host device connections on TCP port %u.", USB_TCP_PORT);
+
+end:
+    if (!g_usbTcpListenerThreadCreated) usbTcpTransportExit();
+
+    return g_usbTcpListenerThreadCreated;
+}
+
+static void usbTcpTransportExit(void)
+{
+    /* Destroy TCP listener thread. */
+    if (g_usbTcpListenerThreadCreated)
+    {
+        ueventSignal(&g_usbTcpListenerExitEvent);
+        utilsJoinThread(&g_usbTcpListenerThread);
+        g_usbTcpListenerThreadCreated = false;
+    }
+
+    /* Close sockets. */
+    usbTcpTransportDisconnect();
+
+    if (g_usbTcpListenSocket >= 0)
+    {
+        close(g_usbTcpListenSocket);
+        g_usbTcpListenSocket = -1;
+    }
+}
+
+static Waiter usbTcpTransportGetStateChangeWaiter(void)
+{
+    return waiterForUEvent(&g_usbTcpStateChangeEvent);
+}
+
+static bool usbTcpTransportIsHostAvailable(void)
+{
+    return (atomic_load(&g_usbTcpClientSocket) >= 0);
+}
+
+static bool usbTcpTransportTransfer(void *buf, u64 size, bool write)
+{
+    int sock = atomic_load(&g_usbTcpClientSocket);
+    u8 *buf_u8 = (u8*)buf;
+    u64 offset = 0, last_tick = armGetSystemTick(), timeout_ticks = (USB_TRANSFER_TIMEOUT * armGetSystemTickFreq());
+    bool thread_exit = false;
+
+    if (!buf || !size)
+    {
+        LOG_MSG_ERROR("Invalid parameters!");
+        return false;
+    }
+
+    if (sock < 0)
+    {
+        LOG_MSG_ERROR("USB host unavailable!");
+        return false;
+    }
+
+    while(offset < size)
+    {
+        struct pollfd pfd = { .fd = sock, .events = (write ? POLLOUT : POLLIN), .revents = 0 };
+
+        int res = poll(&pfd, 1, USB_TCP_POLL_TIMEOUT);
+        if (res < 0) break;
+
+        if (!res)
+        {
+            /* If the USB session has already been established, then use a regular timeout value. */
+            if (g_usbSessionStarted && (armGetSystemTick() - last_tick) >= timeout_ticks) break;
+
+            /* If we're starting a USB session, wait indefinitely to let the user start the host script, unless the exit event is triggered. */
+            if (!g_usbSessionStarted && R_SUCCEEDED(waitSingle(waiterForUEvent(&g_usbDetectionThreadExitEvent), 0)))
+            {
+                g_usbDetectionThreadExitFlag = thread_exit = true;
+                break;
+            }
+
+            continue;
+        }
+
+        ssize_t cur_size = (write ? send(sock, buf_u8 + offset, size - offset, 0) : recv(sock, buf_u8 + offset, size - offset, 0));
+        if (cur_size <= 0) break;
+
+        offset += (u64)cur_size;
+        last_tick = armGetSystemTick();
+    }
+
+    if (offset < size)
+    {
+        if (!thread_exit) LOG_MSG_ERROR("TCP %s failed! Transferred 0x%lX out of 0x%lX bytes (%d).", write ? "send" : "recv", offset, size, errno);
+
+        /* The host device is out of sync by now, so we'll drop the connection and wait for a new one. */
+        usbTcpTransportDisconnect();
+        if (g_usbSessionStarted) ueventSignal(&g_usbTimeoutEvent);
+
+        return false;
+    }
+
+    return true;
+}
+
+static bool usbTcpTransportPostAsync(void *buf, u32 size, u32 *out_id)
+{
+    /* TCP sockets have no notion of asynchronous writes, so we rely on socket buffering instead. Writes posted this way are always complete by the time we return. */
+    *out_id = g_usbTcpWriteId++;
+    return usbTcpTransportTransfer(buf, size, true);
+}
+
+static bool usbTcpTransportWaitAsync(const u32 *ids, const u32 *sizes, u32 count)
+{
+    NX_IGNORE_ARG(ids);
+    NX_IGNORE_ARG(sizes);
+    NX_IGNORE_ARG(count);
+
+    return usbTcpTransportIsHostAvailable();
+}
+
+static void usbTcpTransportCancelAsync(void)
+{
+    /* Part of a data frame may have already been sent, so the host device is out of sync. */
+    usbTcpTransportDisconnect();
+}
+
+static void usbTcpTransportSetZlt(bool enable)
+{
+    /* Stream sockets don't need Zero Length Termination packets. The host device must not expect them over TCP. */
+    NX_IGNORE_ARG(enable);
+}
+
+static void usbTcpTransportDisconnect(void)
+{
+    int sock = atomic_exchange(&g_usbTcpClientSocket, -1);
+    if (sock >= 0)
+    {
+        shutdown(sock, SHUT_RDWR);
+        close(sock);
+
+        /* Let the USB detection thread know the host device is gone. */
+        ueventSignal(&g_usbTcpStateChangeEvent);
+    }
+}
+
+static void usbTcpListenerThreadFunc(void *arg)
+{
+    NX_IGNORE_ARG(arg);
+
+    Waiter exit_event_waiter = waiterForUEvent(&g_usbTcpListenerExitEvent);
+
+    while(R_FAILED(waitSingle(exit_event_waiter, 0)))
+    {
+        struct pollfd pfd = { .fd = g_usbTcpListenSocket, .events = POLLIN, .revents = 0 };
+        if (poll(&pfd, 1, USB_TCP_POLL_TIMEOUT) <= 0) continue;
+
+        int sock = accept(g_usbTcpListenSocket, NULL, NULL);
+        if (sock < 0) continue;
+
+        /* Only a single host device can be connected at a time. */
+        if (atomic_load(&g_usbTcpClientSocket) >= 0)
+        {
+            LOG_MSG_WARNING("Rejecting TCP connection: a host device is already connected.");
+            close(sock);
+            continue;
+        }
+
+        /* Disable Nagle's algorithm, since frame headers are sent separately from their payloads. */
+        int opt = 1, buf_size = USB_TCP_SOCKET_BUFFER_SIZE;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+
+        atomic_store(&g_usbTcpClientSocket, sock);
+
+        LOG_MSG_INFO("Host device connected over TCP.");
+
+        /* Let the USB detection thread start a new session. */
+        ueventSignal(&g_usbTcpStateChangeEvent);
+    }
+
+    threadExit();
+}
+#endif
@@ -29,18 +29,20 @@ using namespace i18n::literals; /* For _i18n. */
 
 namespace nxdt::tasks
 {
-    GameCardDumpTaskError GameCardImageDumpTask::DoInBackground(const std::string& output_path, const bool& prepend_key_area, const bool& keep_certificate, const bool& trim_dump,
+    GameCardDumpTaskError GameCardImageDumpTask::DoInBackground(const std::string& output_path, const std::string& mirror_path, const bool& prepend_key_area, const bool& keep_certificate, const bool& trim_dump,
                                                                 const bool& calculate_checksum, const bool& lookup_checksum)
     {
         std::scoped_lock lock(this->task_mtx);
 
+        GameCardHeader gc_header{};
         GameCardKeyArea gc_key_area{};
         GameCardSecurityInformation gc_security_information{};
 
         u32 gc_key_area_crc = 0;
-        size_t gc_img_size = 0;
+        size_t gc_img_size = 0, gc_data_size = 0, resume_offset = 0;
 
         nxdt::utils::FileWriter *file = nullptr;
+        nxdt::utils::FileWriter::JournalState journal_id{}, journal_state{};
         void *buf = nullptr;
 
         DataTransferProgress progress{};
@@ -49,12 +51,23 @@ namespace nxdt::tasks
         this->calculate_checksum = calculate_checksum;
         this->lookup_checksum = lookup_checksum;
 
-        LOG_MSG_DEBUG("Starting dump with parameters:\n- Output path: \"%s\".\n- Prepend key area: %u.\n- Keep certificate: %u.\n- Trim dump: %u.\n- Calculate checksum: %u.\n- Lookup checksum: %d.", \
-                      output_path.c_str(), prepend_key_area, keep_certificate, trim_dump, calculate_checksum, lookup_checksum);
+        LOG_MSG_DEBUG("Starting dump with parameters:\n- Output path: \"%s\".\n- Mirror path: \"%s\".\n- Prepend key area: %u.\n- Keep certificate: %u.\n- Trim dump: %u.\n- Calculate checksum: %u.\n- Lookup checksum: %d.", \
+                      output_path.c_str(), mirror_path.c_str(), prepend_key_area, keep_certificate, trim_dump, calculate_checksum, lookup_checksum);
+
+        /* Load the offline checksum database index before dumping anything. It may have to be built from the DAT file first, which takes a while. */
+        if (calculate_checksum && lookup_checksum && !datIsAvailable())
+        {
+            LOG_MSG_WARNING("Checksum database unavailable. Gamecard image checksum won't be looked up.");
+            this->lookup_checksum = false;
+        }
 
         /* Retrieve gamecard image size. */
         if ((!trim_dump && !gamecardGetTotalSize(&gc_img_size)) || (trim_dump && !gamecardGetTrimmedSize(&gc_img_size)) || !gc_img_size) return "tasks/gamecard/image/get_size_failed"_i18n;
 
+        /* Determine how much data we actually need to read from the gamecard. */
+        /* Everything past the trimmed size in untrimmed dumps is just 0xFF padding, which we can synthesize on our own. */
+        gc_data_size = (trim_dump ? gc_img_size : this->GetPaddingStartOffset(gc_img_size));
+
         /* Check if we're supposed to prepend the key area to the gamecard image. */
         if (prepend_key_area)
         {
@@ -75,13 +88,28 @@ namespace nxdt::tasks
             }
         }
 
+        /* Generate journal ID. This lets us resume interrupted dumps from this very same gamecard, as long as the same dump options are used. */
+        /* Journaling is simply disabled if we can't retrieve the gamecard header. */
+        bool use_journal = gamecardGetHeader(&gc_header);
+        if (use_journal)
+        {
+            memcpy(journal_id.data(), gc_header.package_id, sizeof(gc_header.package_id));
+            journal_id[0x8] = prepend_key_area;
+            journal_id[0x9] = keep_certificate;
+            journal_id[0xA] = trim_dump;
+        }
+
         /* Push progress onto the class. */
         progress.total_size = gc_img_size;
         this->PublishProgress(progress);
 
         /* Open output file. */
         try {
-            file = new nxdt::utils::FileWriter(output_path, gc_img_size);
+            /* Use asynchronous writes, so gamecard reads overlap with writes to the output device(s). */
+            std::vector<std::string> mirror_paths{};
+            if (!mirror_path.empty()) mirror_paths.push_back(mirror_path);
+
+            file = new nxdt::utils::FileWriter(output_path, gc_img_size, 0, use_journal ? &journal_id : nullptr, true, mirror_paths);
         } catch(const std::string& msg) {
             LOG_MSG_ERROR("%s", msg.c_str());
             return msg;
@@ -89,14 +117,35 @@ namespace nxdt::tasks
 
         ON_SCOPE_EXIT { delete file; };
 
-        if (prepend_key_area)
+        /* Restore our state if we're resuming a previously interrupted dump. */
+        resume_offset = file->GetResumeOffset();
+        if (resume_offset)
         {
-            /* Write GameCardKeyArea object. */
-            if (!file->Write(&gc_key_area, sizeof(GameCardKeyArea))) return "tasks/gamecard/image/write_key_area_failed"_i18n;
+            const nxdt::utils::FileWriter::JournalState& resume_state = file->GetResumeState();
+            memcpy(&(this->gc_img_crc), resume_state.data(), sizeof(u32));
+            memcpy(&(this->full_gc_img_crc), resume_state.data() + sizeof(u32), sizeof(u32));
+
+            LOG_MSG_INFO("Resuming gamecard image dump at offset 0x%lX.", resume_offset);
 
             /* Push progress onto the class. */
-            progress.xfer_size += sizeof(GameCardKeyArea);
+            progress.xfer_size = resume_offset;
             this->PublishProgress(progress);
+        }
+
+        if (prepend_key_area)
+        {
+            if (!resume_offset)
+            {
+                /* Write GameCardKeyArea object. */
+                if (!file->Write(&gc_key_area, sizeof(GameCardKeyArea), this->GetJournalState(journal_state))) return "tasks/gamecard/image/write_key_area_failed"_i18n;
+
+                /* Push progress onto the class. */
+                progress.xfer_size += sizeof(GameCardKeyArea);
+                this->PublishProgress(progress);
+            } else {
+                /* Skip the key area. */
+                resume_offset -= sizeof(GameCardKeyArea);
+            }
 
             /* Update gamecard image size. */
             gc_img_size -= sizeof(GameCardKeyArea);
@@ -108,20 +157,41 @@ namespace nxdt::tasks
 
         ON_SCOPE_EXIT { free(buf); };
 
+        /* Only account for reads issued by this dump. */
+        gamecardResetReadStatistics();
+
         /* Dump gamecard image. */
-        for(size_t offset = 0, blksize = USB_TRANSFER_BUFFER_SIZE; offset < gc_img_size; offset += blksize)
+        for(size_t offset = resume_offset, blksize = USB_TRANSFER_BUFFER_SIZE; offset < gc_img_size; offset += blksize)
         {
-            /* Don't proceed if the task has been cancelled. */
-            if (this->IsCancelled()) return {};
+            /* Don't proceed if the task has been cancelled. Partial output files are useless in this case. */
+            if (this->IsCancelled())
+            {
+                file->Close(true);
+                return {};
+            }
+
+            /* Check if we're dealing with padding. */
+            bool padding = (offset >= gc_data_size);
 
-            /* Adjust current block size, if needed. */
-            if (blksize > (gc_img_size - offset)) blksize = (gc_img_size - offset);
+            /* Adjust current block size, if needed. Blocks never cross the padding boundary. */
+            size_t block_end_offset = (padding ? gc_img_size : gc_data_size);
+            if (blksize > (block_end_offset - offset)) blksize = (block_end_offset - offset);
 
-            /* Read current block. */
-            if (!gamecardReadStorage(buf, blksize, offset)) return i18n::getStr("tasks/gamecard/image/io_failed", "generic/read"_i18n, blksize, offset);
+            if (!padding)
+            {
+                /* Read current block. */
+                if (!gamecardReadStorage(buf, blksize, offset)) return i18n::getStr("tasks/gamecard/image/io_failed", "generic/read"_i18n, blksize, offset);
 
-            /* Remove certificate, if needed. */
-            if (!keep_certificate && offset == 0) memset(static_cast<u8*>(buf) + GAMECARD_CERT_OFFSET, 0xFF, sizeof(FsGameCardCertificate));
+                /* Remove certificate, if needed. */
+                if (!keep_certificate && offset == 0) memset(static_cast<u8*>(buf) + GAMECARD_CERT_OFFSET, 0xFF, sizeof(FsGameCardCertificate));
+            } else
+            if (offset == gc_data_size || offset == resume_offset)
+            {
+                /* Synthesize padding. Our buffer is only used for checksum calculation from this point on. */
+                memset(buf, 0xFF, USB_TRANSFER_BUFFER_SIZE);
+                blksize = USB_TRANSFER_BUFFER_SIZE;
+                if (blksize > (gc_img_size - offset)) blksize = (gc_img_size - offset);
+            }
 
             /* Update image checksum. */
             if (calculate_checksum)
@@ -131,7 +201,12 @@ namespace nxdt::tasks
             }
 
             /* Write current block. */
-            if (!file->Write(buf, blksize)) return i18n::getStr("tasks/gamecard/image/io_failed", "generic/write"_i18n, blksize, offset);
+            this->GetJournalState(journal_state);
+
+            if ((!padding && !file->Write(buf, blksize, journal_state)) || (padding && !file->WriteFill(0xFF, blksize, journal_state)))
+            {
+                return i18n::getStr("tasks/gamecard/image/io_failed", "generic/write"_i18n, blksize, offset);
+            }
 
             /* Push progress onto the class. */
             progress.xfer_size += blksize;
@@ -139,6 +214,61 @@ namespace nxdt::tasks
             this->PublishProgress(progress);
         }
 
+        /* Wait for all queued data to be written. Asynchronous write errors are reported here at the latest. */
+        if (!file->Flush()) return "tasks/gamecard/image/flush_failed"_i18n;
+
+        GameCardReadStatistics read_stats{};
+        gamecardGetReadStatistics(&read_stats);
+        LOG_MSG_INFO("Gamecard read statistics: %lu request(s), %lu storage read(s), 0x%lX byte(s) read, %lu read-ahead hit(s), %lu storage area switch(es).", read_stats.request_count, \
+                     read_stats.storage_read_count, read_stats.storage_read_size, read_stats.read_ahead_hit_count, read_stats.area_switch_count);
+
+        /* Report output times as well. If the asynchronous buffer wait time makes up most of the dump time, the output device is the bottleneck. */
+        LOG_MSG_INFO("Gamecard image output times: %lu ms allocating, %lu ms writing, %lu ms waiting for asynchronous write buffers.", file->GetAllocationTime() / 1000000, \
+                     file->GetWriteTime() / 1000000, file->GetAsyncWaitTime() / 1000000);
+
+        /* Look up the image checksum in the offline checksum database. The index has already been loaded by now, so this only takes a binary search. */
+        if (calculate_checksum && this->lookup_checksum)
+        {
+            this->checksum_match = datLookupByCrc32(this->gc_img_crc, gc_img_size, &(this->checksum_match_info));
+            if (this->checksum_match)
+            {
+                LOG_MSG_INFO("Gamecard image checksum (%08X) matches checksum database entry \"%s\".", this->gc_img_crc, this->checksum_match_info.name);
+            } else {
+                LOG_MSG_WARNING("Gamecard image checksum (%08X) not found in checksum database.", this->gc_img_crc);
+            }
+        }
+
         return {};
     }
+
+    const nxdt::utils::FileWriter::JournalState& GameCardImageDumpTask::GetJournalState(nxdt::utils::FileWriter::JournalState& out)
+    {
+        out.fill(0);
+        memcpy(out.data(), &(this->gc_img_crc), sizeof(u32));
+        memcpy(out.data() + sizeof(u32), &(this->full_gc_img_crc), sizeof(u32));
+        return out;
+    }
+
+    size_t GameCardImageDumpTask::GetPaddingStartOffset(const size_t& gc_img_size)
+    {
+        size_t gc_trimmed_size = 0;
+        u8 page[GAMECARD_PAGE_SIZE] = {0};
+
+        /* Retrieve trimmed gamecard image size. */
+        if (!gamecardGetTrimmedSize(&gc_trimmed_size) || gc_trimmed_size >= gc_img_size) return gc_img_size;
+
+        /* Sample both the first and last pages from the padding area. If any of them holds something other than 0xFF bytes, we'll just read the whole thing. */
+        for(size_t offset : { gc_trimmed_size, gc_img_size - GAMECARD_PAGE_SIZE })
+        {
+            if (!gamecardReadStorage(page, sizeof(page), offset) || std::any_of(std::begin(page), std::end(page), [](u8 b) { return b != 0xFF; }))
+            {
+                LOG_MSG_WARNING("Unexpected data found in padding page at offset 0x%lX! Padding won't be synthesized.", offset);
+                return gc_img_size;
+            }
+        }
+
+        LOG_MSG_DEBUG("Padding will be synthesized from offset 0x%lX onwards (0x%lX bytes).", gc_trimmed_size, gc_img_size - gc_trimmed_size);
+
+        return gc_trimmed_size;
+    }
 }
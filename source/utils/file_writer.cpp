@@ -21,24 +21,92 @@
 
 #include <utils/file_writer.hpp>
 
+#define FILE_WRITER_FILL_BUFFER_SIZE        0x800000    /* 8 MiB. */
+
+#define FILE_WRITER_ASYNC_BUFFER_SIZE       USB_TRANSFER_BUFFER_SIZE
+#define FILE_WRITER_ASYNC_BUFFER_COUNT      3
+
+#define FILE_WRITER_JOURNAL_EXTENSION       ".journal"
+#define FILE_WRITER_JOURNAL_MAGIC           0x4E584A4C  /* "NXJL". */
+#define FILE_WRITER_JOURNAL_VERSION         1
+#define FILE_WRITER_JOURNAL_MAX_VERIFY      4           /* Max number of journal entries to check (starting from the last one) before giving up on resuming a dump. */
+
 namespace i18n = brls::i18n;    /* For getStr(). */
 using namespace i18n::literals; /* For _i18n. */
 
 namespace nxdt::utils
 {
-    FileWriter::FileWriter(const std::string& output_path, const size_t& total_size, const u32& nsp_header_size) : output_path(output_path), total_size(total_size), nsp_header_size(nsp_header_size)
+    /* Journal file header. */
+    typedef struct {
+        u32 magic;                      ///< FILE_WRITER_JOURNAL_MAGIC.
+        u32 version;                    ///< FILE_WRITER_JOURNAL_VERSION.
+        u64 total_size;                 ///< Output file size.
+        u32 nsp_header_size;            ///< NSP header size. Zero if not dealing with a NSP.
+        u8 reserved[0x4];
+        FileWriter::JournalState id;    ///< Journal ID provided by the caller.
+    } FileWriterJournalHeader;
+
+    NXDT_ASSERT(FileWriterJournalHeader, 0x28);
+
+    /* Journal file entry. Appended right after each journaled chunk is written. */
+    typedef struct {
+        u64 offset;                     ///< Chunk offset within the output file.
+        u32 size;                       ///< Chunk size.
+        u32 crc;                        ///< CRC32 checksum calculated over the chunk data.
+        FileWriter::JournalState state; ///< Caller state after writing this chunk.
+    } FileWriterJournalEntry;
+
+    NXDT_ASSERT(FileWriterJournalEntry, 0x20);
+
+    FileWriter::FileWriter(const std::string& output_path, const size_t& total_size, const u32& nsp_header_size, const JournalState *journal_id, const bool& async_write,
+                           const std::vector<std::string>& mirror_paths) : output_path(output_path), total_size(total_size), nsp_header_size(nsp_header_size), async_write(async_write)
     {
         const char *output_path_str = this->output_path.c_str();
 
         LOG_MSG_DEBUG("Creating FileWriter object with arguments:\r\n" \
                       "- output_path: \"%s\".\r\n" \
                       "- total_size: 0x%lX.\r\n" \
-                      "- nsp_header_size: 0x%X.", \
-                      output_path_str, total_size, nsp_header_size);
+                      "- nsp_header_size: 0x%X.\r\n" \
+                      "- async_write: %u.\r\n" \
+                      "- mirror count: %lu.", \
+                      output_path_str, total_size, nsp_header_size, async_write, mirror_paths.size());
 
         /* Determine the storage device based on the input path. */
-        this->storage_type = (this->output_path.starts_with(DEVOPTAB_SDMC_DEVICE) ? StorageType::SdCard  :
-                             (this->output_path.starts_with('/')                  ? StorageType::UsbHost : StorageType::UmsDevice));
+        this->storage_type = FileWriter::GetStorageTypeFromPath(this->output_path);
+
+        if (!mirror_paths.empty())
+        {
+            /* Make sure all output files are stored in different storage devices. Only a single file can be transferred to the USB host at a time. */
+            /* SD card and USB host outputs are identified by their storage type alone, while UMS devices are identified by their device name. */
+            auto get_storage_device_id = [](const std::string& path, const StorageType& storage_type) -> std::string {
+                if (storage_type == StorageType::SdCard) return DEVOPTAB_SDMC_DEVICE;
+                if (storage_type == StorageType::UsbHost) return "/";
+
+                UsbHsFsDevice ums_device{};
+                if (!usbHsFsGetDeviceByPath(path.c_str(), &ums_device)) throw "utils/file_writer/ums_device_info_error"_i18n;
+
+                return ums_device.name;
+            };
+
+            std::vector<std::string> storage_device_ids{ get_storage_device_id(this->output_path, this->storage_type) };
+
+            for(const std::string& mirror_path : mirror_paths)
+            {
+                std::string mirror_device_id = get_storage_device_id(mirror_path, FileWriter::GetStorageTypeFromPath(mirror_path));
+
+                if (std::find(storage_device_ids.begin(), storage_device_ids.end(), mirror_device_id) != storage_device_ids.end())
+                {
+                    throw "utils/file_writer/invalid_mirror_error"_i18n;
+                }
+
+                storage_device_ids.push_back(mirror_device_id);
+            }
+
+            /* Interrupted dumps can't be resumed consistently across multiple output files, so journaling is disabled. */
+            /* Asynchronous writes are always used, so that every output file gets its own writer thread. The slowest one sets the pace. */
+            journal_id = nullptr;
+            this->async_write = true;
+        }
 
         if (this->storage_type != StorageType::UsbHost)
         {
@@ -61,9 +129,42 @@ namespace nxdt::utils
 
         LOG_MSG_DEBUG("storage_type: %d | split_file: %u | split_file_part_cnt: %u", this->storage_type, this->split_file, this->split_file_part_cnt);
 
+        /* Set up journaling, if requested. Not available for USB hosts, since we can't read the partial output back from them. */
+        if (journal_id && this->total_size)
+        {
+            if (this->storage_type != StorageType::UsbHost)
+            {
+                this->journal_path = (this->output_path + FILE_WRITER_JOURNAL_EXTENSION);
+                this->journal_id = *journal_id;
+            } else {
+                LOG_MSG_DEBUG("Journaling not available for USB host output files.");
+            }
+        }
+
+        /* Try to resume a previously interrupted dump using its journal file. */
+        if (!this->journal_path.empty() && this->ResumeFromJournal())
+        {
+            /* Check free space for the remaining data. */
+            if (auto chk = this->CheckFreeSpace())
+            {
+                this->CloseCurrentFile();
+                this->CloseJournal(false);
+                this->file_closed = true;
+                throw chk.value();
+            }
+
+            /* Start asynchronous writer, if needed. */
+            if (this->async_write && !this->StartAsyncWriter()) LOG_MSG_ERROR("Failed to start asynchronous writer! Falling back to synchronous writes.");
+
+            return;
+        }
+
         /* Check free space. */
         if (auto chk = this->CheckFreeSpace()) throw chk.value();
 
+        /* Create journal file, if needed. We'll just carry on without it if this fails. */
+        if (!this->journal_path.empty() && !this->CreateJournal()) LOG_MSG_ERROR("Failed to create journal file! Dump won't be resumable.");
+
         /* Create initial file. */
         if (!this->CreateInitialFile())
         {
@@ -89,6 +190,17 @@ namespace nxdt::utils
             /* Manually adjust current file offset. */
             this->cur_size += this->nsp_header_size;
         }
+
+        /* Start asynchronous writer, if needed. */
+        if (this->async_write && this->total_size && !this->StartAsyncWriter()) LOG_MSG_ERROR("Failed to start asynchronous writer! Falling back to synchronous writes.");
+
+        /* Create mirrors. */
+        try {
+            for(const std::string& mirror_path : mirror_paths) this->mirrors.push_back(std::make_unique<FileWriter>(mirror_path, this->total_size, this->nsp_header_size, nullptr, true));
+        } catch(const std::string&) {
+            this->Close(true);
+            throw;
+        }
     }
 
     FileWriter::~FileWriter()
@@ -111,26 +223,291 @@ namespace nxdt::utils
 
         LOG_MSG_DEBUG("Free space in \"%.*s\": 0x%lX.", static_cast<int>(strchr(output_path_str, '/') + 1 - output_path_str), output_path_str, free_space);
 
-        /* Perform the actual free space check. */
-        bool ret = (free_space > this->total_size);
+        /* Perform the actual free space check. Data from resumed dumps is already stored in the target storage device. */
+        size_t needed_size = (this->total_size - this->cur_size);
+        bool ret = (free_space > needed_size);
         if (!ret)
         {
             char needed_size_str[0x40] = {0};
-            utilsGenerateFormattedSizeString(static_cast<double>(this->total_size), needed_size_str, sizeof(needed_size_str));
+            utilsGenerateFormattedSizeString(static_cast<double>(needed_size), needed_size_str, sizeof(needed_size_str));
             return i18n::getStr("utils/file_writer/free_space_check/insufficient_space_error", needed_size_str);
         }
 
         return {};
     }
 
+    bool FileWriter::ResumeFromJournal(void)
+    {
+        const char *journal_path_str = this->journal_path.c_str();
+        FileWriterJournalHeader header{};
+        FileWriterJournalEntry entry{};
+        std::vector<FileWriterJournalEntry> entries{};
+        size_t expected_offset = this->nsp_header_size;
+        bool success = false;
+
+        /* Open journal file. Bail out quietly if it doesn't exist. */
+        FILE *fp = fopen(journal_path_str, "rb");
+        if (!fp) return false;
+
+        LOG_MSG_DEBUG("Found journal file: \"%s\".", journal_path_str);
+
+        /* Read and validate journal header. */
+        if (fread(&header, 1, sizeof(header), fp) != sizeof(header) || header.magic != FILE_WRITER_JOURNAL_MAGIC || header.version != FILE_WRITER_JOURNAL_VERSION || \
+            header.total_size != this->total_size || header.nsp_header_size != this->nsp_header_size || header.id != this->journal_id)
+        {
+            LOG_MSG_INFO("Journal file doesn't match the current dump. Discarding it.");
+            fclose(fp);
+            goto end;
+        }
+
+        /* Read journal entries. Stop at the first one that doesn't look right -- the last entry may have been truncated. */
+        while(fread(&entry, 1, sizeof(entry), fp) == sizeof(entry))
+        {
+            if (entry.offset != expected_offset || !entry.size || (entry.offset + entry.size) > this->total_size) break;
+            entries.push_back(entry);
+            expected_offset += entry.size;
+        }
+
+        fclose(fp);
+
+        LOG_MSG_DEBUG("Read %lu journal entr%s.", entries.size(), entries.size() == 1 ? "y" : "ies");
+
+        /* Verify the tail of the partial output file, starting from the last journal entry. */
+        {
+            std::vector<u8> buf{};
+
+            for(size_t i = 0; i < FILE_WRITER_JOURNAL_MAX_VERIFY && !entries.empty(); i++)
+            {
+                const FileWriterJournalEntry& last_entry = entries.back();
+                u32 crc = 0;
+                bool valid = true;
+
+                if (buf.size() < std::min(static_cast<size_t>(last_entry.size), static_cast<size_t>(FILE_WRITER_FILL_BUFFER_SIZE)))
+                {
+                    buf.resize(std::min(static_cast<size_t>(last_entry.size), static_cast<size_t>(FILE_WRITER_FILL_BUFFER_SIZE)));
+                }
+
+                for(size_t offset = 0, blksize = buf.size(); offset < last_entry.size; offset += blksize)
+                {
+                    if (blksize > (last_entry.size - offset)) blksize = (last_entry.size - offset);
+
+                    if (!(valid = this->ReadOutputData(buf.data(), blksize, last_entry.offset + offset))) break;
+
+                    crc = crc32CalculateWithSeed(crc, buf.data(), blksize);
+                }
+
+                if (valid && crc == last_entry.crc) break;
+
+                LOG_MSG_INFO("Chunk at offset 0x%lX (0x%X bytes) failed verification. Discarding journal entry.", last_entry.offset, last_entry.size);
+                entries.pop_back();
+            }
+        }
+
+        /* Don't proceed if we have nothing to resume. */
+        if (entries.empty() || (entries.back().offset + entries.back().size) == this->nsp_header_size) goto end;
+
+        /* Reopen the output file at the resume offset. */
+        this->resume_offset = (entries.back().offset + entries.back().size);
+        if (!this->OpenOutputFileAtOffset(this->resume_offset))
+        {
+            LOG_MSG_ERROR("Failed to reopen output file at offset 0x%lX!", this->resume_offset);
+            this->resume_offset = this->split_file_part_size = 0;
+            this->split_file_part_idx = 0;
+            goto end;
+        }
+
+        this->resume_state = entries.back().state;
+        this->cur_size = this->resume_offset;
+        this->file_created = true;
+
+        /* Rewrite journal file using the verified entries. */
+        if (this->CreateJournal())
+        {
+            for(const FileWriterJournalEntry& cur_entry : entries)
+            {
+                this->AppendJournalEntry(cur_entry.offset, cur_entry.size, cur_entry.crc, cur_entry.state);
+                if (!this->journal_fp) break;
+            }
+        }
+
+        if (!this->journal_fp) LOG_MSG_ERROR("Failed to rewrite journal file! Dump won't be resumable.");
+
+        LOG_MSG_INFO("Resuming dump at offset 0x%lX (0x%lX bytes left).", this->resume_offset, this->total_size - this->resume_offset);
+
+        success = true;
+
+end:
+        if (!success) remove(journal_path_str);
+
+        return success;
+    }
+
+    bool FileWriter::CreateJournal(void)
+    {
+        this->journal_fp = fopen(this->journal_path.c_str(), "wb");
+        if (!this->journal_fp)
+        {
+            LOG_MSG_ERROR("fopen() failed to create journal file! (%d).", errno);
+            return false;
+        }
+
+        FileWriterJournalHeader header{};
+        header.magic = FILE_WRITER_JOURNAL_MAGIC;
+        header.version = FILE_WRITER_JOURNAL_VERSION;
+        header.total_size = this->total_size;
+        header.nsp_header_size = this->nsp_header_size;
+        header.id = this->journal_id;
+
+        if (fwrite(&header, 1, sizeof(header), this->journal_fp) != sizeof(header) || fflush(this->journal_fp) != 0)
+        {
+            LOG_MSG_ERROR("Failed to write journal header! (%d).", errno);
+            this->CloseJournal(true);
+            return false;
+        }
+
+        return true;
+    }
+
+    void FileWriter::AppendJournalEntry(const size_t& offset, const size_t& size, const u32& crc, const JournalState& state)
+    {
+        if (!this->journal_fp) return;
+
+        FileWriterJournalEntry entry{};
+        entry.offset = offset;
+        entry.size = static_cast<u32>(size);
+        entry.crc = crc;
+        entry.state = state;
+
+        /* Flush right away. Journal entries must never be recorded before the data they describe, and they must reach the storage device as soon as possible. */
+        if (fwrite(&entry, 1, sizeof(entry), this->journal_fp) != sizeof(entry) || fflush(this->journal_fp) != 0)
+        {
+            /* A stale journal is worse than no journal at all. */
+            LOG_MSG_ERROR("Failed to append journal entry for chunk at offset 0x%lX! (%d). Dump won't be resumable.", offset, errno);
+            this->CloseJournal(true);
+        }
+    }
+
+    void FileWriter::CloseJournal(bool remove_journal)
+    {
+        if (this->journal_fp)
+        {
+            fclose(this->journal_fp);
+            this->journal_fp = nullptr;
+        }
+
+        if (remove_journal && !this->journal_path.empty())
+        {
+            remove(this->journal_path.c_str());
+            this->journal_path.clear();
+        }
+    }
+
+    bool FileWriter::ReadOutputData(void *out, const size_t& read_size, const size_t& offset)
+    {
+        u8 *out_u8 = static_cast<u8*>(out);
+        size_t cur_offset = offset, remaining = read_size;
+
+        while(remaining)
+        {
+            std::string path{};
+            size_t file_offset = cur_offset, chunk_size = remaining;
+
+            if (this->storage_type == StorageType::UmsDevice && this->split_file)
+            {
+                /* Read data from the right part file. */
+                path = fmt::format("{}/{:02d}", this->output_path, cur_offset / CONCATENATION_FILE_PART_SIZE);
+                file_offset = (cur_offset % CONCATENATION_FILE_PART_SIZE);
+                chunk_size = std::min(remaining, static_cast<size_t>(CONCATENATION_FILE_PART_SIZE) - file_offset);
+            } else {
+                path = this->output_path;
+            }
+
+            FILE *fp = fopen(path.c_str(), "rb");
+            if (!fp) return false;
+
+            bool ret = (fseek(fp, static_cast<long>(file_offset), SEEK_SET) == 0 && fread(out_u8, 1, chunk_size, fp) == chunk_size);
+
+            fclose(fp);
+
+            if (!ret) return false;
+
+            out_u8 += chunk_size;
+            cur_offset += chunk_size;
+            remaining -= chunk_size;
+        }
+
+        return true;
+    }
+
+    bool FileWriter::OpenOutputFileAtOffset(const size_t& offset)
+    {
+        std::string path{};
+        size_t file_offset = offset;
+
+        if (this->storage_type == StorageType::UmsDevice && this->split_file)
+        {
+            /* Stick to the previous part file if we're right at a part file boundary. Write() will take care of switching to the next one. */
+            size_t part_idx = (offset / CONCATENATION_FILE_PART_SIZE);
+            file_offset = (offset % CONCATENATION_FILE_PART_SIZE);
+
+            if (!file_offset && part_idx > 0)
+            {
+                part_idx--;
+                file_offset = CONCATENATION_FILE_PART_SIZE;
+            }
+
+            path = fmt::format("{}/{:02d}", this->output_path, part_idx);
+
+            this->split_file_part_idx = static_cast<u8>(part_idx + 1);
+            this->split_file_part_size = file_offset;
+        } else {
+            path = this->output_path;
+        }
+
+        this->cur_file_size = file_offset;
+
+        LOG_MSG_DEBUG("Reopening output file \"%s\" at offset 0x%lX.", path.c_str(), file_offset);
+
+        this->fp = fopen(path.c_str(), "rb+");
+        if (!this->fp)
+        {
+            LOG_MSG_ERROR("fopen() failed! (%d).", errno);
+            return false;
+        }
+
+        if (fseek(this->fp, static_cast<long>(file_offset), SEEK_SET) != 0)
+        {
+            LOG_MSG_ERROR("fseek() failed! (%d).", errno);
+            this->CloseCurrentFile();
+            return false;
+        }
+
+        /* Disable file stream buffering. */
+        setvbuf(this->fp, nullptr, _IONBF, 0);
+
+        /* Preallocate the rest of the file (or part file). It may have been truncated when it was last closed. */
+        this->PreallocateCurrentFile(this->GetCurrentFileFinalSize());
+
+        return true;
+    }
+
     void FileWriter::CloseCurrentFile(void)
     {
         if (this->fp)
         {
+            /* Trim preallocated space we didn't get to write to, so incomplete files don't end with a garbage tail. */
+            if (this->cur_file_size < this->cur_file_alloc_size)
+            {
+                LOG_MSG_DEBUG("Truncating current file to 0x%lX bytes.", this->cur_file_size);
+                if (ftruncate(fileno(this->fp), static_cast<off_t>(this->cur_file_size)) != 0) LOG_MSG_WARNING("Failed to truncate current file! (%d).", errno);
+            }
+
             LOG_MSG_DEBUG("Closing current file.");
             fclose(this->fp);
             this->fp = nullptr;
         }
+
+        this->cur_file_size = this->cur_file_alloc_size = 0;
     }
 
     bool FileWriter::OpenNextFile(void)
@@ -187,9 +564,41 @@ namespace nxdt::utils
         /* Disable file stream buffering. */
         setvbuf(this->fp, nullptr, _IONBF, 0);
 
+        /* Preallocate the whole file (or part file) right away, since we already know its final size. */
+        this->PreallocateCurrentFile(this->GetCurrentFileFinalSize());
+
         return true;
     }
 
+    size_t FileWriter::GetCurrentFileFinalSize(void)
+    {
+        if (this->storage_type != StorageType::UmsDevice || !this->split_file) return this->total_size;
+
+        size_t part_offset = (static_cast<size_t>(this->split_file_part_idx - 1) * CONCATENATION_FILE_PART_SIZE);
+        return std::min(this->total_size - part_offset, static_cast<size_t>(CONCATENATION_FILE_PART_SIZE));
+    }
+
+    void FileWriter::PreallocateCurrentFile(const size_t& size)
+    {
+        if (size <= this->cur_file_size) return;
+
+        u64 start_tick = armGetSystemTick();
+
+        /* This lets the filesystem driver allocate all clusters at once, instead of growing the file chunk by chunk. */
+        /* The file pointer isn't moved. We'll just carry on if this fails -- writes will grow the file as usual. */
+        if (ftruncate(fileno(this->fp), static_cast<off_t>(size)) != 0)
+        {
+            LOG_MSG_WARNING("Failed to preallocate 0x%lX bytes for the current file! (%d).", size, errno);
+            return;
+        }
+
+        u64 ticks = (armGetSystemTick() - start_tick);
+        this->alloc_ticks += ticks;
+        this->cur_file_alloc_size = size;
+
+        LOG_MSG_DEBUG("Preallocated 0x%lX bytes for the current file (%lu ms).", size, armTicksToNs(ticks) / 1000000);
+    }
+
     bool FileWriter::CreateInitialFile(void)
     {
         /* Don't proceed if the file has already been created. */
@@ -226,67 +635,506 @@ namespace nxdt::utils
         return true;
     }
 
-    bool FileWriter::Write(const void *data, const size_t& data_size)
+    bool FileWriter::WriteData(const void *data, const size_t& data_size, const size_t& offset)
     {
-        /* Sanity check. */
-        if (!data || !data_size || !this->file_created || this->cur_size >= this->total_size || (this->storage_type != StorageType::UsbHost && !this->fp)) return false;
-
-        /* Make sure we don't write past the established file size. */
-        size_t write_size = ((this->cur_size + data_size) > this->total_size ? (this->total_size - this->cur_size) : data_size);
-
         if (this->storage_type == StorageType::UmsDevice && this->split_file)
         {
             /* Switch to the next part file if we need to. */
             if (this->split_file_part_size >= CONCATENATION_FILE_PART_SIZE && !this->OpenNextFile()) return false;
 
             /* Make sure we don't write past the part file size limit. */
-            size_t part_file_write_size = ((this->split_file_part_size + write_size) > CONCATENATION_FILE_PART_SIZE ? (CONCATENATION_FILE_PART_SIZE - this->split_file_part_size) : write_size);
+            size_t part_file_write_size = ((this->split_file_part_size + data_size) > CONCATENATION_FILE_PART_SIZE ? (CONCATENATION_FILE_PART_SIZE - this->split_file_part_size) : data_size);
 
             /* Write data to current part file. */
+            u64 start_tick = armGetSystemTick();
             size_t n = fwrite(data, 1, part_file_write_size, this->fp);
+            this->write_ticks += (armGetSystemTick() - start_tick);
+
             if (n != part_file_write_size)
             {
                 LOG_MSG_ERROR("fwrite() failed to write 0x%lX-byte long block at offset 0x%lX to part file #%u (absolute offset 0x%lX).",
-                              part_file_write_size, this->split_file_part_size, this->split_file_part_idx - 1, this->cur_size);
+                              part_file_write_size, this->split_file_part_size, this->split_file_part_idx - 1, offset);
                 return false;
             }
 
             /* Update part file size. */
             this->split_file_part_size += part_file_write_size;
-
-            /* Update the written data size. */
-            this->cur_size += part_file_write_size;
+            this->cur_file_size += part_file_write_size;
 
             /* Write the rest of the data to the next part file if we need to. */
-            if (part_file_write_size < write_size && !this->Write(static_cast<const u8*>(data) + part_file_write_size, write_size - part_file_write_size)) return false;
+            if (part_file_write_size < data_size && !this->WriteData(static_cast<const u8*>(data) + part_file_write_size, data_size - part_file_write_size, offset + part_file_write_size)) return false;
+        } else
+        if (this->storage_type == StorageType::UsbHost)
+        {
+            /* Send data to USB host. */
+            if (!usbSendFileData(data, data_size))
+            {
+                LOG_MSG_ERROR("Failed to send 0x%lX-byte long block at offset 0x%lX to USB host.", data_size, offset);
+                return false;
+            }
         } else {
-            if (this->storage_type == StorageType::UsbHost)
+            /* Write data to output file. */
+            u64 start_tick = armGetSystemTick();
+            size_t n = fwrite(data, 1, data_size, this->fp);
+            this->write_ticks += (armGetSystemTick() - start_tick);
+
+            if (n != data_size)
+            {
+                LOG_MSG_ERROR("fwrite() failed to write 0x%lX-byte long block at offset 0x%lX to output file.", data_size, offset);
+                return false;
+            }
+
+            this->cur_file_size += data_size;
+        }
+
+        return true;
+    }
+
+    void FileWriter::RecordChunk(const size_t& offset, const size_t& size, const u32& crc, const JournalState& state)
+    {
+        /* Journal entries must never be recorded before the data they describe, so the writer thread takes care of them if asynchronous writes are enabled. */
+        if (this->async_thread.joinable())
+        {
+            AsyncRequest request{};
+            request.type = AsyncRequestType::Journal;
+            request.offset = offset;
+            request.size = size;
+            request.crc = crc;
+            request.state = state;
+
+            /* Errors are reported by the next call. */
+            this->QueueAsyncRequest(request, nullptr);
+        } else {
+            this->AppendJournalEntry(offset, size, crc, state);
+        }
+    }
+
+    bool FileWriter::IsJournaling(void)
+    {
+        /* The journal file is owned by the writer thread while asynchronous writes are enabled. */
+        return (this->async_thread.joinable() ? this->async_journal : (this->journal_fp != nullptr));
+    }
+
+    bool FileWriter::StartAsyncWriter(void)
+    {
+        /* Buffers are allocated on demand by QueueAsyncRequest(), so small output files only ever take up a single buffer, which is never larger than the file itself. */
+        /* References to pooled buffers are handed out to the USB interface, so they must never be moved around. */
+        this->async_buf_size = std::min(static_cast<size_t>(FILE_WRITER_ASYNC_BUFFER_SIZE), ALIGN_UP(std::max(this->total_size, static_cast<size_t>(1)), static_cast<size_t>(USB_TRANSFER_ALIGNMENT)));
+        this->async_buf_refs.reserve(FILE_WRITER_ASYNC_BUFFER_COUNT);
+
+        this->async_usb_pending = 0;
+        this->async_exit = this->async_discard = this->async_error = this->async_busy = false;
+        this->async_written_size = this->cur_size;
+        this->async_cur_buf = nullptr;
+        this->async_cur_offset = this->async_cur_size = 0;
+        this->async_cur_journal.clear();
+        this->async_journal = (this->journal_fp != nullptr);
+
+        /* Start writer thread. */
+        try {
+            this->async_thread = std::thread(&FileWriter::AsyncWriterThreadFunc, this);
+        } catch(const std::system_error& e) {
+            LOG_MSG_ERROR("Failed to create asynchronous writer thread! (%s).", e.what());
+            this->StopAsyncWriter(true);
+            return false;
+        }
+
+        LOG_MSG_DEBUG("Started asynchronous writer (up to %u buffer[s], 0x%lX bytes each).", FILE_WRITER_ASYNC_BUFFER_COUNT, this->async_buf_size);
+
+        return true;
+    }
+
+    void FileWriter::StopAsyncWriter(bool discard)
+    {
+        if (this->async_thread.joinable())
+        {
+            /* Let the writer thread go through all queued requests before exiting. They're just dropped if we were told to discard them. */
+            {
+                std::scoped_lock lock(this->async_mtx);
+
+                /* Queue partially filled buffer, unless we're discarding data. */
+                if (!discard) this->SubmitAsyncBuffer();
+                this->async_cur_buf = nullptr;
+                this->async_cur_journal.clear();
+
+                this->async_exit = true;
+                if (discard) this->async_discard = true;
+            }
+
+            this->async_cond.notify_all();
+            this->async_thread.join();
+        }
+
+        /* Pooled buffers held by the USB interface are only handed back once the USB host receives them. Cancel the file transfer if that's still not the case. */
+        bool usb_pending = false;
+
+        {
+            std::scoped_lock lock(this->async_mtx);
+            usb_pending = (this->async_usb_pending > 0);
+        }
+
+        if (usb_pending) usbCancelFileTransfer();
+
+        /* Free buffer pool. */
+        for(u8 *buf : this->async_bufs) free(buf);
+
+        this->async_bufs.clear();
+        this->async_free_bufs.clear();
+        this->async_buf_refs.clear();
+        this->async_queue.clear();
+    }
+
+    bool FileWriter::QueueAsyncRequest(const AsyncRequest& request, const void *data)
+    {
+        std::unique_lock lock(this->async_mtx);
+
+        if (request.type != AsyncRequestType::Data)
+        {
+            if (this->async_error) return false;
+
+            if (request.type == AsyncRequestType::Journal && this->async_cur_buf)
+            {
+                /* Journal requests are held back until the partially filled buffer is queued. This keeps journaled chunks from breaking up extents. */
+                this->async_cur_journal.push_back(request);
+            } else {
+                /* Queue partially filled buffer first. Fill requests must never be processed before the data that precedes them. */
+                this->SubmitAsyncBuffer();
+                this->async_queue.push_back(request);
+            }
+        } else {
+            const u8 *data_u8 = static_cast<const u8*>(data);
+
+            /* Coalesce data into pooled buffers. Each one holds a single extent, which never crosses a buffer size boundary within the output file. */
+            for(size_t offset = 0, blksize = 0; offset < request.size; offset += blksize)
             {
-                /* Send data to USB host. */
-                if (!usbSendFileData(data, write_size))
+                if (!this->async_cur_buf)
                 {
-                    LOG_MSG_ERROR("Failed to send 0x%lX-byte long block at offset 0x%lX to USB host.", write_size, this->cur_size);
-                    return false;
+                    /* Only allocate a new buffer if all previously allocated ones are in use. If this fails, we'll just wait for one of them, as long as we have any. */
+                    if (this->async_free_bufs.empty() && this->async_bufs.size() < FILE_WRITER_ASYNC_BUFFER_COUNT && !this->AllocateAsyncBuffer() && this->async_bufs.empty()) return false;
+
+                    /* Wait for a free buffer. This keeps producers from getting too far ahead of the output device. */
+                    u64 start_tick = armGetSystemTick();
+                    this->async_cond.wait(lock, [this] { return (!this->async_free_bufs.empty() || this->async_error); });
+                    this->async_wait_ticks += (armGetSystemTick() - start_tick);
+                    if (this->async_error) return false;
+
+                    this->async_cur_buf = this->async_free_bufs.back();
+                    this->async_cur_offset = (request.offset + offset);
+                    this->async_cur_size = 0;
+
+                    this->async_free_bufs.pop_back();
                 }
-            } else {
-                /* Write data to output file. */
-                size_t n = fwrite(data, 1, write_size, this->fp);
-                if (n != write_size)
+
+                size_t extent_size = (FILE_WRITER_ASYNC_BUFFER_SIZE - (this->async_cur_offset % FILE_WRITER_ASYNC_BUFFER_SIZE));
+                blksize = std::min(request.size - offset, extent_size - this->async_cur_size);
+
+                /* Don't hold the lock while copying data. The writer thread is most likely busy with a previous request. */
+                u8 *dst = (this->async_cur_buf + this->async_cur_size);
+
+                lock.unlock();
+                memcpy(dst, data_u8 + offset, blksize);
+                lock.lock();
+
+                this->async_cur_size += blksize;
+
+                /* Queue buffer as soon as it holds a whole extent, or if we just reached the end of the output file. */
+                if (this->async_cur_size == extent_size || (this->async_cur_offset + this->async_cur_size) == this->total_size) this->SubmitAsyncBuffer();
+            }
+        }
+
+        this->async_cond.notify_all();
+
+        return true;
+    }
+
+    bool FileWriter::AllocateAsyncBuffer(void)
+    {
+        /* Must be called with the asynchronous writer mutex held. Buffers are page aligned, so they can be sent to USB hosts without any additional copies. */
+        u8 *buf = static_cast<u8*>(usbAllocatePageAlignedBuffer(this->async_buf_size));
+        if (!buf)
+        {
+            LOG_MSG_ERROR("Failed to allocate asynchronous write buffer #%lu!", this->async_bufs.size());
+            return false;
+        }
+
+        this->async_bufs.push_back(buf);
+        this->async_free_bufs.push_back(buf);
+        this->async_buf_refs.push_back({ this, buf });
+
+        return true;
+    }
+
+    void FileWriter::SubmitAsyncBuffer(void)
+    {
+        /* Must be called with the asynchronous writer mutex held. */
+        if (!this->async_cur_buf) return;
+
+        AsyncRequest request{};
+        request.type = AsyncRequestType::Data;
+        request.buf = this->async_cur_buf;
+        request.offset = this->async_cur_offset;
+        request.size = this->async_cur_size;
+
+        this->async_queue.push_back(request);
+        this->async_cur_buf = nullptr;
+
+        /* Journal requests for chunks held by this buffer go right after it. */
+        this->async_queue.insert(this->async_queue.end(), this->async_cur_journal.begin(), this->async_cur_journal.end());
+        this->async_cur_journal.clear();
+
+        this->async_cond.notify_all();
+    }
+
+    void FileWriter::AsyncWriterThreadFunc(void)
+    {
+        std::unique_lock lock(this->async_mtx);
+
+        while(true)
+        {
+            /* Pooled buffers held by the USB interface are handed back as soon as the USB host receives them, which only gets checked while sending more data. */
+            /* Wait for all of them if we've got nothing else to send, so producers (and Flush() callers) don't get stuck. Errors are reported by the next USB call. */
+            if (this->async_queue.empty() && this->async_usb_pending)
+            {
+                this->async_busy = true;
+
+                lock.unlock();
+                usbFlushFileData();
+                lock.lock();
+
+                this->async_busy = false;
+                this->async_cond.notify_all();
+            }
+
+            /* Wait until we have something to do. */
+            this->async_cond.wait(lock, [this] { return (!this->async_queue.empty() || this->async_exit); });
+            if (this->async_queue.empty()) break;
+
+            AsyncRequest request = this->async_queue.front();
+            this->async_queue.pop_front();
+            this->async_busy = true;
+
+            /* Requests are just dropped after a write error, or if we were told to discard them. */
+            bool skip = (this->async_error || this->async_discard), success = true;
+
+            /* Pooled buffers sent to USB hosts are handed back by the USB interface through ReleaseAsyncBuffer(), regardless of the result. */
+            bool usb_data = (!skip && request.type == AsyncRequestType::Data && this->storage_type == StorageType::UsbHost);
+            if (usb_data) this->async_usb_pending++;
+
+            lock.unlock();
+
+            if (!skip)
+            {
+                switch(request.type)
                 {
-                    LOG_MSG_ERROR("fwrite() failed to write 0x%lX-byte long block at offset 0x%lX to output file.", write_size, this->cur_size);
+                    case AsyncRequestType::Data:
+                        if (this->storage_type == StorageType::UsbHost)
+                        {
+                            /* Pooled buffers are page aligned, so they can be sent to the USB host as-is. The next buffer can be sent while this one is still in flight. */
+                            auto ref = std::find_if(this->async_buf_refs.begin(), this->async_buf_refs.end(), [&request](const AsyncBufferRef& r) { return (r.buf == request.buf); });
+                            UsbFileDataFragment fragment = { .data = request.buf, .size = request.size, .release = &FileWriter::ReleaseAsyncBuffer, .userdata = &(*ref) };
+                            success = usbSendFileDataV(&fragment, 1);
+                            if (!success) LOG_MSG_ERROR("Failed to send 0x%lX-byte long block at offset 0x%lX to USB host.", request.size, request.offset);
+                        } else {
+                            success = this->WriteData(request.buf, request.size, request.offset);
+                        }
+
+                        break;
+                    case AsyncRequestType::Fill:
+                        success = usbSendFileFill(request.fill_value, request.size);
+                        if (!success) LOG_MSG_ERROR("Failed to send 0x%lX-byte long fill (0x%02X) at offset 0x%lX to USB host.", request.size, request.fill_value, request.offset);
+                        break;
+                    case AsyncRequestType::Journal:
+                        this->AppendJournalEntry(request.offset, request.size, request.crc, request.state);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            lock.lock();
+
+            if (!success)
+            {
+                this->async_error = true;
+            } else
+            if (!skip && request.type != AsyncRequestType::Journal)
+            {
+                this->async_written_size = (request.offset + request.size);
+            }
+
+            if (request.buf && !usb_data) this->async_free_bufs.push_back(request.buf);
+            this->async_busy = false;
+
+            this->async_cond.notify_all();
+        }
+    }
+
+    void FileWriter::ReleaseAsyncBuffer(void *userdata)
+    {
+        /* Called by the USB interface, possibly from another thread. */
+        AsyncBufferRef *ref = static_cast<AsyncBufferRef*>(userdata);
+        FileWriter *writer = ref->writer;
+
+        {
+            std::scoped_lock lock(writer->async_mtx);
+            writer->async_free_bufs.push_back(ref->buf);
+            writer->async_usb_pending--;
+        }
+
+        writer->async_cond.notify_all();
+    }
+
+    bool FileWriter::WriteChunk(const void *data, const size_t& data_size)
+    {
+        bool async = this->async_thread.joinable();
+
+        /* Sanity check. The current file is managed by the writer thread if asynchronous writes are enabled. */
+        if (!data || !data_size || !this->file_created || this->cur_size >= this->total_size || (!async && this->storage_type != StorageType::UsbHost && !this->fp)) return false;
+
+        /* Make sure we don't write past the established file size. */
+        size_t write_size = ((this->cur_size + data_size) > this->total_size ? (this->total_size - this->cur_size) : data_size);
+
+        if (async)
+        {
+            /* Copy data to pooled buffers. The writer thread takes care of the rest. */
+            AsyncRequest request{};
+            request.type = AsyncRequestType::Data;
+            request.offset = this->cur_size;
+            request.size = write_size;
+
+            if (!this->QueueAsyncRequest(request, data))
+            {
+                LOG_MSG_ERROR("Asynchronous write failed! Unable to queue 0x%lX-byte long block at offset 0x%lX.", write_size, this->cur_size);
+                return false;
+            }
+        } else {
+            if (!this->WriteData(data, write_size, this->cur_size)) return false;
+        }
+
+        /* Update the written data size. */
+        this->cur_size += write_size;
+
+        return true;
+    }
+
+    bool FileWriter::Write(const void *data, const size_t& data_size)
+    {
+        /* Fan out data to all mirrors first. They just copy it to their own buffer pools, so this doesn't take long. */
+        for(std::unique_ptr<FileWriter>& mirror : this->mirrors)
+        {
+            if (!mirror->Write(data, data_size)) return false;
+        }
+
+        return this->WriteChunk(data, data_size);
+    }
+
+    bool FileWriter::Write(const void *data, const size_t& data_size, const JournalState& state)
+    {
+        size_t offset = this->cur_size;
+
+        if (!this->Write(data, data_size)) return false;
+
+        /* Record written chunk. */
+        size_t written_size = (this->cur_size - offset);
+        if (this->IsJournaling()) this->RecordChunk(offset, written_size, crc32Calculate(data, written_size), state);
+
+        return true;
+    }
+
+    bool FileWriter::WriteFill(const u8& fill_value, const size_t& fill_size)
+    {
+        bool async = this->async_thread.joinable();
+
+        /* Fan out fill data to all mirrors first. */
+        for(std::unique_ptr<FileWriter>& mirror : this->mirrors)
+        {
+            if (!mirror->WriteFill(fill_value, fill_size)) return false;
+        }
+
+        /* Sanity check. The current file is managed by the writer thread if asynchronous writes are enabled. */
+        if (!fill_size || !this->file_created || this->cur_size >= this->total_size || (!async && this->storage_type != StorageType::UsbHost && !this->fp)) return false;
+
+        /* Make sure we don't write past the established file size. */
+        size_t write_size = ((this->cur_size + fill_size) > this->total_size ? (this->total_size - this->cur_size) : fill_size);
+
+        if (this->storage_type == StorageType::UsbHost)
+        {
+            /* Let the USB host generate the data on its own. */
+            if (async)
+            {
+                AsyncRequest request{};
+                request.type = AsyncRequestType::Fill;
+                request.offset = this->cur_size;
+                request.size = write_size;
+                request.fill_value = fill_value;
+
+                if (!this->QueueAsyncRequest(request, nullptr))
+                {
+                    LOG_MSG_ERROR("Asynchronous write failed! Unable to queue 0x%lX-byte long fill (0x%02X) at offset 0x%lX.", write_size, fill_value, this->cur_size);
                     return false;
                 }
+            } else
+            if (!usbSendFileFill(fill_value, write_size))
+            {
+                LOG_MSG_ERROR("Failed to send 0x%lX-byte long fill (0x%02X) at offset 0x%lX to USB host.", write_size, fill_value, this->cur_size);
+                return false;
             }
 
             /* Update the written data size. */
             this->cur_size += write_size;
+
+            return true;
+        }
+
+        /* Prepare fill buffer. It's kept around for further calls. */
+        size_t fill_buf_size = std::min(write_size, static_cast<size_t>(FILE_WRITER_FILL_BUFFER_SIZE));
+        if (this->fill_buf.size() < fill_buf_size || this->fill_buf.front() != fill_value) this->fill_buf.assign(std::max(fill_buf_size, this->fill_buf.size()), fill_value);
+
+        /* Write fill data. WriteChunk() takes care of part file switching on its own. */
+        for(size_t offset = 0, blksize = this->fill_buf.size(); offset < write_size; offset += blksize)
+        {
+            if (blksize > (write_size - offset)) blksize = (write_size - offset);
+            if (!this->WriteChunk(this->fill_buf.data(), blksize)) return false;
         }
 
         return true;
     }
 
+    bool FileWriter::WriteFill(const u8& fill_value, const size_t& fill_size, const JournalState& state)
+    {
+        size_t offset = this->cur_size;
+
+        if (!this->WriteFill(fill_value, fill_size)) return false;
+
+        /* Return right away if there's no journal to update. */
+        if (!this->IsJournaling()) return true;
+
+        /* Calculate fill data checksum using our fill buffer, which WriteFill() has already prepared. */
+        size_t written_size = (this->cur_size - offset);
+        u32 crc = 0;
+
+        for(size_t cur_offset = 0, blksize = this->fill_buf.size(); cur_offset < written_size; cur_offset += blksize)
+        {
+            if (blksize > (written_size - cur_offset)) blksize = (written_size - cur_offset);
+            crc = crc32CalculateWithSeed(crc, this->fill_buf.data(), blksize);
+        }
+
+        /* Record written chunk. */
+        this->RecordChunk(offset, written_size, crc, state);
+
+        return true;
+    }
+
     bool FileWriter::WriteNspHeader(const void *nsp_header, const u32& nsp_header_size)
     {
+        /* Wait for all queued data to be written. The writer thread stays idle from this point on. */
+        if (!this->Flush()) return false;
+
+        for(std::unique_ptr<FileWriter>& mirror : this->mirrors)
+        {
+            if (!mirror->WriteNspHeader(nsp_header, nsp_header_size)) return false;
+        }
+
         /* Sanity check. */
         if (!nsp_header || !nsp_header_size || nsp_header_size != this->nsp_header_size || !this->file_created || this->cur_size < this->total_size || this->nsp_header_written ||
             (this->storage_type != StorageType::UsbHost && !this->fp)) return false;
@@ -323,16 +1171,61 @@ namespace nxdt::utils
         return true;
     }
 
-    void FileWriter::Close(bool force_delete)
+    bool FileWriter::Flush(void)
+    {
+        for(std::unique_ptr<FileWriter>& mirror : this->mirrors)
+        {
+            if (!mirror->Flush()) return false;
+        }
+
+        if (!this->async_thread.joinable()) return true;
+
+        std::unique_lock lock(this->async_mtx);
+
+        this->SubmitAsyncBuffer();
+        this->async_cond.wait(lock, [this] { return (this->async_queue.empty() && !this->async_busy); });
+
+        return !this->async_error;
+    }
+
+    bool FileWriter::Close(bool force_delete)
     {
         /* Return immediately if the file has already been closed. */
-        if (this->file_closed) return;
+        if (this->file_closed) return !this->async_error;
+
+        /* Close mirrors. Each one takes care of its own output file. */
+        bool mirrors_ok = true;
+
+        for(std::unique_ptr<FileWriter>& mirror : this->mirrors)
+        {
+            if (!mirror->Close(force_delete)) mirrors_ok = false;
+        }
+
+        /* Stop asynchronous writer. Queued data is dropped if we're about to delete the output file anyway. */
+        this->StopAsyncWriter(force_delete);
+
+        /* Data that never made it to the output device doesn't count. */
+        if (this->async_error)
+        {
+            LOG_MSG_ERROR("Asynchronous write failed! Only 0x%lX out of 0x%lX bytes were written.", this->async_written_size, this->cur_size);
+            this->cur_size = this->async_written_size;
+        }
 
         /* Close current file. */
         this->CloseCurrentFile();
 
+        /* Check if we're dealing with a complete file. */
+        bool complete = (this->cur_size == this->total_size && (!this->nsp_header_size || this->nsp_header_written));
+
+        /* Keep incomplete files around if we're journaling, unless we were explicitly told to delete them. */
+        bool keep_partial = (this->journal_fp && !force_delete);
+        if (!complete && keep_partial) LOG_MSG_INFO("Keeping incomplete output file. Dump can be resumed using its journal file.");
+
+        /* Close journal file. It's only kept if we're holding on to an incomplete file. */
+        this->CloseJournal(!keep_partial || complete);
+
         /* Delete created file(s), if needed. */
-        if (this->cur_size != this->total_size && (this->file_created || force_delete))
+        if (this->cur_size != this->total_size && (this->file_created || force_delete) && !keep_partial)
         {
             if (this->storage_type == StorageType::UsbHost)
             {
@@ -358,6 +1251,13 @@ namespace nxdt::utils
             }
         }
 
+        /* Report preallocation and write times separately. Preallocation may take a while on FAT-formatted volumes. */
+        if (this->storage_type != StorageType::UsbHost && this->file_created)
+        {
+            LOG_MSG_INFO("Output file allocation time: %lu ms. Data write time: %lu ms. Asynchronous buffer wait time: %lu ms.", this->GetAllocationTime() / 1000000, \
+                         this->GetWriteTime() / 1000000, this->GetAsyncWaitTime() / 1000000);
+        }
+
         /* Commit SD card filesystem changes, if needed. */
         if (this->storage_type == StorageType::SdCard)
         {
@@ -367,10 +1267,42 @@ namespace nxdt::utils
 
         /* Update flag. */
         this->file_closed = true;
+
+        return (!this->async_error && mirrors_ok);
     }
 
     FileWriter::StorageType FileWriter::GetStorageType(void)
     {
         return this->storage_type;
     }
+
+    FileWriter::StorageType FileWriter::GetStorageTypeFromPath(const std::string& path)
+    {
+        return (path.starts_with(DEVOPTAB_SDMC_DEVICE) ? StorageType::SdCard : (path.starts_with('/') ? StorageType::UsbHost : StorageType::UmsDevice));
+    }
+
+    u64 FileWriter::GetAllocationTime(void)
+    {
+        return armTicksToNs(this->alloc_ticks);
+    }
+
+    u64 FileWriter::GetWriteTime(void)
+    {
+        return armTicksToNs(this->write_ticks);
+    }
+
+    u64 FileWriter::GetAsyncWaitTime(void)
+    {
+        return armTicksToNs(this->async_wait_ticks);
+    }
+
+    size_t FileWriter::GetResumeOffset(void)
+    {
+        return this->resume_offset;
+    }
+
+    const FileWriter::JournalState& FileWriter::GetResumeState(void)
+    {
+        return this->resume_state;
+    }
 }
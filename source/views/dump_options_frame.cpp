@@ -221,8 +221,17 @@ namespace nxdt::views
 
     bool DumpOptionsFrame::GetOutputFilePath(const std::string& extension, std::string& output)
     {
-        std::string tmp = this->storage_prefix;
-        u32 selected = this->output_storage->getSelectedValue();
+        return this->GenerateOutputFilePath(this->storage_prefix, this->output_storage->getSelectedValue(), extension, output);
+    }
+
+    bool DumpOptionsFrame::GetSdCardOutputFilePath(const std::string& extension, std::string& output)
+    {
+        return this->GenerateOutputFilePath(DEVOPTAB_SDMC_DEVICE "/", ConfigOutputStorage_SdCard, extension, output);
+    }
+
+    bool DumpOptionsFrame::GenerateOutputFilePath(const std::string& storage_prefix, u32 selected, const std::string& extension, std::string& output)
+    {
+        std::string tmp = storage_prefix;
         char *sanitized_path = nullptr;
 
         if (selected == ConfigOutputStorage_SdCard || selected >= ConfigOutputStorage_Count)
@@ -68,7 +68,12 @@ namespace nxdt::views
         GAMECARD_TOGGLE_ITEM(calculate_checksum);
 
         /* "Lookup checksum" toggle. */
-        GAMECARD_TOGGLE_ITEM(lookup_checksum, "dump_options/gamecard/image/calculate_checksum/label"_i18n, "No-Intro");
+        GAMECARD_TOGGLE_ITEM(lookup_checksum, "dump_options/gamecard/image/calculate_checksum/label"_i18n, "No-Intro", DAT_FILE_PATH);
+
+        /* "Mirror to SD card" toggle. This one isn't stored in the configuration, since it doubles SD card usage. */
+        this->mirror_to_sd_card = new brls::ToggleListItem("dump_options/gamecard/image/mirror_to_sd_card/label"_i18n, false, "dump_options/gamecard/image/mirror_to_sd_card/description"_i18n,
+                                                           "generic/value_enabled"_i18n, "generic/value_disabled"_i18n);
+        this->addView(this->mirror_to_sd_card);
 
         /* Register dump button callback. */
         this->RegisterButtonListener([this](brls::View *view) {
@@ -78,6 +83,7 @@ namespace nxdt::views
             bool trim_dump_val = this->trim_dump->getToggleState();
             bool calculate_checksum_val = this->calculate_checksum->getToggleState();
             bool lookup_checksum_val = this->lookup_checksum->getToggleState();
+            bool mirror_to_sd_card_val = (this->mirror_to_sd_card->getToggleState() && this->GetSelectedOutputStorage() != ConfigOutputStorage_SdCard);
 
             /* Generate file extension. */
             std::string extension = fmt::format(" [{}][{}][{}].xci", prepend_key_area_val ? "KA" : "NKA", keep_certificate_val ? "C" : "NC", trim_dump_val ? "T" : "NT");
@@ -86,8 +92,12 @@ namespace nxdt::views
             std::string output_path{};
             if (!this->GetOutputFilePath(extension, output_path)) return;
 
+            /* Get SD card mirror path, if needed. */
+            std::string mirror_path{};
+            if (mirror_to_sd_card_val && !this->GetSdCardOutputFilePath(extension, mirror_path)) return;
+
             /* Display task frame. */
-            brls::Application::pushView(new GameCardImageDumpTaskFrame(output_path, prepend_key_area_val, keep_certificate_val, trim_dump_val, calculate_checksum_val,
+            brls::Application::pushView(new GameCardImageDumpTaskFrame(output_path, mirror_path, prepend_key_area_val, keep_certificate_val, trim_dump_val, calculate_checksum_val,
                                         lookup_checksum_val), brls::ViewAnimation::SLIDE_LEFT, false);
         });
     }